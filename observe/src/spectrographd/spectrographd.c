@@ -49,18 +49,22 @@
 #include "../telescoped/thread.h"
 #include "../telescoped/socket.h"
 #include "../telescoped/str.h"
+#include "../telescoped/telemetry.h"
 
 log4c_category_t *p_logcat = NULL;
 
 static int spectrograph_exit_flag = 0;
 static int sockfd_loop = -1;
 static int sockfd_cmd = -1;
+static SOCK_RINGBUF_T ringbuf_loop;
+static SOCK_RINGBUF_T ringbuf_cmd;
 static pthread_mutex_t global_mutex;
 static pthread_mutex_t data_mutex;
 static pthread_t spectrograph_loop_pthread;
 static pthread_t spectrograph_cmd_pthread;
 static char info_data[INFO_SIZE_E][INFO_MAX+1];
 static char info_cmds[INFO_SIZE_E][INFO_MAX+1];
+static time_t info_time = 0;
 static char *p_spectrographd_dir;
 static SPECTROGRAPH_CFG_T spectrograph_cfg;
 static SPECTROGRAPH_IP_T *p_spectrograph_ip_first = NULL;
@@ -82,6 +86,21 @@ static void spectrograph_version(char *name)
     printf("warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.\n");
 }
 
+/* keys of spectrograph_info, used for telemetry */
+static const char *info_keys[INFO_SIZE_E] = {
+    [INFO_GLST_E]    = "GLST",
+    [INFO_SPGP_4_E]  = "SPGP_4",
+    [INFO_SPGP_5_E]  = "SPGP_5",
+    [INFO_SPGP_13_E] = "SPGP_13",
+    [INFO_SPCE_14_E] = "SPCE_14",
+    [INFO_SPFE_14_E] = "SPFE_14",
+    [INFO_SPCE_24_E] = "SPCE_24",
+    [INFO_SPFE_24_E] = "SPFE_24",
+    [INFO_SPGP_22_E] = "SPGP_22",
+    [INFO_SPGS_19_E] = "SPGS_19",
+    [INFO_SPGS_20_E] = "SPGS_20",
+};
+
 static void spectrograph_signal(int sig)
 {
   void *thread_result;
@@ -93,6 +112,7 @@ static void spectrograph_signal(int sig)
 
             pthread_join(spectrograph_loop_pthread, &thread_result);
             pthread_join(spectrograph_cmd_pthread, &thread_result);
+            telemetry_stop();
 
             log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "Exiting...");
 
@@ -116,12 +136,19 @@ static int spectrograph_exit(int status)
 static int spectrograph_loop_service()
 {
     int i;
-    char recvbuf[SOCK_RECVBUF_MAX];
+    char *p_reply;
+    const char *p_values[INFO_SIZE_E];
 
     if (sock_client_create(spectrograph_cfg.ascol_ip, spectrograph_cfg.ascol_loop_port, &sockfd_loop) == -1) {
         return -1;
     }
 
+    for (i = 0; i < INFO_SIZE_E; ++i) {
+        p_values[i] = info_data[i];
+    }
+
+    sock_ringbuf_init(&ringbuf_loop);
+
     while (!spectrograph_exit_flag) {
 
 #ifdef DBG
@@ -135,17 +162,24 @@ static int spectrograph_loop_service()
                 return -1;
             }
 
-            if (sock_recv(sockfd_loop, recvbuf) == -1) {
+            if (sock_recv_line(sockfd_loop, &ringbuf_loop, &p_reply) == -1) {
                 return -1;
             }
 
             /* LOCK */
             pthr_mutex_lock(&data_mutex);
-            strncpy(info_data[i], strim(recvbuf), INFO_MAX);
+            strncpy(info_data[i], strim(p_reply), INFO_MAX);
             pthr_mutex_unlock(&data_mutex);
             /* UNLOCK */
         }
 
+        /* LOCK */
+        pthr_mutex_lock(&data_mutex);
+        info_time = time(NULL);
+        telemetry_publish(p_values, info_time);
+        pthr_mutex_unlock(&data_mutex);
+        /* UNLOCK */
+
 #ifdef DBG
         gettimeofday(&end, NULL);
         seconds = end.tv_sec  - start.tv_sec;
@@ -164,16 +198,18 @@ static int spectrograph_cmd_service()
 {
     int i;
     int socket_result = 0;
-    char recvbuf[SOCK_RECVBUF_MAX];
+    char *p_reply;
 
     if (sock_client_create(spectrograph_cfg.ascol_ip, spectrograph_cfg.ascol_cmd_port, &sockfd_cmd) == -1) {
         return -1;
     }
 
+    sock_ringbuf_init(&ringbuf_cmd);
+
     /* LOCK */
     pthr_mutex_lock(&global_mutex);
     if ((socket_result = sock_send(sockfd_cmd, "GLLG 123\n")) != -1) {
-        socket_result = sock_recv(sockfd_cmd, recvbuf);
+        socket_result = sock_recv_line(sockfd_cmd, &ringbuf_cmd, &p_reply);
     }
     pthr_mutex_unlock(&global_mutex);
     /* UNLOCK */
@@ -182,7 +218,7 @@ static int spectrograph_cmd_service()
         /* LOCK */
         pthr_mutex_lock(&global_mutex);
         if ((socket_result = sock_send(sockfd_cmd, "GLST\n")) != -1) {
-            socket_result = sock_recv(sockfd_cmd, recvbuf);
+            socket_result = sock_recv_line(sockfd_cmd, &ringbuf_cmd, &p_reply);
         }
         pthr_mutex_unlock(&global_mutex);
         /* UNLOCK */
@@ -266,7 +302,7 @@ static xmlrpc_value *spectrograph_execute(xmlrpc_env * const p_env,
     int socket_result;
     char *p_command;
     char command[COMMAND_MAX+1];
-    char recvbuf[SOCK_RECVBUF_MAX];
+    char *p_reply;
     char ip[CFG_TYPE_STR_MAX+1];
     unsigned char *p_ip_addr;
     xmlrpc_value *p_result = NULL;
@@ -311,25 +347,25 @@ static xmlrpc_value *spectrograph_execute(xmlrpc_env * const p_env,
             if (spectrograph_cfg.coude_exposimeter_close) {
                 // 10 = coude exposimeter shutter, 2 = close
                 sock_send(sockfd_cmd, "SPCH 10 2\n");
-                sock_recv(sockfd_cmd, recvbuf);
+                sock_recv_line(sockfd_cmd, &ringbuf_cmd, &p_reply);
             }
 
             if (spectrograph_cfg.oes_exposimeter_close) {
                 // 23 = oes exposimeter shutter, 2 = close
                 sock_send(sockfd_cmd, "SPCH 23 2\n");
-                sock_recv(sockfd_cmd, recvbuf);
+                sock_recv_line(sockfd_cmd, &ringbuf_cmd, &p_reply);
             }
 
             // 15 = slith camera, 5 = close
             sock_send(sockfd_cmd, "SPCH 15 5\n");
-            sock_recv(sockfd_cmd, recvbuf);
+            sock_recv_line(sockfd_cmd, &ringbuf_cmd, &p_reply);
         }
     }
 
     snprintf(command, COMMAND_MAX, "%s\n", p_command);
     socket_result = sock_send(sockfd_cmd, command);
-    if ((socket_result = sock_recv(sockfd_cmd, recvbuf)) != -1) {
-        p_result = xmlrpc_build_value(p_env, "s", strim(recvbuf));
+    if ((socket_result = sock_recv_line(sockfd_cmd, &ringbuf_cmd, &p_reply)) != -1) {
+        p_result = xmlrpc_build_value(p_env, "s", strim(p_reply));
     }
     else {
         p_result = xmlrpc_build_value(p_env, "s", strerror(errno));
@@ -339,7 +375,7 @@ static xmlrpc_value *spectrograph_execute(xmlrpc_env * const p_env,
         if ((!strcmp(p_command, "SPCH 8 0")) || (!strcmp(p_command, "SPCH 9 0"))) {
             // 15 = slith camera, 1 = open
             sock_send(sockfd_cmd, "SPCH 15 1\n");
-            sock_recv(sockfd_cmd, recvbuf);
+            sock_recv_line(sockfd_cmd, &ringbuf_cmd, &p_reply);
         }
     }
 
@@ -381,6 +417,40 @@ static xmlrpc_value *spectrograph_info(xmlrpc_env * const p_env,
     return p_result;
 }
 
+/*
+ * Same values as spectrograph_info plus key "time" (end of the last complete
+ * loop), so exposed can tell how old the FITS header values are.
+ */
+static xmlrpc_value *observatory_snapshot(xmlrpc_env * const p_env,
+                                          xmlrpc_value * const p_param_array,
+                                          void * const p_server_info,
+                                          void * const p_chan_info)
+{
+    xmlrpc_value *p_result = NULL;
+
+    /* LOCK */
+    pthr_mutex_lock(&data_mutex);
+
+    p_result = xmlrpc_build_value(p_env, "{s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:i}",
+        "GLST", info_data[INFO_GLST_E],
+        "SPGP_4", info_data[INFO_SPGP_4_E],
+        "SPGP_5", info_data[INFO_SPGP_5_E],
+        "SPGP_13", info_data[INFO_SPGP_13_E],
+        "SPCE_14", info_data[INFO_SPCE_14_E],
+        "SPFE_14", info_data[INFO_SPFE_14_E],
+        "SPCE_24", info_data[INFO_SPCE_24_E],
+        "SPFE_24", info_data[INFO_SPFE_24_E],
+        "SPGP_22", info_data[INFO_SPGP_22_E],
+        "SPGS_19", info_data[INFO_SPGS_19_E],
+        "SPGS_20", info_data[INFO_SPGS_20_E],
+        "time", (int) info_time);
+
+    pthr_mutex_unlock(&data_mutex);
+    /* UNLOCK */
+
+    return p_result;
+}
+
 static void spectrograph_info_init()
 {
     bzero(info_data, sizeof(info_data));
@@ -488,6 +558,25 @@ static void spectrograph_cfg_get_allow_ips()
     }
 }
 
+static void spectrograph_cfg_get_telemetry()
+{
+    spectrograph_cfg.telemetry_port = 0;
+    spectrograph_cfg.telemetry_min_interval = 500;
+    spectrograph_cfg.telemetry_max_clients = 32;
+
+    if (g_key_file_has_key(spectrograph_cfg.p_key_file, "telemetry", "port", NULL)) {
+        spectrograph_cfg_get_integer(&spectrograph_cfg.telemetry_port, "telemetry", "port");
+    }
+
+    if (g_key_file_has_key(spectrograph_cfg.p_key_file, "telemetry", "min_interval", NULL)) {
+        spectrograph_cfg_get_integer(&spectrograph_cfg.telemetry_min_interval, "telemetry", "min_interval");
+    }
+
+    if (g_key_file_has_key(spectrograph_cfg.p_key_file, "telemetry", "max_clients", NULL)) {
+        spectrograph_cfg_get_integer(&spectrograph_cfg.telemetry_max_clients, "telemetry", "max_clients");
+    }
+}
+
 static void spectrograph_load_cfg()
 {
     GKeyFileFlags flags;
@@ -513,6 +602,7 @@ static void spectrograph_load_cfg()
     spectrograph_cfg_get_integer(&spectrograph_cfg.ascol_loop_port, "spectrographd", "ascol_loop_port");
     spectrograph_cfg_get_integer(&spectrograph_cfg.ascol_cmd_port, "spectrographd", "ascol_cmd_port");
     spectrograph_cfg_get_allow_ips();
+    spectrograph_cfg_get_telemetry();
 
     g_key_file_free(spectrograph_cfg.p_key_file);
     spectrograph_cfg.p_key_file = NULL;
@@ -602,6 +692,11 @@ int main(int argc, char *argv[])
         .methodFunction = &spectrograph_info,
     };
 
+    struct xmlrpc_method_info3 const observatory_snapshot_MI = {
+        .methodName     = "observatory_snapshot",
+        .methodFunction = &observatory_snapshot,
+    };
+
     if ((p_spectrographd_dir = getenv("SPECTROGRAPHD_DIR")) == NULL) {
         fprintf(stderr, "The SPECTROGRAPHD_DIR environment variable is not set.");
         exit(EXIT_FAILURE);
@@ -653,6 +748,11 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    if (telemetry_start(spectrograph_cfg.telemetry_port, spectrograph_cfg.telemetry_min_interval,
+            spectrograph_cfg.telemetry_max_clients, info_keys, INFO_SIZE_E, spectrograph_allowed_ip) == -1) {
+        exit(EXIT_FAILURE);
+    }
+
     if (pthread_create(&spectrograph_loop_pthread, NULL, spectrograph_loop, NULL) != 0) {
         log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "pthread_create(): %i: %s", errno, strerror(errno));
         exit(EXIT_FAILURE);
@@ -669,6 +769,7 @@ int main(int argc, char *argv[])
 
     xmlrpc_registry_add_method3(&env, registryP, &spectrograph_execute_MI);
     xmlrpc_registry_add_method3(&env, registryP, &spectrograph_info_MI);
+    xmlrpc_registry_add_method3(&env, registryP, &observatory_snapshot_MI);
 
     serverparm.config_file_name = NULL;
     serverparm.registryP = registryP;
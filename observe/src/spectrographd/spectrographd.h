@@ -80,6 +80,9 @@ typedef struct {
     int coude_exposimeter_close;
     int ascol_loop_port;
     int ascol_cmd_port;
+    int telemetry_port; // 0 = disabled
+    int telemetry_min_interval; // [ms]
+    int telemetry_max_clients;
 } SPECTROGRAPH_CFG_T;
 
 typedef struct spectrograph_ip {
@@ -13,35 +13,140 @@
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
 #include "telescoped.h"
 #include "socket.h"
 
-int sock_recv(int sockfd, char *p_recvbuf)
+void sock_ringbuf_init(SOCK_RINGBUF_T *p_ringbuf)
 {
-    fd_set rfd;
-    struct timeval timeout;
+    p_ringbuf->head = 0;
+    p_ringbuf->scan = 0;
+    p_ringbuf->tail = 0;
+}
 
-    bzero(p_recvbuf, SOCK_RECVBUF_MAX);
+/*
+ * One readv() into free space of ring, which may wrap. Returns 0 also if
+ * nonblocking socket has no data, -1 on error, closed connection or full
+ * ring.
+ */
+int sock_ringbuf_read(int sockfd, SOCK_RINGBUF_T *p_ringbuf)
+{
+    int count;
+    unsigned int used = p_ringbuf->tail - p_ringbuf->head;
+    unsigned int tail = p_ringbuf->tail & (SOCK_RINGBUF_SIZE - 1);
+    struct iovec iov[2];
 
-    FD_ZERO(&rfd);
-    FD_SET(sockfd, &rfd);
+    if (used >= SOCK_RINGBUF_SIZE - 1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "line is longer than %i bytes", SOCK_RINGBUF_SIZE - 1);
+        return -1;
+    }
 
-    timeout.tv_sec = 5;
-    timeout.tv_usec = 0;
+    iov[0].iov_base = p_ringbuf->buf + tail;
+    iov[0].iov_len = SOCK_RINGBUF_SIZE - tail;
+    if (iov[0].iov_len > SOCK_RINGBUF_SIZE - used) {
+        iov[0].iov_len = SOCK_RINGBUF_SIZE - used;
+    }
+    iov[1].iov_base = p_ringbuf->buf;
+    iov[1].iov_len = SOCK_RINGBUF_SIZE - used - iov[0].iov_len;
 
-    if (select(FD_SETSIZE, &rfd, (fd_set *)0, (fd_set *)0, &timeout) <= 0) {
-        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "select(rfd) failure: %i: %s", errno, strerror(errno));
+    if ((count = readv(sockfd, iov, iov[1].iov_len ? 2 : 1)) == 0) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "socket %i closed by peer", sockfd);
         return -1;
     }
+    else if (count < 0) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+            return 0;
+        }
 
-    if (recv(sockfd, p_recvbuf, SOCK_RECVBUF_MAX, 0) <= 0) {
-        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "recv() failure: %i: %s", errno, strerror(errno));
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "readv() failure: %i: %s", errno, strerror(errno));
         return -1;
     }
 
+    p_ringbuf->tail += count;
+    return 0;
+}
+
+/*
+ * Take next complete line from ring without copying, '\n' is replaced by
+ * '\0'. The line stays in ring (or its wrapped copy) and is valid until the
+ * next read or line on the same p_ringbuf. Returns 1 if line was found, 0 if
+ * ring contains only part of line.
+ */
+int sock_ringbuf_line(SOCK_RINGBUF_T *p_ringbuf, char **pp_line)
+{
+    unsigned int head;
+    unsigned int pos;
+    unsigned int len;
+    char *p_eol = NULL;
+
+    while ((p_ringbuf->scan != p_ringbuf->tail) && (p_eol == NULL)) {
+        pos = p_ringbuf->scan & (SOCK_RINGBUF_SIZE - 1);
+        len = p_ringbuf->tail - p_ringbuf->scan;
+        if (len > SOCK_RINGBUF_SIZE - pos) {
+            len = SOCK_RINGBUF_SIZE - pos;
+        }
+
+        if ((p_eol = memchr(p_ringbuf->buf + pos, '\n', len)) != NULL) {
+            len = p_eol - (p_ringbuf->buf + pos);
+        }
+        p_ringbuf->scan += len;
+    }
+
+    if (p_eol == NULL) {
+        return 0;
+    }
+
+    head = p_ringbuf->head & (SOCK_RINGBUF_SIZE - 1);
+    pos = p_ringbuf->scan & (SOCK_RINGBUF_SIZE - 1);
+
+    if (pos < head) {
+        // wrapped line, append its beginning to the end of ring
+        memcpy(p_ringbuf->buf + SOCK_RINGBUF_SIZE, p_ringbuf->buf, pos);
+        p_ringbuf->buf[SOCK_RINGBUF_SIZE + pos] = '\0';
+    }
+    else {
+        *p_eol = '\0';
+    }
+
+    *pp_line = p_ringbuf->buf + head;
+
+    p_ringbuf->scan += 1;
+    p_ringbuf->head = p_ringbuf->scan;
+
+    return 1;
+}
+
+/*
+ * Wait for next reply (at most 5 s for each segment) and return it like
+ * sock_ringbuf_line(). Replies split over several segments or joined in one
+ * are framed correctly, so pipelined commands can be matched with replies in
+ * order.
+ */
+int sock_recv_line(int sockfd, SOCK_RINGBUF_T *p_ringbuf, char **pp_line)
+{
+    fd_set rfd;
+    struct timeval timeout;
+
+    while (!sock_ringbuf_line(p_ringbuf, pp_line)) {
+        FD_ZERO(&rfd);
+        FD_SET(sockfd, &rfd);
+
+        timeout.tv_sec = 5;
+        timeout.tv_usec = 0;
+
+        if (select(FD_SETSIZE, &rfd, (fd_set *)0, (fd_set *)0, &timeout) <= 0) {
+            log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "select(rfd) failure: %i: %s", errno, strerror(errno));
+            return -1;
+        }
+
+        if (sock_ringbuf_read(sockfd, p_ringbuf) == -1) {
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -71,11 +176,13 @@ int sock_send(int sockfd, char *p_msg)
     return 0;
 }
 
-int sock_client_create(char *p_ip, int port, int *p_sockfd)
+/*
+ * Start nonblocking connect, completion is signalled by writability of
+ * *p_sockfd and checked by sock_client_connected().
+ */
+int sock_client_connect(char *p_ip, int port, int *p_sockfd)
 {
     unsigned long flag_ioctl;
-    fd_set wfd;
-    struct timeval timeout;
     struct sockaddr_in server_address;
 
     bzero((char *)&server_address, sizeof(server_address));
@@ -92,6 +199,7 @@ int sock_client_create(char *p_ip, int port, int *p_sockfd)
     if (ioctl(*p_sockfd, FIONBIO, &flag_ioctl) == -1) { // SET NONBLOCK
         log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "ioctl(FIONBIO) failure: %i: %s", errno, strerror(errno));
         close(*p_sockfd);
+        *p_sockfd = -1;
         return -1;
     }
 
@@ -100,10 +208,42 @@ int sock_client_create(char *p_ip, int port, int *p_sockfd)
         if (errno != EINPROGRESS) {
             log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "connect() failure: %i: %s", errno, strerror(errno));
             close(*p_sockfd);
+            *p_sockfd = -1;
             return -1;
         }
     }
 
+    return 0;
+}
+
+int sock_client_connected(int sockfd)
+{
+    int error = 0;
+    socklen_t len = sizeof(error);
+
+    if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "getsockopt(SO_ERROR) failure: %i: %s", errno, strerror(errno));
+        return -1;
+    }
+
+    if (error) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "connect() failure: %i: %s", error, strerror(error));
+        return -1;
+    }
+
+    log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "create socket %i success", sockfd);
+    return 0;
+}
+
+int sock_client_create(char *p_ip, int port, int *p_sockfd)
+{
+    fd_set wfd;
+    struct timeval timeout;
+
+    if (sock_client_connect(p_ip, port, p_sockfd) == -1) {
+        return -1;
+    }
+
     FD_ZERO(&wfd);
     FD_SET(*p_sockfd, &wfd);
 
@@ -116,6 +256,10 @@ int sock_client_create(char *p_ip, int port, int *p_sockfd)
         return -1;
     }
 
-    log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "create socket %i success", *p_sockfd);
+    if (sock_client_connected(*p_sockfd) == -1) {
+        close(*p_sockfd);
+        return -1;
+    }
+
     return 0;
 }
@@ -8,10 +8,28 @@
 #ifndef __SOCKET_H
 #define __SOCKET_H
 
-#define SOCK_RECVBUF_MAX 1024
+#define SOCK_RINGBUF_SIZE 4096 // power of two, longest line is one byte less
 
-int sock_recv(int sockfd, char *p_recvbuf);
+/*
+ * Received bytes of one connection. head, scan and tail are free running
+ * offsets, bytes [head, tail) are not returned yet and [head, scan) contains
+ * no '\n'. Lines wrapped over the end of ring are made contiguous in the
+ * second half of buf.
+ */
+typedef struct {
+    char buf[2 * SOCK_RINGBUF_SIZE];
+    unsigned int head;
+    unsigned int scan;
+    unsigned int tail;
+} SOCK_RINGBUF_T;
+
+void sock_ringbuf_init(SOCK_RINGBUF_T *p_ringbuf);
+int sock_ringbuf_read(int sockfd, SOCK_RINGBUF_T *p_ringbuf);
+int sock_ringbuf_line(SOCK_RINGBUF_T *p_ringbuf, char **pp_line);
+int sock_recv_line(int sockfd, SOCK_RINGBUF_T *p_ringbuf, char **pp_line);
 int sock_send(int sockfd, char *p_msg);
+int sock_client_connect(char *p_ip, int port, int *p_sockfd);
+int sock_client_connected(int sockfd);
 int sock_client_create(char *p_ip, int port, int *p_sockfd);
 
 #endif
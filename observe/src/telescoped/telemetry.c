@@ -0,0 +1,481 @@
+/**
+  * Author: Jan Fuchs <fuky@sunstel.asu.cas.cz>
+  * $Date$
+  * $Rev$
+  * $URL$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "telescoped.h"
+#include "thread.h"
+#include "telemetry.h"
+
+#define TELEMETRY_LISTEN UINT32_MAX
+#define TELEMETRY_WAKE   (UINT32_MAX - 1)
+
+static int telemetry_exit_flag = 0;
+static int listenfd = -1;
+static int epollfd = -1;
+static int wakefd = -1;
+static int telemetry_min_interval;
+static int telemetry_max_clients;
+static int telemetry_count = 0;
+static int (*telemetry_allowed_ip)(char *p_ip);
+static char telemetry_keys[TELEMETRY_FIELDS_MAX][TELEMETRY_KEY_MAX+1];
+static pthread_t telemetry_pthread;
+static pthread_mutex_t telemetry_mutex;
+static TELEMETRY_CLIENT_T *p_clients = NULL; // owned by telemetry_thread()
+
+/* guarded by telemetry_mutex */
+static char telemetry_values[TELEMETRY_FIELDS_MAX][TELEMETRY_VALUE_MAX+1];
+static time_t telemetry_time = 0;
+static unsigned int telemetry_changed = 0;
+
+static long long telemetry_time_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void telemetry_wake()
+{
+    uint64_t value = 1;
+
+    if (write(wakefd, &value, sizeof(value)) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "write(wakefd) failure: %i: %s", errno, strerror(errno));
+    }
+}
+
+static int telemetry_ctl(int op, int fd, uint32_t events, uint32_t id)
+{
+    struct epoll_event event;
+
+    event.events = events;
+    event.data.u32 = id;
+
+    if (epoll_ctl(epollfd, op, fd, &event) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "epoll_ctl() failure: %i: %s", errno, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static void telemetry_client_close(TELEMETRY_CLIENT_T *p_client, const char *p_reason)
+{
+    log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "telemetry client %i closed: %s", p_client->fd, p_reason);
+
+    epoll_ctl(epollfd, EPOLL_CTL_DEL, p_client->fd, NULL);
+    close(p_client->fd);
+    p_client->fd = -1;
+}
+
+static void telemetry_accept(long long now)
+{
+    int i;
+    int fd;
+    unsigned long flag_ioctl = 1;
+    char ip[INET_ADDRSTRLEN];
+    struct sockaddr_in address;
+    socklen_t len;
+    TELEMETRY_CLIENT_T *p_client;
+
+    for (;;) {
+        len = sizeof(address);
+        if ((fd = accept(listenfd, (struct sockaddr *)&address, &len)) == -1) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "accept() failure: %i: %s", errno, strerror(errno));
+            }
+            return;
+        }
+
+        inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip));
+
+        if ((telemetry_allowed_ip != NULL) && (!telemetry_allowed_ip(ip))) {
+            log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "telemetry: %s is not allowed IP", ip);
+            close(fd);
+            continue;
+        }
+
+        for (i = 0; (i < telemetry_max_clients) && (p_clients[i].fd != -1); ++i);
+
+        if (i == telemetry_max_clients) {
+            log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "telemetry: too many clients, %s refused", ip);
+            close(fd);
+            continue;
+        }
+
+        if ((ioctl(fd, FIONBIO, &flag_ioctl) == -1) || (telemetry_ctl(EPOLL_CTL_ADD, fd, EPOLLIN, i) == -1)) {
+            close(fd);
+            continue;
+        }
+
+        p_client = &p_clients[i];
+        p_client->fd = fd;
+        p_client->pollout = 0;
+        p_client->dirty = (telemetry_count == 32) ? ~0u : (1u << telemetry_count) - 1; // everything
+        p_client->last = now - telemetry_min_interval;
+        p_client->stall = 0;
+        p_client->len = 0;
+        p_client->off = 0;
+
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "telemetry client %i connected from %s", fd, ip);
+    }
+}
+
+/* clients have nothing to say, input is only checked for closed connection */
+static void telemetry_client_read(TELEMETRY_CLIENT_T *p_client)
+{
+    int count;
+    char buf[256];
+
+    while ((count = recv(p_client->fd, buf, sizeof(buf), 0)) > 0);
+
+    if (count == 0) {
+        telemetry_client_close(p_client, "closed by peer");
+    }
+    else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+        telemetry_client_close(p_client, strerror(errno));
+    }
+}
+
+static void telemetry_client_flush(TELEMETRY_CLIENT_T *p_client, int index)
+{
+    int count;
+
+    while (p_client->off < p_client->len) {
+        if ((count = send(p_client->fd, p_client->buf + p_client->off, p_client->len - p_client->off, MSG_NOSIGNAL)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                telemetry_client_close(p_client, strerror(errno));
+                return;
+            }
+
+            break;
+        }
+
+        p_client->off += count;
+    }
+
+    if (p_client->off == p_client->len) {
+        p_client->len = 0;
+        p_client->off = 0;
+        p_client->stall = 0;
+
+        if ((p_client->pollout) && (telemetry_ctl(EPOLL_CTL_MOD, p_client->fd, EPOLLIN, index) != -1)) {
+            p_client->pollout = 0;
+        }
+    }
+    else if ((!p_client->pollout) && (telemetry_ctl(EPOLL_CTL_MOD, p_client->fd, EPOLLIN | EPOLLOUT, index) != -1)) {
+        p_client->pollout = 1;
+    }
+}
+
+/* called with telemetry_mutex */
+static void telemetry_format(TELEMETRY_CLIENT_T *p_client, long long now)
+{
+    int i;
+
+    p_client->len = 0;
+    p_client->off = 0;
+
+    for (i = 0; i < telemetry_count; ++i) {
+        if (p_client->dirty & (1u << i)) {
+            p_client->len += snprintf(p_client->buf + p_client->len, TELEMETRY_BUF_MAX - p_client->len,
+                "%s %s\n", telemetry_keys[i], telemetry_values[i]);
+        }
+    }
+
+    p_client->len += snprintf(p_client->buf + p_client->len, TELEMETRY_BUF_MAX - p_client->len,
+        "time %li\n", (long)telemetry_time);
+
+    p_client->dirty = 0;
+    p_client->last = now;
+    p_client->stall = now;
+}
+
+/*
+ * New batch is formatted only for client which has read the previous one
+ * and has not got any for min_interval, other changes wait in dirty. Nothing
+ * is sent before the first telemetry_publish().
+ */
+static void telemetry_batches(long long now)
+{
+    int i;
+    unsigned int changed;
+
+    /* LOCK */
+    pthr_mutex_lock(&telemetry_mutex);
+
+    changed = telemetry_changed;
+    telemetry_changed = 0;
+
+    for (i = 0; i < telemetry_max_clients; ++i) {
+        if (p_clients[i].fd == -1) {
+            continue;
+        }
+
+        p_clients[i].dirty |= changed;
+
+        if ((telemetry_time) && (p_clients[i].dirty) && (!p_clients[i].len) &&
+            (now - p_clients[i].last >= telemetry_min_interval)) {
+            telemetry_format(&p_clients[i], now);
+        }
+    }
+
+    pthr_mutex_unlock(&telemetry_mutex);
+    /* UNLOCK */
+
+    for (i = 0; i < telemetry_max_clients; ++i) {
+        if ((p_clients[i].fd == -1) || (!p_clients[i].len)) {
+            continue;
+        }
+
+        if (now - p_clients[i].stall >= TELEMETRY_STALL) {
+            telemetry_client_close(&p_clients[i], "client does not read");
+        }
+        else if (!p_clients[i].pollout) {
+            telemetry_client_flush(&p_clients[i], i);
+        }
+    }
+}
+
+/* milliseconds until some waiting batch may be sent */
+static int telemetry_timeout(long long now)
+{
+    int i;
+    long long wait = 1000;
+
+    for (i = 0; i < telemetry_max_clients; ++i) {
+        if ((p_clients[i].fd != -1) && (p_clients[i].dirty) && (!p_clients[i].len) &&
+            (p_clients[i].last + telemetry_min_interval - now < wait)) {
+            wait = p_clients[i].last + telemetry_min_interval - now;
+        }
+    }
+
+    return (wait < 0) ? 0 : wait;
+}
+
+static void *telemetry_thread(void *p_arg)
+{
+    int i;
+    int count;
+    uint32_t id;
+    uint64_t value;
+    long long now;
+    struct epoll_event events[16];
+
+    while (!telemetry_exit_flag) {
+        if ((count = epoll_wait(epollfd, events, 16, telemetry_timeout(telemetry_time_ms()))) == -1) {
+            if (errno != EINTR) {
+                log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "epoll_wait() failure: %i: %s", errno, strerror(errno));
+                sleep(1);
+            }
+            continue;
+        }
+
+        now = telemetry_time_ms();
+
+        for (i = 0; i < count; ++i) {
+            if ((id = events[i].data.u32) == TELEMETRY_WAKE) {
+                if (read(wakefd, &value, sizeof(value)) == -1) {
+                    log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "read(wakefd) failure: %i: %s", errno, strerror(errno));
+                }
+            }
+            else if (id == TELEMETRY_LISTEN) {
+                telemetry_accept(now);
+            }
+            else {
+                if ((p_clients[id].fd != -1) && (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+                    telemetry_client_read(&p_clients[id]);
+                }
+
+                if ((p_clients[id].fd != -1) && (events[i].events & EPOLLOUT)) {
+                    telemetry_client_flush(&p_clients[id], id);
+                }
+            }
+        }
+
+        telemetry_batches(now);
+    }
+
+    for (i = 0; i < telemetry_max_clients; ++i) {
+        if (p_clients[i].fd != -1) {
+            close(p_clients[i].fd);
+        }
+    }
+
+    log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "Exiting telemetry_pthread...");
+    pthread_exit(NULL);
+}
+
+static int telemetry_listen(int port)
+{
+    int flag = 1;
+    unsigned long flag_ioctl = 1;
+    struct sockaddr_in address;
+
+    if ((listenfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "socket() failure: %i: %s", errno, strerror(errno));
+        return -1;
+    }
+
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+    bzero((char *)&address, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (bind(listenfd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "bind(%i) failure: %i: %s", port, errno, strerror(errno));
+        return -1;
+    }
+
+    if ((listen(listenfd, 16) == -1) || (ioctl(listenfd, FIONBIO, &flag_ioctl) == -1)) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "listen() failure: %i: %s", errno, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Port 0 disables telemetry. pp_keys are names of values given to
+ * telemetry_publish(), fce_allowed_ip may be NULL.
+ */
+int telemetry_start(int port, int min_interval, int max_clients, const char **pp_keys, int count,
+        int (*fce_allowed_ip)(char *p_ip))
+{
+    int i;
+
+    if (port <= 0) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "telemetry is disabled");
+        return 0;
+    }
+
+    if ((count <= 0) || (count > TELEMETRY_FIELDS_MAX) ||
+        (max_clients <= 0) || (max_clients > TELEMETRY_CLIENTS_MAX)) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "telemetry: invalid count %i or max_clients %i", count, max_clients);
+        return -1;
+    }
+
+    telemetry_min_interval = (min_interval < 0) ? 0 : min_interval;
+    telemetry_max_clients = max_clients;
+    telemetry_allowed_ip = fce_allowed_ip;
+
+    for (i = 0; i < count; ++i) {
+        strncpy(telemetry_keys[i], pp_keys[i], TELEMETRY_KEY_MAX);
+    }
+
+    if ((p_clients = malloc(max_clients * sizeof(TELEMETRY_CLIENT_T))) == NULL) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "malloc() failed");
+        return -1;
+    }
+
+    for (i = 0; i < max_clients; ++i) {
+        p_clients[i].fd = -1;
+    }
+
+    if (pthread_mutex_init(&telemetry_mutex, NULL) != 0) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "pthread_mutex_init(): %i: %s", errno, strerror(errno));
+        return -1;
+    }
+
+    if (telemetry_listen(port) == -1) {
+        return -1;
+    }
+
+    if ((epollfd = epoll_create(16)) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "epoll_create(): %i: %s", errno, strerror(errno));
+        return -1;
+    }
+
+    if ((wakefd = eventfd(0, EFD_NONBLOCK)) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "eventfd(): %i: %s", errno, strerror(errno));
+        return -1;
+    }
+
+    if ((telemetry_ctl(EPOLL_CTL_ADD, listenfd, EPOLLIN, TELEMETRY_LISTEN) == -1) ||
+        (telemetry_ctl(EPOLL_CTL_ADD, wakefd, EPOLLIN, TELEMETRY_WAKE) == -1)) {
+        return -1;
+    }
+
+    // publish can run from now on
+    telemetry_count = count;
+
+    if (pthread_create(&telemetry_pthread, NULL, telemetry_thread, NULL) != 0) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "pthread_create(): %i: %s", errno, strerror(errno));
+        telemetry_count = 0;
+        return -1;
+    }
+
+    log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "telemetry listens on port %i", port);
+    return 0;
+}
+
+/* pp_values are in order of pp_keys given to telemetry_start() */
+void telemetry_publish(const char **pp_values, time_t time)
+{
+    int i;
+    unsigned int changed = 0;
+
+    if (!telemetry_count) {
+        return;
+    }
+
+    /* LOCK */
+    pthr_mutex_lock(&telemetry_mutex);
+
+    for (i = 0; i < telemetry_count; ++i) {
+        if (strncmp(telemetry_values[i], pp_values[i], TELEMETRY_VALUE_MAX)) {
+            strncpy(telemetry_values[i], pp_values[i], TELEMETRY_VALUE_MAX);
+            changed |= 1u << i;
+        }
+    }
+
+    telemetry_time = time;
+    telemetry_changed |= changed;
+
+    pthr_mutex_unlock(&telemetry_mutex);
+    /* UNLOCK */
+
+    if (changed) {
+        telemetry_wake();
+    }
+}
+
+void telemetry_stop(void)
+{
+    void *thread_result;
+
+    if (!telemetry_count) {
+        return;
+    }
+
+    telemetry_exit_flag = 1;
+    telemetry_wake();
+    pthread_join(telemetry_pthread, &thread_result);
+
+    telemetry_count = 0;
+    close(listenfd);
+    close(wakefd);
+    close(epollfd);
+}
@@ -0,0 +1,44 @@
+/**
+  * Author: Jan Fuchs <fuky@sunstel.asu.cas.cz>
+  * $Date$
+  * $Rev$
+  * $URL$
+ */
+
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#include <time.h>
+
+#define TELEMETRY_FIELDS_MAX  32
+#define TELEMETRY_KEY_MAX     15
+#define TELEMETRY_VALUE_MAX   123
+#define TELEMETRY_CLIENTS_MAX 256
+#define TELEMETRY_BUF_MAX     8192
+#define TELEMETRY_STALL       60000 // drop client not reading for [ms]
+
+typedef struct {
+    int fd; // -1 = free slot
+    int pollout; // EPOLLOUT is registered
+    unsigned int dirty; // fields changed since last batch
+    long long last; // time of last batch [ms]
+    long long stall; // batch waits for client since [ms]
+    int len;
+    int off;
+    char buf[TELEMETRY_BUF_MAX];
+} TELEMETRY_CLIENT_T;
+
+/*
+ * Push channel for info values. Every client gets all values after connect,
+ * then only changed ones, one "key value\n" per line, each batch is closed by
+ * "time <unix time>\n". A client gets at most one batch per min_interval and
+ * a new batch only after it has read the previous one, changes in between
+ * are merged, so slow clients see the latest values less often instead of
+ * growing buffers.
+ */
+int telemetry_start(int port, int min_interval, int max_clients, const char **pp_keys, int count,
+        int (*fce_allowed_ip)(char *p_ip));
+void telemetry_publish(const char **pp_values, time_t time);
+void telemetry_stop(void);
+
+#endif
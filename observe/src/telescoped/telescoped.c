@@ -30,10 +30,13 @@
 #include <errno.h>
 #include <time.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <netinet/in.h>
@@ -50,24 +53,68 @@
 #include "thread.h"
 #include "socket.h"
 #include "str.h"
+#include "telemetry.h"
 
 log4c_category_t *p_logcat = NULL;
 
 static int telescope_exit_flag = 0;
-static int sockfd_loop = -1;
-static int sockfd_cmd = -1;
-static pthread_mutex_t global_mutex;
+static int epollfd = -1;
+static int wakefd = -1;
+static pthread_mutex_t queue_mutex;
 static pthread_mutex_t data_mutex;
-static pthread_t telescope_loop_pthread;
-static pthread_t telescope_cmd_pthread;
-static char info_data[INFO_SIZE_E][INFO_MAX+1];
-static char info_cmds[INFO_SIZE_E][INFO_MAX+1];
+static pthread_t telescope_reactor_pthread;
+static TELESCOPE_REQUEST_T *p_queue_first = NULL; // guarded by queue_mutex
+static TELESCOPE_REQUEST_T *p_queue_last = NULL;
+static TELESCOPE_INFO_T info_buffers[2];
+static TELESCOPE_INFO_T *p_info = &info_buffers[0]; // published, guarded by data_mutex
+
+/* owned by telescope_reactor() */
+static TELESCOPE_CONN_T conn_loop;
+static TELESCOPE_CONN_T conn_cmd;
+static TELESCOPE_INFO_T *p_info_new;
+static long long info_next[INFO_SIZE_E];
+static long long info_start;
+static int info_due[INFO_SIZE_E];
+static int info_due_count = 0; // info commands in flight
+static int info_due_done = 0;
+static TELESCOPE_REQUEST_T *p_pending_first = NULL; // taken from queue
+static TELESCOPE_REQUEST_T *p_pending_last = NULL;
+static TELESCOPE_REQUEST_T *p_cmd_current = NULL;
+static TELESCOPE_CACHE_T cache[CACHE_SIZE];
+static long long cache_cleared = 0; // last reply to state-changing command
+static TELESCOPE_REQUEST_T cmd_login = {.command = "GLLG 123\n"};
+static TELESCOPE_REQUEST_T cmd_keepalive = {.command = "GLST\n"};
+static long long cmd_last = 0;
 static char telescope_tsra[COMMAND_MAX+1];
 static char telescope_object[COMMAND_MAX+1];
 static char *p_telescoped_dir;
 static TELESCOPE_CFG_T telescope_cfg;
 static TELESCOPE_IP_T *p_telescope_ip_first = NULL;
 
+static const struct {
+    const char *p_cmd;
+    const char *p_key; // telescoped.cfg [info_period]
+    int period; // default refresh period [ms]
+} info_defs[INFO_SIZE_E] = {
+    [INFO_GLST_E]   = {"GLST\n",   "glst",   1000}, /* Global State */
+    [INFO_TRRD_E]   = {"TRRD\n",   "trrd",   500},  /* Star Coordinates */
+    [INFO_TRHD_E]   = {"TRHD\n",   "trhd",   500},  /* Source Coordinates */
+    [INFO_TRGV_E]   = {"TRGV\n",   "trgv",   1000}, /* Telescope Read Guiding Value */
+    [INFO_TRUS_E]   = {"TRUS\n",   "trus",   1000}, /* Telescope Read User Speed */
+    [INFO_DOPO_E]   = {"DOPO\n",   "dopo",   1000}, /* DOme POsition */
+    [INFO_TRCS_E]   = {"TRCS\n",   "trcs",   2000}, /* Telescope Read Correction Set */
+    [INFO_FOPO_E]   = {"FOPO\n",   "fopo",   5000}, /* FOcus POsition */
+    [INFO_GLUT_E]   = {"GLUT\n",   "glut",   1000}, /* UT */
+    [INFO_GLME_0_E] = {"GLME 0\n", "glme_0", 10000}, /* Meteo outtemp */
+    [INFO_GLME_1_E] = {"GLME 1\n", "glme_1", 10000}, /* Meteo airpress */
+    [INFO_GLME_2_E] = {"GLME 2\n", "glme_2", 10000}, /* Meteo airhumex */
+    [INFO_GLME_4_E] = {"GLME 4\n", "glme_4", 10000}, /* Meteo dometemp */
+};
+
+#define TELEMETRY_TSRA_E   INFO_SIZE_E
+#define TELEMETRY_OBJECT_E (INFO_SIZE_E + 1)
+#define TELEMETRY_SIZE_E   (INFO_SIZE_E + 2)
+
 static void telescope_help(char *name)
 {
     printf("Usage: %s\n", name);
@@ -88,14 +135,16 @@ static void telescope_version(char *name)
 static void telescope_signal(int sig)
 {
   void *thread_result;
+  uint64_t value = 1;
 
     switch (sig) {
         case SIGTERM:
             telescope_exit_flag = 1;
             log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "Received signal SIGTERM");
 
-            pthread_join(telescope_loop_pthread, &thread_result);
-            pthread_join(telescope_cmd_pthread, &thread_result);
+            write(wakefd, &value, sizeof(value)); // reactor waits at most 1 s anyway
+            pthread_join(telescope_reactor_pthread, &thread_result);
+            telemetry_stop();
 
             log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "Exiting...");
 
@@ -116,122 +165,609 @@ static int telescope_exit(int status)
     exit(status);
 }
 
-static int telescope_loop_service()
+static long long telescope_time_ms()
 {
-    int i;
-    char recvbuf[SOCK_RECVBUF_MAX];
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Complete p_request and all requests coalesced with it. p_reply is NULL on
+ * error.
+ */
+static void telescope_request_done(TELESCOPE_REQUEST_T *p_request, const char *p_reply, int error)
+{
+    TELESCOPE_REQUEST_T *p_same;
+
+    while (p_request != NULL) {
+        p_same = p_request->p_same;
+        p_request->p_same = NULL;
+
+        if (p_reply != NULL) {
+            strncpy(p_request->reply, p_reply, COMMAND_MAX);
+        }
+        p_request->error = error;
+
+        if (p_request->wait) {
+            pthr_sem_post(&p_request->done); // p_request may be gone now
+        }
+
+        p_request = p_same;
+    }
+}
+
+/*
+ * Called from XML-RPC handlers. The request is queued in FIFO order and
+ * handled by the reactor, the caller only waits for its completion and never
+ * holds a lock while ASCOL replies.
+ */
+static int telescope_submit(TELESCOPE_REQUEST_T *p_request)
+{
+    uint64_t value = 1;
+
+    p_request->p_next = NULL;
+    p_request->p_same = NULL;
+    p_request->error = 0;
+    p_request->wait = 1;
+    bzero(p_request->reply, sizeof(p_request->reply));
 
-    if (sock_client_create(telescope_cfg.ascol_ip, telescope_cfg.ascol_loop_port, &sockfd_loop) == -1) {
+    if (sem_init(&p_request->done, 0, 0) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "sem_init() failure: %i: %s", errno, strerror(errno));
+        p_request->error = errno;
         return -1;
     }
 
-    while (!telescope_exit_flag) {
+    /* LOCK */
+    pthr_mutex_lock(&queue_mutex);
+    if (p_queue_last == NULL) {
+        p_queue_first = p_request;
+    }
+    else {
+        p_queue_last->p_next = p_request;
+    }
+    p_queue_last = p_request;
+    pthr_mutex_unlock(&queue_mutex);
+    /* UNLOCK */
 
-#ifdef DBG
-        struct timeval start, end;
-        long mtime, seconds, useconds;
-        gettimeofday(&start, NULL);
-#endif
+    if (write(wakefd, &value, sizeof(value)) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "write(wakefd) failure: %i: %s", errno, strerror(errno));
+    }
 
-        for (i = 0; i < INFO_SIZE_E; ++i) {
-            if (sock_send(sockfd_loop, info_cmds[i]) == -1) {
-                return -1;
-            }
+    while ((pthr_sem_wait(&p_request->done) != 0) && (errno == EINTR));
 
-            if (sock_recv(sockfd_loop, recvbuf) == -1) {
-                return -1;
-            }
+    sem_destroy(&p_request->done);
 
-            /* LOCK */
-            pthr_mutex_lock(&data_mutex);
-            strncpy(info_data[i], strim(recvbuf), INFO_MAX);
-            pthr_mutex_unlock(&data_mutex);
-            /* UNLOCK */
-        }
+    return p_request->error ? -1 : 0;
+}
 
-#ifdef DBG
-        gettimeofday(&end, NULL);
-        seconds = end.tv_sec  - start.tv_sec;
-        useconds = end.tv_usec - start.tv_usec;
-        mtime = ((seconds) * 1000 + useconds/1000.0);
-        log4c_category_log(p_logcat, LOG4C_PRIORITY_DEBUG,
-            "telescope_loop_service() elapsed time: %ld milliseconds", mtime);
-#endif
+/* move everything submitted so far to the reactor's pending list */
+static void telescope_queue_take()
+{
+    TELESCOPE_REQUEST_T *p_first;
+    TELESCOPE_REQUEST_T *p_last;
+
+    /* LOCK */
+    pthr_mutex_lock(&queue_mutex);
+    p_first = p_queue_first;
+    p_last = p_queue_last;
+    p_queue_first = NULL;
+    p_queue_last = NULL;
+    pthr_mutex_unlock(&queue_mutex);
+    /* UNLOCK */
+
+    if (p_first == NULL) {
+        return;
+    }
+
+    if (p_pending_last == NULL) {
+        p_pending_first = p_first;
+    }
+    else {
+        p_pending_last->p_next = p_first;
+    }
+    p_pending_last = p_last;
+}
+
+/* first word of p_command is in [cache] commands */
+static int telescope_cacheable(const char *p_command)
+{
+    size_t len;
+    size_t item;
+    const char *p_list = telescope_cfg.cache_commands;
+
+    if ((len = strcspn(p_command, " \n")) == 0) {
+        return 0;
+    }
 
+    while (*p_list != '\0') {
+        item = strcspn(p_list, ";");
+        if ((item == len) && (!strncmp(p_list, p_command, len))) {
+            return 1;
+        }
+
+        p_list += item;
+        if (*p_list == ';') {
+            ++p_list;
+        }
     }
 
     return 0;
 }
 
-static int telescope_cmd_service()
+static TELESCOPE_CACHE_T *telescope_cache_find(const char *p_command)
 {
     int i;
-    int socket_result = 0;
-    char recvbuf[SOCK_RECVBUF_MAX];
 
-    if (sock_client_create(telescope_cfg.ascol_ip, telescope_cfg.ascol_cmd_port, &sockfd_cmd) == -1) {
-        return -1;
+    for (i = 0; i < CACHE_SIZE; ++i) {
+        if ((cache[i].time) && (!strcmp(cache[i].command, p_command))) {
+            return &cache[i];
+        }
     }
 
-    /* LOCK */
-    pthr_mutex_lock(&global_mutex);
-    if ((socket_result = sock_send(sockfd_cmd, "GLLG 123\n")) != -1) {
-        socket_result = sock_recv(sockfd_cmd, recvbuf);
+    return NULL;
+}
+
+/* loop and command replies both refresh the cache, the oldest entry is replaced */
+static void telescope_cache_store(const char *p_command, const char *p_reply, long long now)
+{
+    int i;
+    TELESCOPE_CACHE_T *p_cache;
+
+    if (strlen(p_command) > INFO_MAX) {
+        return;
     }
-    pthr_mutex_unlock(&global_mutex);
-    /* UNLOCK */
 
-    while ((!telescope_exit_flag) && (!socket_result)) {
-        /* LOCK */
-        pthr_mutex_lock(&global_mutex);
-        if ((socket_result = sock_send(sockfd_cmd, "GLST\n")) != -1) {
-            socket_result = sock_recv(sockfd_cmd, recvbuf);
+    if ((p_cache = telescope_cache_find(p_command)) == NULL) {
+        p_cache = &cache[0];
+        for (i = 1; i < CACHE_SIZE; ++i) {
+            if (cache[i].time < p_cache->time) {
+                p_cache = &cache[i];
+            }
         }
-        pthr_mutex_unlock(&global_mutex);
-        /* UNLOCK */
 
-        if (socket_result == -1) {
-            break;
+        strcpy(p_cache->command, p_command);
+    }
+
+    strncpy(p_cache->reply, p_reply, COMMAND_MAX);
+    p_cache->time = now;
+}
+
+/*
+ * Reply to a command outside [cache] commands means the telescope state may
+ * have changed, so no cached reply is valid anymore. Info replies already in
+ * flight were queried before the change, telescope_loop_read() drops them.
+ */
+static void telescope_cache_clear(long long now)
+{
+    int i;
+
+    for (i = 0; i < CACHE_SIZE; ++i) {
+        cache[i].time = 0;
+    }
+
+    cache_cleared = now;
+}
+
+static void telescope_conn_open(TELESCOPE_CONN_T *p_conn, long long now)
+{
+    struct epoll_event event;
+
+    p_conn->reconnect = now + ASCOL_RECONNECT;
+
+    if (sock_client_connect(telescope_cfg.ascol_ip, p_conn->port, &p_conn->sockfd) == -1) {
+        return;
+    }
+
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.ptr = p_conn;
+
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, p_conn->sockfd, &event) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "epoll_ctl(ADD) failure: %i: %s", errno, strerror(errno));
+        close(p_conn->sockfd);
+        p_conn->sockfd = -1;
+        return;
+    }
+
+    p_conn->connected = 0;
+    p_conn->deadline = now + ASCOL_TIMEOUT;
+    sock_ringbuf_init(&p_conn->ringbuf);
+}
+
+static void telescope_conn_close(TELESCOPE_CONN_T *p_conn, long long now, int error)
+{
+    epoll_ctl(epollfd, EPOLL_CTL_DEL, p_conn->sockfd, NULL);
+    close(p_conn->sockfd);
+
+    p_conn->sockfd = -1;
+    p_conn->connected = 0;
+    p_conn->deadline = 0;
+    p_conn->reconnect = now + ASCOL_RECONNECT;
+
+    log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "Reconnect telescope %s", p_conn->p_name);
+
+    if (p_conn == &conn_loop) {
+        info_due_count = 0;
+    }
+    else if (p_cmd_current != NULL) {
+        telescope_request_done(p_cmd_current, NULL, error);
+        p_cmd_current = NULL;
+    }
+}
+
+static void telescope_cmd_send(TELESCOPE_REQUEST_T *p_request, long long now)
+{
+    p_cmd_current = p_request;
+    cmd_last = now;
+
+    if (sock_send(conn_cmd.sockfd, p_request->command) == -1) {
+        telescope_conn_close(&conn_cmd, now, errno);
+        return;
+    }
+
+    conn_cmd.deadline = now + ASCOL_TIMEOUT;
+}
+
+static void telescope_conn_connected(TELESCOPE_CONN_T *p_conn, long long now)
+{
+    struct epoll_event event;
+
+    if (sock_client_connected(p_conn->sockfd) == -1) {
+        telescope_conn_close(p_conn, now, ECONNREFUSED);
+        return;
+    }
+
+    event.events = EPOLLIN;
+    event.data.ptr = p_conn;
+
+    if (epoll_ctl(epollfd, EPOLL_CTL_MOD, p_conn->sockfd, &event) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "epoll_ctl(MOD) failure: %i: %s", errno, strerror(errno));
+        telescope_conn_close(p_conn, now, errno);
+        return;
+    }
+
+    p_conn->connected = 1;
+    p_conn->deadline = 0;
+
+    if (p_conn == &conn_loop) {
+        bzero(info_next, sizeof(info_next));
+    }
+    else {
+        telescope_cmd_send(&cmd_login, now);
+    }
+}
+
+/*
+ * One command is on the command connection at a time, ASCOL commands change
+ * the telescope state. Idempotent queries ([cache] commands) are answered
+ * from the cache if the reply is at most max_age old, or join an identical
+ * query already on the wire. Pending requests fail immediately while the
+ * connection is down, nobody would answer.
+ */
+static void telescope_cmd_next(long long now)
+{
+    TELESCOPE_REQUEST_T *p_request;
+    TELESCOPE_REQUEST_T *p_prev = NULL;
+    TELESCOPE_REQUEST_T *p_next;
+    TELESCOPE_CACHE_T *p_cache;
+
+    telescope_queue_take();
+
+    for (p_request = p_pending_first; p_request != NULL; p_request = p_next) {
+        p_next = p_request->p_next;
+
+        if (conn_cmd.sockfd == -1) {
+            telescope_request_done(p_request, NULL, ENOTCONN);
+        }
+        else if ((telescope_cacheable(p_request->command)) &&
+                 ((p_cache = telescope_cache_find(p_request->command)) != NULL) &&
+                 (now - p_cache->time <= telescope_cfg.cache_max_age)) {
+            telescope_request_done(p_request, p_cache->reply, 0);
+        }
+        else if ((p_cmd_current != NULL) && (telescope_cacheable(p_request->command)) &&
+                 (!strcmp(p_cmd_current->command, p_request->command))) {
+            p_request->p_same = p_cmd_current->p_same;
+            p_cmd_current->p_same = p_request;
+        }
+        else if ((p_cmd_current == NULL) && (conn_cmd.connected)) {
+            telescope_cmd_send(p_request, now);
+        }
+        else {
+            p_prev = p_request;
+            continue;
         }
 
-        for (i = 0; i < 30; ++i) {
-            if (telescope_exit_flag) {
-                break;
-            }
-            sleep(1);
+        // p_request was handled, unlink it
+        if (p_prev == NULL) {
+            p_pending_first = p_next;
+        }
+        else {
+            p_prev->p_next = p_next;
+        }
+
+        if (p_pending_last == p_request) {
+            p_pending_last = p_prev;
         }
     }
 
-    return socket_result;
+    if ((p_cmd_current == NULL) && (conn_cmd.connected) && (now - cmd_last >= ASCOL_KEEPALIVE)) {
+        telescope_cmd_send(&cmd_keepalive, now);
+    }
+}
+
+static void telescope_cmd_read(long long now)
+{
+    char *p_reply;
+    TELESCOPE_REQUEST_T *p_request;
+
+    if (sock_ringbuf_read(conn_cmd.sockfd, &conn_cmd.ringbuf) == -1) {
+        telescope_conn_close(&conn_cmd, now, ECONNRESET);
+        return;
+    }
+
+    while (sock_ringbuf_line(&conn_cmd.ringbuf, &p_reply)) {
+        if ((p_request = p_cmd_current) == NULL) {
+            log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "Unexpected reply '%s'", p_reply);
+            continue;
+        }
+
+        p_reply = strim(p_reply);
+        if (telescope_cacheable(p_request->command)) {
+            telescope_cache_store(p_request->command, p_reply, now);
+        }
+        else {
+            telescope_cache_clear(now);
+        }
+
+        p_cmd_current = NULL;
+        conn_cmd.deadline = 0;
+        telescope_request_done(p_request, p_reply, 0);
+    }
 }
 
-static void run_loop(int *p_sockfd, int (*fce_loop)())
+/*
+ * Every info command has its own period (info_defs[], [info_period]). Due
+ * commands are sent in one write, replies come back in the same order. New
+ * values are written to the unpublished buffer and made visible by swapping
+ * p_info, so readers always see one consistent snapshot.
+ */
+static void telescope_loop_poll(long long now)
 {
-    while ((!telescope_exit_flag) && (fce_loop() == -1)) {
-        if (*p_sockfd != -1) {
-            close(*p_sockfd);
+    int i;
+    char cmds[INFO_SIZE_E * (INFO_MAX+1) + 1];
+
+    if ((!conn_loop.connected) || (info_due_count)) {
+        return;
+    }
+
+    cmds[0] = '\0';
+
+    for (i = 0; i < INFO_SIZE_E; ++i) {
+        if (info_next[i] <= now) {
+            info_due[info_due_count++] = i;
+            strcat(cmds, info_defs[i].p_cmd);
+            info_next[i] = now + telescope_cfg.info_period[i];
         }
+    }
 
-        sleep(1);
-        log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "Reconnect telescope");
+    if (!info_due_count) {
+        return;
     }
 
-    if (*p_sockfd != -1) {
-        close(*p_sockfd);
+    if (sock_send(conn_loop.sockfd, cmds) == -1) {
+        telescope_conn_close(&conn_loop, now, errno);
+        return;
     }
+
+    // only the reactor changes p_info, it can be read without lock
+    p_info_new = (p_info == &info_buffers[0]) ? &info_buffers[1] : &info_buffers[0];
+    memcpy(p_info_new, p_info, sizeof(TELESCOPE_INFO_T));
+
+    info_due_done = 0;
+    info_start = now;
+    conn_loop.deadline = now + ASCOL_TIMEOUT;
 }
 
-static void *telescope_loop(void *p_arg)
+static void telescope_loop_read(long long now)
 {
-    run_loop(&sockfd_loop, telescope_loop_service);
-    log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "Exiting telescope_loop_pthread...");
-    pthread_exit(NULL);
+    int i;
+    char *p_reply;
+    char tsra[INFO_MAX+1];
+    char object[INFO_MAX+1];
+    const char *p_values[TELEMETRY_SIZE_E];
+
+    if (sock_ringbuf_read(conn_loop.sockfd, &conn_loop.ringbuf) == -1) {
+        telescope_conn_close(&conn_loop, now, ECONNRESET);
+        return;
+    }
+
+    while (sock_ringbuf_line(&conn_loop.ringbuf, &p_reply)) {
+        if (info_due_done >= info_due_count) {
+            log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "Unexpected reply '%s'", p_reply);
+            continue;
+        }
+
+        p_reply = strim(p_reply);
+        strncpy(p_info_new->data[info_due[info_due_done]], p_reply, INFO_MAX);
+        if (info_start > cache_cleared) {
+            telescope_cache_store(info_defs[info_due[info_due_done]].p_cmd, p_reply, now);
+        }
+        ++info_due_done;
+    }
+
+    if ((!info_due_count) || (info_due_done < info_due_count)) {
+        return;
+    }
+
+    p_info_new->time = time(NULL);
+
+    /* LOCK */
+    pthr_mutex_lock(&data_mutex);
+    p_info = p_info_new;
+    strncpy(tsra, telescope_tsra, INFO_MAX);
+    strncpy(object, telescope_object, INFO_MAX);
+    pthr_mutex_unlock(&data_mutex);
+    /* UNLOCK */
+
+    tsra[INFO_MAX] = '\0';
+    object[INFO_MAX] = '\0';
+
+    for (i = 0; i < INFO_SIZE_E; ++i) {
+        p_values[i] = p_info->data[i];
+    }
+    p_values[TELEMETRY_TSRA_E] = tsra;
+    p_values[TELEMETRY_OBJECT_E] = object;
+    telemetry_publish(p_values, p_info->time);
+
+#ifdef DBG
+    log4c_category_log(p_logcat, LOG4C_PRIORITY_DEBUG,
+        "telescope_loop_read() %i commands, elapsed time: %lld milliseconds", info_due_count, now - info_start);
+#endif
+
+    info_due_count = 0;
+    conn_loop.deadline = 0;
+}
+
+/* milliseconds until the reactor has something to do */
+static int telescope_timeout(long long now)
+{
+    int i;
+    long long wait = 1000;
+    TELESCOPE_CONN_T *p_conns[] = {&conn_loop, &conn_cmd};
+
+    for (i = 0; i < 2; ++i) {
+        if ((p_conns[i]->sockfd == -1) && (p_conns[i]->reconnect - now < wait)) {
+            wait = p_conns[i]->reconnect - now;
+        }
+
+        if ((p_conns[i]->deadline) && (p_conns[i]->deadline - now < wait)) {
+            wait = p_conns[i]->deadline - now;
+        }
+    }
+
+    if ((conn_loop.connected) && (!info_due_count)) {
+        for (i = 0; i < INFO_SIZE_E; ++i) {
+            if (info_next[i] - now < wait) {
+                wait = info_next[i] - now;
+            }
+        }
+    }
+
+    if ((conn_cmd.connected) && (p_cmd_current == NULL) && (cmd_last + ASCOL_KEEPALIVE - now < wait)) {
+        wait = cmd_last + ASCOL_KEEPALIVE - now;
+    }
+
+    return (wait < 0) ? 0 : wait;
 }
 
-static void *telescope_cmd(void *p_arg)
+static int telescope_reactor_init()
 {
-    run_loop(&sockfd_cmd, telescope_cmd_service);
-    log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "Exiting telescope_cmd_pthread...");
+    struct epoll_event event;
+
+    if ((epollfd = epoll_create(4)) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "epoll_create(): %i: %s", errno, strerror(errno));
+        return -1;
+    }
+
+    if ((wakefd = eventfd(0, EFD_NONBLOCK)) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "eventfd(): %i: %s", errno, strerror(errno));
+        return -1;
+    }
+
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wakefd, &event) == -1) {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "epoll_ctl(ADD): %i: %s", errno, strerror(errno));
+        return -1;
+    }
+
+    bzero(&conn_loop, sizeof(conn_loop));
+    conn_loop.p_name = "loop";
+    conn_loop.port = telescope_cfg.ascol_loop_port;
+    conn_loop.sockfd = -1;
+
+    bzero(&conn_cmd, sizeof(conn_cmd));
+    conn_cmd.p_name = "cmd";
+    conn_cmd.port = telescope_cfg.ascol_cmd_port;
+    conn_cmd.sockfd = -1;
+
+    return 0;
+}
+
+/*
+ * The only thread talking to ASCOL. It owns both connections, polls info
+ * commands and serves queued requests, XML-RPC handlers are woken up by
+ * wakefd.
+ */
+static void *telescope_reactor(void *p_arg)
+{
+    int i;
+    int count;
+    long long now;
+    uint64_t value;
+    struct epoll_event events[4];
+    TELESCOPE_CONN_T *p_conn;
+    TELESCOPE_CONN_T *p_conns[] = {&conn_loop, &conn_cmd};
+
+    while (!telescope_exit_flag) {
+        now = telescope_time_ms();
+
+        for (i = 0; i < 2; ++i) {
+            if ((p_conns[i]->sockfd == -1) && (p_conns[i]->reconnect <= now)) {
+                telescope_conn_open(p_conns[i], now);
+            }
+            else if ((p_conns[i]->deadline) && (p_conns[i]->deadline <= now)) {
+                log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "Telescope %s timeout", p_conns[i]->p_name);
+                telescope_conn_close(p_conns[i], now, ETIMEDOUT);
+            }
+        }
+
+        telescope_loop_poll(now);
+        telescope_cmd_next(now);
+
+        if ((count = epoll_wait(epollfd, events, 4, telescope_timeout(now))) == -1) {
+            if (errno != EINTR) {
+                log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "epoll_wait() failure: %i: %s", errno, strerror(errno));
+                sleep(1);
+            }
+            continue;
+        }
+
+        now = telescope_time_ms();
+
+        for (i = 0; i < count; ++i) {
+            if ((p_conn = events[i].data.ptr) == NULL) {
+                if (read(wakefd, &value, sizeof(value)) == -1) {
+                    log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN, "read(wakefd) failure: %i: %s", errno, strerror(errno));
+                }
+                continue;
+            }
+
+            if (p_conn->sockfd == -1) {
+                continue;
+            }
+
+            if (!p_conn->connected) {
+                telescope_conn_connected(p_conn, now);
+            }
+            else if (p_conn == &conn_loop) {
+                telescope_loop_read(now);
+            }
+            else {
+                telescope_cmd_read(now);
+            }
+        }
+    }
+
+    for (i = 0; i < 2; ++i) {
+        if (p_conns[i]->sockfd != -1) {
+            close(p_conns[i]->sockfd);
+        }
+    }
+
+    log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "Exiting telescope_reactor_pthread...");
     pthread_exit(NULL);
 }
 
@@ -261,6 +797,22 @@ static int telescope_allowed_ip(char *p_ip)
     return 0;
 }
 
+/* keys are the same as in observatory_snapshot, but "glut" is not converted */
+static int telescope_telemetry_start()
+{
+    int i;
+    const char *p_keys[TELEMETRY_SIZE_E];
+
+    for (i = 0; i < INFO_SIZE_E; ++i) {
+        p_keys[i] = info_defs[i].p_key;
+    }
+    p_keys[TELEMETRY_TSRA_E] = "tsra";
+    p_keys[TELEMETRY_OBJECT_E] = "object";
+
+    return telemetry_start(telescope_cfg.telemetry_port, telescope_cfg.telemetry_min_interval,
+        telescope_cfg.telemetry_max_clients, p_keys, TELEMETRY_SIZE_E, telescope_allowed_ip);
+}
+
 static char *glut2ut(char *p_glut)
 {
     static char buffer[256];
@@ -306,12 +858,8 @@ static xmlrpc_value *telescope_execute(xmlrpc_env * const p_env,
                                        void * const p_server_info,
                                        void * const p_chan_info)
 {
-    const char *p_result_str;
-
-    int socket_result;
     char *p_command;
-    char command[COMMAND_MAX+1];
-    char recvbuf[SOCK_RECVBUF_MAX];
+    TELESCOPE_REQUEST_T request;
     char ip[CFG_TYPE_STR_MAX+1];
     unsigned char *p_ip_addr;
     xmlrpc_value *p_result = NULL;
@@ -337,30 +885,27 @@ static xmlrpc_value *telescope_execute(xmlrpc_env * const p_env,
         "RPC telescope_execute is from IP address %s, command = '%s'",
         ip, p_command);
 
-    /* LOCK */
-    pthr_mutex_lock(&global_mutex);
+    snprintf(request.command, COMMAND_MAX, "%s\n", p_command);
 
-    snprintf(command, COMMAND_MAX, "%s\n", p_command);
-    socket_result = sock_send(sockfd_cmd, command);
-    if ((socket_result = sock_recv(sockfd_cmd, recvbuf)) != -1) {
-        p_result_str = strim(recvbuf);
-        p_result = xmlrpc_build_value(p_env, "s", p_result_str);
+    if (telescope_submit(&request) != -1) {
+        p_result = xmlrpc_build_value(p_env, "s", request.reply);
 
-        if ((strstr(p_command, "TSRA ") == p_command) && (p_result_str[0] == '1')) {
+        if ((strstr(p_command, "TSRA ") == p_command) && (request.reply[0] == '1')) {
+            /* LOCK */
+            pthr_mutex_lock(&data_mutex);
             bzero(&telescope_tsra, sizeof(telescope_tsra));
             bzero(&telescope_object, sizeof(telescope_object));
             strncpy(telescope_tsra, p_command+5, COMMAND_MAX);
             strncpy(telescope_object, "unknown", COMMAND_MAX);
+            pthr_mutex_unlock(&data_mutex);
+            /* UNLOCK */
             log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "Save TSRA = '%s'", telescope_tsra);
         }
     }
     else {
-        p_result = xmlrpc_build_value(p_env, "s", strerror(errno));
+        p_result = xmlrpc_build_value(p_env, "s", strerror(request.error));
     }
 
-    pthr_mutex_unlock(&global_mutex);
-    /* UNLOCK */
-
 cleanup:
     /* CLEANUP */
 
@@ -372,11 +917,7 @@ static xmlrpc_value *telescope_set_coordinates(xmlrpc_env * const p_env,
                                        void * const p_server_info,
                                        void * const p_chan_info)
 {
-    const char *p_result_str;
-
-    int socket_result;
-    char command[COMMAND_MAX+1];
-    char recvbuf[SOCK_RECVBUF_MAX];
+    TELESCOPE_REQUEST_T request;
     char ip[CFG_TYPE_STR_MAX+1];
     unsigned char *p_ip_addr;
     xmlrpc_value *p_result = NULL;
@@ -409,30 +950,27 @@ static xmlrpc_value *telescope_set_coordinates(xmlrpc_env * const p_env,
         "ra = '%s', dec = '%s', object = '%s', position = '%i'",
         ip, coords.p_ra, coords.p_dec, coords.p_object, coords.position);
 
-    /* LOCK */
-    pthr_mutex_lock(&global_mutex);
+    snprintf(request.command, COMMAND_MAX, "TSRA %s %s %i\n", coords.p_ra, coords.p_dec, coords.position);
 
-    snprintf(command, COMMAND_MAX, "TSRA %s %s %i\n", coords.p_ra, coords.p_dec, coords.position);
-    socket_result = sock_send(sockfd_cmd, command);
-    if ((socket_result = sock_recv(sockfd_cmd, recvbuf)) != -1) {
-        p_result_str = strim(recvbuf);
-        p_result = xmlrpc_build_value(p_env, "s", p_result_str);
+    if (telescope_submit(&request) != -1) {
+        p_result = xmlrpc_build_value(p_env, "s", request.reply);
 
-        if (p_result_str[0] == '1') {
+        if (request.reply[0] == '1') {
+            /* LOCK */
+            pthr_mutex_lock(&data_mutex);
             bzero(&telescope_tsra, sizeof(telescope_tsra));
             bzero(&telescope_object, sizeof(telescope_object));
-            strncpy(telescope_tsra, &command[5], strlen(command) - 6);
+            strncpy(telescope_tsra, &request.command[5], strlen(request.command) - 6);
             strncpy(telescope_object, coords.p_object, COMMAND_MAX);
+            pthr_mutex_unlock(&data_mutex);
+            /* UNLOCK */
             log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "Save TSRA = '%s'", telescope_tsra);
         }
     }
     else {
-        p_result = xmlrpc_build_value(p_env, "s", strerror(errno));
+        p_result = xmlrpc_build_value(p_env, "s", strerror(request.error));
     }
 
-    pthr_mutex_unlock(&global_mutex);
-    /* UNLOCK */
-
 cleanup:
     /* CLEANUP */
 
@@ -450,15 +988,15 @@ static xmlrpc_value *telescope_info(xmlrpc_env * const p_env,
     pthr_mutex_lock(&data_mutex);
 
     p_result = xmlrpc_build_value(p_env, "{s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s}", 
-        "ut", glut2ut(info_data[INFO_GLUT_E]),
-        "glst", info_data[INFO_GLST_E],
-        "trrd", info_data[INFO_TRRD_E],
-        "trhd", info_data[INFO_TRHD_E],
-        "trgv", info_data[INFO_TRGV_E],
-        "trus", info_data[INFO_TRUS_E],
-        "dopo", info_data[INFO_DOPO_E],
-        "trcs", info_data[INFO_TRCS_E],
-        "fopo", info_data[INFO_FOPO_E],
+        "ut", glut2ut(p_info->data[INFO_GLUT_E]),
+        "glst", p_info->data[INFO_GLST_E],
+        "trrd", p_info->data[INFO_TRRD_E],
+        "trhd", p_info->data[INFO_TRHD_E],
+        "trgv", p_info->data[INFO_TRGV_E],
+        "trus", p_info->data[INFO_TRUS_E],
+        "dopo", p_info->data[INFO_DOPO_E],
+        "trcs", p_info->data[INFO_TRCS_E],
+        "fopo", p_info->data[INFO_FOPO_E],
         "tsra", telescope_tsra,
         "object", telescope_object);
 
@@ -468,20 +1006,50 @@ static xmlrpc_value *telescope_info(xmlrpc_env * const p_env,
     return p_result;
 }
 
-static void telescope_info_init()
+/*
+ * Everything exposed needs for FITS header in one response, served from
+ * p_info->data[] refreshed by telescope_loop_read() in the reactor. Key "time"
+ * is the end of the last complete loop.
+ */
+static xmlrpc_value *observatory_snapshot(xmlrpc_env * const p_env,
+                                          xmlrpc_value * const p_param_array,
+                                          void * const p_server_info,
+                                          void * const p_chan_info)
 {
-    bzero(info_data, sizeof(info_data));
-    bzero(info_cmds, sizeof(info_cmds));
+    xmlrpc_value *p_result = NULL;
+
+    /* LOCK */
+    pthr_mutex_lock(&data_mutex);
+
+    p_result = xmlrpc_build_value(p_env,
+        "{s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:s,s:i}",
+        "ut", glut2ut(p_info->data[INFO_GLUT_E]),
+        "glst", p_info->data[INFO_GLST_E],
+        "trrd", p_info->data[INFO_TRRD_E],
+        "trhd", p_info->data[INFO_TRHD_E],
+        "trgv", p_info->data[INFO_TRGV_E],
+        "trus", p_info->data[INFO_TRUS_E],
+        "dopo", p_info->data[INFO_DOPO_E],
+        "trcs", p_info->data[INFO_TRCS_E],
+        "fopo", p_info->data[INFO_FOPO_E],
+        "tsra", telescope_tsra,
+        "object", telescope_object,
+        "glme_0", p_info->data[INFO_GLME_0_E],
+        "glme_1", p_info->data[INFO_GLME_1_E],
+        "glme_2", p_info->data[INFO_GLME_2_E],
+        "glme_4", p_info->data[INFO_GLME_4_E],
+        "time", (int) p_info->time);
+
+    pthr_mutex_unlock(&data_mutex);
+    /* UNLOCK */
+
+    return p_result;
+}
 
-    strncpy(info_cmds[INFO_GLST_E], "GLST\n", INFO_MAX); /* Global State */
-    strncpy(info_cmds[INFO_TRRD_E], "TRRD\n", INFO_MAX); /* Star Coordinates */
-    strncpy(info_cmds[INFO_TRHD_E], "TRHD\n", INFO_MAX); /* Source Coordinates */
-    strncpy(info_cmds[INFO_TRGV_E], "TRGV\n", INFO_MAX); /* Telescope Read Guiding Value */
-    strncpy(info_cmds[INFO_TRUS_E], "TRUS\n", INFO_MAX); /* Telescope Read User Speed */
-    strncpy(info_cmds[INFO_DOPO_E], "DOPO\n", INFO_MAX); /* DOme POsition */
-    strncpy(info_cmds[INFO_TRCS_E], "TRCS\n", INFO_MAX); /* Telescope Read Correction Set */
-    strncpy(info_cmds[INFO_FOPO_E], "FOPO\n", INFO_MAX); /* FOcus POsition */
-    strncpy(info_cmds[INFO_GLUT_E], "GLUT\n", INFO_MAX); /* UT */
+static void telescope_info_init()
+{
+    bzero(info_buffers, sizeof(info_buffers));
+    p_info = &info_buffers[0];
 }
 
 static void telescope_cfg_get_string(char *p_dest, char *p_group_name, char *p_key)
@@ -573,6 +1141,60 @@ static void telescope_cfg_get_allow_ips()
     }
 }
 
+static void telescope_cfg_get_info_periods()
+{
+    int i;
+
+    for (i = 0; i < INFO_SIZE_E; ++i) {
+        telescope_cfg.info_period[i] = info_defs[i].period;
+
+        if (!g_key_file_has_key(telescope_cfg.p_key_file, "info_period", info_defs[i].p_key, NULL)) {
+            continue;
+        }
+
+        telescope_cfg_get_integer(&telescope_cfg.info_period[i], "info_period", (char *)info_defs[i].p_key);
+
+        if (telescope_cfg.info_period[i] <= 0) {
+            log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR,
+                "info_period.%s must be positive", info_defs[i].p_key);
+            telescope_exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void telescope_cfg_get_cache()
+{
+    telescope_cfg.cache_max_age = CACHE_MAX_AGE;
+    strncpy(telescope_cfg.cache_commands, CACHE_COMMANDS, CFG_TYPE_STR_MAX);
+
+    if (g_key_file_has_key(telescope_cfg.p_key_file, "cache", "max_age", NULL)) {
+        telescope_cfg_get_integer(&telescope_cfg.cache_max_age, "cache", "max_age");
+    }
+
+    if (g_key_file_has_key(telescope_cfg.p_key_file, "cache", "commands", NULL)) {
+        telescope_cfg_get_string(telescope_cfg.cache_commands, "cache", "commands");
+    }
+}
+
+static void telescope_cfg_get_telemetry()
+{
+    telescope_cfg.telemetry_port = 0;
+    telescope_cfg.telemetry_min_interval = 500;
+    telescope_cfg.telemetry_max_clients = 32;
+
+    if (g_key_file_has_key(telescope_cfg.p_key_file, "telemetry", "port", NULL)) {
+        telescope_cfg_get_integer(&telescope_cfg.telemetry_port, "telemetry", "port");
+    }
+
+    if (g_key_file_has_key(telescope_cfg.p_key_file, "telemetry", "min_interval", NULL)) {
+        telescope_cfg_get_integer(&telescope_cfg.telemetry_min_interval, "telemetry", "min_interval");
+    }
+
+    if (g_key_file_has_key(telescope_cfg.p_key_file, "telemetry", "max_clients", NULL)) {
+        telescope_cfg_get_integer(&telescope_cfg.telemetry_max_clients, "telemetry", "max_clients");
+    }
+}
+
 static void telescope_load_cfg()
 {
     GKeyFileFlags flags;
@@ -594,6 +1216,9 @@ static void telescope_load_cfg()
     telescope_cfg_get_integer(&telescope_cfg.ascol_loop_port, "telescoped", "ascol_loop_port");
     telescope_cfg_get_integer(&telescope_cfg.ascol_cmd_port, "telescoped", "ascol_cmd_port");
     telescope_cfg_get_allow_ips();
+    telescope_cfg_get_info_periods();
+    telescope_cfg_get_cache();
+    telescope_cfg_get_telemetry();
 
     g_key_file_free(telescope_cfg.p_key_file);
     telescope_cfg.p_key_file = NULL;
@@ -688,6 +1313,11 @@ int main(int argc, char *argv[])
         .methodFunction = &telescope_info,
     };
 
+    struct xmlrpc_method_info3 const observatory_snapshot_MI = {
+        .methodName     = "observatory_snapshot",
+        .methodFunction = &observatory_snapshot,
+    };
+
     if ((p_telescoped_dir = getenv("TELESCOPED_DIR")) == NULL) {
         fprintf(stderr, "The TELESCOPED_DIR environment variable is not set.");
         exit(EXIT_FAILURE);
@@ -734,7 +1364,7 @@ int main(int argc, char *argv[])
     (void)signal(SIGTERM, telescope_signal);
     (void)signal(SIGPIPE, SIG_IGN);       /* send() */
 
-    if (pthread_mutex_init(&global_mutex, NULL) != 0) {
+    if (pthread_mutex_init(&queue_mutex, NULL) != 0) {
         log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "pthread_mutex_init(): %i: %s", errno, strerror(errno));
         exit(EXIT_FAILURE);
     }
@@ -744,16 +1374,19 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    if (pthread_create(&telescope_loop_pthread, NULL, telescope_loop, NULL) != 0) {
-        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "pthread_create(): %i: %s", errno, strerror(errno));
+    if (telescope_reactor_init() == -1) {
         exit(EXIT_FAILURE);
     }
 
-    if (pthread_create(&telescope_cmd_pthread, NULL, telescope_cmd, NULL) != 0) {
+    if (telescope_telemetry_start() == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (pthread_create(&telescope_reactor_pthread, NULL, telescope_reactor, NULL) != 0) {
         log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR, "pthread_create(): %i: %s", errno, strerror(errno));
         exit(EXIT_FAILURE);
     }
- 
+
     xmlrpc_env_init(&env);
 
     registryP = xmlrpc_registry_new(&env);
@@ -761,6 +1394,7 @@ int main(int argc, char *argv[])
     xmlrpc_registry_add_method3(&env, registryP, &telescope_execute_MI);
     xmlrpc_registry_add_method3(&env, registryP, &telescope_set_coordinates_MI);
     xmlrpc_registry_add_method3(&env, registryP, &telescope_info_MI);
+    xmlrpc_registry_add_method3(&env, registryP, &observatory_snapshot_MI);
 
     serverparm.config_file_name = NULL;
     serverparm.registryP = registryP;
@@ -777,7 +1411,7 @@ int main(int argc, char *argv[])
 
     xmlrpc_server_abyss(&env, &serverparm, XMLRPC_APSIZE(log_file_name));
 
-    pthread_mutex_destroy(&global_mutex);
+    pthread_mutex_destroy(&queue_mutex);
     pthread_mutex_destroy(&data_mutex);
     log4c_fini();
 
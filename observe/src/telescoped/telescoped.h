@@ -8,9 +8,13 @@
 #ifndef __TELESCOPE_H
 #define __TELESCOPE_H
 
+#include <time.h>
+#include <semaphore.h>
 #include <glib.h>
 #include <log4c.h>
 
+#include "socket.h"
+
 #define MAKE_DATE_TIME "(" __DATE__ " " __TIME__ ")"
 
 #define COMMAND_MAX 1023
@@ -18,6 +22,14 @@
 
 #define CFG_TYPE_STR_MAX 511
 
+#define ASCOL_TIMEOUT   5000  // connect and reply timeout [ms]
+#define ASCOL_RECONNECT 1000  // delay before next connect [ms]
+#define ASCOL_KEEPALIVE 30000 // GLST on idle command connection [ms]
+
+#define CACHE_SIZE     64
+#define CACHE_MAX_AGE  1000 // default [ms]
+#define CACHE_COMMANDS "GLST;GLUT;GLME;TRRD;TRHD;TRGV;TRUS;TRCS;DOPO;FOPO"
+
 extern log4c_category_t *p_logcat;
 
 typedef enum {
@@ -30,9 +42,48 @@ typedef enum {
     INFO_TRCS_E,
     INFO_FOPO_E,
     INFO_GLUT_E, // vraci UT ve formatu HHMMSS.SSSYYYYmmdd
+    INFO_GLME_0_E, // outtemp
+    INFO_GLME_1_E, // airpress
+    INFO_GLME_2_E, // airhumex
+    INFO_GLME_4_E, // dometemp
     INFO_SIZE_E,
 } TELESCOPE_INFO_E;
 
+/* values of info commands published at once by telescope_loop_read() */
+typedef struct {
+    char data[INFO_SIZE_E][INFO_MAX+1];
+    time_t time; // last publication
+} TELESCOPE_INFO_T;
+
+/* ASCOL command queued by XML-RPC handler for the reactor */
+typedef struct telescope_request {
+    struct telescope_request *p_next;
+    struct telescope_request *p_same; // coalesced, waits for the same reply
+    char command[COMMAND_MAX+1]; // terminated by '\n'
+    char reply[COMMAND_MAX+1];
+    int error; // 0 or errno of failure
+    int wait; // submitter waits for done
+    sem_t done;
+} TELESCOPE_REQUEST_T;
+
+/* reply of query command, e.g. "GLME 0\n" */
+typedef struct {
+    char command[INFO_MAX+1];
+    char reply[COMMAND_MAX+1];
+    long long time; // 0 = unused
+} TELESCOPE_CACHE_T;
+
+/* ASCOL connection owned by the reactor */
+typedef struct {
+    const char *p_name;
+    int port;
+    int sockfd; // -1 = wait for reconnect
+    int connected; // 0 = connect in progress
+    long long deadline; // connect or reply timeout, 0 = none
+    long long reconnect; // next connect when sockfd == -1
+    SOCK_RINGBUF_T ringbuf;
+} TELESCOPE_CONN_T;
+
 typedef struct {
     const char *p_ra;
     const char *p_dec;
@@ -49,6 +100,12 @@ typedef struct {
     int port;
     int ascol_loop_port;
     int ascol_cmd_port;
+    int info_period[INFO_SIZE_E]; // refresh period of info command [ms]
+    int cache_max_age; // [ms]
+    char cache_commands[CFG_TYPE_STR_MAX+1]; // idempotent queries separated by ';'
+    int telemetry_port; // 0 = disabled
+    int telemetry_min_interval; // [ms]
+    int telemetry_max_clients;
 } TELESCOPE_CFG_T;
 
 typedef struct telescope_ip {
@@ -71,6 +71,13 @@
 *
 * 26-Sep-2011 sds  2.0    Removed unused ASTROPCI_GET_CR_PROGRESS command.
 *
+*                  3.0    Added ASTROPCI_COMMAND_BATCH, executes a list of
+*                         commands ( e.g. a .lod download ) in one ioctl.
+*
+*                  3.0    Added ASTROPCI_WAIT_FOR_PIXELS and
+*                         ASTROPCI_WAIT_FOR_FRAME, sleep until the readout
+*                         progress reaches a value. The ISR wakes the waiters.
+*
 *   Development notes:
 *   ---------------------------------------------------------------------------
 *   This driver has been tested on CentOS 5.x x64, Kernel 2.6.18-238.12.1.el5.
@@ -109,6 +116,15 @@ static astropci_dev_t	devices[ MAX_DEV ];
 static uint32_t		nextValidStartAddress = 0;
 static int		astropci_major = 0;
 
+/*
+ * PCI bus master DMA is cache coherent on x86, so the image buffer may be
+ * mapped write-back and read by the CPU at full memory speed. Set to 1 to
+ * map it uncached as before.
+ */
+static int		uncached_buffer = 0;
+module_param( uncached_buffer, int, S_IRUGO );
+MODULE_PARM_DESC( uncached_buffer, "Map image buffer uncached (default 0)" );
+
 /******************************************************************************
         Prototypes for main entry points
 ******************************************************************************/
@@ -123,6 +139,9 @@ static int  astropci_mmap( struct file *file, struct vm_area_struct *vma );
 static int __devinit astropci_probe( struct pci_dev *pdev, const struct pci_device_id *ent );
 static void __devexit astropci_remove( struct pci_dev *pdev );
 static irqreturn_t astropci_ISR( int irq, void *dev_id );
+static int astropci_command( int devnum, uint32_t *Cmd_data );
+static int astropci_get_progress( int devnum, int ctrlCode, uint32_t *progress );
+static int astropci_wait_for_progress( int devnum, int ctrlCode, unsigned long arg );
 static int astropci_flush_reply_buffer( int devnum );
 static int astropci_check_reply_flags( int devnum );
 static int astropci_check_dsp_input_fifo( int devnum );
@@ -254,6 +273,8 @@ static int __init astropci_init( void )
 			devices[ minor ].has_irq = 0;
 			devices[ minor ].opened = 0;
 			devices[ minor ].irqDevNum = minor + 1;
+			init_waitqueue_head( &devices[ minor ].waitQueue );
+			atomic_set( &devices[ minor ].irqCount, 0 );
 			sprintf( devices[ minor ].name, "%s%d", DRIVER_NAME, minor );
 
 			result = cdev_add( &devices[ minor ].cdev, devnum, 1 );
@@ -639,6 +660,14 @@ static long astropci_ioctl( struct file *file, unsigned int cmd, unsigned long a
 		result = -ENXIO;
 	}
 
+	// The wait commands sleep without holding the semaphore, so the
+	// device can still be used ( e.g. abort readout ) while waiting
+	else if ( EXCMD( cmd ) == ASTROPCI_WAIT_FOR_PIXELS ||
+			  EXCMD( cmd ) == ASTROPCI_WAIT_FOR_FRAME )
+	{
+		result = astropci_wait_for_progress( devnum, EXCMD( cmd ), arg );
+	}
+
 	else
 	{
 		if ( down_interruptible( &devices[ devnum ].sem ) )
@@ -675,36 +704,8 @@ static long astropci_ioctl( struct file *file, unsigned int cmd, unsigned long a
 			case ASTROPCI_GET_FRAMES_READ:
 			{
 				uint32_t progress = 0;
-				uint32_t upper    = 0;
-				uint32_t lower    = 0;
 
-				// Ask the PCI board for the current value
-				if ( ctrlCode == ASTROPCI_GET_PROGRESS )
-				{
-                	result = Write_HCVR( devnum,
-							     ( uint32_t )READ_PCI_IMAGE_ADDR );
-				}
-
-				else if ( ctrlCode == ASTROPCI_GET_FRAMES_READ )
-				{
-                	result = Write_HCVR( devnum,
-							     ( uint32_t )READ_NUMBER_OF_FRAMES_READ );
-				}
-
-                		// Read the current image address
-				if ( result == 0 )
-				{
-                	if ( astropci_check_dsp_output_fifo( devnum ) == OUTPUT_FIFO_OK_MASK )
-					{
-                		lower = Read_REPLY_BUFFER_16( devnum );
-                		upper = Read_REPLY_BUFFER_16( devnum );
-                		progress = ( ( upper << 16 ) | lower );
-	            	}
-                	else
-                	{
-                 		result = -EFAULT;
-					}
-				}
+				result = astropci_get_progress( devnum, ctrlCode, &progress );
 
 		       	if ( put_user( progress, ( uint32_t * )arg ) )
 				{
@@ -859,10 +860,7 @@ static long astropci_ioctl( struct file *file, unsigned int cmd, unsigned long a
 			// -----------------------------------------------
 			case ASTROPCI_COMMAND:
 			{
-				uint32_t Cmd_data[ 6 ] = { 0, 0, 0, 0, 0, 0 };
-				uint32_t currStatus    = 0;
-				int numberOfParams     = 0;
-				int i                  = 0;
+				uint32_t Cmd_data[ CMD_MAX ] = { 0, 0, 0, 0, 0, 0 };
 
 				if ( copy_from_user( Cmd_data, ( uint32_t * ) arg, sizeof( Cmd_data ) ) )
  				{
@@ -871,87 +869,72 @@ static long astropci_ioctl( struct file *file, unsigned int cmd, unsigned long a
 
 				else
 				{
-					// Check that the command isn't maskable and that
-					// we're currently not in readout.
-					currStatus = ( Read_HSTR( devnum ) & HTF_BIT_MASK ) >> 3;
+					result = astropci_command( devnum, Cmd_data );
+				}
 
-					if ( ( Cmd_data[ 1 ] & 0x8000 ) == 0 && currStatus == READOUT_STATUS )
-					{
-						result = -EIO;
-					}
+				if ( copy_to_user( ( uint32_t * ) arg, Cmd_data, sizeof( Cmd_data ) ) )
+				{
+					result = -EFAULT;
+				}
+			} break;
 
-					// Clear the status bits
-					if ( result == 0 )
+			// -----------------------------------------------
+			//  SEND COMMAND BATCH
+			// -----------------------------------------------
+			case ASTROPCI_COMMAND_BATCH:
+			{
+				astropci_batch_t batch;
+				uint32_t Cmd_data[ CMD_MAX ];
+				uint32_t __user *pCmds = NULL;
+				uint32_t i = 0;
+
+				if ( copy_from_user( &batch, ( void * ) arg, sizeof( batch ) ) )
+				{
+					result = -EFAULT;
+					break;
+				}
+
+				if ( batch.count > ASTROPCI_BATCH_MAX )
+				{
+					result = -EINVAL;
+					break;
+				}
+
+				pCmds = ( uint32_t __user * )( unsigned long )batch.cmds;
+
+				// Every command is executed exactly like ASTROPCI_COMMAND,
+				// its first word is replaced by the reply. Stops at the
+				// first failed command, batch.done tells how many ran.
+				for ( i = 0; i < batch.count; i++ )
+				{
+					if ( signal_pending( current ) )
 					{
-						result = Write_HCVR( devnum, ( uint32_t )CLEAR_REPLY_FLAGS );
+						result = -EINTR;
+						break;
 					}
-                        
-					// Wait for the FIFO to be empty.
-					if ( result == 0 )
+
+					if ( copy_from_user( Cmd_data, pCmds + i * CMD_MAX, sizeof( Cmd_data ) ) )
 					{
-						if ( !astropci_check_dsp_input_fifo( devnum ) )
-						{
-							result = -EIO;
-						}
+						result = -EFAULT;
+						break;
 					}
-						
-					if ( result == 0 )
-					{
-						// Get the number of command parameters.
-						numberOfParams = Cmd_data[ 0 ] & 0x000000FF;
 
-						if ( numberOfParams > CMD_MAX )
-						{
-							astropci_printf( "(astropci_ioctl): Incorrect number of command parameters!\n" );
-							result = -EFAULT;
-						}
-						else
-						{
-							// All is well, so write rest of the data.
-							for ( i = 0; i < numberOfParams; i++ )
-							{
-								Write_CMD_DATA_32( devnum, Cmd_data[ i ] );
-								//astropci_printf( "astropci: CMD[ %d ]: 0x%X\n", i, Cmd_data[ i ] );
-							}
+					result = astropci_command( devnum, Cmd_data );
 
-							// Tell the PCI board to do a WRITE_COMMAND vector command
-							result = Write_HCVR( devnum, ( uint32_t )WRITE_COMMAND );
-							//astropci_printf( "astropci: WRITE_COMMAND reply: 0x%X\n", result );
-						}
+					if ( put_user( Cmd_data[ 0 ], pCmds + i * CMD_MAX ) )
+					{
+						result = -EFAULT;
 					}
 
-					if ( result == 0 )
+					if ( result != 0 )
 					{
-						// Set the reply
-						reply =  astropci_check_reply_flags( devnum );
-
-						if ( reply == RDR )
-						{
-							// Flush the reply buffer
-							astropci_flush_reply_buffer( devnum );
-
-							// Go read some data
-							result = Write_HCVR( devnum, ( uint32_t )READ_REPLY_VALUE );
-
-							if ( result == 0 )
-							{
-								if ( astropci_check_dsp_output_fifo( devnum ) )
-								{
-									reply = Read_REPLY_BUFFER_32( devnum );
-								}
-								else
-								{
-									result = -EFAULT;
-								}
-							}
-						}
+						break;
 					}
 				}
 
-				// Return reply
-				Cmd_data[ 0 ] = reply;
+				batch.done = i;
 
-				if ( copy_to_user( ( uint32_t * ) arg, Cmd_data, sizeof( Cmd_data ) ) )
+				if ( copy_to_user( ( void * ) arg, &batch, sizeof( batch ) ) )
 				{
 					result = -EFAULT;
 				}
@@ -1156,6 +1139,227 @@ static long astropci_ioctl( struct file *file, unsigned int cmd, unsigned long a
 	return ( long )result;
 }
 
+/******************************************************************************
+ FUNCTION: ASTROPCI_GET_PROGRESS()
+ 
+ PURPOSE:  Read the current image address ( pixel count ) or the number of
+           frames read from the PCI board. The caller must hold the device
+           semaphore.
+ 
+ RETURNS:  0 on success, else an error code.
+******************************************************************************/
+static int astropci_get_progress( int devnum, int ctrlCode, uint32_t *progress )
+{
+	uint32_t upper  = 0;
+	uint32_t lower  = 0;
+	int      result = 0;
+
+	*progress = 0;
+
+	// Ask the PCI board for the current value
+	if ( ctrlCode == ASTROPCI_GET_PROGRESS || ctrlCode == ASTROPCI_WAIT_FOR_PIXELS )
+	{
+		result = Write_HCVR( devnum, ( uint32_t )READ_PCI_IMAGE_ADDR );
+	}
+
+	else
+	{
+		result = Write_HCVR( devnum, ( uint32_t )READ_NUMBER_OF_FRAMES_READ );
+	}
+
+	// Read the current image address
+	if ( result == 0 )
+	{
+		if ( astropci_check_dsp_output_fifo( devnum ) == OUTPUT_FIFO_OK_MASK )
+		{
+			lower = Read_REPLY_BUFFER_16( devnum );
+			upper = Read_REPLY_BUFFER_16( devnum );
+			*progress = ( ( upper << 16 ) | lower );
+		}
+		else
+		{
+			result = -EFAULT;
+		}
+	}
+
+	return result;
+}
+
+/******************************************************************************
+ FUNCTION: ASTROPCI_WAIT_FOR_PROGRESS()
+ 
+ PURPOSE:  Sleep until the pixel count ( ASTROPCI_WAIT_FOR_PIXELS ) or the
+           number of frames read ( ASTROPCI_WAIT_FOR_FRAME ) reaches the
+           requested value. The DSP interrupts at the end of an image, which
+           wakes the waiter immediately. In between, the progress is read
+           every WAIT_POLL_DELAY msec.
+ 
+ RETURNS:  0 when the value is reached, -ETIMEDOUT on timeout, -ERESTARTSYS
+           if interrupted by a signal, else an error code. The progress is
+           returned to the user in every case.
+******************************************************************************/
+static int astropci_wait_for_progress( int devnum, int ctrlCode, unsigned long arg )
+{
+	astropci_wait_t wait;
+	unsigned long   deadline  = 0;
+	long            remaining = 0;
+	int             irqCount  = 0;
+	int             result    = 0;
+
+	if ( copy_from_user( &wait, ( void * )arg, sizeof( wait ) ) )
+	{
+		return -EFAULT;
+	}
+
+	deadline = jiffies + msecs_to_jiffies( wait.timeout );
+
+	while ( 1 )
+	{
+		irqCount = atomic_read( &devices[ devnum ].irqCount );
+
+		if ( down_interruptible( &devices[ devnum ].sem ) )
+		{
+			result = -ERESTARTSYS;
+			break;
+		}
+
+		result = astropci_get_progress( devnum, ctrlCode, &wait.progress );
+
+		up( &devices[ devnum ].sem );
+
+		if ( result != 0 || wait.progress >= wait.value )
+		{
+			break;
+		}
+
+		remaining = ( long )( deadline - jiffies );
+
+		if ( remaining <= 0 )
+		{
+			result = -ETIMEDOUT;
+			break;
+		}
+
+		if ( remaining > ( long )msecs_to_jiffies( WAIT_POLL_DELAY ) )
+		{
+			remaining = ( long )msecs_to_jiffies( WAIT_POLL_DELAY );
+		}
+
+		if ( wait_event_interruptible_timeout( devices[ devnum ].waitQueue,
+			 atomic_read( &devices[ devnum ].irqCount ) != irqCount,
+			 remaining ) < 0 )
+		{
+			result = -ERESTARTSYS;
+			break;
+		}
+	}
+
+	if ( copy_to_user( ( void * )arg, &wait, sizeof( wait ) ) )
+	{
+		result = -EFAULT;
+	}
+
+	return result;
+}
+
+/******************************************************************************
+ FUNCTION: ASTROPCI_COMMAND()
+ 
+ PURPOSE:  Write a command ( header, command, arguments ) to the PCI board and
+           read the controller reply. The reply is stored in Cmd_data[ 0 ].
+ 
+ RETURNS:  Returns 0 for success, or the appropriate error number.
+******************************************************************************/
+static int astropci_command( int devnum, uint32_t *Cmd_data )
+{
+	uint32_t currStatus    = 0;
+	uint32_t reply         = 0;
+	int numberOfParams     = 0;
+	int result             = 0;
+	int i                  = 0;
+
+	// Check that the command isn't maskable and that
+	// we're currently not in readout.
+	currStatus = ( Read_HSTR( devnum ) & HTF_BIT_MASK ) >> 3;
+
+	if ( ( Cmd_data[ 1 ] & 0x8000 ) == 0 && currStatus == READOUT_STATUS )
+	{
+		result = -EIO;
+	}
+
+	// Clear the status bits
+	if ( result == 0 )
+	{
+		result = Write_HCVR( devnum, ( uint32_t )CLEAR_REPLY_FLAGS );
+	}
+
+	// Wait for the FIFO to be empty.
+	if ( result == 0 )
+	{
+		if ( !astropci_check_dsp_input_fifo( devnum ) )
+		{
+			result = -EIO;
+		}
+	}
+
+	if ( result == 0 )
+	{
+		// Get the number of command parameters.
+		numberOfParams = Cmd_data[ 0 ] & 0x000000FF;
+
+		if ( numberOfParams > CMD_MAX )
+		{
+			astropci_printf( "(astropci_ioctl): Incorrect number of command parameters!\n" );
+			result = -EFAULT;
+		}
+		else
+		{
+			// All is well, so write rest of the data.
+			for ( i = 0; i < numberOfParams; i++ )
+			{
+				Write_CMD_DATA_32( devnum, Cmd_data[ i ] );
+				//astropci_printf( "astropci: CMD[ %d ]: 0x%X\n", i, Cmd_data[ i ] );
+			}
+
+			// Tell the PCI board to do a WRITE_COMMAND vector command
+			result = Write_HCVR( devnum, ( uint32_t )WRITE_COMMAND );
+			//astropci_printf( "astropci: WRITE_COMMAND reply: 0x%X\n", result );
+		}
+	}
+
+	if ( result == 0 )
+	{
+		// Set the reply
+		reply =  astropci_check_reply_flags( devnum );
+
+		if ( reply == RDR )
+		{
+			// Flush the reply buffer
+			astropci_flush_reply_buffer( devnum );
+
+			// Go read some data
+			result = Write_HCVR( devnum, ( uint32_t )READ_REPLY_VALUE );
+
+			if ( result == 0 )
+			{
+				if ( astropci_check_dsp_output_fifo( devnum ) )
+				{
+					reply = Read_REPLY_BUFFER_32( devnum );
+				}
+				else
+				{
+					result = -EFAULT;
+				}
+			}
+		}
+	}
+
+	// Return reply
+	Cmd_data[ 0 ] = reply;
+
+	return result;
+}
+
 /******************************************************************************
  FUNCTION: ASTROPCI_ISR()
  
@@ -1202,6 +1406,10 @@ static irqreturn_t astropci_ISR( int irq, void *dev_id )
 
 	Write_HCVR( devnum, ( uint32_t )CLEAR_INTERRUPT );
 
+	// Wake up ASTROPCI_WAIT_FOR_PIXELS / ASTROPCI_WAIT_FOR_FRAME
+	atomic_inc( &devices[ devnum ].irqCount );
+	wake_up_interruptible( &devices[ devnum ].waitQueue );
+
 	return 0;
 }
 
@@ -1587,8 +1795,9 @@ static int astropci_mmap( struct file *file, struct vm_area_struct *vma )
 				    devices[ devnum ].imageBufferPhysAddr + devices[ devnum ].imageBufferSize,
 				    devices[ devnum ].imageBufferSize );
 
-		// Ensure that the memory will not be cached; see drivers/char/mem.c
-		if ( boot_cpu_data.x86 > 3 )
+		// Ensure that the memory will not be cached if requested; see
+		// drivers/char/mem.c
+		if ( uncached_buffer && boot_cpu_data.x86 > 3 )
 		{
 			prot = pgprot_val( vma->vm_page_prot ) | _PAGE_PCD | _PAGE_PWT;
 			vma->vm_page_prot = __pgprot( prot );
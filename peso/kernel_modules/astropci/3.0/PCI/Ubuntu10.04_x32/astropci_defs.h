@@ -63,6 +63,7 @@
 
 #define CFG_OFFSET			0
 #define CFG_VALUE			1
+#define WAIT_POLL_DELAY		20		// msec, ASTROPCI_WAIT_FOR_PIXELS progress poll
 
 /******************************************************************************
         Debug Print Definitions
@@ -100,6 +101,8 @@ typedef struct astropci_dev
 	uint8_t		 irq;			// PCI board IRQ level
 	uint8_t		 has_irq;		// 1 if IRQ is set, 0 otherwise
 	uint8_t		 has_been_probed;	// 1 if already setup by probe(), else 0
+	wait_queue_head_t waitQueue;		// Readout waiters, woken by the ISR
+	atomic_t	 irqCount;		// Number of DMA interrupts
 	unsigned long	 imageBufferVirtAddr;	// Virtual start address of image buffer
 	uint32_t	 imageBufferPhysAddr;	// Physical start address of image buffer
 	uint32_t	 imageBufferSize;	// Image buffer size (bytes)
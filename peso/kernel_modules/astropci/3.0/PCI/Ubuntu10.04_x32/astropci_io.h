@@ -43,6 +43,9 @@
 #define ASTROPCI_PCI_DOWNLOAD		0x13
 #define ASTROPCI_PCI_DOWNLOAD_WAIT	0x14
 #define ASTROPCI_COMMAND			0x15
+#define ASTROPCI_COMMAND_BATCH		0x23
+#define ASTROPCI_WAIT_FOR_PIXELS	0x24
+#define ASTROPCI_WAIT_FOR_FRAME		0x25
 
 #define ASTROPCI_GET_CONFIG_BYTE	0x30
 #define ASTROPCI_GET_CONFIG_WORD	0x31
@@ -52,6 +55,36 @@
 #define ASTROPCI_SET_CONFIG_DWORD	0x35
 
 
+/*********************************************
+        ASTROPCI_COMMAND_BATCH argument. cmds
+        points to count x CMD_MAX words laid out
+        as for ASTROPCI_COMMAND, the first word
+        of each command is replaced by its reply.
+*********************************************/
+#define ASTROPCI_BATCH_MAX			65536
+
+typedef struct astropci_batch
+{
+	uint32_t count;		// IN: number of commands
+	uint32_t done;		// OUT: number of executed commands
+	uint64_t cmds;		// IN: user address of the commands
+} astropci_batch_t;
+
+
+/*********************************************
+        ASTROPCI_WAIT_FOR_PIXELS and
+        ASTROPCI_WAIT_FOR_FRAME argument.
+        Fails with ETIMEDOUT if value isn't
+        reached within timeout msec.
+*********************************************/
+typedef struct astropci_wait
+{
+	uint32_t value;		// IN: pixel count or frame number
+	uint32_t timeout;	// IN: timeout (msec)
+	uint32_t progress;	// OUT: current pixel count or frames read
+} astropci_wait_t;
+
+
 /*********************************************
 
         Generic Constants
@@ -3,22 +3,383 @@
 
 #ifdef WIN32
 #include <windows.h>
+#else
+#include <unistd.h>
+#include <pthread.h>
 #endif
 
 #include <sstream>
 #include <stdexcept>
 #include <cstring>
+#include <new>
 #include "CDeinterlace.h"
 
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define DEINT_X86
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 using namespace arc;
 
+
+// +----------------------------------------------------------------------------
+// |  Thread and work unit limits
+// +----------------------------------------------------------------------------
+// |  A work unit is the smallest independent piece of an algorithm, typically
+// |  one row or one pair of rows. Small images are not worth the thread start.
+// +----------------------------------------------------------------------------
+#define DEINTERLACE_MAX_THREADS		16
+#define DEINTERLACE_MIN_UNITS		32
+
+// +----------------------------------------------------------------------------
+// |  Internal pass that copies the temporary image back to the user buffer
+// +----------------------------------------------------------------------------
+#define DEINTERLACE_COPY_BACK		-1
+
+
+// +----------------------------------------------------------------------------
+// |  Thread arguments
+// +----------------------------------------------------------------------------
+struct CDeinterlaceThread
+{
+	CDeinterlace   *pThis;
+	int             dAlg;
+	unsigned short *pData;
+	int             dRows;
+	int             dCols;
+	int             dArg;
+	int             dFirst;
+	int             dLast;
+	unsigned short *pRow;
+};
+
+
+// +----------------------------------------------------------------------------
+// |  HaveSSE2 - Returns true if the processor supports SSE2
+// +----------------------------------------------------------------------------
+static bool HaveSSE2()
+{
+#ifdef DEINT_X86
+	return ( __builtin_cpu_supports( "sse2" ) != 0 );
+#else
+	return false;
+#endif
+}
+
+#ifdef DEINT_X86
+// +----------------------------------------------------------------------------
+// |  SSE2 helpers
+// +----------------------------------------------------------------------------
+// |  Split 16 interleaved pixels into the even and odd ones. The values are
+// |  sign extended before the signed pack, so all 16 bits survive unchanged.
+// +----------------------------------------------------------------------------
+__attribute__(( target( "sse2" ) ))
+static inline void SplitSSE2( __m128i v0, __m128i v1, __m128i *pEven, __m128i *pOdd )
+{
+	*pEven = _mm_packs_epi32( _mm_srai_epi32( _mm_slli_epi32( v0, 16 ), 16 ),
+							  _mm_srai_epi32( _mm_slli_epi32( v1, 16 ), 16 ) );
+
+	*pOdd  = _mm_packs_epi32( _mm_srai_epi32( v0, 16 ),
+							  _mm_srai_epi32( v1, 16 ) );
+}
+
+// +----------------------------------------------------------------------------
+// |  Reverse the order of eight pixels
+// +----------------------------------------------------------------------------
+__attribute__(( target( "sse2" ) ))
+static inline __m128i ReverseSSE2( __m128i v )
+{
+	v = _mm_shufflelo_epi16( v, 0x1B );
+	v = _mm_shufflehi_epi16( v, 0x1B );
+
+	return _mm_shuffle_epi32( v, 0x4E );
+}
+
+// +----------------------------------------------------------------------------
+// |  Transpose an 8x8 block of pixels
+// +----------------------------------------------------------------------------
+__attribute__(( target( "sse2" ) ))
+static inline void TransposeSSE2( __m128i *r )
+{
+	__m128i a0 = _mm_unpacklo_epi16( r[ 0 ], r[ 1 ] );
+	__m128i a1 = _mm_unpackhi_epi16( r[ 0 ], r[ 1 ] );
+	__m128i a2 = _mm_unpacklo_epi16( r[ 2 ], r[ 3 ] );
+	__m128i a3 = _mm_unpackhi_epi16( r[ 2 ], r[ 3 ] );
+	__m128i a4 = _mm_unpacklo_epi16( r[ 4 ], r[ 5 ] );
+	__m128i a5 = _mm_unpackhi_epi16( r[ 4 ], r[ 5 ] );
+	__m128i a6 = _mm_unpacklo_epi16( r[ 6 ], r[ 7 ] );
+	__m128i a7 = _mm_unpackhi_epi16( r[ 6 ], r[ 7 ] );
+
+	__m128i b0 = _mm_unpacklo_epi32( a0, a2 );
+	__m128i b1 = _mm_unpackhi_epi32( a0, a2 );
+	__m128i b2 = _mm_unpacklo_epi32( a1, a3 );
+	__m128i b3 = _mm_unpackhi_epi32( a1, a3 );
+	__m128i b4 = _mm_unpacklo_epi32( a4, a6 );
+	__m128i b5 = _mm_unpackhi_epi32( a4, a6 );
+	__m128i b6 = _mm_unpacklo_epi32( a5, a7 );
+	__m128i b7 = _mm_unpackhi_epi32( a5, a7 );
+
+	r[ 0 ] = _mm_unpacklo_epi64( b0, b4 );
+	r[ 1 ] = _mm_unpackhi_epi64( b0, b4 );
+	r[ 2 ] = _mm_unpacklo_epi64( b1, b5 );
+	r[ 3 ] = _mm_unpackhi_epi64( b1, b5 );
+	r[ 4 ] = _mm_unpacklo_epi64( b2, b6 );
+	r[ 5 ] = _mm_unpackhi_epi64( b2, b6 );
+	r[ 6 ] = _mm_unpacklo_epi64( b3, b7 );
+	r[ 7 ] = _mm_unpackhi_epi64( b3, b7 );
+}
+
+// +----------------------------------------------------------------------------
+// |  PairSSE2 - See Pair()
+// +----------------------------------------------------------------------------
+__attribute__(( target( "sse2" ) ))
+static long PairSSE2( const unsigned short *src, unsigned short *dst, long n,
+					  long i, long last )
+{
+	__m128i e, o;
+
+	for ( ; i + 8 <= last; i += 8 )
+	{
+		SplitSSE2( _mm_loadu_si128( ( const __m128i * )( src + 2 * i ) ),
+				   _mm_loadu_si128( ( const __m128i * )( src + 2 * i + 8 ) ),
+				   &e, &o );
+
+		_mm_storeu_si128( ( __m128i * )( dst + i ), e );
+		_mm_storeu_si128( ( __m128i * )( dst + n - i - 8 ), ReverseSSE2( o ) );
+	}
+
+	return i;
+}
+
+// +----------------------------------------------------------------------------
+// |  QuadSSE2 - See Quad()
+// +----------------------------------------------------------------------------
+__attribute__(( target( "sse2" ) ))
+static long QuadSSE2( const unsigned short *src, long n, unsigned short *pA,
+					  unsigned short *pB, unsigned short *pC, unsigned short *pD,
+					  bool bReverse )
+{
+	__m128i e0, o0, e1, o1, a, b, c, d;
+	long i = 0;
+
+	for ( ; i + 8 <= n; i += 8 )
+	{
+		const unsigned short *s = src + 4 * i;
+
+		SplitSSE2( _mm_loadu_si128( ( const __m128i * )( s ) ),
+				   _mm_loadu_si128( ( const __m128i * )( s + 8 ) ),
+				   &e0, &o0 );
+
+		SplitSSE2( _mm_loadu_si128( ( const __m128i * )( s + 16 ) ),
+				   _mm_loadu_si128( ( const __m128i * )( s + 24 ) ),
+				   &e1, &o1 );
+
+		SplitSSE2( e0, e1, &a, &c );
+		SplitSSE2( o0, o1, &b, &d );
+
+		_mm_storeu_si128( ( __m128i * )( pA + i ), a );
+		_mm_storeu_si128( ( __m128i * )( pD + i ), d );
+
+		if ( bReverse )
+		{
+			_mm_storeu_si128( ( __m128i * )( pB - i - 7 ), ReverseSSE2( b ) );
+			_mm_storeu_si128( ( __m128i * )( pC - i - 7 ), ReverseSSE2( c ) );
+		}
+		else
+		{
+			_mm_storeu_si128( ( __m128i * )( pB + i ), b );
+			_mm_storeu_si128( ( __m128i * )( pC + i ), c );
+		}
+	}
+
+	return i;
+}
+
+// +----------------------------------------------------------------------------
+// |  STA1600SSE2 - See STA1600Row()
+// +----------------------------------------------------------------------------
+__attribute__(( target( "sse2" ) ))
+static long STA1600SSE2( const unsigned short *src, unsigned short *dst, long offset )
+{
+	__m128i r[ 8 ];
+	long c = 0;
+
+	for ( ; c + 8 <= offset; c += 8 )
+	{
+		for ( int m=0; m<8; m++ )
+		{
+			r[ m ] = _mm_loadu_si128( ( const __m128i * )( src + 16 * ( c + m ) ) );
+		}
+
+		TransposeSSE2( r );
+
+		for ( int k=0; k<8; k++ )
+		{
+			_mm_storeu_si128( ( __m128i * )( dst + c + ( 7 - k ) * offset ), r[ k ] );
+		}
+	}
+
+	return c;
+}
+#endif	// DEINT_X86
+
+// +----------------------------------------------------------------------------
+// |  Pair - Two channel split used by parallel and serial readouts
+// +----------------------------------------------------------------------------
+// |  dst[ i ] = src[ 2i ] and dst[ n - 1 - i ] = src[ 2i + 1 ] for i in
+// |  [ i, last ).
+// +----------------------------------------------------------------------------
+static void Pair( const unsigned short *src, unsigned short *dst, long n,
+				  long i, long last, bool bSIMD )
+{
+#ifdef DEINT_X86
+	if ( bSIMD )
+	{
+		i = PairSSE2( src, dst, n, i, last );
+	}
+#endif
+
+	for ( ; i < last; i++ )
+	{
+		dst[ i ]         = src[ 2 * i ];
+		dst[ n - i - 1 ] = src[ 2 * i + 1 ];
+	}
+}
+
+// +----------------------------------------------------------------------------
+// |  Quad - Four channel split used by the quad readouts
+// +----------------------------------------------------------------------------
+// |  Pixel 4i + k goes to channel k. Channels A and D always run forward,
+// |  B and C run backward ( pB[ -i ], pC[ -i ] ) if bReverse is set.
+// +----------------------------------------------------------------------------
+static void Quad( const unsigned short *src, long n, unsigned short *pA,
+				  unsigned short *pB, unsigned short *pC, unsigned short *pD,
+				  bool bReverse, bool bSIMD )
+{
+	long i    = 0;
+	long step = ( bReverse ? -1 : 1 );
+
+#ifdef DEINT_X86
+	if ( bSIMD )
+	{
+		i = QuadSSE2( src, n, pA, pB, pC, pD, bReverse );
+	}
+#endif
+
+	for ( ; i < n; i++ )
+	{
+		pA[ i ]        = src[ 4 * i ];
+		pB[ step * i ] = src[ 4 * i + 1 ];
+		pC[ step * i ] = src[ 4 * i + 2 ];
+		pD[ i ]        = src[ 4 * i + 3 ];
+	}
+}
+
+// +----------------------------------------------------------------------------
+// |  STA1600Row - Eight channel split of one STA1600 row
+// +----------------------------------------------------------------------------
+// |  dst[ c + ( 7 - k ) * offset ] = src[ 16c + k ], the other eight pixels
+// |  of each group belong to the opposite row.
+// +----------------------------------------------------------------------------
+static void STA1600Row( const unsigned short *src, unsigned short *dst, long offset,
+						bool bSIMD )
+{
+	long c = 0;
+
+#ifdef DEINT_X86
+	if ( bSIMD )
+	{
+		c = STA1600SSE2( src, dst, offset );
+	}
+#endif
+
+	for ( ; c < offset; c++ )
+	{
+		for ( int k=0; k<8; k++ )
+		{
+			dst[ c + ( 7 - k ) * offset ] = src[ 16 * c + k ];
+		}
+	}
+}
+
 // +----------------------------------------------------------------------------
 // | Default constructor
 // +----------------------------------------------------------------------------
 CDeinterlace::CDeinterlace()
 {
-	new_iptr = NULL;
+	new_iptr   = NULL;
+	new_size   = 0;
+	row_iptr   = NULL;
+	row_size   = 0;
+	m_dThreads = 0;
+	m_bSIMD    = HaveSSE2();
+
+	SetThreads( 0 );
+}
+
+// +----------------------------------------------------------------------------
+// | Destructor
+// +----------------------------------------------------------------------------
+CDeinterlace::~CDeinterlace()
+{
+	delete[] new_iptr;
+	delete[] row_iptr;
+}
+
+// +----------------------------------------------------------------------------
+// | SetThreads - Sets the number of deinterlacing threads
+// +----------------------------------------------------------------------------
+// |  <IN>  -> dThreads - Thread count, 0 = number of online processors
+// +----------------------------------------------------------------------------
+void CDeinterlace::SetThreads( int dThreads )
+{
+	if ( dThreads <= 0 )
+	{
+#ifdef WIN32
+		dThreads = 1;
+#else
+		dThreads = int( sysconf( _SC_NPROCESSORS_ONLN ) );
+#endif
+	}
+
+	if ( dThreads < 1 )
+	{
+		dThreads = 1;
+	}
+
+	else if ( dThreads > DEINTERLACE_MAX_THREADS )
+	{
+		dThreads = DEINTERLACE_MAX_THREADS;
+	}
+
+	m_dThreads = dThreads;
+}
+
+// +----------------------------------------------------------------------------
+// | GetThreads - Returns the number of deinterlacing threads
+// +----------------------------------------------------------------------------
+int CDeinterlace::GetThreads()
+{
+	return m_dThreads;
+}
+
+// +----------------------------------------------------------------------------
+// | SetSIMD - Turns the SIMD kernels on/off
+// +----------------------------------------------------------------------------
+// |  The kernels stay off if the processor doesn't support them.
+// +----------------------------------------------------------------------------
+void CDeinterlace::SetSIMD( bool bOnOff )
+{
+	m_bSIMD = ( bOnOff && HaveSSE2() );
+}
+
+// +----------------------------------------------------------------------------
+// | IsSIMD - Returns true if the SIMD kernels are used
+// +----------------------------------------------------------------------------
+bool CDeinterlace::IsSIMD()
+{
+	return m_bSIMD;
 }
 
 // +----------------------------------------------------------------------------
@@ -74,24 +435,11 @@ CDeinterlace::CDeinterlace()
 // +----------------------------------------------------------------------------
 void CDeinterlace::RunAlg( void *data, int rows, int cols, int algorithm, int arg )
 {
-	unsigned short *old_iptr = NULL;	// Old image buffer pointer
-	new_iptr = NULL;					// New (temp) image buffer pointer
-
-	// NOTE ****** Instead of memcpy old_iptr to new_iptr, maybe just return the
-	// buffer pointer.
-
-	// Form a pointer to the current image buffer
-	// -------------------------------------------------------------------
-	old_iptr = ( unsigned short * )data;
-
-	// Allocate a new buffer to hold the deinterlaced image
-	// -------------------------------------------------------------------
-	new_iptr = new unsigned short[ cols * rows ];
+	unsigned short *old_iptr = ( unsigned short * )data;
 
-	if ( new_iptr == NULL || old_iptr == NULL )
+	if ( old_iptr == NULL )
 	{
-		ThrowException( "RunAlg",
-			"Error in allocating temporary image buffer for deinterlacing." );
+		ThrowException( "RunAlg", "Image buffer is NULL." );
 	}
 
 	switch( algorithm )
@@ -179,8 +527,283 @@ void CDeinterlace::RunAlg( void *data, int rows, int cols, int algorithm, int ar
 		}
 		break;
 	}	// End switch
+}
 
-	delete[] new_iptr;
+// +----------------------------------------------------------------------------
+// | GrowBuffers - Makes the temporary buffers large enough
+// +----------------------------------------------------------------------------
+// |  The buffers are kept between frames and only reallocated when an image
+// |  larger than all the previous ones arrives. Pass rows = 0 if the
+// |  algorithm doesn't need the temporary image and dThreads = 0 if it
+// |  doesn't need the row buffers.
+// |
+// |  <IN>  -> rows     - Number of rows in image to deinterlace
+// |  <IN>  -> cols     - Number of cols in image to deinterlace
+// |  <IN>  -> dThreads - Number of threads that need a row buffer
+// +----------------------------------------------------------------------------
+void CDeinterlace::GrowBuffers( int rows, int cols, int dThreads )
+{
+	size_t uiImage = size_t( rows ) * size_t( cols );
+	size_t uiRows  = size_t( dThreads ) * size_t( cols );
+
+	if ( uiImage > new_size )
+	{
+		delete[] new_iptr;
+		new_size = 0;
+		new_iptr = new ( nothrow ) unsigned short[ uiImage ];
+
+		if ( new_iptr == NULL )
+		{
+			ThrowException( "GrowBuffers",
+				"Error in allocating temporary image buffer for deinterlacing." );
+		}
+
+		new_size = uiImage;
+	}
+
+	if ( uiRows > row_size )
+	{
+		delete[] row_iptr;
+		row_size = 0;
+		row_iptr = new ( nothrow ) unsigned short[ uiRows ];
+
+		if ( row_iptr == NULL )
+		{
+			ThrowException( "GrowBuffers",
+				"Error in allocating temporary row buffer for deinterlacing." );
+		}
+
+		row_size = uiRows;
+	}
+}
+
+// +----------------------------------------------------------------------------
+// | UseThreads - Returns the number of threads to use for dUnits work units
+// +----------------------------------------------------------------------------
+int CDeinterlace::UseThreads( int dUnits )
+{
+	int dThreads = dUnits / DEINTERLACE_MIN_UNITS;
+
+	if ( dThreads > m_dThreads )
+	{
+		dThreads = m_dThreads;
+	}
+
+	return ( dThreads < 1 ? 1 : dThreads );
+}
+
+// +----------------------------------------------------------------------------
+// | RunThread - Deinterlacing thread
+// +----------------------------------------------------------------------------
+void *CDeinterlace::RunThread( void *pArg )
+{
+	CDeinterlaceThread *pThread = ( CDeinterlaceThread * )pArg;
+
+	pThread->pThis->RunRange( pThread->dAlg, pThread->pData, pThread->dRows,
+							  pThread->dCols, pThread->dArg, pThread->dFirst,
+							  pThread->dLast, pThread->pRow );
+
+	return NULL;
+}
+
+// +----------------------------------------------------------------------------
+// | RunUnits - Splits the work units of one pass between the threads
+// +----------------------------------------------------------------------------
+// |  Work units are independent, each thread gets a contiguous block of them
+// |  and its own row buffer. The calling thread processes the last block and
+// |  also takes over any block whose thread couldn't be started.
+// |
+// |  <IN>  -> algorithm - Algorithm number or DEINTERLACE_COPY_BACK
+// |  <IN>  -> data      - Pointer to the image pixels to deinterlace
+// |  <IN>  -> rows      - Number of rows in image to deinterlace
+// |  <IN>  -> cols      - Number of cols in image to deinterlace
+// |  <IN>  -> arg       - Any algorithm specific argument
+// |  <IN>  -> dUnits    - Number of work units
+// +----------------------------------------------------------------------------
+void CDeinterlace::RunUnits( int algorithm, unsigned short *data, int rows, int cols,
+							 int arg, int dUnits )
+{
+	int dThreads = UseThreads( dUnits );
+
+	GrowBuffers( 0, cols, dThreads );
+
+#ifdef WIN32
+	RunRange( algorithm, data, rows, cols, arg, 0, dUnits, row_iptr );
+#else
+	CDeinterlaceThread tThread[ DEINTERLACE_MAX_THREADS ];
+	pthread_t          tId[ DEINTERLACE_MAX_THREADS ];
+	bool               bStarted[ DEINTERLACE_MAX_THREADS ];
+
+	for ( int t=0; t<dThreads; t++ )
+	{
+		tThread[ t ].pThis  = this;
+		tThread[ t ].dAlg   = algorithm;
+		tThread[ t ].pData  = data;
+		tThread[ t ].dRows  = rows;
+		tThread[ t ].dCols  = cols;
+		tThread[ t ].dArg   = arg;
+		tThread[ t ].dFirst = int( ( long( dUnits ) * t ) / dThreads );
+		tThread[ t ].dLast  = int( ( long( dUnits ) * ( t + 1 ) ) / dThreads );
+		tThread[ t ].pRow   = row_iptr + size_t( t ) * size_t( cols );
+		bStarted[ t ]       = false;
+	}
+
+	for ( int t=0; t<dThreads-1; t++ )
+	{
+		bStarted[ t ] = ( pthread_create( &tId[ t ], NULL, RunThread, &tThread[ t ] ) == 0 );
+	}
+
+	for ( int t=0; t<dThreads; t++ )
+	{
+		if ( !bStarted[ t ] )
+		{
+			RunThread( &tThread[ t ] );
+		}
+	}
+
+	for ( int t=0; t<dThreads-1; t++ )
+	{
+		if ( bStarted[ t ] )
+		{
+			pthread_join( tId[ t ], NULL );
+		}
+	}
+#endif
+}
+
+// +----------------------------------------------------------------------------
+// | RunRange - Runs work units [ dFirst, dLast ) of one pass
+// +----------------------------------------------------------------------------
+// |  The algorithms that can't work in place write the temporary image
+// |  ( new_iptr ) and are followed by a DEINTERLACE_COPY_BACK pass, whose
+// |  work unit is one row. Serial and HawaiiRG only move pixels within a row,
+// |  so they deinterlace into the row buffer and copy it straight back.
+// |
+// |  <IN>  -> algorithm - Algorithm number or DEINTERLACE_COPY_BACK
+// |  <IN>  -> data      - Pointer to the image pixels to deinterlace
+// |  <IN>  -> rows      - Number of rows in image to deinterlace
+// |  <IN>  -> cols      - Number of cols in image to deinterlace
+// |  <IN>  -> arg       - Any algorithm specific argument
+// |  <IN>  -> dFirst    - First work unit
+// |  <IN>  -> dLast     - One past the last work unit
+// |  <IN>  -> pRow      - Row buffer ( cols pixels ) of the calling thread
+// +----------------------------------------------------------------------------
+void CDeinterlace::RunRange( int algorithm, unsigned short *data, int rows, int cols,
+							 int arg, int dFirst, int dLast, unsigned short *pRow )
+{
+	long lCols = cols;
+	long lSize = long( rows ) * lCols;
+
+	switch( algorithm )
+	{
+		// Unit = one row
+		case DEINTERLACE_COPY_BACK:
+		{
+#ifdef WIN32
+			CopyMemory( data + dFirst * lCols, new_iptr + dFirst * lCols,
+						( dLast - dFirst ) * lCols * sizeof( unsigned short ) );
+#else
+			memcpy( data + dFirst * lCols, new_iptr + dFirst * lCols,
+					( dLast - dFirst ) * lCols * sizeof( unsigned short ) );
+#endif
+		}
+		break;
+
+		// Unit = rows u and ( rows - 1 - u ) of the output
+		case DEINTERLACE_PARALLEL:
+		{
+			Pair( data, new_iptr, lSize, dFirst * lCols, dLast * lCols, m_bSIMD );
+		}
+		break;
+
+		// Unit = one row
+		case DEINTERLACE_SERIAL:
+		{
+			for ( long r=dFirst; r<dLast; r++ )
+			{
+				Pair( data + r * lCols, pRow, lCols, 0, lCols / 2, m_bSIMD );
+				memcpy( data + r * lCols, pRow, lCols * sizeof( unsigned short ) );
+			}
+		}
+		break;
+
+		// Unit = rows u and ( rows - 1 - u ) of the output
+		case DEINTERLACE_CCD_QUAD:
+		{
+			for ( long u=dFirst; u<dLast; u++ )
+			{
+				unsigned short *pFront = new_iptr + u * lCols;
+				unsigned short *pEnd   = new_iptr + ( rows - 1 - u ) * lCols;
+
+				Quad( data + 2 * u * lCols, lCols / 2, pFront, pFront + lCols - 1,
+					  pEnd + lCols - 1, pEnd, true, m_bSIMD );
+			}
+		}
+		break;
+
+		// Unit = rows ( rows - 1 - u ) and ( rows/2 - 1 - u ) of the output.
+		// CDS images are two IR quad images of rows/2 rows each.
+		case DEINTERLACE_IR_QUAD:
+		case DEINTERLACE_CDS_IR_QUAD:
+		{
+			long lRows = ( algorithm == DEINTERLACE_IR_QUAD ? rows : rows / 2 );
+			long lHalf = lRows / 2;
+
+			for ( long u=dFirst; u<dLast; u++ )
+			{
+				long lBase = ( u / lHalf ) * lRows * lCols;
+				long j     = lRows - 1 - ( u % lHalf );
+
+				unsigned short *pBegin = new_iptr + lBase + j * lCols;
+				unsigned short *pEnd   = new_iptr + lBase + ( j - lHalf ) * lCols;
+
+				Quad( data + lBase + 2 * ( u % lHalf ) * lCols, lCols / 2, pBegin,
+					  pBegin + lCols / 2, pEnd + lCols / 2, pEnd, false, m_bSIMD );
+			}
+		}
+		break;
+
+		// Unit = one row. The rows are in place only if the channels fill them,
+		// otherwise they're written to the temporary image.
+		case DEINTERLACE_HAWAII_RG:
+		{
+			long lOffset = lCols / arg;
+
+			for ( long r=dFirst; r<dLast; r++ )
+			{
+				unsigned short *pSrc = data + r * lOffset * arg;
+				unsigned short *pDst = ( pRow != NULL ? pRow : new_iptr + r * lCols );
+
+				for ( long c=0; c<lOffset; c++ )
+				{
+					for ( int i=0; i<arg; i++ )
+					{
+						pDst[ c + i * lOffset ] = *pSrc++;
+					}
+				}
+
+				if ( pRow != NULL )
+				{
+					memcpy( data + r * lCols, pRow, lCols * sizeof( unsigned short ) );
+				}
+			}
+		}
+		break;
+
+		// Unit = rows u and ( rows - 1 - u ) of the output
+		case DEINTERLACE_STA1600:
+		{
+			for ( long u=dFirst; u<dLast; u++ )
+			{
+				unsigned short *pSrc = data + 2 * u * lCols;
+
+				STA1600Row( pSrc, new_iptr + u * lCols, lCols / 8, m_bSIMD );
+				STA1600Row( pSrc + 8, new_iptr + ( rows - 1 - u ) * lCols, lCols / 8,
+							m_bSIMD );
+			}
+		}
+		break;
+	}
 }
 
 // +-------------------------------------------------------------------+
@@ -212,17 +835,10 @@ void CDeinterlace::Parallel( unsigned short *data, int rows, int cols )
 	}
 	else
 	{
-		for ( int i=0; i<( cols * rows )/2; i++ )
-		{
-			*( new_iptr + i )                       = *( data + ( 2 * i ) );
-			*( new_iptr + ( cols * rows ) - i - 1 ) = *( data + ( 2 * i ) + 1 );
-		}
+		GrowBuffers( rows, cols, 0 );
 
-#ifdef WIN32
-		CopyMemory( data, new_iptr, cols*rows*sizeof( unsigned short ) );
-#else
-		memcpy( data, new_iptr, cols*rows*sizeof( unsigned short ) );
-#endif
+		RunUnits( DEINTERLACE_PARALLEL, data, rows, cols, 0, rows / 2 );
+		RunUnits( DEINTERLACE_COPY_BACK, data, rows, cols, 0, rows );
 	}
 }
 
@@ -248,42 +864,14 @@ void CDeinterlace::Parallel( unsigned short *data, int rows, int cols )
 // +-------------------------------------------------------------------+
 void CDeinterlace::Serial( unsigned short *data, int rows, int cols )
 {
-	int p1    = 0;
-	int p2    = 0;
-	int begin = 0;
-	int end   = 0;
-
-	if ( ( float )cols/2 != ( int )cols/2 ) 
+	if ( ( float )cols/2 != ( int )cols/2 )
 	{
 		ThrowException(	"Serial",
 				"Number of cols must be EVEN for DEINTERLACE_SERIAL." );
 	}
 	else
 	{
-		for ( int i=0; i<rows; i++ )
-		{
-			// Leave in +0 for clarity
-			p1      = i * cols + 0; // Position in raw image
-			p2      = i * cols + 1;
-			begin   = i * cols + 0; // Position in interlaced image
-			end     = i * cols + cols - 1;
-       				
-			for ( int j=0; j<cols; j+=2 )
-			{
-				*( new_iptr + begin ) = *( data + p1 );
-				*( new_iptr + end )   = *( data + p2 );
-				++begin;
-				--end;
-				p1 += 2;
-				p2 += 2;
-			}
-		}
-
-#ifdef WIN32
-		CopyMemory( data, new_iptr, cols*rows*sizeof( unsigned short ) );
-#else
-		memcpy( data, new_iptr, cols*rows*sizeof( unsigned short ) );
-#endif
+		RunUnits( DEINTERLACE_SERIAL, data, rows, cols, 0, rows );
 	}
 }
 
@@ -309,12 +897,6 @@ void CDeinterlace::Serial( unsigned short *data, int rows, int cols )
 // +-------------------------------------------------------------------+
 void CDeinterlace::CCDQuad( unsigned short *data, int rows, int cols )
 {
-	int i       = 0;
-	int j       = 0;
-	int counter = 0;
-	int end     = 0;
-	int begin   = 0;
-
 	if ( ( float )cols/2 != ( int )cols/2 || ( float )rows/2 != ( int )rows/2 )
 	{
 		ThrowException(	"CCDQuad",
@@ -322,28 +904,10 @@ void CDeinterlace::CCDQuad( unsigned short *data, int rows, int cols )
 	}
 	else
 	{
-		while( i < cols*rows )
-		{
-			if ( counter%( cols/2 ) == 0 )
-			{
-				end = ( cols * rows ) - ( cols * j ) - 1;
-               	begin = ( cols * j ) + 0;	// Left in 0 for clarity
-              	j++;						// Number of completed rows
-               	counter = 0;				// Reset for next convergece
-			}
-        				
-			*( new_iptr + begin + counter )            = *( data + i++ );	// front_row--->
-			*( new_iptr + begin + cols - 1 - counter ) = *( data + i++ );	// front_row<--
-			*( new_iptr + end - counter )              = *( data + i++ );	// end_row<----
-			*( new_iptr + end - cols + 1 + counter )   = *( data + i++ );	// end_row---->
-			counter++;
-		}
+		GrowBuffers( rows, cols, 0 );
 
-#ifdef WIN32
-		CopyMemory( data, new_iptr, cols*rows*sizeof( unsigned short ) );
-#else
-		memcpy( data, new_iptr, cols*rows*sizeof( unsigned short ) );
-#endif
+		RunUnits( DEINTERLACE_CCD_QUAD, data, rows, cols, 0, rows / 2 );
+		RunUnits( DEINTERLACE_COPY_BACK, data, rows, cols, 0, rows );
 	}
 }
 
@@ -369,12 +933,6 @@ void CDeinterlace::CCDQuad( unsigned short *data, int rows, int cols )
 // +-------------------------------------------------------------------+
 void CDeinterlace::IRQuad( unsigned short *data, int rows, int cols )
 {
-	int i       = 0;
-	int j       = rows - 1;
-	int counter = 0;
-	int end     = 0;
-	int begin   = 0;
-
 	if ( ( float )cols/2 != ( int )cols/2 || ( float )rows/2 != ( int )rows/2 )
 	{
 		ThrowException( "IRQuad",
@@ -382,28 +940,10 @@ void CDeinterlace::IRQuad( unsigned short *data, int rows, int cols )
 	}
 	else
 	{
-		while( i < cols*rows )
-		{
-			if ( counter%( cols/2 ) == 0 )
-			{
-				end = ( j - ( rows/2 ) )*cols;
-				begin = j*cols;
-				j--; 			// Nnumber of completed rows
-				counter = 0; 	// Reset for next convergece
-			}
-
-			*( new_iptr + begin + counter )              = *( data + i++ ); // front_row--->
-			*( new_iptr + begin + ( cols/2 ) + counter ) = *( data + i++ ); // front_row<--
-			*( new_iptr + end + ( cols/2 ) + counter )   = *( data + i++ ); // end_row<----
-			*( new_iptr + end + counter )                = *( data + i++ ); // end_row---->
-			counter++;
-		}
+		GrowBuffers( rows, cols, 0 );
 
-#ifdef WIN32
-		CopyMemory( data, new_iptr, cols*rows*sizeof( unsigned short ) );
-#else
-		memcpy( data, new_iptr, cols*rows*sizeof( unsigned short ) );
-#endif
+		RunUnits( DEINTERLACE_IR_QUAD, data, rows, cols, 0, rows / 2 );
+		RunUnits( DEINTERLACE_COPY_BACK, data, rows, cols, 0, rows );
 	}
 }
 
@@ -438,24 +978,8 @@ void CDeinterlace::IRQuad( unsigned short *data, int rows, int cols )
 // +-------------------------------------------------------------------+
 void CDeinterlace::IRQuadCDS( unsigned short *data, int rows, int cols )
 {
-	int i       = 0;
-	int j       = 0;
-	int counter = 0;
-	int end     = 0;
-	int begin   = 0;
-	int oldRows = 0;
-
-	unsigned short *orig_old_iptr = data;
-	unsigned short *orig_new_iptr = new_iptr;
-
-	if ( orig_old_iptr == NULL || orig_new_iptr == NULL )
-	{
-		ThrowException(	"IRQuadCDS",
-						"One or more image buffers are NULL." );
-	}
-
-	else if ( float( cols/2 ) != int( cols/2 ) ||
-			  float( rows/2 ) != int( rows/2 ) )
+	if ( float( cols/2 ) != int( cols/2 ) ||
+		 float( rows/2 ) != int( rows/2 ) )
 	{
 		ThrowException(	"IRQuadCDS",
 			"Number of cols AND rows must be EVEN for DEINTERLACE_CDS_IR_QUAD." );
@@ -463,47 +987,12 @@ void CDeinterlace::IRQuadCDS( unsigned short *data, int rows, int cols )
 
 	else
 	{
-		// Set the the number of rows to half the image size.
-		oldRows = rows;
-		rows = rows/2;
-
-		// Deinterlace the two image halves separately.
-		for ( int imageSection = 0; imageSection <= 1; imageSection++ )
-		{
-			i = 0;
-			j = rows-1;
-			counter = 0;
-			end = 0;
-			begin = 0;
-
-			while( i < cols*rows )
-			{
-       			if ( counter%( cols/2 ) == 0 )
-       			{
-					end = ( j - ( rows/2 ) )*cols;
-					begin = j*cols;
-					j--; 			// Number of completed rows
-					counter = 0; 	// Reset for next convergece
-				}
+		// Deinterlace the two image halves of rows/2 rows, each of them
+		// has ( rows/2 )/2 work units.
+		GrowBuffers( rows, cols, 0 );
 
-				*( new_iptr + begin + counter )                = *( data + i++ ); // front_row--->
-				*( new_iptr + begin + ( cols / 2 ) + counter ) = *( data + i++ ); // front_row<--
-				*( new_iptr + end + ( cols / 2 ) + counter )   = *( data + i++ ); // end_row<----
-				*( new_iptr + end + counter )                  = *( data + i++ ); // end_row---->
-				counter++;
-			}
-			data += rows * cols;
-			new_iptr += rows * cols;
-		}
-
-		data = orig_old_iptr;
-		new_iptr = orig_new_iptr;
-
-#ifdef WIN32
-		CopyMemory( data, new_iptr, cols*oldRows*sizeof( unsigned short ) );
-#else
-		memcpy( data, new_iptr, cols*oldRows*sizeof( unsigned short ) );
-#endif
+		RunUnits( DEINTERLACE_CDS_IR_QUAD, data, rows, cols, 0, 2 * ( rows / 4 ) );
+		RunUnits( DEINTERLACE_COPY_BACK, data, rows, cols, 0, rows );
 	}
 }
 
@@ -550,28 +1039,20 @@ void CDeinterlace::HawaiiRG( unsigned short *data, int rows, int cols, int arg )
 			"The readout channel count must be EVEN for DEINTERLACE_HAWAII_RG." );
 	}
 
-	else
+	else if ( cols % arg == 0 )
 	{
-		unsigned short *rowPtr = new_iptr;
-		int offset             = cols / arg;	// Needs to be long because of array size
-		int dataIndex          = 0;				// Data index
-
-		for ( int r=0; r<rows; r++ )
-		{
-			rowPtr = new_iptr + ( cols * r );
+		RunUnits( DEINTERLACE_HAWAII_RG, data, rows, cols, arg, rows );
+	}
 
-			for ( int c=0; c<cols/arg; c++ )
-			{
-				for ( int i=0; i<arg; i++ )
-					rowPtr[ c + i * offset ] = data[ dataIndex++ ];
-			}
-		}
+	else
+	{
+		// The channels don't fill the rows, so the source rows are shifted
+		// against the output rows and can't be deinterlaced in place.
+		GrowBuffers( rows, cols, 0 );
+		memset( new_iptr, 0, size_t( rows ) * size_t( cols ) * sizeof( unsigned short ) );
 
-#ifdef WIN32
-		CopyMemory( data, new_iptr, cols*rows*sizeof( unsigned short ) );
-#else
-		memcpy( data, new_iptr, cols*rows*sizeof( unsigned short ) );
-#endif
+		RunRange( DEINTERLACE_HAWAII_RG, data, rows, cols, arg, 0, rows, NULL );
+		RunUnits( DEINTERLACE_COPY_BACK, data, rows, cols, 0, rows );
 	}
 }
 
@@ -616,43 +1097,10 @@ void CDeinterlace::STA1600( unsigned short *data, int rows, int cols )
 
 	else
 	{
-		unsigned short *botPtr = new_iptr;
-		unsigned short *topPtr = new_iptr + ( cols * ( rows - 1 ) );
-		long offset = cols / 8;		// Needs to be long because of array size
-		long dataIndex = 0;			// Data index
-
-		for ( long r=0; r<rows/2; r++ )
-		{
-			topPtr = new_iptr + ( cols * ( rows - r - 1 ) );
-			botPtr = new_iptr + ( cols * r );
+		GrowBuffers( rows, cols, 0 );
 
-			for ( long c=0; c<cols/8; c++ )
-			{
-				botPtr[ c + 7 * offset ] = data[ dataIndex++ ];
-				botPtr[ c + 6 * offset ] = data[ dataIndex++ ];
-				botPtr[ c + 5 * offset ] = data[ dataIndex++ ];
-				botPtr[ c + 4 * offset ] = data[ dataIndex++ ];
-				botPtr[ c + 3 * offset ] = data[ dataIndex++ ];
-				botPtr[ c + 2 * offset ] = data[ dataIndex++ ];
-				botPtr[ c + 1 * offset ] = data[ dataIndex++ ];
-				botPtr[ c + 0 * offset ] = data[ dataIndex++ ];
-
-				topPtr[ c + 7 * offset ] = data[ dataIndex++ ];
-				topPtr[ c + 6 * offset ] = data[ dataIndex++ ];
-				topPtr[ c + 5 * offset ] = data[ dataIndex++ ];
-				topPtr[ c + 4 * offset ] = data[ dataIndex++ ];
-				topPtr[ c + 3 * offset ] = data[ dataIndex++ ];
-				topPtr[ c + 2 * offset ] = data[ dataIndex++ ];
-				topPtr[ c + 1 * offset ] = data[ dataIndex++ ];
-				topPtr[ c + 0 * offset ] = data[ dataIndex++ ];
-			}
-		}
-
-#ifdef WIN32
-		CopyMemory( data, new_iptr, cols*rows*sizeof( unsigned short ) );
-#else
-		memcpy( data, new_iptr, cols*rows*sizeof( unsigned short ) );
-#endif
+		RunUnits( DEINTERLACE_STA1600, data, rows, cols, 0, rows / 2 );
+		RunUnits( DEINTERLACE_COPY_BACK, data, rows, cols, 0, rows );
 	}
 }
 
@@ -16,6 +16,7 @@
 
 #include <stdexcept>
 #include <string>
+#include <cstddef>
 #include "DllMain.h"
 
 
@@ -27,8 +28,14 @@ namespace arc
 	{
 	public:
 		CDeinterlace();
+		~CDeinterlace();
 		
 		void RunAlg( void *data, int rows, int cols, int algorithm, int arg = -1 );
+
+		void SetThreads( int dThreads );
+		int  GetThreads();
+		void SetSIMD( bool bOnOff );
+		bool IsSIMD();
 		
 		const static int DEINTERLACE_NONE        = 0;
 		const static int DEINTERLACE_PARALLEL    = 1;
@@ -40,8 +47,21 @@ namespace arc
 		const static int DEINTERLACE_STA1600	 = 7;
 		
 	private:
-		unsigned short *new_iptr;
-		
+		unsigned short *new_iptr;		// Reused between frames, only grows
+		size_t          new_size;		// new_iptr size in pixels
+		unsigned short *row_iptr;		// One row of scratch per thread
+		size_t          row_size;		// row_iptr size in pixels
+		int             m_dThreads;
+		bool            m_bSIMD;
+
+		void GrowBuffers( int rows, int cols, int dThreads );
+		int  UseThreads( int dUnits );
+		void RunUnits( int algorithm, unsigned short *data, int rows, int cols,
+					   int arg, int dUnits );
+		void RunRange( int algorithm, unsigned short *data, int rows, int cols,
+					   int arg, int dFirst, int dLast, unsigned short *pRow );
+		static void *RunThread( void *pArg );
+
 		void Parallel( unsigned short *data, int rows, int cols );
 		void Serial( unsigned short *data, int rows, int cols );
 		void CCDQuad( unsigned short *data, int rows, int cols );
@@ -450,6 +450,69 @@ CImage::CImgDifStats CImage::GetDiffStats( void *pMem1, void *pMem2, int dRows,
 	return GetDiffStats( pMem1, pMem2, 0, dRows, 0, dCols, dRows, dCols, dBpp );
 }
 
+// +----------------------------------------------------------------------------
+// |  ImgStats
+// +----------------------------------------------------------------------------
+// |  Single pass over the pixels. Sums are kept per row in type S, which is an
+// |  integer for 16-bit pixels, so the variance is computed from exact sums.
+// |  Pixels equal to the largest value of the type are saturated.
+// |
+// |  <IN>  -> pMem      : Pointer to image memory
+// |  <IN>  -> dRow1     : Start row
+// |  <IN>  -> dRow2     : End row ( excluded )
+// |  <IN>  -> dCol1     : Start column
+// |  <IN>  -> dCol2     : End column ( excluded )
+// |  <IN>  -> dCols     : Number of columns in full image
+// |  <OUT> -> cImgStats : The statistics
+// +----------------------------------------------------------------------------
+template <typename T, typename S>
+static void ImgStats( const T* pMem, int dRow1, int dRow2, int dCol1, int dCol2,
+					  int dCols, CImage::CImgStats& cImgStats )
+{
+	const T tSaturated = T( ~T( 0 ) );
+
+	T tMin = tSaturated;
+	T tMax = 0;
+	unsigned long long u64Sum = 0;
+	unsigned long long u64Saturated = 0;
+	long double gSqrdSum = 0.0;
+
+	for ( int i=dRow1; i<dRow2; i++ )
+	{
+		const T* pRow = pMem + ( ( long )i * dCols );
+
+		unsigned long long u64RowSum = 0;
+		S tRowSqrdSum = 0;
+
+		for ( int j=dCol1; j<dCol2; j++ )
+		{
+			T tVal = pRow[ j ];
+
+			if ( tVal < tMin ) tMin = tVal;
+			if ( tVal > tMax ) tMax = tVal;
+
+			u64Saturated  += ( tVal == tSaturated );
+			u64RowSum     += tVal;
+			tRowSqrdSum   += S( ( unsigned long long )tVal * tVal );
+		}
+
+		u64Sum   += u64RowSum;
+		gSqrdSum += tRowSqrdSum;
+	}
+
+	double gTotalPixelCount = double( dRow2 - dRow1 ) * double( dCol2 - dCol1 );
+	long double gMean = ( long double )u64Sum / gTotalPixelCount;
+	long double gVariance = ( gSqrdSum / gTotalPixelCount ) - ( gMean * gMean );
+
+	cImgStats.gTotalPixels     = gTotalPixelCount;
+	cImgStats.gMin             = tMin;
+	cImgStats.gMax             = tMax;
+	cImgStats.gSaturatedPixCnt = double( u64Saturated );
+	cImgStats.gMean            = double( gMean );
+	cImgStats.gVariance        = ( gVariance < 0 ? 0.0 : double( gVariance ) );
+	cImgStats.gStdDev          = sqrt( cImgStats.gVariance );
+}
+
 // +----------------------------------------------------------------------------
 // |  GetStats
 // +----------------------------------------------------------------------------
@@ -471,78 +534,35 @@ CImage::CImgDifStats CImage::GetDiffStats( void *pMem1, void *pMem2, int dRows,
 CImage::CImgStats CImage::GetStats( void *pMem, int dRow1, int dRow2, int dCol1,
 								    int dCol2, int dRows, int dCols, int dBpp )
 {
-	double gVal = 0.0, gSum = 0.0, gDevSqrdSum = 0.0;
-	double gMax16Bpp = T_SIZE( unsigned short );
-	double gMax32Bpp = T_SIZE( unsigned int );
-
 	if ( pMem == NULL )
 	{
 		ThrowException( "GetStats",
 						"Invalid image memory pointer parameter!" );
 	}
 
-	VerifyRowWithinRange( "GetDiffStats", dRow1, dRows );
-	VerifyRowWithinRange( "GetDiffStats", dRow2, dRows );
-	VerifyColWithinRange( "GetDiffStats", dCol1, dCols );
-	VerifyColWithinRange( "GetDiffStats", dCol2, dCols );
-
-	CImgStats cImgStats;
-
-	cImgStats.gMin = ( ( dBpp == BPP16 ) ?
-						 T_SIZE( unsigned short ) :
-						 T_SIZE( unsigned int ) );
+	VerifyRowWithinRange( "GetStats", dRow1, dRows );
+	VerifyRowWithinRange( "GetStats", dRow2, dRows );
+	VerifyColWithinRange( "GetStats", dCol1, dCols );
+	VerifyColWithinRange( "GetStats", dCol2, dCols );
 
 	if ( dRow1 == dRow2 ) dRow2++;
 	if ( dCol1 == dCol2 ) dCol2++;
-	double gTotalPixelCount = ( ( dRow2 - dRow1 ) * ( dCol2 - dCol1 ) );
-	cImgStats.gTotalPixels = gTotalPixelCount;
 
-	for ( int i=dRow1; i<dRow2; i++ )
-	{
-		for ( int j=dCol1; j<dCol2; j++ )
-		{
-			gVal = ( double )( ( dBpp == BPP16 ) ?
-				   ( ( unsigned short * )pMem )[ j + i * dCols ] :
-				   ( ( unsigned int * )pMem )[ j + i * dCols ] );
-
-			//
-			// Determine min/max values
-			//
-			if ( gVal < cImgStats.gMin )
-				cImgStats.gMin = gVal;
-
-			else if ( gVal > cImgStats.gMax )
-				cImgStats.gMax = gVal;
-
-			//
-			// Monitor for saturated pixels
-			//
-			if ( ( dBpp == BPP16 && gVal >= gMax16Bpp ) ||
-				 ( dBpp == BPP32 && gVal >= gMax32Bpp ) )
-			{
-				cImgStats.gSaturatedPixCnt++;
-			}
+	CImgStats cImgStats;
 
-			gSum += gVal;
-		}
+	if ( dBpp == BPP16 )
+	{
+		ImgStats<unsigned short, unsigned long long>(
+					static_cast<unsigned short *>( pMem ),
+					dRow1, dRow2, dCol1, dCol2, dCols, cImgStats );
 	}
-
-	// Calculate mean
-	cImgStats.gMean = gSum / gTotalPixelCount;
-
-	for ( int i=dRow1; i<dRow2; i++ )
+	else
 	{
-		for ( int j=dCol1; j<dCol2; j++ )
-		{
-			gDevSqrdSum += pow( ( double )( ( dBpp == BPP16 ) ?
-							  ( ( unsigned short * )pMem )[ j + i * dCols ] :
-							  ( ( unsigned int * )pMem )[ j + i * dCols ] ) - cImgStats.gMean, 2 );
-		}
+		ImgStats<unsigned int, long double>(
+					static_cast<unsigned int *>( pMem ),
+					dRow1, dRow2, dCol1, dCol2, dCols, cImgStats );
 	}
 
-	cImgStats.gVariance = gDevSqrdSum / gTotalPixelCount;
-	cImgStats.gStdDev = sqrt( cImgStats.gVariance );
-
 	return cImgStats;
 }
 
@@ -570,7 +590,7 @@ CImage::CImgStats CImage::GetStats( void *pMem, int dRows, int dCols, int dBpp )
 // +----------------------------------------------------------------------------
 // |  Calculates the histogram over the specified image memory rows and cols.
 // |
-// |  <OUT> -> m_pHistSize : Number of elements in returned array ( 2^16 or 2^32 )
+// |  <OUT> -> m_pHistSize : Number of elements in returned array ( 2^16 )
 // |  <IN> -> pMem  : Pointer to image memory
 // |  <IN> -> dRow1 : Start row
 // |  <IN> -> dRow2 : End row
@@ -580,16 +600,14 @@ CImage::CImgStats CImage::GetStats( void *pMem, int dRows, int dCols, int dBpp )
 // |  <IN> -> dCols : Number of columns in full image
 // |  <IN> -> dBpp  : The image data bits-per-pixel; either BPP16 or BPP32.
 // |
-// |  Returns a pointer to an array of 2^16 or 2^32 elements (depending on T
-// |  parameter) that represent the histogram. This data SHOULD NOT be freed by
-// |  the calling application.
+// |  Returns a pointer to an array of 2^16 elements that represent the
+// |  histogram. The array is reused by the next call and SHOULD NOT be freed
+// |  by the calling application. BPP32 images throw a std::runtime_error.
 // +----------------------------------------------------------------------------
 int* CImage::Histogram( int& m_pHistSize, void *pMem, int dRow1, int dRow2,
 					    int dCol1, int dCol2, int dRows, int dCols, int dBpp )
 {
-	int tSize  = int( ( ( dBpp == BPP16 ) ?
-						 T_SIZE( unsigned short ) :
-						 T_SIZE( unsigned int ) ) );
+	int tSize  = int( T_SIZE( unsigned short ) );
 
 	if ( pMem == NULL )
 	{
@@ -597,23 +615,30 @@ int* CImage::Histogram( int& m_pHistSize, void *pMem, int dRow1, int dRow2,
 						"Invalid image memory pointer parameter!" );
 	}
 
- 	VerifyRowWithinRange( "GetDiffStats", dRow1, dRows );
-	VerifyRowWithinRange( "GetDiffStats", dRow2, dRows );
-	VerifyColWithinRange( "GetDiffStats", dCol1, dCols );
-	VerifyColWithinRange( "GetDiffStats", dCol2, dCols );
-
-	if ( m_pHist != NULL )
-		delete [] m_pHist;
-
-	try
+	if ( dBpp != BPP16 )
 	{
-		m_pHist = new int[ tSize ];
+		ThrowException( "Histogram",
+						"Only BPP16 images are supported, BPP32 would need 2^32 bins!" );
 	}
-	catch ( bad_alloc& ba )
+
+ 	VerifyRowWithinRange( "Histogram", dRow1, dRows );
+	VerifyRowWithinRange( "Histogram", dRow2, dRows );
+	VerifyColWithinRange( "Histogram", dCol1, dCols );
+	VerifyColWithinRange( "Histogram", dCol2, dCols );
+
+	// The array has a fixed size, keep it between calls
+	if ( m_pHist == NULL )
 	{
-		ThrowException( "Histogram",
-						"Failed to allocate histogram array! " +
-						string( ba.what() ) );
+		try
+		{
+			m_pHist = new int[ tSize ];
+		}
+		catch ( bad_alloc& ba )
+		{
+			ThrowException( "Histogram",
+							"Failed to allocate histogram array! " +
+							string( ba.what() ) );
+		}
 	}
 
 	m_pHistSize = tSize;
@@ -625,11 +650,12 @@ int* CImage::Histogram( int& m_pHistSize, void *pMem, int dRow1, int dRow2,
 
 	for ( int i=dRow1; i<dRow2; i++ )
 	{
+		const unsigned short* pRow = static_cast<unsigned short *>( pMem ) +
+									 ( ( long )i * dCols );
+
 		for ( int j=dCol1; j<dCol2; j++ )
 		{
-			m_pHist[ ( ( dBpp == BPP16 ) ?
-				   ( ( unsigned short * )pMem )[ j + i * dCols ] :
-				   ( ( unsigned int * )pMem )[ j + i * dCols ] ) ]++;
+			m_pHist[ pRow[ j ] ]++;
 		}
 	}
 
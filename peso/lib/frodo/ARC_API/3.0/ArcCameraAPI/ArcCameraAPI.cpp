@@ -924,6 +924,26 @@ ArcCam_GetFrameCount( struct ArcCAPIStatus* pStatus )
 }
 
 
+ARCCAM_API int
+ArcCam_WaitForPixels( int dPixelCount, int dTimeoutMs, struct ArcCAPIStatus* pStatus )
+{
+	VERIFY_CLASS_PTR( "CArcDevice", pCArcDev.get(), pStatus )
+
+	TRY_CATCH_INT( pCArcDev.get()->WaitForPixels( dPixelCount, dTimeoutMs ),
+				   pStatus )
+}
+
+
+ARCCAM_API int
+ArcCam_WaitForFrame( int dFrame, int dTimeoutMs, struct ArcCAPIStatus* pStatus )
+{
+	VERIFY_CLASS_PTR( "CArcDevice", pCArcDev.get(), pStatus )
+
+	TRY_CATCH_INT( pCArcDev.get()->WaitForFrame( dFrame, dTimeoutMs ),
+				   pStatus )
+}
+
+
 ARCCAM_API int
 ArcCam_ContainsError( int dWord )
 {
@@ -1047,6 +1067,60 @@ ArcCam_SaveTemperatureCtrlData( const char* pszFilename, struct ArcCAPIStatus* p
 }
 
 
+ARCCAM_API void
+ArcCam_StartTemperatureSampler( int dPeriodMs, struct ArcCAPIStatus* pStatus )
+{
+	VERIFY_CLASS_PTR( "CArcDevice", pCArcDev.get(), pStatus )
+
+	TRY_CATCH(
+		pCArcDev.get()->StartTemperatureSampler( dPeriodMs ),
+		pStatus )
+}
+
+
+ARCCAM_API void
+ArcCam_StopTemperatureSampler( struct ArcCAPIStatus* pStatus )
+{
+	VERIFY_CLASS_PTR( "CArcDevice", pCArcDev.get(), pStatus )
+
+	TRY_CATCH(
+		pCArcDev.get()->StopTemperatureSampler(),
+		pStatus )
+}
+
+
+ARCCAM_API void
+ArcCam_PauseTemperatureSampler( int dPause, struct ArcCAPIStatus* pStatus )
+{
+	VERIFY_CLASS_PTR( "CArcDevice", pCArcDev.get(), pStatus )
+
+	TRY_CATCH(
+		pCArcDev.get()->PauseTemperatureSampler( static_cast<bool>( dPause ) ),
+		pStatus )
+}
+
+
+ARCCAM_API double
+ArcCam_GetCachedArrayTemperature( long* pTime, struct ArcCAPIStatus* pStatus )
+{
+	VERIFY_CLASS_PTR( "CArcDevice", pCArcDev.get(), pStatus )
+
+	double gTemperature = 0.0;
+	time_t tTime        = 0;
+
+	TRY_CATCH(
+		gTemperature = pCArcDev.get()->GetCachedArrayTemperature( &tTime ),
+		pStatus )
+
+	if ( pTime != NULL )
+	{
+		*pTime = long( tTime );
+	}
+
+	return gTemperature;
+}
+
+
 ARCCAM_API void
 ArcCam_Deinterlace( void *pData, int dRows, int dCols, int dAlgorithm, struct ArcCAPIStatus* pStatus )
 {
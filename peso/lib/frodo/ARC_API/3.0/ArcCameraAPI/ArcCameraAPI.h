@@ -175,6 +175,10 @@ ARCCAM_API int ArcCam_IsReadout(struct ArcCAPIStatus* pStatus);
 ARCCAM_API int ArcCam_GetPixelCount(struct ArcCAPIStatus* pStatus);
 ARCCAM_API int ArcCam_GetCRPixelCount(struct ArcCAPIStatus* pStatus);
 ARCCAM_API int ArcCam_GetFrameCount(struct ArcCAPIStatus* pStatus);
+ARCCAM_API int ArcCam_WaitForPixels(int dPixelCount, int dTimeoutMs,
+        struct ArcCAPIStatus* pStatus);
+ARCCAM_API int ArcCam_WaitForFrame(int dFrame, int dTimeoutMs,
+        struct ArcCAPIStatus* pStatus);
 
 //  Error & Degug message access
 // +-------------------------------------------------+
@@ -194,6 +198,14 @@ ARCCAM_API void ArcCam_SetArrayTemperature(double gTempVal,
 ARCCAM_API void ArcCam_LoadTemperatureCtrlData(const char* pszFilename);
 ARCCAM_API void ArcCam_SaveTemperatureCtrlData(const char* pszFilename);
 
+ARCCAM_API void ArcCam_StartTemperatureSampler(int dPeriodMs,
+        struct ArcCAPIStatus* pStatus);
+ARCCAM_API void ArcCam_StopTemperatureSampler(struct ArcCAPIStatus* pStatus);
+ARCCAM_API void ArcCam_PauseTemperatureSampler(int dPause,
+        struct ArcCAPIStatus* pStatus);
+ARCCAM_API double ArcCam_GetCachedArrayTemperature(long* pTime,
+        struct ArcCAPIStatus* pStatus);
+
 // +============================================================================+
 // | CDeinterlace functions                                                     |
 // +============================================================================+
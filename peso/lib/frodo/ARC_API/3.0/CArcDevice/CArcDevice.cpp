@@ -3,10 +3,13 @@
 #else
 	#include <sys/ioctl.h>
 	#include <sys/mman.h>
+	#include <sys/stat.h>
 	#include <unistd.h>
+	#include <fcntl.h>
 	#include <errno.h>
 	#include <cstring>
 	#include <cstdlib>
+	#include <cstdio>
 #endif
 
 #include <fstream>
@@ -23,6 +26,32 @@ using namespace std;
 using namespace arc;
 
 
+// +----------------------------------------------------------------------------
+// |  Pre-parsed .lod image layout. The header is followed by uiSegments
+// |  segments, each one is followed by its uiCount data words.
+// +----------------------------------------------------------------------------
+typedef struct ARC_LOD_CACHE_HEADER
+{
+	unsigned int		uiMagic;		// LOD_CACHE_MAGIC
+	unsigned int		uiVersion;		// LOD_CACHE_VERSION
+	long long			llMTime;		// .lod modification time
+	long long			llSize;			// .lod size in bytes
+	unsigned long long	u64Hash;		// FNV-1a of the .lod contents
+	int					dBoardId;
+	int					dIsCLodFile;
+	unsigned int		uiSegments;
+	unsigned int		uiReserved;
+} ArcLodHeader_t;
+
+typedef struct ARC_LOD_CACHE_SEGMENT
+{
+	int					dType;			// X_MEM, Y_MEM, P_MEM or R_MEM
+	int					dAddr;			// start address
+	unsigned int		uiCount;		// number of data words
+	unsigned int		uiReserved;
+} ArcLodSegment_t;
+
+
 
 // +----------------------------------------------------------------------------
 // |  Class Constructor
@@ -32,9 +61,31 @@ CArcDevice::CArcDevice( void )
 	m_hDevice    = INVALID_HANDLE_VALUE;
 	m_dCCParam   = 0;
 	m_bStoreCmds = false;
+	m_bBatchCmds = true;
 
 	Arc_ZeroMemory( &m_tImgBuffer, sizeof( ImgBuf_t ) );
 
+	m_bTempRun         = false;
+	m_bTempBusy        = false;
+	m_dTempPause       = 0;
+	m_dTempPeriod      = TEMP_SAMPLE_PERIOD;
+	m_dTempSampleCount = 0;
+	m_dTempSampleNext  = 0;
+	m_gTempAvg         = 0.0;
+	m_tTempTime        = 0;
+
+#ifndef WIN32
+	pthread_mutexattr_t tAttr;
+
+	pthread_mutexattr_init( &tAttr );
+	pthread_mutexattr_settype( &tAttr, PTHREAD_MUTEX_RECURSIVE );
+	pthread_mutex_init( &m_tCmdMutex, &tAttr );
+	pthread_mutexattr_destroy( &tAttr );
+
+	pthread_mutex_init( &m_tTempMutex, NULL );
+	pthread_cond_init( &m_tTempCond, NULL );
+#endif
+
 	SetDefaultTemperatureValues();
 }
 
@@ -43,8 +94,37 @@ CArcDevice::CArcDevice( void )
 // +----------------------------------------------------------------------------
 CArcDevice::~CArcDevice( void )
 {
+	StopTemperatureSampler();
+
+#ifndef WIN32
+	pthread_cond_destroy( &m_tTempCond );
+	pthread_mutex_destroy( &m_tTempMutex );
+	pthread_mutex_destroy( &m_tCmdMutex );
+#endif
 }
 
+
+// +----------------------------------------------------------------------------
+// |  Keeps the temperature sampler paused while in scope, so it doesn't
+// |  talk to the controller between SEX and the end of readout.
+// +----------------------------------------------------------------------------
+class CTempSamplerPause
+{
+	public:
+		CTempSamplerPause( CArcDevice* pDevice ) : m_pDevice( pDevice )
+		{
+			m_pDevice->PauseTemperatureSampler( true );
+		}
+
+		~CTempSamplerPause()
+		{
+			m_pDevice->PauseTemperatureSampler( false );
+		}
+
+	private:
+		CArcDevice* m_pDevice;
+};
+
 // +----------------------------------------------------------------------------
 // |  IsOpen
 // +----------------------------------------------------------------------------
@@ -68,7 +148,7 @@ bool CArcDevice::IsOpen()
 void CArcDevice::ReMapCommonBuffer( int dBytes )
 {
 	UnMapCommonBuffer();
-	MapCommonBuffer();
+	MapCommonBuffer( dBytes );
 }
 
 // +----------------------------------------------------------------------------
@@ -340,6 +420,477 @@ void CArcDevice::SetupController( bool bReset, bool bTdl, bool bPower, int dRows
 	}
 }
 
+// +----------------------------------------------------------------------------
+// |  CommandBatch
+// +----------------------------------------------------------------------------
+// |  Sends a list of commands to the controller and returns the controller
+// |  reply for each of them. Devices that can't pass the whole list to the
+// |  driver at once fall back to this one Command() per entry loop.
+// |
+// |  Throws std::runtime_error on error
+// |
+// |  <IN>  -> vCmds - Commands ( board id, command, up to four arguments )
+// +----------------------------------------------------------------------------
+std::vector<int> CArcDevice::CommandBatch( const std::vector<ArcCmd_t>& vCmds )
+{
+	std::vector<int> vReplies;
+
+	vReplies.reserve( vCmds.size() );
+
+	for ( size_t i = 0; i < vCmds.size(); i++ )
+	{
+		vReplies.push_back( Command( vCmds[ i ].dBoardId,
+									 vCmds[ i ].dCommand,
+									 vCmds[ i ].dArg[ 0 ],
+									 vCmds[ i ].dArg[ 1 ],
+									 vCmds[ i ].dArg[ 2 ],
+									 vCmds[ i ].dArg[ 3 ] ) );
+	}
+
+	return vReplies;
+}
+
+// +----------------------------------------------------------------------------
+// |  SetBatchCmds
+// +----------------------------------------------------------------------------
+// |  Turns batched command submission on/off. If off, CommandBatch sends
+// |  every command separately. Mostly useful for comparing setup times.
+// |
+// |  <IN> -> bOnOff - 'true' to batch commands ( default ); 'false' otherwise.
+// +----------------------------------------------------------------------------
+void CArcDevice::SetBatchCmds( bool bOnOff )
+{
+	m_bBatchCmds = bOnOff;
+}
+
+// +----------------------------------------------------------------------------
+// |  LoadGen23Data
+// +----------------------------------------------------------------------------
+// |  Writes the WRM commands parsed from a GenII/III .lod file in batches of
+// |  LOD_BATCH_SIZE words. If validation is requested, every batch is read
+// |  back with one batch of RDM commands.
+// |
+// |  Throws std::runtime_error on error
+// |
+// |  <IN> -> dBoardId  - TIM_ID or UTIL_ID
+// |  <IN> -> vCmds     - WRM commands, dArg[ 0 ] address, dArg[ 1 ] data
+// |  <IN> -> bValidate - Set to 'true' if the download should be read back.
+// |  <IN> -> bAbort    - 'true' to stop; 'false' otherwise. Default: false
+// +----------------------------------------------------------------------------
+void CArcDevice::LoadGen23Data( int dBoardId, const std::vector<ArcCmd_t>& vCmds, bool bValidate, const bool& bAbort )
+{
+	std::vector<ArcCmd_t> vBatch;
+	std::vector<int> vReplies;
+
+	for ( size_t i = 0; i < vCmds.size(); i += LOD_BATCH_SIZE )
+	{
+		if ( bAbort ) { return; }
+
+		size_t dEnd = ( ( i + LOD_BATCH_SIZE ) < vCmds.size() ? ( i + LOD_BATCH_SIZE ) : vCmds.size() );
+
+		vBatch.assign( vCmds.begin() + i, vCmds.begin() + dEnd );
+		vReplies = CommandBatch( vBatch );
+
+		for ( size_t j = 0; j < vBatch.size(); j++ )
+		{
+			if ( vReplies[ j ] != DON )
+			{
+				CArcTools::ThrowException(
+								"CArcDevice",
+								"LoadGen23Data",
+								"Write ('WRM') to controller %s board failed. WRM 0x%X 0x%X -> 0x%X",
+								( dBoardId == TIM_ID ? "TIMING" : "UTILITY" ),
+								vBatch[ j ].dArg[ 0 ],
+								vBatch[ j ].dArg[ 1 ],
+								vReplies[ j ] );
+			}
+		}
+
+		if ( bAbort ) { return; }
+
+		//
+		// Validate the data if required.
+		// --------------------------------------------------------------
+		if ( bValidate )
+		{
+			for ( size_t j = 0; j < vBatch.size(); j++ )
+			{
+				vBatch[ j ].dCommand = RDM;
+				vBatch[ j ].dArg[ 1 ] = -1;
+			}
+
+			vReplies = CommandBatch( vBatch );
+
+			for ( size_t j = 0; j < vBatch.size(); j++ )
+			{
+				if ( vReplies[ j ] != vCmds[ i + j ].dArg[ 1 ] )
+				{
+					CArcTools::ThrowException(
+							"CArcDevice",
+							"LoadGen23Data",
+							"Write ('WRM') to controller %s board failed. RDM 0x%X -> 0x%X [ Expected: 0x%X ]",
+							( dBoardId == TIM_ID ? "TIMING" : "UTILITY" ),
+							vBatch[ j ].dArg[ 0 ],
+							vReplies[ j ],
+							vCmds[ i + j ].dArg[ 1 ] );
+				}
+			}
+		}
+	}
+}
+
+// +----------------------------------------------------------------------------
+// |  ParseGen23ControllerFile
+// +----------------------------------------------------------------------------
+// |  Reads a GenII/III timing or utility file (.lod) and returns the WRM
+// |  commands for its "_DATA" blocks. The parsed image is saved next to the
+// |  file ( LOD_CACHE_SUFFIX ) and reused while the .lod file keeps its
+// |  modification time, size and contents hash. Failing to save the image
+// |  is not an error.
+// |
+// |  Throws std::runtime_error on error
+// |
+// |  <IN>  -> pszFilename - The TIM or UTIL lod file to read.
+// |  <OUT> -> dBoardId    - TIM_ID or UTIL_ID
+// |  <OUT> -> bIsCLodFile - 'true' for a "CRT" file.
+// |  <OUT> -> vCmds       - WRM commands, dArg[ 0 ] address, dArg[ 1 ] data
+// |  <IN>  -> bAbort      - 'true' to stop; 'false' otherwise. Default: false
+// +----------------------------------------------------------------------------
+void CArcDevice::ParseGen23ControllerFile( const char* pszFilename, int& dBoardId, bool& bIsCLodFile,
+										   std::vector<ArcCmd_t>& vCmds, const bool& bAbort )
+{
+	int  dType			= 0;
+	int  dAddr			= 0;
+	int  dData			= 0;
+	char typeChar		= ' ';
+
+	std::string sFilename( pszFilename );
+	std::string sCacheFile( sFilename + LOD_CACHE_SUFFIX );
+	std::string sLine;
+	std::string sToken;
+	CArcTools::CTokenizer cTokenizer;
+
+	dBoardId    = 0;
+	bIsCLodFile = false;
+	vCmds.clear();
+
+	//
+	// Read the whole file, it's hashed before parsing.
+	// -------------------------------------------------------------------
+	ifstream inFile( sFilename.c_str(), ios::in | ios::binary );
+
+	if ( !inFile.is_open() )
+	{
+		CArcTools::ThrowException( "CArcDevice",
+								   "ParseGen23ControllerFile",
+						           "Cannot open file: %s",
+						            sFilename.c_str() );
+	}
+
+	ostringstream ossFile;
+
+	ossFile << inFile.rdbuf();
+	inFile.close();
+
+	std::string sFile( ossFile.str() );
+	unsigned long long u64Hash = 0xCBF29CE484222325ULL;
+
+	for ( size_t i = 0; i < sFile.size(); i++ )
+	{
+		u64Hash ^= ( unsigned char )sFile[ i ];
+		u64Hash *= 0x100000001B3ULL;
+	}
+
+	struct stat tStat;
+
+	Arc_ZeroMemory( &tStat, sizeof( tStat ) );
+	stat( sFilename.c_str(), &tStat );
+
+	if ( ReadLodCache( sCacheFile, tStat, u64Hash, dBoardId, bIsCLodFile, vCmds ) )
+	{
+		return;
+	}
+
+	if ( bAbort ) { return; }
+
+	istringstream inStream( sFile );
+
+	//
+	// Check for valid TIM or UTIL file
+	// -------------------------------------------------------------------
+	getline( inStream, sLine );
+
+	if ( sLine.find( "TIM" ) != std::string::npos )
+	{
+		dBoardId = TIM_ID;
+	}
+
+	else if ( sLine.find( "CRT" ) != std::string::npos )
+	{
+		dBoardId = TIM_ID;
+		bIsCLodFile = true;
+	}
+
+	else if ( sLine.find( "UTIL" ) != std::string::npos )
+	{
+		dBoardId = UTIL_ID;
+	}
+
+	else
+	{
+		CArcTools::ThrowException(
+					"CArcDevice",
+					"ParseGen23ControllerFile",
+					"Invalid file. Missing 'TIMBOOT/CRT' or 'UTILBOOT' string." );
+	}
+
+	//
+	// Read in the file one line at a time
+	// --------------------------------------
+	while ( !inStream.eof() )
+	{
+		if ( bAbort ) { return; }
+
+		getline( inStream, sLine );
+
+		//
+		// Only "_DATA" blocks are valid for download
+		// ---------------------------------------------
+		if ( sLine.find( '_' ) == 0 && sLine.find( "_DATA " ) != std::string::npos )
+		{
+			cTokenizer.Victim( sLine );
+			cTokenizer.Next();	// Dump _DATA string
+
+			//
+			// Get the memory type and start address
+			// ---------------------------------------------
+			typeChar = CArcTools::StringToChar( cTokenizer.Next() );
+			dAddr    = CArcTools::StringToHex( cTokenizer.Next() );
+
+			//
+			// The start address must be less than MAX_DSP_START_LOAD_ADDR
+			// -------------------------------------------------------------
+			if ( dAddr < MAX_DSP_START_LOAD_ADDR )
+			{
+				//
+				// Set the DSP memory type
+				// ----------------------------------
+				if      ( typeChar == 'X' ) dType = X_MEM;
+				else if ( typeChar == 'Y' ) dType = Y_MEM;
+				else if ( typeChar == 'P' ) dType = P_MEM;
+				else if ( typeChar == 'R' ) dType = R_MEM;
+
+				//
+				// Read the data block
+				// ----------------------------------
+				while ( !inStream.eof() && inStream.peek() != '_' )
+				{
+					getline( inStream, sLine );
+					cTokenizer.Victim( sLine );
+
+					while ( !( ( sToken = cTokenizer.Next() ).empty() ) )
+					{
+						dData = CArcTools::StringToHex( sToken );
+
+						ArcCmd_t tCmd = { dBoardId, WRM, { ( dType | dAddr ), dData, -1, -1 } };
+
+						vCmds.push_back( tCmd );
+
+						dAddr++;
+
+					} // while tokenizer next
+				} // if not EOF or '_'
+			}	// if address < 0x4000
+		}	// if '_DATA'
+	}	// if not EOF
+
+	WriteLodCache( sCacheFile, tStat, u64Hash, dBoardId, bIsCLodFile, vCmds );
+}
+
+// +----------------------------------------------------------------------------
+// |  ReadLodCache
+// +----------------------------------------------------------------------------
+// |  Maps a pre-parsed .lod image and expands it into WRM commands.
+// |
+// |  Throws NOTHING on error. Returns 'false' if the image is missing, invalid
+// |  or doesn't belong to the current .lod file.
+// +----------------------------------------------------------------------------
+bool CArcDevice::ReadLodCache( const std::string& sCacheFile, const struct stat& tStat, unsigned long long u64Hash,
+							   int& dBoardId, bool& bIsCLodFile, std::vector<ArcCmd_t>& vCmds )
+{
+#ifdef WIN32
+
+	return false;
+
+#else
+
+	struct stat tCacheStat;
+
+	int dFd = open( sCacheFile.c_str(), O_RDONLY );
+
+	if ( dFd == -1 )
+	{
+		return false;
+	}
+
+	if ( fstat( dFd, &tCacheStat ) != 0 ||
+		 size_t( tCacheStat.st_size ) < sizeof( ArcLodHeader_t ) )
+	{
+		close( dFd );
+		return false;
+	}
+
+	size_t dSize = size_t( tCacheStat.st_size );
+	void*  pMap  = mmap( 0, dSize, PROT_READ, MAP_PRIVATE, dFd, 0 );
+
+	close( dFd );
+
+	if ( pMap == MAP_FAILED )
+	{
+		return false;
+	}
+
+	const unsigned char*  pData   = ( const unsigned char * )pMap;
+	const ArcLodHeader_t* pHeader = ( const ArcLodHeader_t * )pData;
+	bool bValid = ( pHeader->uiMagic   == LOD_CACHE_MAGIC   &&
+					pHeader->uiVersion == LOD_CACHE_VERSION &&
+					pHeader->llMTime   == ( long long )tStat.st_mtime &&
+					pHeader->llSize    == ( long long )tStat.st_size  &&
+					pHeader->u64Hash   == u64Hash );
+
+	size_t dOffset = sizeof( ArcLodHeader_t );
+
+	vCmds.clear();
+
+	for ( unsigned int i = 0; bValid && i < pHeader->uiSegments; i++ )
+	{
+		if ( dOffset + sizeof( ArcLodSegment_t ) > dSize )
+		{
+			bValid = false;
+			break;
+		}
+
+		const ArcLodSegment_t* pSegment = ( const ArcLodSegment_t * )( pData + dOffset );
+
+		dOffset += sizeof( ArcLodSegment_t );
+
+		if ( pSegment->uiCount > ( dSize - dOffset ) / sizeof( int ) )
+		{
+			bValid = false;
+			break;
+		}
+
+		const int* pWords = ( const int * )( pData + dOffset );
+
+		for ( unsigned int j = 0; j < pSegment->uiCount; j++ )
+		{
+			ArcCmd_t tCmd = { pHeader->dBoardId,
+							  WRM,
+							  { ( pSegment->dType | ( pSegment->dAddr + int( j ) ) ), pWords[ j ], -1, -1 } };
+
+			vCmds.push_back( tCmd );
+		}
+
+		dOffset += pSegment->uiCount * sizeof( int );
+	}
+
+	if ( bValid )
+	{
+		dBoardId    = pHeader->dBoardId;
+		bIsCLodFile = ( pHeader->dIsCLodFile != 0 );
+	}
+	else
+	{
+		vCmds.clear();
+	}
+
+	munmap( pMap, dSize );
+
+	return bValid;
+
+#endif
+}
+
+// +----------------------------------------------------------------------------
+// |  WriteLodCache
+// +----------------------------------------------------------------------------
+// |  Saves the parsed .lod file. Consecutive addresses of the same memory
+// |  type are stored as one segment. The image is written under a temporary
+// |  name and renamed, so a reader never sees a partial file.
+// |
+// |  Throws NOTHING on error. No error handling.
+// +----------------------------------------------------------------------------
+void CArcDevice::WriteLodCache( const std::string& sCacheFile, const struct stat& tStat, unsigned long long u64Hash,
+								int dBoardId, bool bIsCLodFile, const std::vector<ArcCmd_t>& vCmds )
+{
+#ifndef WIN32
+
+	std::vector<ArcLodSegment_t> vSegments;
+	std::vector<int> vWords;
+
+	vWords.reserve( vCmds.size() );
+
+	for ( size_t i = 0; i < vCmds.size(); i++ )
+	{
+		int dType = vCmds[ i ].dArg[ 0 ] & ~( MAX_DSP_START_LOAD_ADDR - 1 );
+		int dAddr = vCmds[ i ].dArg[ 0 ] & ( MAX_DSP_START_LOAD_ADDR - 1 );
+
+		if ( vSegments.empty() ||
+			 vSegments.back().dType != dType ||
+			 vSegments.back().dAddr + int( vSegments.back().uiCount ) != dAddr )
+		{
+			ArcLodSegment_t tSegment = { dType, dAddr, 0, 0 };
+
+			vSegments.push_back( tSegment );
+		}
+
+		vSegments.back().uiCount++;
+		vWords.push_back( vCmds[ i ].dArg[ 1 ] );
+	}
+
+	ArcLodHeader_t tHeader;
+
+	Arc_ZeroMemory( &tHeader, sizeof( tHeader ) );
+
+	tHeader.uiMagic     = LOD_CACHE_MAGIC;
+	tHeader.uiVersion   = LOD_CACHE_VERSION;
+	tHeader.llMTime     = ( long long )tStat.st_mtime;
+	tHeader.llSize      = ( long long )tStat.st_size;
+	tHeader.u64Hash     = u64Hash;
+	tHeader.dBoardId    = dBoardId;
+	tHeader.dIsCLodFile = ( bIsCLodFile ? 1 : 0 );
+	tHeader.uiSegments  = ( unsigned int )vSegments.size();
+
+	std::string sTmpFile( sCacheFile + ".tmp" );
+	ofstream outFile( sTmpFile.c_str(), ios::out | ios::binary | ios::trunc );
+
+	if ( !outFile.is_open() )
+	{
+		return;
+	}
+
+	outFile.write( ( const char * )&tHeader, sizeof( tHeader ) );
+
+	size_t dWord = 0;
+
+	for ( size_t i = 0; i < vSegments.size(); i++ )
+	{
+		outFile.write( ( const char * )&vSegments[ i ], sizeof( ArcLodSegment_t ) );
+		outFile.write( ( const char * )&vWords[ dWord ], vSegments[ i ].uiCount * sizeof( int ) );
+
+		dWord += vSegments[ i ].uiCount;
+	}
+
+	outFile.close();
+
+	if ( outFile.fail() || rename( sTmpFile.c_str(), sCacheFile.c_str() ) != 0 )
+	{
+		remove( sTmpFile.c_str() );
+	}
+
+#endif
+}
+
 // +----------------------------------------------------------------------------
 // |  LoadControllerFile
 // +----------------------------------------------------------------------------
@@ -1383,6 +1934,8 @@ void CArcDevice::Expose( float fExpTime, int dRows, int dCols, const bool& bAbor
 	int   dPixelCount		= 0;
 	int   dExposeCounter	= 0;
 
+	CTempSamplerPause cTempPause( this );
+
 	//
 	// Set the shutter position
 	//
@@ -1429,7 +1982,7 @@ void CArcDevice::Expose( float fExpTime, int dRows, int dCols, const bool& bAbor
 		// Checking the elapsed time > 1 sec. is to prevent race conditions with
 		// sending RET while the PCI board is going into readout. Added check
 		// for exposure_time > 1 sec. to prevent RET error.
-		if ( !bInReadout && fElapsedTime > 1.1f && dExposeCounter >= 5 && fExpTime > 1.0f )
+		if ( !bInReadout && fElapsedTime > 1.1f && dExposeCounter > 0 && fExpTime > 1.0f )
 		{
 			// Ignore all RET timeouts
 			try
@@ -1484,8 +2037,9 @@ void CArcDevice::Expose( float fExpTime, int dRows, int dCols, const bool& bAbor
 		}
 
 		// Save the last pixel count for use by the timeout counter.
+		// Sleeps until the image is read out or READ_WAIT_PERIOD expires.
 		dLastPixelCount = dPixelCount;
-		dPixelCount = GetPixelCount();
+		dPixelCount = WaitForPixels( dRows * dCols, READ_WAIT_PERIOD );
 
 		if ( ContainsError( dPixelCount ) )
 		{
@@ -1524,7 +2078,7 @@ void CArcDevice::Expose( float fExpTime, int dRows, int dCols, const bool& bAbor
 		// large and/or slow arrays.
 		if ( bInReadout && dPixelCount == dLastPixelCount )
 		{
-			dTimeoutCounter++;
+			dTimeoutCounter += READ_WAIT_PERIOD;
 		}
 		else
 		{
@@ -1548,8 +2102,6 @@ void CArcDevice::Expose( float fExpTime, int dRows, int dCols, const bool& bAbor
 									   "Expose",
 									   "Read Timeout!" );
 		}
-
-		Arc_Sleep( 25 );
 	}
 }
 
@@ -1582,6 +2134,8 @@ void CArcDevice::Continuous( int dRows, int dCols, int dNumOfFrames, float fExpT
 	int dLastPCIFrameCount = 0;
 	int dFPBCount          = 0;
 
+	CTempSamplerPause cTempPause( this );
+
 	// Check for valid frame count
 	if ( dNumOfFrames <= 0 )
 	{
@@ -1704,7 +2258,8 @@ void CArcDevice::Continuous( int dRows, int dCols, int dNumOfFrames, float fExpT
 										   "Continuous readout aborted by user!" );
 			}
 
-			dPCIFrameCount = GetFrameCount();
+			// Sleeps until the next frame is read or READ_WAIT_PERIOD expires
+			dPCIFrameCount = WaitForFrame( dLastPCIFrameCount + 1, READ_WAIT_PERIOD );
 
 			if ( bAbort )
 			{
@@ -1725,7 +2280,7 @@ void CArcDevice::Continuous( int dRows, int dCols, int dNumOfFrames, float fExpT
 											  dPCIFrameCount,
 											  dRows,
 											  dCols,
-											  ( ( unsigned char * )CommonBufferSize() )
+											  ( ( unsigned char * )CommonBufferVA() )
 											  + dFPBCount * dBoundedImageSize );
 				}
 
@@ -1737,22 +2292,85 @@ void CArcDevice::Continuous( int dRows, int dCols, int dNumOfFrames, float fExpT
 		// Set back to single image mode
 		dRetVal = Command( TIM_ID, SNF, 1 );
 
-		if ( dRetVal != DON )
+		if ( dRetVal != DON )
+		{
+			CArcTools::ThrowException(
+						"CArcDevice",
+						"Continuous",
+						"Failed to set number of frames (SNF) to 1. Reply: 0x%X",
+						 dRetVal );
+		}
+	}
+	catch ( std::runtime_error &e )
+	{
+		// Set back to single image mode
+		StopContinuous();
+
+		throw e;
+	}
+}
+
+// +----------------------------------------------------------------------------
+// |  WaitForPixels
+// +----------------------------------------------------------------------------
+// |  Waits until the current image pixel count reaches the specified value or
+// |  the timeout expires. Returns the current pixel count. The default polls
+// |  GetPixelCount() every READ_POLL_PERIOD msec, devices that can sleep in
+// |  the driver override it.
+// |
+// |  Throws std::runtime_error on error
+// |
+// |  <IN> -> dPixelCount - The pixel count to wait for.
+// |  <IN> -> dTimeoutMs  - The maximum time to wait ( in milliseconds ).
+// +----------------------------------------------------------------------------
+int CArcDevice::WaitForPixels( int dPixelCount, int dTimeoutMs )
+{
+	int dPixels = GetPixelCount();
+
+	for ( int dWaited = 0; dWaited < dTimeoutMs; dWaited += READ_POLL_PERIOD )
+	{
+		if ( dPixels >= dPixelCount || ContainsError( dPixels ) )
+		{
+			break;
+		}
+
+		Arc_Sleep( READ_POLL_PERIOD );
+
+		dPixels = GetPixelCount();
+	}
+
+	return dPixels;
+}
+
+// +----------------------------------------------------------------------------
+// |  WaitForFrame
+// +----------------------------------------------------------------------------
+// |  Waits until the number of frames read reaches the specified value or
+// |  the timeout expires. Returns the current frame count. The camera MUST
+// |  be set for continuous readout for this to work.
+// |
+// |  Throws std::runtime_error on error
+// |
+// |  <IN> -> dFrame     - The frame count to wait for.
+// |  <IN> -> dTimeoutMs - The maximum time to wait ( in milliseconds ).
+// +----------------------------------------------------------------------------
+int CArcDevice::WaitForFrame( int dFrame, int dTimeoutMs )
+{
+	int dFrames = GetFrameCount();
+
+	for ( int dWaited = 0; dWaited < dTimeoutMs; dWaited += READ_POLL_PERIOD )
+	{
+		if ( dFrames >= dFrame )
 		{
-			CArcTools::ThrowException(
-						"CArcDevice",
-						"Continuous",
-						"Failed to set number of frames (SNF) to 1. Reply: 0x%X",
-						 dRetVal );
+			break;
 		}
-	}
-	catch ( std::runtime_error &e )
-	{
-		// Set back to single image mode
-		StopContinuous();
 
-		throw e;
+		Arc_Sleep( READ_POLL_PERIOD );
+
+		dFrames = GetFrameCount();
 	}
+
+	return dFrames;
 }
 
 // +----------------------------------------------------------------------------
@@ -2386,14 +3004,11 @@ double CArcDevice::GetArrayTemperatureDN()
 // +----------------------------------------------------------------------------
 double CArcDevice::CalculateAverageTemperature()
 {
-	double* pgTemperature		= new double[ gTmpCtrl_SDNumberOfReads ];
 	double gTemperatureSum		= 0.0;
 	double gAvgTemperature		= 0.0;
-	double gVoltage				= 0.0;
 
 	int dNumberOfReads			= 0;
 	int dNumberOfValidReads		= 0;
-	int dAdu					= 0;
 
 	vector<double> tempCoeffVector;
 
@@ -2412,6 +3027,8 @@ double CArcDevice::CalculateAverageTemperature()
 	//
 	bool bHighGain = ( Command( UTIL_ID, THG ) == 1 ? true : false );
 
+	double* pgTemperature = new double[ gTmpCtrl_SDNumberOfReads ];
+
 	for ( int i=0; i<gTmpCtrl_SDNumberOfReads; i++ )
 	{
 		if ( IsReadout() )
@@ -2419,47 +3036,27 @@ double CArcDevice::CalculateAverageTemperature()
 			break;
 		}
 
-		//
-		// Read the temperature ADU from the controller
-		// ------------------------------------------------
-		if ( bArc12 )
+		try
 		{
-			dAdu = Command( TIM_ID, RDT );
+			pgTemperature[ i ] = ReadTemperature( bArc12, bHighGain );
 		}
-		else
+		catch ( ... )
 		{
-			dAdu = Command( UTIL_ID, RDM, ( Y_MEM | 0xC ) );
-		}
+			delete[] pgTemperature;
 
-		gVoltage = ADUToVoltage( dAdu, bArc12, bHighGain );
+			throw;
+		}
 
-		if ( !ContainsError( dAdu ) )
-		{
-			//
-			// Calculate the temperature from the given adu
-			// ------------------------------------------------
-			pgTemperature[ i ] = CalculateTemperature( gVoltage );
-			gTemperatureSum   += pgTemperature[ i ];
-			dNumberOfReads++;
+		gTemperatureSum += pgTemperature[ i ];
+		dNumberOfReads++;
 
-			//
-			// Sleep for 2 milliseconds. The controller only
-			// updates the temperature ADU value every 3 ms.
-			// ------------------------------------------------
+		//
+		// Sleep for 2 milliseconds. The controller only
+		// updates the temperature ADU value every 3 ms.
+		// ------------------------------------------------
 #ifdef WIN32
-			Sleep( 2 );
+		Sleep( 2 );
 #endif
-		}
-		else
-		{
-			delete[] pgTemperature;
-
-			CArcTools::ThrowException(
-					"CArcDevice",
-					"CalculateAverageTemperature",
-					"Failed to read temperature from controller. Reply: 0x%X",
-					 dAdu );
-		}
 
 		//
 		// Don't average for SmallCam
@@ -2499,6 +3096,396 @@ double CArcDevice::CalculateAverageTemperature()
 	return gAvgTemperature;
 }
 
+// +----------------------------------------------------------------------------
+// |  ReadTemperature
+// +----------------------------------------------------------------------------
+// |  Reads the temperature ADU from the controller once.
+// |
+// |  Throws std::runtime_error on error
+// |
+// |  Returns the temperature ( in Celcius ).
+// |
+// |  <IN> -> bArc12    - 'true' for SmallCam.
+// |  <IN> -> bHighGain - 'true' if High Gain is used.
+// +----------------------------------------------------------------------------
+double CArcDevice::ReadTemperature( bool bArc12, bool bHighGain )
+{
+	int dAdu = 0;
+
+	if ( bArc12 )
+	{
+		dAdu = Command( TIM_ID, RDT );
+	}
+	else
+	{
+		dAdu = Command( UTIL_ID, RDM, ( Y_MEM | 0xC ) );
+	}
+
+	if ( ContainsError( dAdu ) )
+	{
+		CArcTools::ThrowException(
+				"CArcDevice",
+				"ReadTemperature",
+				"Failed to read temperature from controller. Reply: 0x%X",
+				 dAdu );
+	}
+
+	return CalculateTemperature( ADUToVoltage( dAdu, bArc12, bHighGain ) );
+}
+
+// +----------------------------------------------------------------------------
+// |  StartTemperatureSampler
+// +----------------------------------------------------------------------------
+// |  Starts a thread that reads the array temperature every dPeriodMs and
+// |  keeps a rolling average of the last gTmpCtrl_SDNumberOfReads samples
+// |  ( at most TEMP_SAMPLE_MAX ). GetCachedArrayTemperature returns it
+// |  without talking to the controller. No samples are taken while the
+// |  controller is reading out or the sampler is paused; Expose and
+// |  Continuous pause it themselves.
+// |
+// |  Throws std::runtime_error on error
+// |
+// |  <IN> -> dPeriodMs - Sample period ( in milliseconds ).
+// +----------------------------------------------------------------------------
+void CArcDevice::StartTemperatureSampler( int dPeriodMs )
+{
+#ifdef WIN32
+
+	CArcTools::ThrowException( "CArcDevice",
+							   "StartTemperatureSampler",
+							   "Not supported on this platform!" );
+
+#else
+
+	if ( !IsOpen() )
+	{
+		CArcTools::ThrowException( "CArcDevice",
+								   "StartTemperatureSampler",
+								   "Not connected to any device!" );
+	}
+
+	pthread_mutex_lock( &m_tTempMutex );
+
+	if ( m_bTempRun )
+	{
+		pthread_mutex_unlock( &m_tTempMutex );
+		return;
+	}
+
+	m_dTempPeriod      = ( dPeriodMs > 0 ? dPeriodMs : TEMP_SAMPLE_PERIOD );
+	m_dTempSampleCount = 0;
+	m_dTempSampleNext  = 0;
+	m_tTempTime        = 0;
+	m_bTempRun         = true;
+
+	int dErr = pthread_create( &m_tTempThread, NULL, TemperatureSamplerThread, this );
+
+	if ( dErr != 0 )
+	{
+		m_bTempRun = false;
+	}
+
+	pthread_mutex_unlock( &m_tTempMutex );
+
+	if ( dErr != 0 )
+	{
+		CArcTools::ThrowException( "CArcDevice",
+								   "StartTemperatureSampler",
+								   "Failed to create sampler thread : %s",
+								    CArcTools::GetSystemMessage( dErr ).c_str() );
+	}
+
+#endif
+}
+
+// +----------------------------------------------------------------------------
+// |  StopTemperatureSampler
+// +----------------------------------------------------------------------------
+// |  Stops the temperature sampler thread, if running.
+// |
+// |  Throws NOTHING on error. No error handling.
+// +----------------------------------------------------------------------------
+void CArcDevice::StopTemperatureSampler()
+{
+#ifndef WIN32
+
+	pthread_mutex_lock( &m_tTempMutex );
+
+	if ( !m_bTempRun )
+	{
+		pthread_mutex_unlock( &m_tTempMutex );
+		return;
+	}
+
+	m_bTempRun = false;
+	pthread_cond_broadcast( &m_tTempCond );
+
+	pthread_mutex_unlock( &m_tTempMutex );
+
+	pthread_join( m_tTempThread, NULL );
+
+#endif
+}
+
+// +----------------------------------------------------------------------------
+// |  PauseTemperatureSampler
+// +----------------------------------------------------------------------------
+// |  Pauses ( 'true' ) or resumes ( 'false' ) the temperature sampler. Calls
+// |  nest. Pausing waits for a sample in progress, so the controller link is
+// |  free when it returns. Use around exposures driven by Command.
+// |
+// |  Throws NOTHING on error. No error handling.
+// |
+// |  <IN> -> bPause - 'true' to pause, 'false' to resume.
+// +----------------------------------------------------------------------------
+void CArcDevice::PauseTemperatureSampler( bool bPause )
+{
+#ifndef WIN32
+
+	pthread_mutex_lock( &m_tTempMutex );
+
+	if ( bPause )
+	{
+		m_dTempPause++;
+
+		while ( m_bTempBusy )
+		{
+			pthread_cond_wait( &m_tTempCond, &m_tTempMutex );
+		}
+	}
+	else if ( m_dTempPause > 0 )
+	{
+		m_dTempPause--;
+	}
+
+	pthread_mutex_unlock( &m_tTempMutex );
+
+#endif
+}
+
+// +----------------------------------------------------------------------------
+// |  GetCachedArrayTemperature
+// +----------------------------------------------------------------------------
+// |  Returns the array temperature averaged by the temperature sampler. If
+// |  the sampler isn't running, this is the same as GetArrayTemperature.
+// |
+// |  Throws std::runtime_error on error
+// |
+// |  <OUT> -> pTime - Time of the last sample. Optional.
+// +----------------------------------------------------------------------------
+double CArcDevice::GetCachedArrayTemperature( time_t* pTime )
+{
+	double gTemperature = 0.0;
+	time_t tTime        = 0;
+	bool   bRun         = false;
+
+#ifndef WIN32
+	pthread_mutex_lock( &m_tTempMutex );
+#endif
+
+	bRun         = m_bTempRun;
+	gTemperature = m_gTempAvg;
+	tTime        = m_tTempTime;
+
+#ifndef WIN32
+	pthread_mutex_unlock( &m_tTempMutex );
+#endif
+
+	if ( !bRun )
+	{
+		gTemperature = GetArrayTemperature();
+		tTime        = time( NULL );
+	}
+	else if ( tTime == 0 )
+	{
+		CArcTools::ThrowException( "CArcDevice",
+								   "GetCachedArrayTemperature",
+								   "No temperature sample yet!" );
+	}
+
+	if ( pTime != NULL )
+	{
+		*pTime = tTime;
+	}
+
+	return gTemperature;
+}
+
+// +----------------------------------------------------------------------------
+// |  AddTemperatureSample
+// +----------------------------------------------------------------------------
+// |  Adds a sample to the rolling average. Same as CalculateAverageTemperature,
+// |  only samples within gTmpCtrl_SDDegTolerance of the mean are averaged.
+// |  Called with m_tTempMutex held.
+// |
+// |  Throws NOTHING on error. No error handling.
+// +----------------------------------------------------------------------------
+void CArcDevice::AddTemperatureSample( double gTemperature )
+{
+	int dWindow = gTmpCtrl_SDNumberOfReads;
+
+	if ( dWindow < 1 || dWindow > TEMP_SAMPLE_MAX )
+	{
+		dWindow = TEMP_SAMPLE_MAX;
+	}
+
+	m_gTempSample[ m_dTempSampleNext ] = gTemperature;
+	m_dTempSampleNext = ( m_dTempSampleNext + 1 ) % TEMP_SAMPLE_MAX;
+
+	if ( m_dTempSampleCount < TEMP_SAMPLE_MAX )
+	{
+		m_dTempSampleCount++;
+	}
+
+	int    dCount = ( m_dTempSampleCount < dWindow ? m_dTempSampleCount : dWindow );
+	double gSum   = 0.0;
+	int    i      = 0;
+
+	for ( i = 1; i <= dCount; i++ )
+	{
+		gSum += m_gTempSample[ ( m_dTempSampleNext - i + TEMP_SAMPLE_MAX ) % TEMP_SAMPLE_MAX ];
+	}
+
+	double gMean      = gSum / dCount;
+	int    dValid     = 0;
+	double gValidSum  = 0.0;
+
+	for ( i = 1; i <= dCount; i++ )
+	{
+		double gSample = m_gTempSample[ ( m_dTempSampleNext - i + TEMP_SAMPLE_MAX ) % TEMP_SAMPLE_MAX ];
+
+		if ( fabs( gSample - gMean ) < gTmpCtrl_SDDegTolerance )
+		{
+			gValidSum += gSample;
+			dValid++;
+		}
+	}
+
+	m_gTempAvg  = ( dValid > 0 ? gValidSum / dValid : gMean );
+	m_tTempTime = time( NULL );
+}
+
+// +----------------------------------------------------------------------------
+// |  TemperatureSamplerThread
+// +----------------------------------------------------------------------------
+// |  pthread entry point of the temperature sampler.
+// +----------------------------------------------------------------------------
+void* CArcDevice::TemperatureSamplerThread( void* pArg )
+{
+	static_cast<CArcDevice *>( pArg )->RunTemperatureSampler();
+
+	return NULL;
+}
+
+// +----------------------------------------------------------------------------
+// |  RunTemperatureSampler
+// +----------------------------------------------------------------------------
+// |  Temperature sampler loop. The controller id and gain are read with the
+// |  first sample only. Errors are ignored, the sample is just skipped.
+// +----------------------------------------------------------------------------
+void CArcDevice::RunTemperatureSampler()
+{
+#ifndef WIN32
+
+	bool bInit     = false;
+	bool bArc12    = false;
+	bool bHighGain = false;
+
+	pthread_mutex_lock( &m_tTempMutex );
+
+	while ( m_bTempRun )
+	{
+		struct timespec tWake;
+
+		clock_gettime( CLOCK_REALTIME, &tWake );
+
+		tWake.tv_sec  += m_dTempPeriod / 1000;
+		tWake.tv_nsec += ( m_dTempPeriod % 1000 ) * 1000000L;
+
+		if ( tWake.tv_nsec >= 1000000000L )
+		{
+			tWake.tv_sec++;
+			tWake.tv_nsec -= 1000000000L;
+		}
+
+		while ( m_bTempRun &&
+				pthread_cond_timedwait( &m_tTempCond, &m_tTempMutex, &tWake ) != ETIMEDOUT );
+
+		if ( !m_bTempRun || m_dTempPause > 0 )
+		{
+			continue;
+		}
+
+		m_bTempBusy = true;
+		pthread_mutex_unlock( &m_tTempMutex );
+
+		double gTemperature = 0.0;
+		bool   bValid       = false;
+
+		try
+		{
+			CArcCmdLock cCmdLock( this );
+
+			if ( !IsReadout() )
+			{
+				if ( !bInit )
+				{
+					bArc12    = IS_ARC12( GetControllerId() );
+					bHighGain = ( Command( UTIL_ID, THG ) == 1 ? true : false );
+					bInit     = true;
+				}
+
+				gTemperature = ReadTemperature( bArc12, bHighGain );
+				bValid       = true;
+			}
+		}
+		catch ( ... ) {}
+
+		pthread_mutex_lock( &m_tTempMutex );
+
+		if ( bValid )
+		{
+			AddTemperatureSample( gTemperature );
+		}
+
+		m_bTempBusy = false;
+		pthread_cond_broadcast( &m_tTempCond );
+	}
+
+	pthread_mutex_unlock( &m_tTempMutex );
+
+#endif
+}
+
+// +----------------------------------------------------------------------------
+// |  LockCommand
+// +----------------------------------------------------------------------------
+// |  Locks the device for one controller transaction ( command and reply ).
+// |  Use CArcCmdLock instead of calling it directly.
+// |
+// |  Throws NOTHING on error. No error handling.
+// +----------------------------------------------------------------------------
+void CArcDevice::LockCommand()
+{
+#ifndef WIN32
+	pthread_mutex_lock( &m_tCmdMutex );
+#endif
+}
+
+// +----------------------------------------------------------------------------
+// |  UnlockCommand
+// +----------------------------------------------------------------------------
+// |  Unlocks the device, see LockCommand.
+// |
+// |  Throws NOTHING on error. No error handling.
+// +----------------------------------------------------------------------------
+void CArcDevice::UnlockCommand()
+{
+#ifndef WIN32
+	pthread_mutex_unlock( &m_tCmdMutex );
+#endif
+}
+
 // +----------------------------------------------------------------------------
 // |  ADUToVoltage
 // +----------------------------------------------------------------------------
@@ -11,8 +11,15 @@
 
 #ifdef linux
 #include <sys/types.h>
+#include <sys/stat.h>
 #endif
 
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
+#include <ctime>
+
 
 namespace arc
 {
@@ -28,6 +35,18 @@ namespace arc
 	} ImgBuf_t;
 
 
+	// +------------------------------------------------+
+	// | Controller command for CommandBatch. Unused    |
+	// | arguments are -1, same as for Command.         |
+	// +------------------------------------------------+
+	typedef struct ARC_DEVICE_CMD
+	{
+		int dBoardId;
+		int dCommand;
+		int dArg[ 4 ];
+	} ArcCmd_t;
+
+
 	// +------------------------------------------------+
 	// | Device info                                    |
 	// +------------------------------------------------+
@@ -41,6 +60,14 @@ namespace arc
 	} ArcDev_t;
 
 
+	// +------------------------------------------------------------------+
+	// | Background temperature sampler period ( msec ) and the maximum   |
+	// | number of samples in its rolling average                         |
+	// +------------------------------------------------------------------+
+	#define TEMP_SAMPLE_PERIOD	1000
+	#define TEMP_SAMPLE_MAX		32
+
+
 	// +------------------------------------------------+
 	// | CArcDevice class definition                    |
 	// +------------------------------------------------+
@@ -79,6 +106,8 @@ namespace arc
 			//  Setup & General commands
 			// +-------------------------------------------------+
 			virtual int  Command( int dBoardId, int dCommand, int dArg1 = -1, int dArg2 = -1, int dArg3 = -1, int dArg4 = -1 ) = 0;
+			virtual std::vector<int> CommandBatch( const std::vector<ArcCmd_t>& vCmds );
+			void SetBatchCmds( bool bOnOff );
 			virtual int  GetControllerId() = 0;
 			virtual void ResetController() = 0;
 			virtual bool IsControllerConnected() = 0;
@@ -123,6 +152,9 @@ namespace arc
 			virtual int  GetCRPixelCount() = 0;
 			virtual int  GetFrameCount() = 0;
 
+			virtual int  WaitForPixels( int dPixelCount, int dTimeoutMs );
+			virtual int  WaitForFrame( int dFrame, int dTimeoutMs );
+
 			//  Error & Degug message access
 			// +-------------------------------------------------+
 			bool ContainsError( int dWord );
@@ -140,11 +172,24 @@ namespace arc
 			void   LoadTemperatureCtrlData( const char* pszFilename );
 			void   SaveTemperatureCtrlData( const char* pszFilename );
 
+			void   StartTemperatureSampler( int dPeriodMs = TEMP_SAMPLE_PERIOD );
+			void   StopTemperatureSampler();
+			void   PauseTemperatureSampler( bool bPause );
+			double GetCachedArrayTemperature( time_t* pTime = NULL );
+
 		protected:
 			void   SetDefaultTemperatureValues();
 			double ADUToVoltage( int dAdu, bool bArc12 = false, bool bHighGain = false );
 			double VoltageToADU( double gVoltage, bool bArc12 = false, bool bHighGain = false );
 			double CalculateAverageTemperature();
+			double ReadTemperature( bool bArc12, bool bHighGain );
+			void   AddTemperatureSample( double gTemperature );
+			void   RunTemperatureSampler();
+			static void* TemperatureSamplerThread( void* pArg );
+			void   LockCommand();
+			void   UnlockCommand();
+
+			friend class CArcCmdLock;
 			double CalculateVoltage( double gTemperature );
 			double CalculateTemperature( double gVoltage );
 
@@ -155,6 +200,14 @@ namespace arc
 
 			std::string FormatDLoadString( int dReply, int dBoardId, std::vector<int>& vData );
 
+			void LoadGen23Data( int dBoardId, const std::vector<ArcCmd_t>& vCmds, bool bValidate, const bool& bAbort = false );
+			void ParseGen23ControllerFile( const char* pszFilename, int& dBoardId, bool& bIsCLodFile,
+										   std::vector<ArcCmd_t>& vCmds, const bool& bAbort = false );
+			bool ReadLodCache( const std::string& sCacheFile, const struct stat& tStat, unsigned long long u64Hash,
+							   int& dBoardId, bool& bIsCLodFile, std::vector<ArcCmd_t>& vCmds );
+			void WriteLodCache( const std::string& sCacheFile, const struct stat& tStat, unsigned long long u64Hash,
+								int dBoardId, bool bIsCLodFile, const std::vector<ArcCmd_t>& vCmds );
+
 			//  Temperature control variables
 			// +--------------------------------------+
 			double gTmpCtrl_DT670Coeff1;
@@ -178,6 +231,51 @@ namespace arc
 			ImgBuf_t 		m_tImgBuffer;
 			int		 		m_dCCParam;
 			bool	 		m_bStoreCmds;	// 'true' stores cmd strings in queue
+			bool			m_bBatchCmds;	// 'true' lets CommandBatch use one driver call
+
+#ifndef WIN32
+			pthread_mutex_t	m_tCmdMutex;	// one controller transaction at a time, see CArcCmdLock
+#endif
+
+			//  Background temperature sampler, see StartTemperatureSampler
+			// +--------------------------------------+
+#ifndef WIN32
+			pthread_t		m_tTempThread;
+			pthread_mutex_t	m_tTempMutex;
+			pthread_cond_t	m_tTempCond;
+#endif
+			bool			m_bTempRun;		// sampler thread is running
+			bool			m_bTempBusy;	// sampler is talking to the controller
+			int				m_dTempPause;	// pause nesting count
+			int				m_dTempPeriod;	// sample period ( msec )
+			double			m_gTempSample[ TEMP_SAMPLE_MAX ];
+			int				m_dTempSampleCount;
+			int				m_dTempSampleNext;
+			double			m_gTempAvg;		// last rolling average
+			time_t			m_tTempTime;	// time of last sample, 0 = none
+	};
+
+
+	// +------------------------------------------------------------------+
+	// | Holds the device command lock while in scope. A command and its  |
+	// | reply are several register accesses, which must not interleave   |
+	// | with the temperature sampler thread. The lock is recursive.      |
+	// +------------------------------------------------------------------+
+	class CArcCmdLock
+	{
+		public:
+			CArcCmdLock( CArcDevice* pDevice ) : m_pDevice( pDevice )
+			{
+				m_pDevice->LockCommand();
+			}
+
+			~CArcCmdLock()
+			{
+				m_pDevice->UnlockCommand();
+			}
+
+		private:
+			CArcDevice* m_pDevice;
 	};
 
 
@@ -187,9 +285,29 @@ namespace arc
 	#define CTLR_CMD_MAX	6
 
 	// +------------------------------------------------------------------+
-	// | Timeout loop count for image readout                             |
+	// | Number of .lod words written by one CommandBatch call            |
+	// +------------------------------------------------------------------+
+	#define LOD_BATCH_SIZE	1024
+
+	// +------------------------------------------------------------------+
+	// | Pre-parsed .lod image, stored as <file>.lod + LOD_CACHE_SUFFIX   |
+	// +------------------------------------------------------------------+
+	#define LOD_CACHE_SUFFIX	".bin"
+	#define LOD_CACHE_MAGIC		0x4C435241		// 'ARCL'
+	#define LOD_CACHE_VERSION	1
+
+	// +------------------------------------------------------------------+
+	// | Image readout timeout ( msec without a pixel count change )      |
+	// +------------------------------------------------------------------+
+	#define READ_TIMEOUT	5000
+
+	// +------------------------------------------------------------------+
+	// | WaitForPixels/WaitForFrame period used by Expose and Continuous, |
+	// | and the poll period of the default WaitForPixels/WaitForFrame    |
+	// | ( msec )                                                         |
 	// +------------------------------------------------------------------+
-	#define READ_TIMEOUT	200
+	#define READ_WAIT_PERIOD	250
+	#define READ_POLL_PERIOD	25
 
 }	// end namespace
 
@@ -104,7 +104,8 @@ char** CArcPCI::m_pszDevList = NULL;
 // +----------------------------------------------------------------------------
 CArcPCI::CArcPCI( void )
 {
-	m_hDevice = INVALID_HANDLE_VALUE;
+	m_hDevice    = INVALID_HANDLE_VALUE;
+	m_bWaitIoctl = true;
 }
 
 // +----------------------------------------------------------------------------
@@ -613,6 +614,8 @@ void CArcPCI::Open( int dDeviceNumber, int dBytes )
 // +----------------------------------------------------------------------------
 void CArcPCI::Close()
 {
+	StopTemperatureSampler();
+
 	//
 	// Prevents access violation from code that follows
 	//
@@ -1039,6 +1042,8 @@ void CArcPCI::LoadDeviceFile( const char* pszFile )
 // +----------------------------------------------------------------------------
 int CArcPCI::Command( int dBoardId, int dCommand, int dArg0, int dArg1, int dArg2, int dArg3 )
 {
+	CArcCmdLock cCmdLock( this );
+
 	int dCmdData[ CTLR_CMD_MAX ] = { -1 };
 	int dNumberOfArgs			 = 0;
 	int dHeader					 = 0;
@@ -1115,6 +1120,123 @@ int CArcPCI::Command( int dBoardId, int dCommand, int dArg0, int dArg1, int dArg
 	return dCmdData[ 0 ];
 }
 
+// +----------------------------------------------------------------------------
+// |  CommandBatch
+// +----------------------------------------------------------------------------
+// |  Sends a list of commands with a single ASTROPCI_COMMAND_BATCH ioctl. The
+// |  driver executes them one after the other exactly like Command() does.
+// |  Falls back to CArcDevice::CommandBatch() if command logging is on,
+// |  batching is turned off or the driver doesn't know the ioctl.
+// |
+// |  Throws std::runtime_error on error
+// |
+// |  <IN>  -> vCmds - Commands ( board id, command, up to four arguments )
+// +----------------------------------------------------------------------------
+std::vector<int> CArcPCI::CommandBatch( const std::vector<ArcCmd_t>& vCmds )
+{
+	CArcCmdLock cCmdLock( this );
+
+	if ( !IsOpen() )
+	{
+		CArcTools::ThrowException( "CArcPCI",
+								   "CommandBatch",
+								   "Not connected to any device!" );
+	}
+
+#ifdef linux
+
+	if ( m_bStoreCmds || !m_bBatchCmds || vCmds.empty() ||
+		 vCmds.size() > ASTROPCI_BATCH_MAX )
+	{
+		return CArcDevice::CommandBatch( vCmds );
+	}
+
+	std::vector<int> vCmdData( vCmds.size() * CTLR_CMD_MAX, -1 );
+	std::vector<int> vReplies( vCmds.size() );
+
+	for ( size_t i = 0; i < vCmds.size(); i++ )
+	{
+		int* pCmdData      = &vCmdData[ i * CTLR_CMD_MAX ];
+		int  dNumberOfArgs = 2;
+
+		while ( dNumberOfArgs < CTLR_CMD_MAX && vCmds[ i ].dArg[ dNumberOfArgs - 2 ] != -1 )
+		{
+			dNumberOfArgs++;
+		}
+
+		pCmdData[ 0 ] = ( ( vCmds[ i ].dBoardId << 8 ) | dNumberOfArgs );
+		pCmdData[ 1 ] = vCmds[ i ].dCommand;
+		pCmdData[ 2 ] = vCmds[ i ].dArg[ 0 ];
+		pCmdData[ 3 ] = vCmds[ i ].dArg[ 1 ];
+		pCmdData[ 4 ] = vCmds[ i ].dArg[ 2 ];
+		pCmdData[ 5 ] = vCmds[ i ].dArg[ 3 ];
+	}
+
+	AstroPCIBatch_t tBatch;
+
+	tBatch.uiCount = ( unsigned int )vCmds.size();
+	tBatch.uiDone  = 0;
+	tBatch.ullCmds = ( unsigned long long )( size_t )&vCmdData[ 0 ];
+
+	int dSuccess = Arc_IOCtl( m_hDevice,
+							  ASTROPCI_COMMAND_BATCH,
+							  &tBatch,
+							  sizeof( tBatch ) );
+
+	if ( !dSuccess )
+	{
+		int dErrorCode = Arc_ErrorCode();
+
+		//
+		// Driver without ASTROPCI_COMMAND_BATCH
+		//
+		if ( dErrorCode == EINVAL && tBatch.uiDone == 0 )
+		{
+			m_bBatchCmds = false;
+
+			return CArcDevice::CommandBatch( vCmds );
+		}
+
+		size_t dFailed = ( tBatch.uiDone < vCmds.size() ? tBatch.uiDone : vCmds.size() - 1 );
+
+		CArcTools::ThrowException( "CArcPCI",
+								   "CommandBatch",
+								   "Command %u of %u failed: %s",
+								    ( unsigned int )dFailed + 1,
+								    ( unsigned int )vCmds.size(),
+								    CArcTools::CmdToString( vCmdData[ dFailed * CTLR_CMD_MAX ],
+															vCmds[ dFailed ].dBoardId,
+															vCmds[ dFailed ].dCommand,
+															vCmds[ dFailed ].dArg[ 0 ],
+															vCmds[ dFailed ].dArg[ 1 ],
+															vCmds[ dFailed ].dArg[ 2 ],
+															vCmds[ dFailed ].dArg[ 3 ],
+															dErrorCode ).c_str() );
+	}
+
+	for ( size_t i = 0; i < vCmds.size(); i++ )
+	{
+		vReplies[ i ] = vCmdData[ i * CTLR_CMD_MAX ];
+
+		if ( vReplies[ i ] == CNR )
+		{
+			CArcTools::ThrowException(
+						"CArcPCI",
+						"CommandBatch",
+						"Controller not ready! Verify controller has been setup! Reply: 0x%X",
+						 vReplies[ i ] );
+		}
+	}
+
+	return vReplies;
+
+#else
+
+	return CArcDevice::CommandBatch( vCmds );
+
+#endif
+}
+
 // +----------------------------------------------------------------------------
 // |  GetControllerId
 // +----------------------------------------------------------------------------
@@ -1270,6 +1392,103 @@ int CArcPCI::GetFrameCount()
 	return IoctlDevice( ASTROPCI_GET_FRAMES_READ );
 }
 
+// +----------------------------------------------------------------------------
+// |  WaitForPixels
+// +----------------------------------------------------------------------------
+// |  Sleeps in the driver until the image pixel count reaches the specified
+// |  value or the timeout expires. The driver is woken by the end of image
+// |  interrupt. Returns the current pixel count.
+// |
+// |  Throws std::runtime_error on error
+// |
+// |  <IN> -> dPixelCount - The pixel count to wait for.
+// |  <IN> -> dTimeoutMs  - The maximum time to wait ( in milliseconds ).
+// +----------------------------------------------------------------------------
+int CArcPCI::WaitForPixels( int dPixelCount, int dTimeoutMs )
+{
+	return WaitForProgress( ASTROPCI_WAIT_FOR_PIXELS, dPixelCount, dTimeoutMs );
+}
+
+// +----------------------------------------------------------------------------
+// |  WaitForFrame
+// +----------------------------------------------------------------------------
+// |  Sleeps in the driver until the number of frames read reaches the
+// |  specified value or the timeout expires. Returns the current frame count.
+// |
+// |  Throws std::runtime_error on error
+// |
+// |  <IN> -> dFrame     - The frame count to wait for.
+// |  <IN> -> dTimeoutMs - The maximum time to wait ( in milliseconds ).
+// +----------------------------------------------------------------------------
+int CArcPCI::WaitForFrame( int dFrame, int dTimeoutMs )
+{
+	return WaitForProgress( ASTROPCI_WAIT_FOR_FRAME, dFrame, dTimeoutMs );
+}
+
+// +----------------------------------------------------------------------------
+// |  WaitForProgress
+// +----------------------------------------------------------------------------
+// |  Issues ASTROPCI_WAIT_FOR_PIXELS or ASTROPCI_WAIT_FOR_FRAME. A timeout or
+// |  a signal isn't an error, the current progress is returned. Falls back
+// |  to polling if the driver doesn't support the wait commands.
+// |
+// |  Throws std::runtime_error on error
+// +----------------------------------------------------------------------------
+int CArcPCI::WaitForProgress( int dIoctlCmd, int dValue, int dTimeoutMs )
+{
+	if ( !IsOpen() )
+	{
+		CArcTools::ThrowException( "CArcPCI",
+								   "WaitForProgress",
+								   "Not connected to any device." );
+	}
+
+#ifdef linux
+
+	if ( m_bWaitIoctl && !m_bStoreCmds && dValue >= 0 && dTimeoutMs >= 0 )
+	{
+		AstroPCIWait_t tWait;
+
+		tWait.uiValue    = ( unsigned int )dValue;
+		tWait.uiTimeout  = ( unsigned int )dTimeoutMs;
+		tWait.uiProgress = 0;
+
+		int dSuccess = Arc_IOCtl( m_hDevice,
+								  dIoctlCmd,
+								  &tWait,
+								  sizeof( tWait ) );
+
+		if ( dSuccess || Arc_ErrorCode() == ETIMEDOUT || Arc_ErrorCode() == EINTR )
+		{
+			return int( tWait.uiProgress );
+		}
+
+		//
+		// Driver without ASTROPCI_WAIT_FOR_PIXELS/FRAME
+		//
+		if ( Arc_ErrorCode() != EINVAL )
+		{
+			CArcTools::ThrowException( "CArcPCI",
+									   "WaitForProgress",
+									   "Ioctl failed cmd: 0x%X arg: 0x%X : %e",
+										dIoctlCmd,
+										dValue,
+										Arc_ErrorCode() );
+		}
+
+		m_bWaitIoctl = false;
+	}
+
+#endif
+
+	if ( dIoctlCmd == ASTROPCI_WAIT_FOR_FRAME )
+	{
+		return CArcDevice::WaitForFrame( dValue, dTimeoutMs );
+	}
+
+	return CArcDevice::WaitForPixels( dValue, dTimeoutMs );
+}
+
 // +----------------------------------------------------------------------------
 // |  SetHctr
 // +----------------------------------------------------------------------------
@@ -1360,6 +1579,8 @@ int CArcPCI::GetHctr()
 // +----------------------------------------------------------------------------
 int CArcPCI::PCICommand( int dCommand )
 {
+	CArcCmdLock cCmdLock( this );
+
 	if ( !IsOpen() )
 	{
 		CArcTools::ThrowException( "CArcPCI",
@@ -1419,19 +1640,12 @@ int CArcPCI::PCICommand( int dCommand )
 void CArcPCI::LoadGen23ControllerFile( const char *pszFilename, bool bValidate, const bool& bAbort )
 {
 	int  dBoardId		= 0;
-	int  dType			= 0;
-	int  dAddr			= 0;
-	int  dData			= 0;
 	int  dReply			= 0;
 	int  dPciStatus		= 0;
-	char typeChar		= ' ';
 	bool bPciStatusSet	= false;
 	bool bIsCLodFile	= false;
 
-	std::string sFilename( pszFilename );
-	std::string sLine;
-	std::string sToken;
-	CArcTools::CTokenizer cTokenizer;
+	std::vector<ArcCmd_t> vCmds;
 
 	if ( bAbort ) { return; }
 
@@ -1448,50 +1662,11 @@ void CArcPCI::LoadGen23ControllerFile( const char *pszFilename, bool bValidate,
 	if ( bAbort ) { return; }
 
 	//
-	// Open the file for reading.
-	// -------------------------------------------------------------------
-	ifstream inFile( sFilename.c_str() );
-
-	if ( !inFile.is_open() )
-	{
-		CArcTools::ThrowException( "CArcPCI",
-								   "LoadGen23ControllerFile",
-						           "Cannot open file: %s",
-						            sFilename.c_str() );
-	}
-
-	if ( bAbort ) { inFile.close(); return; }
-
-	//
-	// Check for valid TIM or UTIL file
+	// Read the file, the pre-parsed image is used if up to date
 	// -------------------------------------------------------------------
-	getline( inFile, sLine );
-
-	if ( sLine.find( "TIM" ) != std::string::npos )
-	{
-		dBoardId = TIM_ID;
-	}
-
-	else if ( sLine.find( "CRT" ) != std::string::npos )
-	{
-		dBoardId = TIM_ID;
-		bIsCLodFile = true;
-	}
-
-	else if ( sLine.find( "UTIL" ) != std::string::npos )
-	{
-		dBoardId = UTIL_ID;
-	}
-
-	else
-	{
-		CArcTools::ThrowException(
-					"CArcPCI",
-					"LoadGen23ControllerFile",
-					"Invalid file. Missing 'TIMBOOT/CRT' or 'UTILBOOT' string." );
-	}
+	ParseGen23ControllerFile( pszFilename, dBoardId, bIsCLodFile, vCmds, bAbort );
 
-	if ( bAbort ) { inFile.close(); return; }
+	if ( bAbort ) { return; }
 
 	//
 	// First, send the stop command. Otherwise, the controller crashes
@@ -1509,7 +1684,7 @@ void CArcPCI::LoadGen23ControllerFile( const char *pszFilename, bool bValidate,
 					 dReply );
 	}
 
-	if ( bAbort ) { inFile.close(); return; }
+	if ( bAbort ) { return; }
 
 	//
 	// Set the PCI status bit #1 (X:0 bit 1 = 1).
@@ -1530,109 +1705,7 @@ void CArcPCI::LoadGen23ControllerFile( const char *pszFilename, bool bValidate,
 									dReply );
 	}
 
-	//
-	// Read in the file one line at a time
-	// --------------------------------------
-	while ( !inFile.eof() )
-	{
-		if ( bAbort ) { inFile.close(); return; }
-
-		getline( inFile, sLine );
-
-		//
-		// Only "_DATA" blocks are valid for download
-		// ---------------------------------------------
-		if ( sLine.find( '_' ) == 0 && sLine.find( "_DATA " ) != std::string::npos )
-		{
-			cTokenizer.Victim( sLine );
-			cTokenizer.Next();	// Dump _DATA string
-
-			//
-			// Get the memory type and start address
-			// ---------------------------------------------
-			typeChar = CArcTools::StringToChar( cTokenizer.Next() );
-			dAddr    = CArcTools::StringToHex( cTokenizer.Next() );
-
-			//
-			// The start address must be less than MAX_DSP_START_LOAD_ADDR
-			// -------------------------------------------------------------
-			if ( dAddr < MAX_DSP_START_LOAD_ADDR )
-			{
-				//
-				// Set the DSP memory type
-				// ----------------------------------
-				if      ( typeChar == 'X' ) dType = X_MEM;
-				else if ( typeChar == 'Y' ) dType = Y_MEM;
-				else if ( typeChar == 'P' ) dType = P_MEM;
-				else if ( typeChar == 'R' ) dType = R_MEM;
-
-				//
-				// Read the data block
-				// ----------------------------------
-				while ( !inFile.eof() && inFile.peek() != '_' )
-				{
-					if ( bAbort ) { inFile.close(); return; }
-
-					getline( inFile, sLine );
-					cTokenizer.Victim( sLine );
-
-					while ( !( ( sToken = cTokenizer.Next() ).empty() ) )
-					{
-						if ( bAbort ) { inFile.close(); return; }
-
-						dData = CArcTools::StringToHex( sToken );
-
-						//
-						// Write the data to the controller.
-						// --------------------------------------------------------------
-						dReply = Command( dBoardId,
-										  WRM,
-										  ( dType | dAddr ),
-										  dData );
-
-						if ( dReply != DON )
-						{
-							CArcTools::ThrowException(
-											"CArcPCI",
-											"LoadGen23ControllerFile",
-											"Write ('WRM') to controller %s board failed. WRM 0x%X 0x%X -> 0x%X",
-											( dBoardId == TIM_ID ? "TIMING" : "UTILITY" ),
-											( dType | dAddr ),
-											 dData,
-											 dReply );
-						}
-
-						if ( bAbort ) { inFile.close(); return; }
-
-						//
-						// Validate the data if required.
-						// --------------------------------------------------------------
-						if ( bValidate )
-						{
-							dReply = Command( dBoardId, RDM, ( dType | dAddr ) );
-
-							if ( dReply != dData )
-							{
-								CArcTools::ThrowException(
-										"CArcPCI",
-										"LoadGen23ControllerFile",
-										"Write ('WRM') to controller %s board failed. RDM 0x%X -> 0x%X [ Expected: 0x%X ]",
-										( dBoardId == TIM_ID ? "TIMING" : "UTILITY" ),
-										( dType | dAddr ),
-										 dReply,
-										 dData );
-							}
-						}	// End if 'validate'
-
-						dAddr++;
-
-					} // while tokenizer next
-				} // if not EOF or '_'
-			}	// if address < 0x4000
-		}	// if '_DATA'
-	}	// if not EOF
-
-	inFile.close();
+	LoadGen23Data( dBoardId, vCmds, bValidate, bAbort );
 
 	if ( bAbort ) { return; }
 
@@ -1699,6 +1772,8 @@ void CArcPCI::LoadGen23ControllerFile( const char *pszFilename, bool bValidate,
 // +----------------------------------------------------------------------------
 int CArcPCI::SmallCamDLoad( int dBoardId, vector<int>& vData )
 {
+	CArcCmdLock cCmdLock( this );
+
 	int dHeader	= 0;
 	int dReply	= 0;
 
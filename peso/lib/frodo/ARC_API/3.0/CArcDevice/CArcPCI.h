@@ -59,6 +59,7 @@ namespace arc
 			//  Setup & General commands
 			// +-------------------------------------------------+
 			int  Command( int dBoardId, int dCommand, int dArg1 = -1, int dArg2 = -1, int dArg3 = -1, int dArg4 = -1 );
+			std::vector<int> CommandBatch( const std::vector<ArcCmd_t>& vCmds );
 
 			int  GetControllerId();
 			void ResetController();
@@ -72,6 +73,9 @@ namespace arc
 			int  GetCRPixelCount();
 			int  GetFrameCount();
 
+			int  WaitForPixels( int dPixelCount, int dTimeoutMs );
+			int  WaitForFrame( int dFrame, int dTimeoutMs );
+
 			//  PCI only commands
 			// +-------------------------------------------------+
 			void SetHctr( int dVal );
@@ -87,12 +91,15 @@ namespace arc
 			void LoadPCIFile( const char *c_filename, const bool& bAbort = false );
 			void LoadGen23ControllerFile( const char *pszFilename, bool bValidate, const bool& bAbort = false );
 			void SetByteSwapping();
+			int  WaitForProgress( int dIoctlCmd, int dValue, int dTimeoutMs );
 
 			const std::string FormatPCICommand( int dCmd, int dReply, int dArg = -1, int dSysErr = -1 );
 			const std::string FormatPCICommand( int dCmd, int dReply, int dArg[], int dArgCount, int dSysErr = -1 );
 
 			CStringList* GetHSTRBitList( int dData, bool bDrawSeparator = false );
 
+			bool							m_bWaitIoctl;	// 'false' if the driver can't wait for readout
+
 			static std::vector<ArcDev_t>	m_vDevList;
 			static char**					m_pszDevList;
 	};
@@ -125,6 +132,31 @@ namespace arc
 	#define ASTROPCI_SET_CONFIG_BYTE		0x33
 	#define ASTROPCI_SET_CONFIG_WORD		0x34
 	#define ASTROPCI_SET_CONFIG_DWORD		0x35
+	#define ASTROPCI_COMMAND_BATCH			0x23
+	#define ASTROPCI_WAIT_FOR_PIXELS		0x24
+	#define ASTROPCI_WAIT_FOR_FRAME			0x25
+
+	// +------------------------------------------------------------------------------
+	// |  ASTROPCI_COMMAND_BATCH argument, see astropci_io.h
+	// +------------------------------------------------------------------------------
+	#define ASTROPCI_BATCH_MAX				65536
+
+	typedef struct ASTROPCI_BATCH
+	{
+		unsigned int		uiCount;	// IN: number of commands
+		unsigned int		uiDone;		// OUT: number of executed commands
+		unsigned long long	ullCmds;	// IN: address of count x CTLR_CMD_MAX words
+	} AstroPCIBatch_t;
+
+	// +------------------------------------------------------------------------------
+	// |  ASTROPCI_WAIT_FOR_PIXELS / ASTROPCI_WAIT_FOR_FRAME argument, see astropci_io.h
+	// +------------------------------------------------------------------------------
+	typedef struct ASTROPCI_WAIT
+	{
+		unsigned int		uiValue;	// IN: pixel count or frame number
+		unsigned int		uiTimeout;	// IN: timeout ( msec )
+		unsigned int		uiProgress;	// OUT: current pixel count or frames read
+	} AstroPCIWait_t;
 
 	// +------------------------------------------------------------------------------
 	// |  Status register ( HSTR ) constants
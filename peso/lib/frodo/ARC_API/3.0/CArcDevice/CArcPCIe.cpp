@@ -54,6 +54,9 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <cstring>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/sysmacros.h>
 #endif
 
 #ifdef __APPLE__
@@ -76,6 +79,7 @@ using namespace arc;
 
 	#define DEVICE_DIR		"/dev/"
 	#define DEVICE_NAME		"AstroPCIe"
+	#define DEVICE_SYSFS	"/sys/dev/char/%u:%u/device/resource%d"
 
 #elif defined( __APPLE__ )
 
@@ -200,7 +204,10 @@ char** CArcPCIe::m_pszDevList = NULL;
 // +----------------------------------------------------------------------------
 CArcPCIe::CArcPCIe()
 {
-	m_hDevice = INVALID_HANDLE_VALUE;
+	m_hDevice        = INVALID_HANDLE_VALUE;
+	m_pDevRegBar     = NULL;
+	m_dDevRegBarSize = 0;
+	m_bMappedBar     = true;
 }
 
 // +----------------------------------------------------------------------------
@@ -595,6 +602,14 @@ void CArcPCIe::Open( int dDeviceNumber )
 								   CArcTools::GetSystemMessage( Arc_ErrorCode() ).c_str() );
 	}
 
+	//
+	//  Map the device registers, ioctl() is used on failure
+	// +-------------------------------------------------------+
+	if ( m_bMappedBar )
+	{
+		MapDevRegBar();
+	}
+
 	//
 	//  Clear the status register
 	// +-------------------------------------------------------+
@@ -635,6 +650,8 @@ void CArcPCIe::Open( int dDeviceNumber, int dBytes )
 // +----------------------------------------------------------------------------
 void CArcPCIe::Close()
 {
+	StopTemperatureSampler();
+
 	//
 	// Prevents access violation from code that follows
 	//
@@ -643,6 +660,8 @@ void CArcPCIe::Close()
 
 	UnMapCommonBuffer();
 
+	UnMapDevRegBar();
+
 	Arc_CloseHandle( m_hDevice );
 
 	m_dCCParam   = 0;
@@ -884,6 +903,8 @@ void CArcPCIe::LoadDeviceFile( const char* pszFile )
 // +----------------------------------------------------------------------------
 int CArcPCIe::Command( int dBoardId, int dCommand, int dArg0, int dArg1, int dArg2, int dArg3 )
 {
+	CArcCmdLock cCmdLock( this );
+
 	int dNumOfArgs = 2;
 	int dHeader    = 0;
 	int dReply     = 0;
@@ -1049,6 +1070,8 @@ int CArcPCIe::Command( int dBoardId, int dCommand, int dArg0, int dArg1, int dAr
 // +----------------------------------------------------------------------------
 int CArcPCIe::GetControllerId()
 {
+	CArcCmdLock cCmdLock( this );
+
 	int dReply = 0;
 
 	//
@@ -1090,6 +1113,8 @@ int CArcPCIe::GetControllerId()
 // +----------------------------------------------------------------------------
 void CArcPCIe::ResetController()
 {
+	CArcCmdLock cCmdLock( this );
+
 	//
 	//  Clear status register
 	// +-------------------------------------------------+
@@ -1177,6 +1202,8 @@ bool CArcPCIe::IsFiberConnected( int dFiberId )
 // +----------------------------------------------------------------------------
 void CArcPCIe::StopExposure()
 {
+	CArcCmdLock cCmdLock( this );
+
 	//
 	//  Send Header
 	// +-------------------------------------------------+
@@ -1319,6 +1346,15 @@ void CArcPCIe::WriteBar( int dBar, int dOffset, int dValue )
 									dBar );
 	}
 
+	if ( dBar == DEV_REG_BAR && m_pDevRegBar != NULL &&
+		 dOffset >= 0 && size_t( dOffset ) + sizeof( int ) <= m_dDevRegBarSize &&
+		 ( dOffset & 0x3 ) == 0 )
+	{
+		m_pDevRegBar[ dOffset >> 2 ] = ( unsigned int )dValue;
+
+		return;
+	}
+
 	int dSuccess = Arc_IOCtl( m_hDevice,
 							  ARC_WRITE_BAR,
 							  dArgs,
@@ -1378,6 +1414,13 @@ int CArcPCIe::ReadBar( int dBar, int dOffset )
 									dBar );
 	}
 
+	if ( dBar == DEV_REG_BAR && m_pDevRegBar != NULL &&
+		 dOffset >= 0 && size_t( dOffset ) + sizeof( int ) <= m_dDevRegBarSize &&
+		 ( dOffset & 0x3 ) == 0 )
+	{
+		return int( m_pDevRegBar[ dOffset >> 2 ] );
+	}
+
 	int dSuccess = Arc_IOCtl( m_hDevice,
 							  ARC_READ_BAR,
 							  dIn,
@@ -1412,6 +1455,147 @@ int CArcPCIe::ReadBar( int dBar, int dOffset )
 	return dIn[ 0 ];
 }
 
+// +----------------------------------------------------------------------------
+// |  SetMappedBar
+// +----------------------------------------------------------------------------
+// |  Enables or disables direct access to the device registers ( BAR2 ). If
+// |  enabled, the registers are mapped into user space and ReadBar/WriteBar
+// |  use MMIO instead of one ioctl() per register. Mapping is attempted by
+// |  Open(), ioctl() stays in use if it fails. Enabled by default.
+// |
+// |  Throws NOTHING on error. No error handling.
+// |
+// |  <IN> -> bOnOff - 'true' to map the registers, 'false' to use ioctl().
+// +----------------------------------------------------------------------------
+void CArcPCIe::SetMappedBar( bool bOnOff )
+{
+	m_bMappedBar = bOnOff;
+
+	if ( !bOnOff )
+	{
+		UnMapDevRegBar();
+	}
+	else if ( IsOpen() && m_pDevRegBar == NULL )
+	{
+		MapDevRegBar();
+	}
+}
+
+// +----------------------------------------------------------------------------
+// |  IsMappedBar
+// +----------------------------------------------------------------------------
+// |  Returns 'true' if the device registers are accessed through MMIO.
+// +----------------------------------------------------------------------------
+bool CArcPCIe::IsMappedBar()
+{
+	return ( m_pDevRegBar != NULL );
+}
+
+// +----------------------------------------------------------------------------
+// |  MapDevRegBar
+// +----------------------------------------------------------------------------
+// |  Maps the device registers ( BAR2 ) through the sysfs resource file of the
+// |  PCIe device behind the open driver node. The mapping is only kept if the
+// |  id register reads the same as through ioctl().
+// |
+// |  Throws NOTHING on error. Returns 'false' if the registers are not mapped.
+// +----------------------------------------------------------------------------
+bool CArcPCIe::MapDevRegBar()
+{
+#ifdef linux
+
+	struct stat tStat;
+	char szResource[ 128 ];
+
+	UnMapDevRegBar();
+
+	if ( fstat( m_hDevice, &tStat ) != 0 || !S_ISCHR( tStat.st_mode ) )
+	{
+		return false;
+	}
+
+	snprintf( szResource,
+			  sizeof( szResource ),
+			  DEVICE_SYSFS,
+			  major( tStat.st_rdev ),
+			  minor( tStat.st_rdev ),
+			  int( DEV_REG_BAR ) );
+
+	int dFd = open( szResource, O_RDWR | O_SYNC );
+
+	if ( dFd == -1 )
+	{
+		return false;
+	}
+
+	if ( fstat( dFd, &tStat ) != 0 ||
+		 size_t( tStat.st_size ) < size_t( REG_ID_HI ) + sizeof( int ) )
+	{
+		close( dFd );
+		return false;
+	}
+
+	void* pAddr = mmap( 0,
+						tStat.st_size,
+						( PROT_READ | PROT_WRITE ),
+						MAP_SHARED,
+						dFd,
+						0 );
+
+	close( dFd );
+
+	if ( pAddr == MAP_FAILED )
+	{
+		return false;
+	}
+
+	m_pDevRegBar     = ( volatile unsigned int * )pAddr;
+	m_dDevRegBarSize = size_t( tStat.st_size );
+
+	//
+	//  Compare id register with the value read through the driver
+	// +-------------------------------------------------------+
+	int dMappedId = int( m_pDevRegBar[ REG_ID_HI >> 2 ] );
+	int dIn[ 2 ]  = { DEV_REG_BAR, REG_ID_HI };
+
+	if ( !Arc_IOCtl( m_hDevice, ARC_READ_BAR, dIn, sizeof( dIn ) ) ||
+		 dIn[ 0 ] != dMappedId )
+	{
+		UnMapDevRegBar();
+		return false;
+	}
+
+	return true;
+
+#else
+
+	return false;
+
+#endif
+}
+
+// +----------------------------------------------------------------------------
+// |  UnMapDevRegBar
+// +----------------------------------------------------------------------------
+// |  Un-Maps the device registers mapped by MapDevRegBar().
+// |
+// |  Throws NOTHING
+// +----------------------------------------------------------------------------
+void CArcPCIe::UnMapDevRegBar()
+{
+#ifdef linux
+
+	if ( m_pDevRegBar != NULL )
+	{
+		munmap( ( void * )m_pDevRegBar, m_dDevRegBarSize );
+	}
+
+#endif
+
+	m_pDevRegBar     = NULL;
+	m_dDevRegBarSize = 0;
+}
+
 // +----------------------------------------------------------------------------
 // |  LoadGen23ControllerFile
 // +----------------------------------------------------------------------------
@@ -1427,17 +1611,10 @@ int CArcPCIe::ReadBar( int dBar, int dOffset )
 void CArcPCIe::LoadGen23ControllerFile( const char *pszFilename, bool bValidate, const bool& bAbort )
 {
 	int  dBoardId		= 0;
-	int  dType			= 0;
-	int  dAddr			= 0;
-	int  dData			= 0;
 	int  dReply			= 0;
-	char typeChar		= ' ';
 	bool bIsCLodFile	= false;
 
-	std::string sFilename( pszFilename );
-	std::string sLine;
-	std::string sToken;
-	CArcTools::CTokenizer cTokenizer;
+	std::vector<ArcCmd_t> vCmds;
 
 	if ( bAbort ) { return; }
 
@@ -1454,47 +1631,11 @@ void CArcPCIe::LoadGen23ControllerFile( const char *pszFilename, bool bValidate,
 	if ( bAbort ) { return; }
 
 	//
-	// Open the file for reading.
+	// Read the file, the pre-parsed image is used if up to date
 	// -------------------------------------------------------------------
-	ifstream inFile( sFilename.c_str() );
+	ParseGen23ControllerFile( pszFilename, dBoardId, bIsCLodFile, vCmds, bAbort );
 
-	if ( !inFile.is_open() )
-	{
-		CArcTools::ThrowException( "CArcPCIe",
-								   "LoadGen23ControllerFile",
-						           "Cannot open file: %s",
-						            sFilename.c_str() );
-	}
-
-	if ( bAbort ) { inFile.close(); return; }
-
-	//
-	// Check for valid TIM or UTIL file
-	// -------------------------------------------------------------------
-	getline( inFile, sLine );
-
-	if ( sLine.find( "TIM" ) != std::string::npos )
-	{
-		dBoardId = TIM_ID;
-	}
-	else if ( sLine.find( "CRT" ) != std::string::npos )
-	{
-		dBoardId = TIM_ID;
-		bIsCLodFile = true;
-	}
-	else if ( sLine.find( "UTIL" ) != std::string::npos )
-	{
-		dBoardId = UTIL_ID;
-	}
-	else
-	{
-		CArcTools::ThrowException(
-					"CArcPCIe",
-					"LoadGen23ControllerFile",
-					"Invalid file. Missing 'TIMBOOT/CRT' or 'UTILBOOT' string." );
-	}
-
-	if ( bAbort ) { inFile.close(); return; }
+	if ( bAbort ) { return; }
 
 	//
 	// First, send the stop command. Otherwise, the controller crashes
@@ -1512,116 +1653,14 @@ void CArcPCIe::LoadGen23ControllerFile( const char *pszFilename, bool bValidate,
 					 dReply );
 	}
 
-	if ( bAbort ) { inFile.close(); return; }
+	if ( bAbort ) { return; }
 
 	//
 	// Set the PCI status bit #1 (X:0 bit 1 = 1).
 	// -------------------------------------------
 	// Not Used by PCIe
 
-	//
-	// Read in the file one line at a time
-	// --------------------------------------
-	while ( !inFile.eof() )
-	{
-		if ( bAbort ) { inFile.close(); return; }
-
-		getline( inFile, sLine );
-
-		//
-		// Only "_DATA" blocks are valid for download
-		// ---------------------------------------------
-		if ( sLine.find( '_' ) == 0 && sLine.find( "_DATA " ) != std::string::npos )
-		{
-			cTokenizer.Victim( sLine );
-			cTokenizer.Next();	// Dump _DATA string
-
-			//
-			// Get the memory type and start address
-			// ---------------------------------------------
-			typeChar = CArcTools::StringToChar( cTokenizer.Next() );
-			dAddr    = CArcTools::StringToHex( cTokenizer.Next() );
-
-			//
-			// The start address must be less than MAX_DSP_START_LOAD_ADDR
-			// -------------------------------------------------------------
-			if ( dAddr < MAX_DSP_START_LOAD_ADDR )
-			{
-				//
-				// Set the DSP memory type
-				// ----------------------------------
-				if      ( typeChar == 'X' ) dType = X_MEM;
-				else if ( typeChar == 'Y' ) dType = Y_MEM;
-				else if ( typeChar == 'P' ) dType = P_MEM;
-				else if ( typeChar == 'R' ) dType = R_MEM;
-
-				//
-				// Read the data block
-				// ----------------------------------
-				while ( !inFile.eof() && inFile.peek() != '_' )
-				{
-					if ( bAbort ) { inFile.close(); return; }
-
-					getline( inFile, sLine );
-					cTokenizer.Victim( sLine );
-
-					while ( !( ( sToken = cTokenizer.Next() ).empty() ) )
-					{
-						if ( bAbort ) { inFile.close(); return; }
-
-						dData = CArcTools::StringToHex( sToken );
-
-						//
-						// Write the data to the controller.
-						// --------------------------------------------------------------
-						dReply = Command( dBoardId,
-										  WRM,
-										  ( dType | dAddr ),
-										  dData );
-
-						if ( dReply != DON )
-						{
-							CArcTools::ThrowException(
-											"CArcPCIe",
-											"LoadGen23ControllerFile",
-											"Write ('WRM') to controller %s board failed. WRM 0x%X 0x%X -> 0x%X",
-											( dBoardId == TIM_ID ? "TIMING" : "UTILITY" ),
-											( dType | dAddr ),
-											 dData,
-											 dReply );
-						}
-
-						if ( bAbort ) { inFile.close(); return; }
-
-						//
-						// Validate the data if required.
-						// --------------------------------------------------------------
-						if ( bValidate )
-						{
-							dReply = Command( dBoardId, RDM, ( dType | dAddr ) );
-
-							if ( dReply != dData )
-							{
-								CArcTools::ThrowException(
-										"CArcPCIe",
-										"LoadGen23ControllerFile",
-										"Write ('WRM') to controller %s board failed. RDM 0x%X -> 0x%X [ Expected: 0x%X ]",
-										( dBoardId == TIM_ID ? "TIMING" : "UTILITY" ),
-										( dType | dAddr ),
-										 dReply,
-										 dData );
-							}
-						}	// End if 'validate'
-
-						dAddr++;
-
-					} // while tokenizer next
-				} // if not EOF or '_'
-			}	// if address < 0x4000
-		}	// if '_DATA'
-	}	// if not EOF
-
-	inFile.close();
+	LoadGen23Data( dBoardId, vCmds, bValidate, bAbort );
 
 	if ( bAbort ) { return; }
 
@@ -1666,6 +1705,8 @@ void CArcPCIe::LoadGen23ControllerFile( const char *pszFilename, bool bValidate,
 // +----------------------------------------------------------------------------
 int CArcPCIe::SmallCamDLoad( int dBoardId, vector<int>& vData )
 {
+	CArcCmdLock cCmdLock( this );
+
 	int dHeader    = 0;
 	int dReply     = 0;
 
@@ -81,6 +81,9 @@ namespace arc
 			int  ReadBar( int dBar, int dOffset );
 			int  ReadReply( double fTimeOutSecs = 1.5 );
 
+			void SetMappedBar( bool bOnOff );
+			bool IsMappedBar();
+
 			//  Convenience names for base addr registers ( BAR )
 			// +-------------------------------------------------+
 			enum { LCL_CFG_BAR  = 0x00,		// Local Config Regs
@@ -138,6 +141,13 @@ namespace arc
 			void TestMemory( int dValue );
 			void GetLocalConfiguration();
 
+			bool MapDevRegBar();
+			void UnMapDevRegBar();
+
+			volatile unsigned int*			m_pDevRegBar;		// BAR2 mapped into user space
+			size_t							m_dDevRegBarSize;
+			bool							m_bMappedBar;		// 'true' tries to map BAR2 on Open()
+
 			static std::vector<ArcDev_t>	m_vDevList;
 			static char**					m_pszDevList;
 	};
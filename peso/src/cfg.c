@@ -82,6 +82,11 @@ static void cfg_init(EXPOSED_CFG_T *p_exposed_cfg)
     cfg[CFG_EVENT_ARCHIVE_SCRIPT_E].type = CFG_TYPE_STR_E;
     cfg[CFG_EVENT_ARCHIVE_SCRIPT_E].p_save = p_exposed_cfg->archive_script;
 
+    cfg[CFG_EVENT_SAVE_RAW_E].p_group_name = "exposed";
+    cfg[CFG_EVENT_SAVE_RAW_E].p_key = "save_raw";
+    cfg[CFG_EVENT_SAVE_RAW_E].type = CFG_TYPE_BOOLEAN_E;
+    cfg[CFG_EVENT_SAVE_RAW_E].p_save = &p_exposed_cfg->save_raw;
+
     cfg[CFG_EVENT_CMD_BEGIN_FLAT_E].p_group_name = "commands_begin";
     cfg[CFG_EVENT_CMD_BEGIN_FLAT_E].p_key = "flat";
     cfg[CFG_EVENT_CMD_BEGIN_FLAT_E].type = CFG_TYPE_STR_E;
@@ -146,6 +151,12 @@ static void cfg_init(EXPOSED_CFG_T *p_exposed_cfg)
     cfg[CFG_EVENT_CCD_FRODO_NUM_UTIL_TESTS_E].p_save =
             &p_exposed_cfg->ccd_frodo.num_util_tests;
 
+    cfg[CFG_EVENT_CCD_FRODO_BUFFER_FRAMES_E].p_group_name = "ccd_frodo";
+    cfg[CFG_EVENT_CCD_FRODO_BUFFER_FRAMES_E].p_key = "buffer_frames";
+    cfg[CFG_EVENT_CCD_FRODO_BUFFER_FRAMES_E].type = CFG_TYPE_INT_E;
+    cfg[CFG_EVENT_CCD_FRODO_BUFFER_FRAMES_E].p_save =
+            &p_exposed_cfg->ccd_frodo.buffer_frames;
+
     cfg[CFG_EVENT_CCD_TEMP_E].p_group_name = "ccd";
     cfg[CFG_EVENT_CCD_TEMP_E].p_key = "temp";
     cfg[CFG_EVENT_CCD_TEMP_E].type = CFG_TYPE_DOUBLE_E;
@@ -38,6 +38,7 @@ typedef enum
     CFG_EVENT_ARCHIVE_PATHS_E,
     CFG_EVENT_ARCHIVE_E,
     CFG_EVENT_ARCHIVE_SCRIPT_E,
+    CFG_EVENT_SAVE_RAW_E,
     CFG_EVENT_CMD_BEGIN_FLAT_E,
     CFG_EVENT_CMD_BEGIN_COMP_E,
     CFG_EVENT_CMD_BEGIN_OBJECT_E,
@@ -59,6 +60,7 @@ typedef enum
     CFG_EVENT_CCD_FRODO_NUM_PCI_TESTS_E,
     CFG_EVENT_CCD_FRODO_NUM_TIM_TESTS_E,
     CFG_EVENT_CCD_FRODO_NUM_UTIL_TESTS_E,
+    CFG_EVENT_CCD_FRODO_BUFFER_FRAMES_E,
     CFG_EVENT_MAX_E,
 } CFG_EVENT_T;
 
@@ -101,6 +103,7 @@ typedef struct
     int num_pci_tests;
     int num_tim_tests;
     int num_util_tests;
+    int buffer_frames;
 } CCD_FRODO_T;
 
 typedef struct
@@ -135,6 +138,7 @@ typedef struct
     char file_pid[FILE_PID_MAX + 1];
     int port;
     int archive;
+    int save_raw;
     CMD_T cmd_begin;
     CMD_T cmd_end;
     CCD_T ccd;
@@ -0,0 +1,177 @@
+/**
+ * Author: Jan Fuchs <fuky@sunstel.asu.cas.cz>
+ * $Date$
+ * $Rev$
+ *
+ * Deinterlacing time of all CDeinterlace algorithms with scalar code in one
+ * thread, SIMD code in one thread and SIMD code in all threads. Each result
+ * is checked against the scalar one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdexcept>
+
+#include "CDeinterlace.h"
+
+#define BENCH_REPEAT    5
+#define BENCH_CHANNELS  32
+
+using namespace arc;
+
+static const struct
+{
+    const char *p_name;
+    int algorithm;
+} bench_algs[] = {
+    {"PARALLEL",    CDeinterlace::DEINTERLACE_PARALLEL},
+    {"SERIAL",      CDeinterlace::DEINTERLACE_SERIAL},
+    {"CCD_QUAD",    CDeinterlace::DEINTERLACE_CCD_QUAD},
+    {"IR_QUAD",     CDeinterlace::DEINTERLACE_IR_QUAD},
+    {"CDS_IR_QUAD", CDeinterlace::DEINTERLACE_CDS_IR_QUAD},
+    {"HAWAII_RG",   CDeinterlace::DEINTERLACE_HAWAII_RG},
+    {"STA1600",     CDeinterlace::DEINTERLACE_STA1600},
+};
+
+static const int bench_sizes[] = {2048, 4096};
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Best time of repeat runs, p_out holds the result of the last one.
+ */
+static double bench_run(CDeinterlace *p_deint, const unsigned short *p_raw,
+        unsigned short *p_out, int size, int algorithm, int repeat)
+{
+    int i;
+    double start;
+    double best = -1;
+    size_t bytes = (size_t)size * size * sizeof(unsigned short);
+
+    for (i = 0; i < repeat; ++i)
+    {
+        memcpy(p_out, p_raw, bytes);
+
+        start = bench_now();
+        p_deint->RunAlg(p_out, size, size, algorithm, BENCH_CHANNELS);
+        start = bench_now() - start;
+
+        if ((best < 0) || (start < best))
+        {
+            best = start;
+        }
+    }
+
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    CDeinterlace deint;
+    unsigned short *p_raw;
+    unsigned short *p_ref;
+    unsigned short *p_out;
+    int repeat = BENCH_REPEAT;
+    int threads;
+    int ret = EXIT_SUCCESS;
+    size_t i;
+    size_t a;
+    size_t s;
+    size_t pixels;
+    double scalar;
+    double simd;
+    double parallel;
+
+    if (argc > 1)
+    {
+        repeat = atoi(argv[1]);
+    }
+
+    if (repeat < 1)
+    {
+        printf("Usage: %s [REPEAT]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    threads = deint.GetThreads();
+
+    printf("threads = %i, SIMD = %s\n", threads, deint.IsSIMD() ? "SSE2" : "none");
+    printf("%-12s %5s %11s %11s %11s %8s\n", "algorithm", "size", "scalar [ms]",
+            "SIMD [ms]", "threads [ms]", "speedup");
+
+    for (s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); ++s)
+    {
+        pixels = (size_t)bench_sizes[s] * bench_sizes[s];
+
+        p_raw = (unsigned short *)malloc(pixels * sizeof(unsigned short));
+        p_ref = (unsigned short *)malloc(pixels * sizeof(unsigned short));
+        p_out = (unsigned short *)malloc(pixels * sizeof(unsigned short));
+
+        if ((p_raw == NULL) || (p_ref == NULL) || (p_out == NULL))
+        {
+            printf("Error: malloc() failed\n");
+            return EXIT_FAILURE;
+        }
+
+        for (i = 0; i < pixels; ++i)
+        {
+            p_raw[i] = (unsigned short)rand();
+        }
+
+        for (a = 0; a < sizeof(bench_algs) / sizeof(bench_algs[0]); ++a)
+        {
+            try
+            {
+                deint.SetThreads(1);
+                deint.SetSIMD(false);
+                scalar = bench_run(&deint, p_raw, p_ref, bench_sizes[s],
+                        bench_algs[a].algorithm, repeat);
+
+                deint.SetSIMD(true);
+                simd = bench_run(&deint, p_raw, p_out, bench_sizes[s],
+                        bench_algs[a].algorithm, repeat);
+
+                if (memcmp(p_ref, p_out, pixels * sizeof(unsigned short)) != 0)
+                {
+                    printf("Error: %s SIMD result differs\n", bench_algs[a].p_name);
+                    ret = EXIT_FAILURE;
+                }
+
+                deint.SetThreads(threads);
+                parallel = bench_run(&deint, p_raw, p_out, bench_sizes[s],
+                        bench_algs[a].algorithm, repeat);
+
+                if (memcmp(p_ref, p_out, pixels * sizeof(unsigned short)) != 0)
+                {
+                    printf("Error: %s threaded result differs\n", bench_algs[a].p_name);
+                    ret = EXIT_FAILURE;
+                }
+            }
+            catch (std::runtime_error &e)
+            {
+                printf("Error: %s\n", e.what());
+                ret = EXIT_FAILURE;
+                continue;
+            }
+
+            printf("%-12s %5i %11.3f %11.3f %11.3f %7.1fx\n", bench_algs[a].p_name,
+                    bench_sizes[s], scalar * 1e3, simd * 1e3, parallel * 1e3,
+                    scalar / parallel);
+        }
+
+        free(p_raw);
+        free(p_ref);
+        free(p_out);
+    }
+
+    return ret;
+}
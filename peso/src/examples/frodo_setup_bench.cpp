@@ -0,0 +1,109 @@
+/**
+ * Author: Jan Fuchs <fuky@sunstel.asu.cas.cz>
+ * $Date$
+ * $Rev$
+ *
+ * Controller setup time with one ioctl per command and with batched
+ * commands (CArcDevice::SetBatchCmds).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stdexcept>
+
+#include "CArcPCI.h"
+#include "ArcDefs.h"
+
+#define BENCH_ROWS      512
+#define BENCH_COLS      2720
+#define BENCH_REPEAT    3
+
+using namespace arc;
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench_setup(CArcPCI *p_device, bool batch, const char *p_tim,
+        const char *p_util, int repeat)
+{
+    int i;
+    double start;
+    double best = -1;
+
+    p_device->SetBatchCmds(batch);
+
+    for (i = 0; i < repeat; ++i)
+    {
+        start = bench_now();
+        p_device->SetupController(true, true, true, BENCH_ROWS, BENCH_COLS,
+                p_tim, p_util);
+        start = bench_now() - start;
+
+        if ((best < 0) || (start < best))
+        {
+            best = start;
+        }
+    }
+
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    CArcPCI device;
+    const char *p_util = NULL;
+    int repeat = BENCH_REPEAT;
+    double single;
+    double batch;
+
+    if (argc < 2)
+    {
+        printf("Usage: %s TIM_FILE [UTIL_FILE] [REPEAT]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (argc > 2)
+    {
+        p_util = argv[2];
+    }
+
+    if (argc > 3)
+    {
+        repeat = atoi(argv[3]);
+    }
+
+    try
+    {
+        CArcPCI::FindDevices();
+
+        if (CArcPCI::DeviceCount() < 1)
+        {
+            printf("Error: AstroPCI devices not found\n");
+            return EXIT_FAILURE;
+        }
+
+        device.Open(0);
+
+        single = bench_setup(&device, false, argv[1], p_util, repeat);
+        batch = bench_setup(&device, true, argv[1], p_util, repeat);
+
+        device.Close();
+    }
+    catch (std::runtime_error &e)
+    {
+        printf("Error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    printf("SetupController() one command per ioctl: %8.3f s\n", single);
+    printf("SetupController() batched commands:      %8.3f s\n", batch);
+
+    return EXIT_SUCCESS;
+}
@@ -60,10 +60,12 @@
 #include "socket.h"
 #include "thread.h"
 #include "header.h"
+#include "fitshdr.h"
 #include "fce.h"
 #include "cfg.h"
 #include "telescope.h"
 #include "spectrograph.h"
+#include "imgstats.h"
 
 log4c_category_t *p_logcat = NULL;
 
@@ -81,6 +83,31 @@ static char exposed_ccd_name[EXPOSED_CCD_NAME_MAX + 1];
 static char *p_cmd_begin;
 static char *p_cmd_end;
 static EXPOSED_ALLOCATE_T exposed_allocate;
+static EXPOSED_FRAME_T *save_queue[EXPOSED_SAVE_QUEUE_MAX];
+static int save_queue_head = 0;
+static int save_queue_count = 0;
+static int save_pending = 0;
+static pthread_mutex_t save_mutex;
+static pthread_cond_t save_cond;
+static int expose_event_pending = 0;
+static pthread_mutex_t event_mutex;
+static pthread_cond_t event_cond;
+/* headers of frames saved by writer thread and written by expose thread */
+static FHDR_T save_fhdr;
+static FHDR_T expose_fhdr;
+static pthread_t snapshot_pthread;
+static int snapshot_running = 0;
+static int snapshot_tle_result = -1;
+static int snapshot_sgh_result = -1;
+static time_t snapshot_time;
+static TLE_INFO_T snapshot_tle_info;
+static SGH_INFO_T snapshot_sgh_info;
+static int cont_request = 0;
+static int cont_exptime;
+static int cont_frames;
+static int cont_cube;
+static IST_T quicklook_stats;
+static int quicklook_valid = 0;
 
 static void daemon_version(void)
 {
@@ -127,6 +154,26 @@ static void daemon_exit(int status)
         pthread_mutex_destroy(&global_mutex);
     }
 
+    if (exposed_allocate.save_cond)
+    {
+        pthread_cond_destroy(&save_cond);
+    }
+
+    if (exposed_allocate.save_mutex)
+    {
+        pthread_mutex_destroy(&save_mutex);
+    }
+
+    if (exposed_allocate.event_cond)
+    {
+        pthread_cond_destroy(&event_cond);
+    }
+
+    if (exposed_allocate.event_mutex)
+    {
+        pthread_mutex_destroy(&event_mutex);
+    }
+
     log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "exit");
 
     if (remove(exposed_cfg.file_pid) == -1)
@@ -189,24 +236,43 @@ static void append_log(int priority, const char *p_fmt, ...)
     /* UNLOCK */
 }
 
+/*
+ * Called from expose and writer threads while RPC handlers read p_peso->msg
+ * under global_mutex, so message is formatted locally and copied under lock.
+ * Caller must not hold global_mutex.
+ */
+static void save_error_msg(int priority, const char *p_msg)
+{
+    /* LOCK */
+    pthr_mutex_lock(&global_mutex);
+
+    strcpy(p_peso->msg, p_msg);
+
+    pthr_mutex_unlock(&global_mutex);
+    /* UNLOCK */
+
+    append_log(priority, "%s", p_msg);
+}
+
 __attribute__((format(printf,2,3)))
 static int save_fits_error(int fits_status, const char *p_fmt, ...)
 {
     va_list ap;
     char fits_error[FLEN_ERRMSG];
+    char msg[CCD_MSG_MAX + 1];
     int len;
 
     va_start(ap, p_fmt);
 
-    memset(p_peso->msg, '\0', CCD_MSG_MAX + 1);
-    vsnprintf(p_peso->msg, CCD_MSG_MAX, p_fmt, ap);
-    len = strlen(p_peso->msg);
+    memset(msg, '\0', CCD_MSG_MAX + 1);
+    vsnprintf(msg, CCD_MSG_MAX, p_fmt, ap);
+    len = strlen(msg);
     fits_get_errstatus(fits_status, fits_error);
-    snprintf(p_peso->msg + len, CCD_MSG_MAX - len, " %s", fits_error);
+    snprintf(msg + len, CCD_MSG_MAX - len, " %s", fits_error);
 
     va_end(ap);
 
-    append_log(LOG4C_PRIORITY_ERROR, p_peso->msg);
+    save_error_msg(LOG4C_PRIORITY_ERROR, msg);
 
     return 0;
 }
@@ -215,19 +281,20 @@ __attribute__((format(printf,2,3)))
 static int save_sys_error(int priority, const char *p_fmt, ...)
 {
     va_list ap;
+    char msg[CCD_MSG_MAX + 1];
+    int err = errno;
     int len;
 
     va_start(ap, p_fmt);
 
-    memset(p_peso->msg, '\0', CCD_MSG_MAX + 1);
-    vsnprintf(p_peso->msg, CCD_MSG_MAX, p_fmt, ap);
-    len = strlen(p_peso->msg);
-    snprintf(p_peso->msg + len, CCD_MSG_MAX - len, " %i: %s", errno,
-            strerror(errno));
+    memset(msg, '\0', CCD_MSG_MAX + 1);
+    vsnprintf(msg, CCD_MSG_MAX, p_fmt, ap);
+    len = strlen(msg);
+    snprintf(msg + len, CCD_MSG_MAX - len, " %i: %s", err, strerror(err));
 
     va_end(ap);
 
-    append_log(priority, p_peso->msg);
+    save_error_msg(priority, msg);
 
     return 0;
 }
@@ -259,6 +326,79 @@ static void daemon_signal(int sig)
     }
 }
 
+/*
+ * Wake expose() waiting in expose_event_wait(). Called by commands which
+ * change running exposure.
+ * Not async-signal-safe, daemon_signal() relies on poll timeout.
+ */
+static void expose_event_notify(void)
+{
+    /* LOCK */
+    pthr_mutex_lock(&event_mutex);
+
+    expose_event_pending = 1;
+    pthread_cond_signal(&event_cond);
+
+    pthr_mutex_unlock(&event_mutex);
+    /* UNLOCK */
+}
+
+/* wait for expose_event_notify() at most timeout miliseconds */
+static void expose_event_wait(long timeout)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout / 1000;
+    ts.tv_nsec += (timeout % 1000) * 1000000;
+
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    /* LOCK */
+    pthr_mutex_lock(&event_mutex);
+
+    while (!expose_event_pending)
+    {
+        if (pthread_cond_timedwait(&event_cond, &event_mutex, &ts) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+
+    expose_event_pending = 0;
+
+    pthr_mutex_unlock(&event_mutex);
+    /* UNLOCK */
+}
+
+/*
+ * Poll interval [ms] derived from expected end of exposure or readout. Times
+ * are whole seconds, so the last second and overruns of the estimate are
+ * polled at EXPOSED_POLL_READOUT.
+ */
+static long expose_poll_interval(int elapsed_time, int full_time, long max)
+{
+    long interval;
+
+    interval = (full_time - elapsed_time) * 1000L / 2;
+
+    if (interval < EXPOSED_POLL_READOUT)
+    {
+        interval = EXPOSED_POLL_READOUT;
+    }
+
+    if (interval > max)
+    {
+        interval = max;
+    }
+
+    return interval;
+}
+
 static int save_imagetype(char *p_imagetype)
 {
     if (!strcasecmp(p_imagetype, "flat"))
@@ -300,122 +440,6 @@ static int save_imagetype(char *p_imagetype)
     return -1;
 }
 
-static long save_fits_header(fitsfile *p_fits)
-{
-    int i;
-    int fits_status = 0;
-    int bscale = 1;
-    int bzero = 32768;
-    int value_int;
-    float value_float;
-    double value_double;
-    char key[PHDR_KEY_MAX + 1];
-    char *p_value;
-    char *p_comment;
-    long naxis = 2;
-    // TODO: nacitat z konfiguracniho souboru
-    //long naxes[2] = { 2048, 2048 };
-    //long naxes[2] = { 2720, 512 };
-    long naxes[2] = { exposed_cfg.ccd.x2, exposed_cfg.ccd.y2 };
-
-    if (fits_create_img(p_fits, USHORT_IMG, naxis, naxes, &fits_status))
-    {
-        save_fits_error(fits_status,
-                "Error: fits_create_img(USHORT_IMG, %li, [%li, %li]):", naxis,
-                naxes[0], naxes[1]);
-        return -1;
-    }
-    if (fits_update_key(p_fits, TINT, "BZERO", &bzero, "", &fits_status))
-    {
-        save_fits_error(fits_status, "Error: fits_update_key(bzero = %i):",
-                bzero);
-        return -1;
-    }
-    if (fits_update_key(p_fits, TINT, "BSCALE", &bscale,
-            "REAL=TAPE*BSCALE+BZERO", &fits_status))
-    {
-        save_fits_error(fits_status, "Error: fits_update_key(bscale = %i):",
-                bscale);
-        return -1;
-    }
-
-    for (i = 0; i < PHDR_INDEX_MAX_E; ++i)
-    {
-        if (peso_header[i].value[0] == '\0')
-        {
-            continue;
-        }
-
-        memset(key, '\0', PHDR_KEY_MAX + 1);
-        strncpy(key, peso_header[i].key, PHDR_KEY_MAX);
-        p_value = peso_header[i].value;
-        p_comment = peso_header[i].comment;
-
-        switch (peso_header[i].type)
-        {
-        case PHDR_TYPE_INT_E:
-            value_int = atoi(p_value);
-            if (fits_update_key(p_fits, TINT, key, &value_int, p_comment,
-                    &fits_status))
-            {
-                save_fits_error(fits_status,
-                        "Error: fits_update_key(TLONG, %s, %i, %s):", key,
-                        value_int, p_comment);
-                return -1;
-            }
-            break;
-
-        case PHDR_TYPE_FLOAT_E:
-            value_float = atof(p_value);
-            if (fits_update_key(p_fits, TFLOAT, key, &value_float, p_comment,
-                    &fits_status))
-            {
-                save_fits_error(fits_status,
-                        "Error: fits_update_key(TFLOAT, %s, %0.2f, %s):", key,
-                        value_float, p_comment);
-                return -1;
-            }
-            break;
-
-        case PHDR_TYPE_DOUBLE_E:
-            value_double = atof(p_value);
-            if (fits_update_key(p_fits, TDOUBLE, key, &value_double, p_comment,
-                    &fits_status))
-            {
-                save_fits_error(fits_status,
-                        "Error: fits_update_key(TDOUBLE, %s, %0.2f, %s):", key,
-                        value_double, p_comment);
-                return -1;
-            }
-            break;
-
-        case PHDR_TYPE_STR_E:
-            if (fits_update_key(p_fits, TSTRING, key, p_value, p_comment,
-                    &fits_status))
-            {
-                save_fits_error(fits_status,
-                        "Error: fits_update_key(TSTRING, %s, %s, %s):", key,
-                        p_value, p_comment);
-                return -1;
-            }
-            break;
-
-        default:
-            break;
-        }
-    }
-
-    if (fits_write_date(p_fits, &fits_status))
-    {
-        save_fits_error(fits_status, "Error: fits_write_date():");
-        return -1;
-    }
-
-    /* TODO: pridavat komentare */
-    //if (fits_write_comment(p_fits, comment, &fits_status)) ccd_log_fits(LOG4C_PRIORITY_WARN, fits_status);
-    return 0;
-}
-
 static char *exposed_state2str(int state)
 {
     switch (state)
@@ -667,6 +691,20 @@ static xmlrpc_value *cmd_get(xmlrpc_env *p_env, char *p_variable)
         snprintf(result, RESULT_MAX, "+OK GAINS = %s",
                 mod_ccd.get_gains());
     }
+    else if (!strcmp(p_variable, "STATS"))
+    {
+        if (quicklook_valid)
+        {
+            snprintf(result, RESULT_MAX,
+                    "+OK STATS = %u %u %.2f %.2f %llu", quicklook_stats.min,
+                    quicklook_stats.max, ist_mean(&quicklook_stats),
+                    ist_stddev(&quicklook_stats), quicklook_stats.saturated);
+        }
+        else
+        {
+            snprintf(result, RESULT_MAX, "-ERR STATS not available");
+        }
+    }
     else
     {
         snprintf(result, RESULT_MAX, "-ERR %s is unknown variable", p_variable);
@@ -774,24 +812,33 @@ static xmlrpc_value *cmd_set(xmlrpc_env *p_env, char *p_variable, char *p_value)
     finish: return xmlrpc_build_value(p_env, "s", result);
 }
 
-static xmlrpc_value *cmd_expose(xmlrpc_env *p_env, int exptime, int expcount, int expmeter)
+/* shutter according to IMAGETYP, -1 if IMAGETYP is not set */
+static int cmd_shutter(void)
 {
-    char result[RESULT_MAX + 1];
-
     switch (p_peso->imgtype)
     {
     case CCD_IMGTYPE_FLAT_E:
     case CCD_IMGTYPE_COMP_E:
     case CCD_IMGTYPE_TARGET_E:
         p_peso->shutter = 1;
-        break;
+        return 0;
 
     case CCD_IMGTYPE_DARK_E:
     case CCD_IMGTYPE_ZERO_E:
         p_peso->shutter = 0;
-        break;
+        return 0;
 
     default:
+        return -1;
+    }
+}
+
+static xmlrpc_value *cmd_expose(xmlrpc_env *p_env, int exptime, int expcount, int expmeter)
+{
+    char result[RESULT_MAX + 1];
+
+    if (cmd_shutter() == -1)
+    {
         snprintf(result, RESULT_MAX, "-ERR must execute SETKEY IMAGETYP");
         xmlrpc_env_set_fault_formatted(p_env, XMLRPC_INTERNAL_ERROR, "%s",
                 result);
@@ -829,6 +876,7 @@ static xmlrpc_value *cmd_addtime(xmlrpc_env *p_env, int addtime)
 
     p_peso->addtime = addtime;
     strncpy(result, "+OK", RESULT_MAX);
+    expose_event_notify();
 
     return xmlrpc_build_value(p_env, "s", result);
 }
@@ -839,6 +887,7 @@ static xmlrpc_value *cmd_exptime_update(xmlrpc_env *p_env, int exptime)
 
     p_peso->exptime_update = exptime;
     strncpy(result, "+OK", RESULT_MAX);
+    expose_event_notify();
 
     return xmlrpc_build_value(p_env, "s", result);
 }
@@ -849,6 +898,7 @@ static xmlrpc_value *cmd_expmeter_update(xmlrpc_env *p_env, int expmeter)
 
     p_peso->expmeter_update = expmeter;
     strncpy(result, "+OK", RESULT_MAX);
+    expose_event_notify();
 
     return xmlrpc_build_value(p_env, "s", result);
 }
@@ -892,97 +942,88 @@ static int expose_dms2number(char *p_input, char *p_output, int output_len)
     return 0;
 }
 
-static void fit_save_tle_hdr(void)
+static void fit_save_tle_hdr(TLE_INFO_T *p_tle_info, time_t ut_time)
 {
-    TLE_INFO_T tle_info;
     char value[EXPOSED_STR_MAX+1];
 
-    if (tle_telescope_info(&tle_info) == -1)
-    {
-        // TODO: zalogovat
-    }
-    else
-    {
-        // TLE-TRCS - Correction Set
-        snprintf(peso_header[PHDR_TLE_TRCS_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.trcs);
+    // TLE-TRCS - Correction Set
+    snprintf(peso_header[PHDR_TLE_TRCS_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->trcs);
 
-        // TLE-TRGV - Guiding Value
-        snprintf(peso_header[PHDR_TLE_TRGV_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.trgv);
+    // TLE-TRGV - Guiding Value
+    snprintf(peso_header[PHDR_TLE_TRGV_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->trgv);
 
-        // TLE-TRHD - Hour and Declination Axis
-        snprintf(peso_header[PHDR_TLE_TRHD_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.trhd);
+    // TLE-TRHD - Hour and Declination Axis
+    snprintf(peso_header[PHDR_TLE_TRHD_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->trhd);
 
-        // TLE-TRRD - Right ascension and Declination
-        snprintf(peso_header[PHDR_TLE_TRRD_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.trrd);
+    // TLE-TRRD - Right ascension and Declination
+    snprintf(peso_header[PHDR_TLE_TRRD_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->trrd);
 
-        // TLE-TRUS - User Speed
-        snprintf(peso_header[PHDR_TLE_TRUS_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.trus);
+    // TLE-TRUS - User Speed
+    snprintf(peso_header[PHDR_TLE_TRUS_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->trus);
 
-        // AIRHUMEX
-        snprintf(peso_header[PHDR_AIRHUMEX_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.airhumex);
+    // AIRHUMEX
+    snprintf(peso_header[PHDR_AIRHUMEX_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->airhumex);
 
-        // AIRPRESS
-        snprintf(peso_header[PHDR_AIRPRESS_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.airpress);
+    // AIRPRESS
+    snprintf(peso_header[PHDR_AIRPRESS_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->airpress);
 
-        // DOMEAZ
-        snprintf(peso_header[PHDR_DOMEAZ_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.domeaz);
+    // DOMEAZ
+    snprintf(peso_header[PHDR_DOMEAZ_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->domeaz);
 
-        // DOMETEMP
-        snprintf(peso_header[PHDR_DOMETEMP_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.dometemp);
+    // DOMETEMP
+    snprintf(peso_header[PHDR_DOMETEMP_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->dometemp);
 
-        // OUTTEMP
-        snprintf(peso_header[PHDR_OUTTEMP_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.outtemp);
+    // OUTTEMP
+    snprintf(peso_header[PHDR_OUTTEMP_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->outtemp);
 
-        // TELFOCUS
-        snprintf(peso_header[PHDR_TELFOCUS_E].value, PHDR_VALUE_MAX, "%.2f",
-                tle_info.fopo);
+    // TELFOCUS
+    snprintf(peso_header[PHDR_TELFOCUS_E].value, PHDR_VALUE_MAX, "%.2f",
+            p_tle_info->fopo);
 
-        // DEC
-        snprintf(peso_header[PHDR_DEC_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.dec);
+    // DEC
+    snprintf(peso_header[PHDR_DEC_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->dec);
 
-        expose_dms2number(tle_info.dec, value, EXPOSED_STR_MAX);
-        snprintf(peso_header[PHDR_DEC_E].comment, PHDR_COMMENT_MAX, "%s",
-                value);
+    expose_dms2number(p_tle_info->dec, value, EXPOSED_STR_MAX);
+    snprintf(peso_header[PHDR_DEC_E].comment, PHDR_COMMENT_MAX, "%s",
+            value);
 
-        // RA
-        snprintf(peso_header[PHDR_RA_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.ra);
+    // RA
+    snprintf(peso_header[PHDR_RA_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->ra);
 
-        // ST
-        snprintf(peso_header[PHDR_ST_E].value, PHDR_VALUE_MAX, "%s",
-                tle_info.st);
+    // ST
+    snprintf(peso_header[PHDR_ST_E].value, PHDR_VALUE_MAX, "%s",
+            p_tle_info->st);
 
-        expose_dms2number(tle_info.ra, value, EXPOSED_STR_MAX);
-        snprintf(peso_header[PHDR_RA_E].comment, PHDR_COMMENT_MAX, "%s",
-                value);
+    expose_dms2number(p_tle_info->ra, value, EXPOSED_STR_MAX);
+    snprintf(peso_header[PHDR_RA_E].comment, PHDR_COMMENT_MAX, "%s",
+            value);
 
-        // TM-DIFF
-        time_t ut_time = time(NULL);
-        time_t tle_ut_time = 0;
-        struct tm tle_tm;
+    // TM-DIFF
+    time_t tle_ut_time = 0;
+    struct tm tle_tm;
 
-        setenv("TZ", "UTC", 1);
-        if (strptime(tle_info.ut, "%Y-%m-%d %H:%M:%S", &tle_tm) != NULL) {
-            tle_ut_time = mktime(&tle_tm);
-        }
+    setenv("TZ", "UTC", 1);
+    if (strptime(p_tle_info->ut, "%Y-%m-%d %H:%M:%S", &tle_tm) != NULL) {
+        tle_ut_time = mktime(&tle_tm);
+    }
 
-        snprintf(peso_header[PHDR_TM_DIFF_E].value, PHDR_VALUE_MAX, "%jd",
-                (intmax_t)(tle_ut_time - ut_time));
+    snprintf(peso_header[PHDR_TM_DIFF_E].value, PHDR_VALUE_MAX, "%jd",
+            (intmax_t)(tle_ut_time - ut_time));
 
-        snprintf(peso_header[PHDR_TM_DIFF_E].comment, PHDR_COMMENT_MAX, "T%jd - P%jd",
-                (intmax_t)tle_ut_time, (intmax_t)ut_time);
-    }
+    snprintf(peso_header[PHDR_TM_DIFF_E].comment, PHDR_COMMENT_MAX, "T%jd - P%jd",
+            (intmax_t)tle_ut_time, (intmax_t)ut_time);
 }
 
 static void sgh_collimator2human(SGH_INFO_T *p_sgh_info, char *p_value,
@@ -1072,102 +1113,94 @@ static void sgh_msc2human(SGH_INFO_T *p_sgh_info, char *p_value, int value_len)
     }
 }
 
-static void fit_save_sgh_hdr(void)
+static void fit_save_sgh_hdr(SGH_INFO_T *p_sgh_info)
 {
-    SGH_INFO_T sgh_info;
     char value[EXPOSED_STR_MAX+1];
     int *p_spectemp = NULL;
     int *p_camfocus = NULL;
     float spectemp_human;
 
-    if (sgh_spectrograph_info(&sgh_info) == -1)
-    {
-        // TODO: zalogovat
+    if (!strcmp(exposed_cfg.instrument, "OES")) {
+        // SGH-OIC - OES Iodine cell
+        snprintf(peso_header[PHDR_SGH_OIC_E].value, PHDR_VALUE_MAX, "%i",
+                p_sgh_info->oes_iodine_cell);
     }
-    else
-    {
-        if (!strcmp(exposed_cfg.instrument, "OES")) {
-            // SGH-OIC - OES Iodine cell
-            snprintf(peso_header[PHDR_SGH_OIC_E].value, PHDR_VALUE_MAX, "%i",
-                    sgh_info.oes_iodine_cell);
-        }
-        else {
-            // SGH-CPA - Correction plate 700
-            sgh_cplate2human(sgh_info.correction_plate_700, value, EXPOSED_STR_MAX);
-            snprintf(peso_header[PHDR_SGH_CPA_E].value, PHDR_VALUE_MAX, "%s",
-                    value);
-
-            // SGH-CPB - Correction plate 400
-            sgh_cplate2human(sgh_info.correction_plate_400, value, EXPOSED_STR_MAX);
-            snprintf(peso_header[PHDR_SGH_CPB_E].value, PHDR_VALUE_MAX, "%s",
-                    value);
-
-            // GRATANG
-            snprintf(peso_header[PHDR_GRATANG_E].value, PHDR_VALUE_MAX, "%4.2f",
-                    sgh_gratpos2gratang(sgh_info.grating_position));
-
-            sgh_gratpos2gratang_str(sgh_info.grating_position, value,
-                    EXPOSED_STR_MAX);
-            snprintf(peso_header[PHDR_GRATANG_E].comment, PHDR_COMMENT_MAX, "%s",
-                    value);
-
-            // GRATPOS
-            snprintf(peso_header[PHDR_GRATPOS_E].value, PHDR_VALUE_MAX, "%i",
-                    sgh_info.grating_position);
-
-            // SPECFILT
-            snprintf(peso_header[PHDR_SPECFILT_E].value, PHDR_VALUE_MAX, "%i",
-                    sgh_info.spectral_filter);
-
-            // DICHMIR
-            snprintf(peso_header[PHDR_DICHMIR_E].value, PHDR_VALUE_MAX, "%i",
-                    sgh_info.dichroic_mirror);
-        }
-
-        // COLIMAT - Collimator mask status
-        sgh_collimator2human(&sgh_info, value, EXPOSED_STR_MAX);
-        snprintf(peso_header[PHDR_COLIMAT_E].value, PHDR_VALUE_MAX, "%s",
+    else {
+        // SGH-CPA - Correction plate 700
+        sgh_cplate2human(p_sgh_info->correction_plate_700, value, EXPOSED_STR_MAX);
+        snprintf(peso_header[PHDR_SGH_CPA_E].value, PHDR_VALUE_MAX, "%s",
                 value);
 
-        // SGH-MCO - Mirror Coude Oes
-        sgh_mco2human(&sgh_info, value, EXPOSED_STR_MAX);
-        snprintf(peso_header[PHDR_SGH_MCO_E].value, PHDR_VALUE_MAX, "%s",
+        // SGH-CPB - Correction plate 400
+        sgh_cplate2human(p_sgh_info->correction_plate_400, value, EXPOSED_STR_MAX);
+        snprintf(peso_header[PHDR_SGH_CPB_E].value, PHDR_VALUE_MAX, "%s",
                 value);
 
-        // SGH-MSC - Mirror Star Calibration
-        sgh_msc2human(&sgh_info, value, EXPOSED_STR_MAX);
-        snprintf(peso_header[PHDR_SGH_MSC_E].value, PHDR_VALUE_MAX, "%s",
+        // GRATANG
+        snprintf(peso_header[PHDR_GRATANG_E].value, PHDR_VALUE_MAX, "%4.2f",
+                sgh_gratpos2gratang(p_sgh_info->grating_position));
+
+        sgh_gratpos2gratang_str(p_sgh_info->grating_position, value,
+                EXPOSED_STR_MAX);
+        snprintf(peso_header[PHDR_GRATANG_E].comment, PHDR_COMMENT_MAX, "%s",
                 value);
 
-        if (!strcmp(exposed_cfg.instrument, "CCD700")) {
-            p_spectemp = &sgh_info.coude_temp;
-            p_camfocus = &sgh_info.focus_700;
-        }
-        else if (!strcmp(exposed_cfg.instrument, "CCD400")) {
-            p_spectemp = &sgh_info.coude_temp;
-            p_camfocus = &sgh_info.focus_1400;
-        }
-        else if (!strcmp(exposed_cfg.instrument, "OES")) {
-            p_spectemp = &sgh_info.oes_temp;
-            p_camfocus = &sgh_info.focus_oes;
-        }
+        // GRATPOS
+        snprintf(peso_header[PHDR_GRATPOS_E].value, PHDR_VALUE_MAX, "%i",
+                p_sgh_info->grating_position);
 
-        // SPECTEMP
-        if (p_spectemp != NULL)
-        {
-            spectemp_human = sgh_temp2human(*p_spectemp);
-            snprintf(peso_header[PHDR_SPECTEMP_E].value, PHDR_VALUE_MAX, "%.1f",
-                    spectemp_human);
-            snprintf(peso_header[PHDR_SPECTEMP_E].comment, PHDR_COMMENT_MAX, "%i",
-                    *p_spectemp);
-        }
+        // SPECFILT
+        snprintf(peso_header[PHDR_SPECFILT_E].value, PHDR_VALUE_MAX, "%i",
+                p_sgh_info->spectral_filter);
 
-        // CAMFOCUS
-        if (p_camfocus != NULL)
-        {
-            snprintf(peso_header[PHDR_CAMFOCUS_E].value, PHDR_VALUE_MAX, "%i",
-                    *p_camfocus);
-        }
+        // DICHMIR
+        snprintf(peso_header[PHDR_DICHMIR_E].value, PHDR_VALUE_MAX, "%i",
+                p_sgh_info->dichroic_mirror);
+    }
+
+    // COLIMAT - Collimator mask status
+    sgh_collimator2human(p_sgh_info, value, EXPOSED_STR_MAX);
+    snprintf(peso_header[PHDR_COLIMAT_E].value, PHDR_VALUE_MAX, "%s",
+            value);
+
+    // SGH-MCO - Mirror Coude Oes
+    sgh_mco2human(p_sgh_info, value, EXPOSED_STR_MAX);
+    snprintf(peso_header[PHDR_SGH_MCO_E].value, PHDR_VALUE_MAX, "%s",
+            value);
+
+    // SGH-MSC - Mirror Star Calibration
+    sgh_msc2human(p_sgh_info, value, EXPOSED_STR_MAX);
+    snprintf(peso_header[PHDR_SGH_MSC_E].value, PHDR_VALUE_MAX, "%s",
+            value);
+
+    if (!strcmp(exposed_cfg.instrument, "CCD700")) {
+        p_spectemp = &p_sgh_info->coude_temp;
+        p_camfocus = &p_sgh_info->focus_700;
+    }
+    else if (!strcmp(exposed_cfg.instrument, "CCD400")) {
+        p_spectemp = &p_sgh_info->coude_temp;
+        p_camfocus = &p_sgh_info->focus_1400;
+    }
+    else if (!strcmp(exposed_cfg.instrument, "OES")) {
+        p_spectemp = &p_sgh_info->oes_temp;
+        p_camfocus = &p_sgh_info->focus_oes;
+    }
+
+    // SPECTEMP
+    if (p_spectemp != NULL)
+    {
+        spectemp_human = sgh_temp2human(*p_spectemp);
+        snprintf(peso_header[PHDR_SPECTEMP_E].value, PHDR_VALUE_MAX, "%.1f",
+                spectemp_human);
+        snprintf(peso_header[PHDR_SPECTEMP_E].comment, PHDR_COMMENT_MAX, "%i",
+                *p_spectemp);
+    }
+
+    // CAMFOCUS
+    if (p_camfocus != NULL)
+    {
+        snprintf(peso_header[PHDR_CAMFOCUS_E].value, PHDR_VALUE_MAX, "%i",
+                *p_camfocus);
     }
 }
 
@@ -1227,6 +1260,64 @@ static void exposure_meter_end(void)
     expose_sgh_exe(answer, "SSPE %i", p_peso->expmeter_id);
 }
 
+/*
+ * Telescope and spectrograph state for FITS header is read while the shutter
+ * is already open, so that neither the exposure meter start nor the expose
+ * loop waits for telescoped/spectrographd round trips. tle_telescope_info()
+ * and sgh_spectrograph_info() have their own xmlrpc clients and error
+ * messages, so they don't collide with expose_sgh_exe().
+ */
+static void *fit_snapshot(void *p_arg)
+{
+    snapshot_tle_result = tle_telescope_info(&snapshot_tle_info);
+    snapshot_time = time(NULL);
+    snapshot_sgh_result = sgh_spectrograph_info(&snapshot_sgh_info);
+
+    return NULL;
+}
+
+static void fit_snapshot_start(void)
+{
+    if (pthread_create(&snapshot_pthread, NULL, fit_snapshot, NULL) != 0)
+    {
+        append_log(LOG4C_PRIORITY_WARN,
+                "Warning: pthread_create(): %i: %s", errno, strerror(errno));
+        fit_snapshot(NULL);
+        return;
+    }
+
+    snapshot_running = 1;
+}
+
+static void fit_snapshot_end(void)
+{
+    if (snapshot_running)
+    {
+        pthread_join(snapshot_pthread, NULL);
+        snapshot_running = 0;
+    }
+
+    if (snapshot_tle_result == -1)
+    {
+        append_log(LOG4C_PRIORITY_WARN, "Warning: tle_telescope_info(): %s",
+                tle_get_info_err_msg());
+    }
+    else
+    {
+        fit_save_tle_hdr(&snapshot_tle_info, snapshot_time);
+    }
+
+    if (snapshot_sgh_result == -1)
+    {
+        append_log(LOG4C_PRIORITY_WARN, "Warning: sgh_spectrograph_info(): %s",
+                sgh_get_info_err_msg());
+    }
+    else
+    {
+        fit_save_sgh_hdr(&snapshot_sgh_info);
+    }
+}
+
 static void fit_start_time(void)
 {
     struct tm *p_tm;
@@ -1277,9 +1368,8 @@ static void fit_start_time(void)
     snprintf(peso_header[PHDR_SYSVER_E].value, PHDR_VALUE_MAX, "PESO %s.%s",
             SVN_REV, mod_ccd.peso_get_version());
 
-    fit_save_tle_hdr();
-    fit_save_sgh_hdr();
     exposure_meter_start();
+    fit_snapshot_start();
 }
 
 static void fit_end_time(void)
@@ -1313,158 +1403,1059 @@ static void fit_end_time(void)
             p_peso->actual_temp);
 }
 
-static int save_image(void)
+static void log_fits_header(PESO_HEADER_T *p_header)
 {
     int i;
-    int fits_status = 0;
-    fitsfile *p_fits;
 
     log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "BEGIN header");
 
     for (i = 0; i < PHDR_INDEX_MAX_E; ++i)
     {
-        if (peso_header[i].value[0] == '\0')
+        if (p_header[i].value[0] == '\0')
         {
             continue;
         }
 
         log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "    %s = %s / %s",
-                peso_header[i].key, peso_header[i].value,
-                peso_header[i].comment);
+                p_header[i].key, p_header[i].value, p_header[i].comment);
     }
 
     log4c_category_log(p_logcat, LOG4C_PRIORITY_INFO, "END header");
+}
 
-    if (mod_ccd.save_raw_image() == -1)
+static void save_image_finish(char *p_fits_file, int archive)
+{
+    chown(p_fits_file, exposed_cfg.uid, exposed_cfg.gid);
+    append_log(LOG4C_PRIORITY_INFO, "save fits file %s success", p_fits_file);
+
+    if (archive)
     {
-        save_sys_error(LOG4C_PRIORITY_WARN, "Warning: save_raw_image():");
+        char archive_cmd[EXPOSED_STR_MAX + 1];
+
+        snprintf(archive_cmd, EXPOSED_STR_MAX, "%s %s",
+                exposed_cfg.archive_script, p_fits_file);
+        append_log(LOG4C_PRIORITY_INFO, "execute archive script %s",
+                archive_cmd);
+        system(archive_cmd);
     }
-    else
+}
+
+/* p_prefixNNNN.fit => p_prefixNNNN.tmp, see fce_make_filename() */
+static void save_tmp_name(char *p_fits_file, char *p_tmp_file)
+{
+    int len;
+
+    strncpy(p_tmp_file, p_fits_file, PESO_PATH_MAX);
+    p_tmp_file[PESO_PATH_MAX] = '\0';
+
+    if ((len = strlen(p_tmp_file)) >= 3)
     {
-        append_log(LOG4C_PRIORITY_INFO, "save raw image %s success",
-                p_peso->raw_image);
+        strcpy(p_tmp_file + len - 3, FCE_TMP_SUFFIX);
     }
+}
+
+/*
+ * Whole header block of p_fhdr is written with one write() over empty file
+ * created by fce_make_filename(), CFITSIO opens it and appends data unit only.
+ * Cards changed since previous frame are serialized again, the rest is taken
+ * from p_fhdr as it is. Each thread has its own p_fhdr.
+ */
+static int save_fits_create(fitsfile **pp_fits, char *p_tmp_file,
+        FHDR_T *p_fhdr, PESO_HEADER_T *p_header, int naxis, long *p_naxes)
+{
+    int fd;
+    int fits_status = 0;
 
-    if (fits_create_file(&p_fits, p_peso->fits_file, &fits_status))
+    if (fhdr_update(p_fhdr, p_header, naxis, p_naxes) == -1)
     {
-        save_fits_error(fits_status, "Error: fits_create_file(%s):",
-                p_peso->fits_file);
+        append_log(LOG4C_PRIORITY_ERROR,
+                "Error: fhdr_update(): more than %i header cards",
+                FHDR_CARDS_MAX);
         return -1;
     }
 
-    if (save_fits_header(p_fits) == -1)
+    if ((fd = open(p_tmp_file, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
     {
-        fits_close_file(p_fits, &fits_status);
+        save_sys_error(LOG4C_PRIORITY_ERROR, "Error: open(%s):", p_tmp_file);
         return -1;
     }
 
-    if (mod_ccd.save_fits_file(p_fits, &fits_status) == -1)
+    if (fhdr_write(p_fhdr, fd) == -1)
     {
-        save_fits_error(fits_status, "Error: save_fits_file():");
-        fits_close_file(p_fits, &fits_status);
+        save_sys_error(LOG4C_PRIORITY_ERROR, "Error: fhdr_write(%s):",
+                p_tmp_file);
+        close(fd);
         return -1;
     }
 
-    if (fits_write_chksum(p_fits, &fits_status))
+    if (close(fd) == -1)
     {
-        save_fits_error(fits_status, "Error: fits_write_chksum():");
-        fits_close_file(p_fits, &fits_status);
+        save_sys_error(LOG4C_PRIORITY_ERROR, "Error: close(%s):", p_tmp_file);
         return -1;
     }
 
-    if (fits_close_file(p_fits, &fits_status))
+    if (fits_open_file(pp_fits, p_tmp_file, READWRITE, &fits_status))
+    {
+        save_fits_error(fits_status, "Error: fits_open_file(%s):",
+                p_tmp_file);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Temporary file must be on disk before rename(), otherwise crash could
+ * leave final name with incomplete content. Incomplete temporary file can be
+ * recovered by restore_tmp_fits.
+ */
+static int save_fits_commit(char *p_tmp_file, char *p_fits_file)
+{
+    int fd;
+    char dir[PESO_PATH_MAX + 1];
+
+    if ((fd = open(p_tmp_file, O_RDONLY)) == -1)
+    {
+        save_sys_error(LOG4C_PRIORITY_ERROR, "Error: open(%s):", p_tmp_file);
+        return -1;
+    }
+
+    if (fsync(fd) == -1)
+    {
+        save_sys_error(LOG4C_PRIORITY_ERROR, "Error: fsync(%s):", p_tmp_file);
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+
+    if (rename(p_tmp_file, p_fits_file) == -1)
+    {
+        save_sys_error(LOG4C_PRIORITY_ERROR, "Error: rename(%s, %s):",
+                p_tmp_file, p_fits_file);
+        return -1;
+    }
+
+    /* directory entry */
+    strncpy(dir, p_fits_file, PESO_PATH_MAX);
+    dir[PESO_PATH_MAX] = '\0';
+
+    if ((fd = open(dirname(dir), O_RDONLY)) != -1)
+    {
+        fsync(fd);
+        close(fd);
+    }
+
+    return 0;
+}
+
+/* create temporary FITS file and write header of current exposure */
+static int save_image_begin(fitsfile **pp_fits, char *p_tmp_file)
+{
+    long naxes[2] = { exposed_cfg.ccd.x2, exposed_cfg.ccd.y2 };
+
+    log_fits_header(peso_header);
+
+    save_tmp_name(p_peso->fits_file, p_tmp_file);
+
+    return save_fits_create(pp_fits, p_tmp_file, &expose_fhdr, peso_header, 2,
+            naxes);
+}
+
+/* pixels are written, close temporary file, commit and archive it */
+static int save_fits_close(fitsfile *p_fits, char *p_tmp_file,
+        char *p_fits_file, int archive)
+{
+    int fits_status = 0;
+
+    if (fits_write_chksum(p_fits, &fits_status))
+    {
+        save_fits_error(fits_status, "Error: fits_write_chksum():");
+        fits_close_file(p_fits, &fits_status);
+        return -1;
+    }
+
+    if (fits_close_file(p_fits, &fits_status))
     {
         save_fits_error(fits_status, "Error: fits_close_file():");
         return -1;
     }
 
-    chown(p_peso->fits_file, exposed_cfg.uid, exposed_cfg.gid);
-    append_log(LOG4C_PRIORITY_INFO, "save fits file %s success",
-            p_peso->fits_file);
+    if (save_fits_commit(p_tmp_file, p_fits_file) == -1)
+    {
+        return -1;
+    }
+
+    save_image_finish(p_fits_file, archive);
+
+    return 0;
+}
+
+/* debug only, FITS file is written directly */
+static void save_raw_image(void)
+{
+    if (!exposed_cfg.save_raw)
+    {
+        return;
+    }
 
-    if (remove(p_peso->raw_image) == -1)
+    if (mod_ccd.save_raw_image() == -1)
     {
-        save_sys_error(LOG4C_PRIORITY_WARN,
-                "Warning: remove raw image %s failed:", p_peso->raw_image);
+        save_sys_error(LOG4C_PRIORITY_WARN, "Warning: save_raw_image():");
     }
     else
     {
-        append_log(LOG4C_PRIORITY_INFO, "remove raw image %s",
+        append_log(LOG4C_PRIORITY_INFO, "save raw image %s success",
                 p_peso->raw_image);
     }
+}
+
+/* synchronous save, used for modules without ccd_frame_acquire() */
+static int save_image(void)
+{
+    int fits_status = 0;
+    char tmp_file[PESO_PATH_MAX + 1];
+    fitsfile *p_fits;
+
+    if (save_image_begin(&p_fits, tmp_file) == -1)
+    {
+        return -1;
+    }
+
+    if (mod_ccd.save_fits_file(p_fits, &fits_status) == -1)
+    {
+        save_fits_error(fits_status, "Error: save_fits_file():");
+        fits_close_file(p_fits, &fits_status);
+        return -1;
+    }
+
+    save_raw_image();
+
+    return save_fits_close(p_fits, tmp_file, p_peso->fits_file,
+            p_peso->archive);
+}
+
+/*
+ * Append rows read out so far. On error the file is dropped and *pp_fits
+ * set to NULL, the image is then saved the usual way after readout.
+ */
+static void save_image_rows(fitsfile **pp_fits, char *p_tmp_file,
+        long *p_written, IST_T *p_stats)
+{
+    int fits_status = 0;
+
+    if (mod_ccd.save_fits_rows(*pp_fits, p_written, p_stats, &fits_status)
+            == -1)
+    {
+        save_fits_error(fits_status, "Error: save_fits_rows(%li):",
+                *p_written);
+        fits_status = 0;
+        fits_close_file(*pp_fits, &fits_status);
+        remove(p_tmp_file);
+        *pp_fits = NULL;
+    }
+}
+
+/*
+ * Fill DATAMIN and DATAMAX of p_header and keep statistics of last saved
+ * frame as quicklook values, see "get STATS".
+ */
+static void save_stats(PESO_HEADER_T *p_header, IST_T *p_stats)
+{
+    snprintf(p_header[PHDR_DATAMIN_E].value, PHDR_VALUE_MAX, "%u",
+            p_stats->min);
+    snprintf(p_header[PHDR_DATAMAX_E].value, PHDR_VALUE_MAX, "%u",
+            p_stats->max);
+
+    append_log(LOG4C_PRIORITY_INFO, "statistics: min = %u, max = %u, "
+            "mean = %.2f, stddev = %.2f, saturated = %llu", p_stats->min,
+            p_stats->max, ist_mean(p_stats), ist_stddev(p_stats),
+            p_stats->saturated);
+
+    /* LOCK */
+    pthr_mutex_lock(&global_mutex);
+
+    quicklook_stats = *p_stats;
+    quicklook_stats.p_hist = NULL;
+    quicklook_valid = 1;
+
+    pthr_mutex_unlock(&global_mutex);
+    /* UNLOCK */
+}
+
+static int save_frame_raw_image(EXPOSED_FRAME_T *p_frame)
+{
+    FILE *fw;
+
+    if ((fw = fopen(p_frame->raw_image, "w")) == NULL)
+    {
+        return -1;
+    }
+
+    if (fwrite(p_frame->p_lease->p_data, sizeof(unsigned short),
+            p_frame->p_lease->nelements, fw) != p_frame->p_lease->nelements)
+    {
+        fclose(fw);
+        return -1;
+    }
+
+    if (fclose(fw) == EOF)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* called from save_loop() only, pixels are written from module buffer */
+static int save_frame(EXPOSED_FRAME_T *p_frame)
+{
+    int fits_status = 0;
+    long fpixel = 1;
+    char tmp_file[PESO_PATH_MAX + 1];
+    fitsfile *p_fits;
+    IST_T stats;
+
+    ist_init(&stats, IST_SATURATION, NULL);
+    ist_add(&stats, p_frame->p_lease->p_data, p_frame->p_lease->nelements);
+    save_stats(p_frame->header, &stats);
+
+    log_fits_header(p_frame->header);
+
+    /* debug only, FITS file is written directly */
+    if (exposed_cfg.save_raw)
+    {
+        if (save_frame_raw_image(p_frame) == -1)
+        {
+            save_sys_error(LOG4C_PRIORITY_WARN, "Warning: save raw image %s:",
+                    p_frame->raw_image);
+        }
+        else
+        {
+            append_log(LOG4C_PRIORITY_INFO, "save raw image %s success",
+                    p_frame->raw_image);
+        }
+    }
+
+    save_tmp_name(p_frame->fits_file, tmp_file);
+
+    if (save_fits_create(&p_fits, tmp_file, &save_fhdr, p_frame->header, 2,
+            p_frame->naxes) == -1)
+    {
+        /* file has no header, nothing to restore */
+        remove(tmp_file);
+        return -1;
+    }
+
+    if (fits_write_img(p_fits, TUSHORT, fpixel, p_frame->p_lease->nelements,
+            p_frame->p_lease->p_data, &fits_status))
+    {
+        save_fits_error(fits_status, "Error: fits_write_img():");
+        fits_close_file(p_fits, &fits_status);
+        return -1;
+    }
+
+    return save_fits_close(p_fits, tmp_file, p_frame->fits_file,
+            p_frame->archive);
+}
+
+/*
+ * Called from save_loop() only, rows of p_frame->p_fits were written during
+ * readout. Header has placeholders of DATAMIN and DATAMAX, they are rewritten
+ * in place.
+ */
+static int save_frame_finish(EXPOSED_FRAME_T *p_frame)
+{
+    int fits_status = 0;
+    char tmp_file[PESO_PATH_MAX + 1];
+
+    save_tmp_name(p_frame->fits_file, tmp_file);
+
+    if ((fhdr_rewrite_card(&p_frame->header[PHDR_DATAMIN_E], p_frame->p_fits,
+            &fits_status) == -1) || (fhdr_rewrite_card(
+            &p_frame->header[PHDR_DATAMAX_E], p_frame->p_fits, &fits_status)
+            == -1))
+    {
+        save_fits_error(fits_status, "Error: fhdr_rewrite_card():");
+        fits_status = 0;
+        fits_close_file(p_frame->p_fits, &fits_status);
+        remove(tmp_file);
+        return -1;
+    }
+
+    return save_fits_close(p_frame->p_fits, tmp_file, p_frame->fits_file,
+            p_frame->archive);
+}
+
+/* return buffer to module, it may be used for next readout */
+static void save_frame_free(EXPOSED_FRAME_T *p_frame)
+{
+    if (p_frame->p_lease == NULL)
+    {
+        /* p_fits is closed by save_frame_finish() */
+    }
+    else if (p_frame->p_lease == &p_frame->copy)
+    {
+        free(p_frame->copy.p_data);
+    }
+    else
+    {
+        mod_ccd.frame_release(p_frame->p_lease);
+    }
+
+    free(p_frame);
+}
+
+/* blocks while save queue is full */
+static void save_queue_push(EXPOSED_FRAME_T *p_frame)
+{
+    /* LOCK */
+    pthr_mutex_lock(&save_mutex);
+
+    while (save_queue_count >= EXPOSED_SAVE_QUEUE_MAX)
+    {
+        pthread_cond_wait(&save_cond, &save_mutex);
+    }
+
+    save_queue[(save_queue_head + save_queue_count) % EXPOSED_SAVE_QUEUE_MAX] =
+            p_frame;
+    ++save_queue_count;
+    ++save_pending;
+    pthread_cond_broadcast(&save_cond);
+
+    pthr_mutex_unlock(&save_mutex);
+    /* UNLOCK */
+}
+
+/* waits until writer thread saves all queued frames */
+static void save_queue_drain(void)
+{
+    /* LOCK */
+    pthr_mutex_lock(&save_mutex);
+
+    while (save_pending > 0)
+    {
+        pthread_cond_wait(&save_cond, &save_mutex);
+    }
+
+    pthr_mutex_unlock(&save_mutex);
+    /* UNLOCK */
+}
+
+static void *save_loop(void *arg)
+{
+    EXPOSED_FRAME_T *p_frame;
+    struct timespec ts;
+
+    while (!exposed_exit)
+    {
+        /* LOCK */
+        pthr_mutex_lock(&save_mutex);
+
+        if (save_queue_count == 0)
+        {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += 1;
+            pthread_cond_timedwait(&save_cond, &save_mutex, &ts);
+        }
+
+        if (save_queue_count == 0)
+        {
+            pthr_mutex_unlock(&save_mutex);
+            /* UNLOCK */
+            continue;
+        }
+
+        p_frame = save_queue[save_queue_head];
+        save_queue_head = (save_queue_head + 1) % EXPOSED_SAVE_QUEUE_MAX;
+        --save_queue_count;
+        pthread_cond_broadcast(&save_cond);
+
+        pthr_mutex_unlock(&save_mutex);
+        /* UNLOCK */
+
+        if (((p_frame->p_fits != NULL) ? save_frame_finish(p_frame)
+                : save_frame(p_frame)) == -1)
+        {
+            /* TODO: report to client */
+        }
+
+        save_frame_free(p_frame);
+
+        /* LOCK */
+        pthr_mutex_lock(&save_mutex);
+
+        --save_pending;
+        pthread_cond_broadcast(&save_cond);
+
+        pthr_mutex_unlock(&save_mutex);
+        /* UNLOCK */
+    }
+
+    pthread_exit(0);
+    return NULL;
+}
+
+/* FITS header and file name of current exposure for writer thread */
+static void save_frame_snapshot(EXPOSED_FRAME_T *p_frame)
+{
+    /* LOCK */
+    pthr_mutex_lock(&global_mutex);
+
+    memcpy(p_frame->header, peso_header, sizeof(p_frame->header));
+    strncpy(p_frame->fits_file, p_peso->fits_file, PESO_PATH_MAX);
+    strncpy(p_frame->raw_image, p_peso->raw_image, PESO_PATH_MAX);
+    p_frame->fits_file[PESO_PATH_MAX] = '\0';
+    p_frame->raw_image[PESO_PATH_MAX] = '\0';
+    p_frame->archive = p_peso->archive;
+
+    pthr_mutex_unlock(&global_mutex);
+    /* UNLOCK */
+}
+
+/*
+ * Lease finished frame from module and pass it together with snapshot of
+ * FITS header to writer thread, so next exposure may start while this one is
+ * being saved. Pixels are not copied, writer returns the buffer to module.
+ */
+static int save_image_async(void)
+{
+    PESO_FRAME_T *p_lease;
+    EXPOSED_FRAME_T *p_frame;
+
+    if ((p_frame = (EXPOSED_FRAME_T *) malloc(sizeof(EXPOSED_FRAME_T)))
+            == NULL)
+    {
+        save_sys_error(LOG4C_PRIORITY_ERROR, "Error: malloc():");
+        return -1;
+    }
+
+    if (mod_ccd.frame_acquire(&p_lease) == -1)
+    {
+        append_log(LOG4C_PRIORITY_ERROR, "Error: mod_ccd.frame_acquire(): %s",
+                p_peso->msg);
+        free(p_frame);
+        return -1;
+    }
+
+    p_frame->p_lease = p_lease;
+    p_frame->p_fits = NULL;
+    p_frame->naxes[0] = exposed_cfg.ccd.x2;
+    p_frame->naxes[1] = exposed_cfg.ccd.y2;
+
+    save_frame_snapshot(p_frame);
+    save_queue_push(p_frame);
+
+    return 0;
+}
+
+/*
+ * All rows are written, pass open file to writer thread which rewrites
+ * DATAMIN and DATAMAX, writes checksum, commits and archives the file. Next
+ * exposure does not wait for fsync() and archive script.
+ */
+static int save_image_rows_end(fitsfile *p_fits, char *p_tmp_file,
+        IST_T *p_stats)
+{
+    int fits_status = 0;
+    EXPOSED_FRAME_T *p_frame;
+
+    save_stats(peso_header, p_stats);
+    save_raw_image();
+
+    if ((p_frame = (EXPOSED_FRAME_T *) malloc(sizeof(EXPOSED_FRAME_T)))
+            == NULL)
+    {
+        save_sys_error(LOG4C_PRIORITY_ERROR, "Error: malloc():");
+        fits_close_file(p_fits, &fits_status);
+        remove(p_tmp_file);
+        return -1;
+    }
+
+    p_frame->p_lease = NULL;
+    p_frame->p_fits = p_fits;
+
+    save_frame_snapshot(p_frame);
+    save_queue_push(p_frame);
+
+    return 0;
+}
+
+static int is_exposure_meter_exit()
+{
+    int expmeter;
+    int expmeter_update;
+    char answer[SGH_ANSWER_MAX+1];
+    int expval;
+
+    /* LOCK */
+    pthr_mutex_lock(&global_mutex);
+
+    expmeter_update = p_peso->expmeter_update;
+
+    if (expmeter_update != 0) {
+        p_peso->expmeter = expmeter_update;
+        p_peso->expmeter_update = 0;
+    }
+
+    expmeter = p_peso->expmeter;
+
+    pthr_mutex_unlock(&global_mutex);
+    /* UNLOCK */
+
+    /* exposure meter off */
+    if (expmeter == -1) {
+        return 0; // false
+    }
+
+    /* exposure meter count of pulses */
+    if (expose_sgh_exe(answer, "SPCE %i", p_peso->expmeter_id) != -1) {
+        expval = atoi(answer);
+
+        if (expval >= expmeter) {
+            append_log(LOG4C_PRIORITY_INFO,
+                    "actual expval = %i, required expval = %i", expval,
+                    expmeter);
+            return 1; // true
+        }
+    }
+
+    return 0; // false
+}
+
+static void expose()
+{
+    int i;
+    int result = 0;
+    long interval;
+    time_t temp_time;
+    time_t actual_time;
+    long written;
+    char prefix[PREFIX_MAX + 1];
+    char tmp_file[PESO_PATH_MAX + 1];
+    fitsfile *p_fits;
+    IST_T stats;
+
+    /* LOCK */
+    pthr_mutex_lock(&global_mutex);
+
+    p_peso->addtime = 0;
+    p_peso->expmeter_update = 0;
+    p_peso->exptime_update = 0;
+    p_peso->abort = 0;
+    p_peso->readout = 0;
+    p_peso->elapsed_time = 0;
+
+    pthr_mutex_unlock(&global_mutex);
+    /* UNLOCK */
+
+    if (fce_make_fits_prefix(exposed_cfg.instrument_prefix[0], prefix,
+            PREFIX_MAX))
+    {
+        p_peso->state = CCD_STATE_READY_E;
+        // TODO
+        return;
+    }
+
+    /* preparing expose */
+    if (p_cmd_begin != NULL)
+    {
+        system(p_cmd_begin);
+    }
+    // TODO
+    //if (system(p_cmd_begin) == -1) {
+    //    // implementovat
+    //}
+
+    for (i = 0; i < p_peso->expcount; ++i)
+    {
+        /* LOCK */
+        pthr_mutex_lock(&global_mutex);
+
+        if ((result = fce_make_filename(p_peso->path, prefix, p_peso->fits_file,
+                PESO_PATH_MAX)) != -1)
+        {
+            p_peso->expnum = i + 1;
+        }
+
+        pthr_mutex_unlock(&global_mutex);
+        /* UNLOCK */
+
+        if (result == -1)
+        {
+            save_sys_error(LOG4C_PRIORITY_ERROR,
+                    "Error: fce_make_filename(%s, %s):", p_peso->path, prefix);
+            break;
+        }
+
+        strcpy(p_peso->raw_image, p_peso->fits_file);
+        strcat(p_peso->raw_image, "raw");
+        strcat(p_peso->fits_file, "fit");
+
+        /* SETKEY FILENAME */
+        memset(peso_header[PHDR_FILENAME_E].value, 0, PHDR_VALUE_MAX + 1);
+        strncpy(peso_header[PHDR_FILENAME_E].value, basename(p_peso->fits_file),
+                PHDR_VALUE_MAX);
+
+        if ((result = mod_ccd.expose_init()) == -1)
+        {
+            /* empty file created by fce_make_filename() */
+            save_tmp_name(p_peso->fits_file, tmp_file);
+            remove(tmp_file);
+            break;
+        }
+
+        if ((result = mod_ccd.expose_start()) == -1)
+        {
+            append_log(LOG4C_PRIORITY_ERROR,
+                    "Error: mod_ccd.expose_start(): %s", p_peso->msg);
+            save_tmp_name(p_peso->fits_file, tmp_file);
+            remove(tmp_file);
+            break;
+        }
+
+        fit_start_time();
+
+        /* exposing */
+        append_log(LOG4C_PRIORITY_INFO, "expose begin");
+        mod_ccd.peso_set_state(CCD_STATE_EXPOSE_E);
+        temp_time = 0;
+        while (mod_ccd.expose())
+        {
+            (void) time(&actual_time);
+
+            if ((actual_time - temp_time) >= EXPOSED_TEMP_PERIOD)
+            {
+                temp_time = actual_time;
+                if (mod_ccd.get_temp(&p_peso->actual_temp) == -1)
+                {
+                    append_log(LOG4C_PRIORITY_WARN,
+                            "Error: mod_ccd.get_temp(): %s", p_peso->msg);
+                }
+            }
+
+            if (is_exposure_meter_exit()) {
+                /* LOCK */
+                pthr_mutex_lock(&global_mutex);
+                p_peso->readout = 1;
+                pthr_mutex_unlock(&global_mutex);
+                /* UNLOCK */
+            }
+
+            interval = expose_poll_interval(p_peso->elapsed_time,
+                    p_peso->exptime, (p_peso->expmeter == -1)
+                            ? EXPOSED_POLL_MAX : EXPOSED_POLL_EXPMETER);
+            expose_event_wait(interval);
+        }
+        append_log(LOG4C_PRIORITY_INFO, "expose end");
+
+        fit_snapshot_end();
+
+        if (p_peso->abort <= 1)
+        {
+            fit_end_time();
+
+            if ((result = mod_ccd.expose_end()) == -1)
+            {
+                append_log(LOG4C_PRIORITY_WARN, "Warning: expose_end(): %s",
+                        p_peso->msg);
+            }
+
+            /* header is complete, rows are written while reading out */
+            p_fits = NULL;
+            written = 0;
+            if (mod_ccd.save_fits_rows != NULL)
+            {
+                ist_init(&stats, IST_SATURATION, NULL);
+                strcpy(peso_header[PHDR_DATAMIN_E].value, "0");
+                strcpy(peso_header[PHDR_DATAMAX_E].value, "0");
+
+                if (save_image_begin(&p_fits, tmp_file) == -1)
+                {
+                    p_fits = NULL;
+                }
+            }
+
+            /* reading out */
+            append_log(LOG4C_PRIORITY_INFO, "readout begin");
+            mod_ccd.peso_set_int(&p_peso->elapsed_time, 0);
+            mod_ccd.peso_set_state(CCD_STATE_READOUT_E);
+            while (mod_ccd.readout())
+            {
+                if (p_fits != NULL)
+                {
+                    save_image_rows(&p_fits, tmp_file, &written, &stats);
+                }
+
+                if (mod_ccd.readout_notify != NULL)
+                {
+                    /* module wakes us up, timeout is only a safety net */
+                    expose_event_wait(EXPOSED_POLL_MAX);
+                }
+                else
+                {
+                    expose_event_wait(expose_poll_interval(
+                            p_peso->elapsed_time, p_peso->readout_time,
+                            EXPOSED_POLL_READOUT));
+                }
+            }
+            append_log(LOG4C_PRIORITY_INFO, "readout end");
+
+            if (p_fits != NULL)
+            {
+                save_image_rows(&p_fits, tmp_file, &written, &stats);
+            }
+
+            if (p_fits != NULL)
+            {
+                if (save_image_rows_end(p_fits, tmp_file, &stats) == -1)
+                {
+                    /* TODO: report to client */
+                }
+            }
+            else if (mod_ccd.frame_acquire != NULL)
+            {
+                if (save_image_async() == -1)
+                {
+                    /* TODO: report to client */
+                }
+            }
+            else if (save_image() == -1)
+            {
+                /* TODO: report to client */
+            }
+        }
+        else
+        {
+            /* empty file created by fce_make_filename() */
+            save_tmp_name(p_peso->fits_file, tmp_file);
+            remove(tmp_file);
+        }
+
+        if ((result = mod_ccd.expose_uninit()) == -1)
+        {
+            append_log(LOG4C_PRIORITY_ERROR, "Error: expose_uninit(): %s",
+                    p_peso->msg);
+            break;
+        }
+
+        if ((p_peso->abort == 2) || (p_peso->readout))
+        {
+            break;
+        }
+    }
+
+    /* finishing expose */
+    mod_ccd.peso_set_state(CCD_STATE_FINISH_EXPOSE_E);
+    if (p_cmd_end != NULL)
+    {
+        system(p_cmd_end);
+    }
+
+    save_queue_drain();
+
+    /* CCD is ready */
+    mod_ccd.peso_set_state(CCD_STATE_READY_E);
+}
+
+/* p_prefixNNNN.fit and p_prefixNNNN.raw, FILENAME is set in peso_header */
+static int cont_make_filename(char *p_prefix, char *p_fits_file,
+        char *p_raw_image)
+{
+    int result;
+    char name[PESO_PATH_MAX + 1];
+
+    /* LOCK */
+    pthr_mutex_lock(&global_mutex);
+
+    result = fce_make_filename(p_peso->path, p_prefix, name, PESO_PATH_MAX - 3);
+
+    pthr_mutex_unlock(&global_mutex);
+    /* UNLOCK */
+
+    if (result == -1)
+    {
+        save_sys_error(LOG4C_PRIORITY_ERROR,
+                "Error: fce_make_filename(%s, %s):", p_peso->path, p_prefix);
+        return -1;
+    }
+
+    snprintf(p_fits_file, PESO_PATH_MAX + 1, "%sfit", name);
+    snprintf(p_raw_image, PESO_PATH_MAX + 1, "%sraw", name);
+
+    /* SETKEY FILENAME */
+    memset(peso_header[PHDR_FILENAME_E].value, 0, PHDR_VALUE_MAX + 1);
+    strncpy(peso_header[PHDR_FILENAME_E].value, basename(p_fits_file),
+            PHDR_VALUE_MAX);
+
+    return 0;
+}
+
+/* EXPTIME and DARKTIME of one frame in whole seconds */
+static void cont_fit_exptime(void)
+{
+    snprintf(peso_header[PHDR_EXPTIME_E].value, PHDR_VALUE_MAX, "%i",
+            (cont_exptime + 500) / 1000);
+    strncpy(peso_header[PHDR_DARKTIME_E].value,
+            peso_header[PHDR_EXPTIME_E].value, PHDR_VALUE_MAX);
+}
+
+/*
+ * Copy frame out of module ring buffer slot, the slot must be released
+ * before the frame is saved.
+ */
+static EXPOSED_FRAME_T *cont_copy_frame(PESO_FRAME_T *p_slot, long *p_naxes)
+{
+    EXPOSED_FRAME_T *p_frame;
+
+    if ((p_frame = (EXPOSED_FRAME_T *) malloc(sizeof(EXPOSED_FRAME_T)))
+            == NULL)
+    {
+        save_sys_error(LOG4C_PRIORITY_ERROR, "Error: malloc():");
+        return NULL;
+    }
+
+    if ((p_frame->copy.p_data = (unsigned short *) malloc(
+            p_slot->nelements * sizeof(unsigned short))) == NULL)
+    {
+        save_sys_error(LOG4C_PRIORITY_ERROR, "Error: malloc():");
+        free(p_frame);
+        return NULL;
+    }
+
+    memcpy(p_frame->copy.p_data, p_slot->p_data,
+            p_slot->nelements * sizeof(unsigned short));
+    p_frame->copy.id = p_slot->id;
+    p_frame->copy.state = PESO_FRAME_LEASED_E;
+    p_frame->copy.nelements = p_slot->nelements;
+    p_frame->p_lease = &p_frame->copy;
+    p_frame->p_fits = NULL;
+    p_frame->naxes[0] = p_naxes[0];
+    p_frame->naxes[1] = p_naxes[1];
+
+    return p_frame;
+}
+
+/* one file per frame, saved by writer thread */
+static int cont_push_frame(EXPOSED_FRAME_T *p_frame, char *p_prefix)
+{
+    if (cont_make_filename(p_prefix, p_frame->fits_file, p_frame->raw_image)
+            == -1)
+    {
+        save_frame_free(p_frame);
+        return -1;
+    }
+
+    /* LOCK */
+    pthr_mutex_lock(&global_mutex);
+
+    memcpy(p_frame->header, peso_header, sizeof(p_frame->header));
+    strcpy(p_peso->fits_file, p_frame->fits_file);
+    p_frame->archive = p_peso->archive;
+
+    pthr_mutex_unlock(&global_mutex);
+    /* UNLOCK */
+
+    /* blocks while writer is behind, module detects ring buffer overrun */
+    save_queue_push(p_frame);
+
+    return 0;
+}
+
+/* frames are written directly from module ring buffer slot */
+static int cont_write_cube(fitsfile *p_fits, PESO_FRAME_T *p_slot, int frame)
+{
+    int fits_status = 0;
 
-    if (p_peso->archive)
+    if (fits_write_img(p_fits, TUSHORT, 1 + (long long) frame * p_slot->nelements,
+            p_slot->nelements, p_slot->p_data, &fits_status))
     {
-        char archive_cmd[EXPOSED_STR_MAX + 1];
-
-        snprintf(archive_cmd, EXPOSED_STR_MAX, "%s %s",
-                exposed_cfg.archive_script, p_peso->fits_file);
-        append_log(LOG4C_PRIORITY_INFO, "execute archive script %s",
-                archive_cmd);
-        system(archive_cmd);
+        save_fits_error(fits_status, "Error: fits_write_img(%i):", frame);
+        return -1;
     }
 
     return 0;
 }
 
-static int is_exposure_meter_exit()
+static void cont_close_cube(fitsfile *p_fits, char *p_tmp_file, long *p_naxes,
+        int frames)
 {
-    int expmeter;
-    int expmeter_update;
-    char answer[SGH_ANSWER_MAX+1];
-    int expval;
+    int fits_status = 0;
 
-    /* LOCK */
-    pthr_mutex_lock(&global_mutex);
+    if ((frames == 0) || (p_peso->abort != 0))
+    {
+        fits_close_file(p_fits, &fits_status);
+        remove(p_tmp_file);
+        return;
+    }
 
-    expmeter_update = p_peso->expmeter_update;
+    if (frames < p_naxes[2])
+    {
+        p_naxes[2] = frames;
 
-    if (expmeter_update != 0) {
-        p_peso->expmeter = expmeter_update;
-        p_peso->expmeter_update = 0;
+        if (fits_resize_img(p_fits, USHORT_IMG, 3, p_naxes, &fits_status))
+        {
+            save_fits_error(fits_status, "Error: fits_resize_img(%i):", frames);
+            fits_close_file(p_fits, &fits_status);
+            return;
+        }
     }
 
-    expmeter = p_peso->expmeter;
-
-    pthr_mutex_unlock(&global_mutex);
-    /* UNLOCK */
+    /* TM_END, EXPVAL, CCDTEMP etc. are known after last frame */
+    if (fhdr_rewrite(&expose_fhdr, peso_header, p_fits, &fits_status) == -1)
+    {
+        save_fits_error(fits_status, "Error: fhdr_rewrite():");
+        fits_close_file(p_fits, &fits_status);
+        return;
+    }
 
-    /* exposure meter off */
-    if (expmeter == -1) {
-        return 0; // false
+    if (fits_write_chksum(p_fits, &fits_status))
+    {
+        save_fits_error(fits_status, "Error: fits_write_chksum():");
+        fits_close_file(p_fits, &fits_status);
+        return;
     }
 
-    /* exposure meter count of pulses */
-    if (expose_sgh_exe(answer, "SPCE %i", p_peso->expmeter_id) != -1) {
-        expval = atoi(answer);
+    if (fits_close_file(p_fits, &fits_status))
+    {
+        save_fits_error(fits_status, "Error: fits_close_file():");
+        return;
+    }
 
-        if (expval >= expmeter) {
-            append_log(LOG4C_PRIORITY_INFO,
-                    "actual expval = %i, required expval = %i", expval,
-                    expmeter);
-            return 1; // true
-        }
+    if (save_fits_commit(p_tmp_file, p_peso->fits_file) == -1)
+    {
+        return;
     }
 
-    return 0; // false
+    save_image_finish(p_peso->fits_file, p_peso->archive);
 }
 
-static void expose()
+/*
+ * Continuous readout of cont_frames frames. Module reads frames into ring
+ * buffer, this thread copies each completed slot out, either into FITS
+ * cube or into one file per frame saved by writer thread.
+ */
+static void expose_continuous(void)
 {
-    int i;
     int result = 0;
-    float second;
+    int frames = 0;
+    long naxes[3] = { exposed_cfg.ccd.x2, exposed_cfg.ccd.y2, cont_frames };
     char prefix[PREFIX_MAX + 1];
+    char tmp_file[PESO_PATH_MAX + 1];
+    fitsfile *p_fits = NULL;
+    PESO_FRAME_T *p_slot;
+    EXPOSED_FRAME_T *p_frame = NULL;
 
     /* LOCK */
     pthr_mutex_lock(&global_mutex);
 
-    p_peso->addtime = 0;
     p_peso->expmeter_update = 0;
     p_peso->exptime_update = 0;
     p_peso->abort = 0;
     p_peso->readout = 0;
     p_peso->elapsed_time = 0;
+    p_peso->expcount = cont_frames;
+    p_peso->expnum = 0;
 
     pthr_mutex_unlock(&global_mutex);
     /* UNLOCK */
@@ -1473,137 +2464,139 @@ static void expose()
             PREFIX_MAX))
     {
         p_peso->state = CCD_STATE_READY_E;
-        // TODO
         return;
     }
 
-    /* preparing expose */
     if (p_cmd_begin != NULL)
     {
         system(p_cmd_begin);
     }
-    // TODO
-    //if (system(p_cmd_begin) == -1) {
-    //    // implementovat
-    //}
 
-    for (i = 0; i < p_peso->expcount; ++i)
+    if (mod_ccd.expose_init() == -1)
     {
-        /* LOCK */
-        pthr_mutex_lock(&global_mutex);
+        append_log(LOG4C_PRIORITY_ERROR, "Error: mod_ccd.expose_init(): %s",
+                p_peso->msg);
+        goto finish;
+    }
 
-        if ((result = fce_make_filename(p_peso->path, prefix, p_peso->fits_file,
-                PESO_PATH_MAX)) == -1)
-        {
-            save_sys_error(LOG4C_PRIORITY_ERROR,
-                    "Error: fce_make_filename(%s, %s, %s, %i):", p_peso->path,
-                    prefix, p_peso->fits_file, PESO_PATH_MAX);
-            break;
-        }
+    if (cont_cube && (cont_make_filename(prefix, p_peso->fits_file,
+            p_peso->raw_image) == -1))
+    {
+        goto uninit;
+    }
 
-        p_peso->expnum = i + 1;
+    /* header of all frames is taken before the first one */
+    fit_start_time();
+    fit_snapshot_end();
+    cont_fit_exptime();
 
-        pthr_mutex_unlock(&global_mutex);
-        /* UNLOCK */
+    if (cont_cube)
+    {
+        save_tmp_name(p_peso->fits_file, tmp_file);
+        log_fits_header(peso_header);
 
-        strcpy(p_peso->raw_image, p_peso->fits_file);
-        strcat(p_peso->raw_image, "raw");
-        strcat(p_peso->fits_file, "fit");
+        if (save_fits_create(&p_fits, tmp_file, &expose_fhdr, peso_header, 3,
+                naxes) == -1)
+        {
+            /* empty file created by cont_make_filename() */
+            remove(tmp_file);
+            p_fits = NULL;
+            goto end_time;
+        }
+    }
 
-        /* SETKEY FILENAME */
-        memset(peso_header[PHDR_FILENAME_E].value, 0, PHDR_VALUE_MAX + 1);
-        strncpy(peso_header[PHDR_FILENAME_E].value, basename(p_peso->fits_file),
-                PHDR_VALUE_MAX);
+    if (mod_ccd.continuous_start(cont_exptime, cont_frames) == -1)
+    {
+        append_log(LOG4C_PRIORITY_ERROR,
+                "Error: mod_ccd.continuous_start(): %s", p_peso->msg);
+        goto end;
+    }
 
-        if ((result = mod_ccd.expose_init()) == -1)
+    append_log(LOG4C_PRIORITY_INFO, "continuous begin, %i frames, %i ms",
+            cont_frames, cont_exptime);
+    mod_ccd.peso_set_state(CCD_STATE_EXPOSE_E);
+
+    while ((frames < cont_frames) && (p_peso->abort == 0)
+            && (!p_peso->readout))
+    {
+        if ((result = mod_ccd.continuous_frame(&p_slot, EXPOSED_POLL_READOUT))
+                == 0)
         {
-            break;
+            continue;
         }
 
-        if ((result = mod_ccd.expose_start()) == -1)
+        if (result == -1)
         {
             append_log(LOG4C_PRIORITY_ERROR,
-                    "Error: mod_ccd.expose_start(): %s", p_peso->msg);
+                    "Error: mod_ccd.continuous_frame(): %s", p_peso->msg);
             break;
         }
 
-        fit_start_time();
-
-        /* exposing */
-        append_log(LOG4C_PRIORITY_INFO, "expose begin");
-        mod_ccd.peso_set_state(CCD_STATE_EXPOSE_E);
-        second = 15;
-        while (mod_ccd.expose())
+        if (cont_cube)
         {
-            if (second >= 15)
-            {
-                second = 0;
-                if (mod_ccd.get_temp(&p_peso->actual_temp) == -1)
-                {
-                    append_log(LOG4C_PRIORITY_WARN,
-                            "Error: mod_ccd.get_temp(): %s", p_peso->msg);
-                }
-            }
-
-            if (is_exposure_meter_exit()) {
-                /* LOCK */
-                pthr_mutex_lock(&global_mutex);
-                p_peso->readout = 1;
-                pthr_mutex_unlock(&global_mutex);
-                /* UNLOCK */
-            }
-
-            second += 0.1;
-            usleep(100000);
+            result = cont_write_cube(p_fits, p_slot, frames);
         }
-        append_log(LOG4C_PRIORITY_INFO, "expose end");
-
-        if (p_peso->abort <= 1)
+        else if ((p_frame = cont_copy_frame(p_slot, naxes)) == NULL)
         {
-            fit_end_time();
-
-            if ((result = mod_ccd.expose_end()) == -1)
-            {
-                append_log(LOG4C_PRIORITY_WARN, "Warning: expose_end(): %s",
-                        p_peso->msg);
-            }
-
-            /* reading out */
-            append_log(LOG4C_PRIORITY_INFO, "readout begin");
-            mod_ccd.peso_set_int(&p_peso->elapsed_time, 0);
-            mod_ccd.peso_set_state(CCD_STATE_READOUT_E);
-            while (mod_ccd.readout())
-            {
-                usleep(100000);
-            }
-            append_log(LOG4C_PRIORITY_INFO, "readout end");
+            result = -1;
+        }
 
-            if (save_image() == -1)
-            {
-                /* TODO: report to client */
-            }
+        if (mod_ccd.continuous_release(p_slot) == -1)
+        {
+            append_log(LOG4C_PRIORITY_ERROR,
+                    "Error: mod_ccd.continuous_release(): %s", p_peso->msg);
+            result = -1;
         }
 
-        if ((result = mod_ccd.expose_uninit()) == -1)
+        if (result == -1)
         {
-            append_log(LOG4C_PRIORITY_ERROR, "Error: expose_uninit(): %s",
-                    p_peso->msg);
+            if (p_frame != NULL)
+            {
+                save_frame_free(p_frame);
+            }
             break;
         }
 
-        if ((p_peso->abort == 2) || (p_peso->readout))
+        if ((p_frame != NULL) && (cont_push_frame(p_frame, prefix) == -1))
         {
             break;
         }
+
+        p_frame = NULL;
+        mod_ccd.peso_set_int(&p_peso->expnum, ++frames);
     }
 
-    /* finishing expose */
-    mod_ccd.peso_set_state(CCD_STATE_FINISH_EXPOSE_E);
+    append_log(LOG4C_PRIORITY_INFO, "continuous end, %i of %i frames", frames,
+            cont_frames);
+
+    end: if (mod_ccd.continuous_end() == -1)
+    {
+        append_log(LOG4C_PRIORITY_WARN, "Warning: continuous_end(): %s",
+                p_peso->msg);
+    }
+
+    end_time: fit_end_time();
+    cont_fit_exptime();
+
+    if (p_fits != NULL)
+    {
+        cont_close_cube(p_fits, tmp_file, naxes, frames);
+    }
+
+    uninit: if (mod_ccd.expose_uninit() == -1)
+    {
+        append_log(LOG4C_PRIORITY_ERROR, "Error: expose_uninit(): %s",
+                p_peso->msg);
+    }
+
+    finish: mod_ccd.peso_set_state(CCD_STATE_FINISH_EXPOSE_E);
     if (p_cmd_end != NULL)
     {
         system(p_cmd_end);
     }
 
+    save_queue_drain();
+
     /* CCD is ready */
     mod_ccd.peso_set_state(CCD_STATE_READY_E);
 }
@@ -1620,7 +2613,15 @@ static void *expose_loop(void *arg)
 
         if (pthr_sem_wait(&expose_sem, 15) != -1)
         {
-            expose();
+            if (cont_request)
+            {
+                cont_request = 0;
+                expose_continuous();
+            }
+            else
+            {
+                expose();
+            }
         }
     }
 
@@ -1875,6 +2876,68 @@ static xmlrpc_value *expose_start(xmlrpc_env * const p_env,
     return p_xmlrpc_result;
 }
 
+/* expose_continuous(exptime [ms], frames, cube) */
+static xmlrpc_value *expose_continuous_start(xmlrpc_env * const p_env,
+        xmlrpc_value * const p_param_array, void * const p_server_info,
+        void * const p_chan_info)
+{
+    char ip[CFG_TYPE_STR_MAX + 1];
+    char result[RESULT_MAX + 1];
+    int exptime = -1;
+    int frames = -1;
+    int cube = 0;
+    xmlrpc_value *p_xmlrpc_result = NULL;
+
+    XMLRPC_FAIL_IF_FAULT(expose_xmlrpc_init(p_env, p_chan_info, ip));
+
+    xmlrpc_decompose_value(p_env, p_param_array, "(iii)", &exptime, &frames,
+            &cube);
+    XMLRPC_FAIL_IF_FAULT(p_env);
+
+    /* LOCK */
+    pthr_mutex_lock(&global_mutex);
+
+    if (mod_ccd.continuous_start == NULL)
+    {
+        snprintf(result, RESULT_MAX, "-ERR continuous readout not supported");
+    }
+    else if (p_peso->state != CCD_STATE_READY_E)
+    {
+        snprintf(result, RESULT_MAX, "-ERR expose already running");
+    }
+    else if ((exptime < 0) || (frames <= 0))
+    {
+        snprintf(result, RESULT_MAX, "-ERR exptime >= 0 and frames > 0 required");
+    }
+    else if (cmd_shutter() == -1)
+    {
+        snprintf(result, RESULT_MAX, "-ERR must execute SETKEY IMAGETYP");
+    }
+    else
+    {
+        cont_exptime = exptime;
+        cont_frames = frames;
+        cont_cube = cube;
+        cont_request = 1;
+        p_peso->state = CCD_STATE_PREPARE_EXPOSE_E;
+
+        snprintf(result, RESULT_MAX, "+OK EXPOSE_CONTINUOUS %i %i %i", exptime,
+                frames, cube);
+
+        pthr_sem_post(&expose_sem);
+    }
+
+    p_xmlrpc_result = xmlrpc_build_value(p_env, "s", result);
+
+    pthr_mutex_unlock(&global_mutex);
+    /* UNLOCK */
+
+    cleanup: expose_xmlrpc_err2log(p_env, "%s:expose_continuous(%i, %i, %i)",
+            ip, exptime, frames, cube);
+
+    return p_xmlrpc_result;
+}
+
 static xmlrpc_value *expose_add_time(xmlrpc_env * const p_env,
         xmlrpc_value * const p_param_array, void * const p_server_info,
         void * const p_chan_info)
@@ -1974,6 +3037,8 @@ static xmlrpc_value *expose_readout(xmlrpc_env * const p_env,
     pthr_mutex_unlock(&global_mutex);
     /* UNLOCK */
 
+    expose_event_notify();
+
     cleanup: expose_xmlrpc_err2log(p_env, "%s:expose_readout()", ip);
 
     return p_xmlrpc_result;
@@ -2001,6 +3066,8 @@ static xmlrpc_value *expose_abort(xmlrpc_env * const p_env,
     pthr_mutex_unlock(&global_mutex);
     /* UNLOCK */
 
+    expose_event_notify();
+
     cleanup: expose_xmlrpc_err2log(p_env, "%s:expose_abort()", ip);
 
     return p_xmlrpc_result;
@@ -2119,6 +3186,8 @@ int main(int argc, char *argv[])
     pid_t pid;
     pid_t sid;
     pthread_t accept_pthread;
+    pthread_t save_pthread;
+    long naxes[2];
     char *p_dlerror_msg;
     xmlrpc_server_abyss_parms serverparm;
     xmlrpc_registry *registryP;
@@ -2144,6 +3213,9 @@ int main(int argc, char *argv[])
     struct xmlrpc_method_info3 const expose_start_MI =
     { .methodName = "expose_start", .methodFunction = &expose_start, };
 
+    struct xmlrpc_method_info3 const expose_continuous_MI =
+    { .methodName = "expose_continuous", .methodFunction = &expose_continuous_start, };
+
     struct xmlrpc_method_info3 const expose_add_time_MI =
     { .methodName = "expose_add_time", .methodFunction = &expose_add_time, };
 
@@ -2301,6 +3373,17 @@ int main(int argc, char *argv[])
 
     init_fits_header();
 
+    naxes[0] = exposed_cfg.ccd.x2;
+    naxes[1] = exposed_cfg.ccd.y2;
+    if ((fhdr_build(&save_fhdr, peso_header, 2, naxes) == -1)
+            || (fhdr_build(&expose_fhdr, peso_header, 2, naxes) == -1))
+    {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR,
+                "Error: fhdr_build(): more than %i header cards",
+                FHDR_CARDS_MAX);
+        daemon_exit(EXIT_FAILURE);
+    }
+
     if ((fw = fopen(exposed_cfg.file_pid, "w")) == NULL)
     {
         log4c_category_log(p_logcat, LOG4C_PRIORITY_WARN,
@@ -2382,6 +3465,12 @@ int main(int argc, char *argv[])
         daemon_exit(EXIT_FAILURE);
     }
 
+    if ((mod_ccd.readout_notify != NULL)
+            && (mod_ccd.readout_notify(expose_event_notify) == -1))
+    {
+        mod_ccd.readout_notify = NULL;
+    }
+
     p_peso->state = CCD_STATE_READY_E;
 
     if (sem_init(&expose_sem, 0, 0) == -1)
@@ -2400,6 +3489,38 @@ int main(int argc, char *argv[])
     }
     exposed_allocate.service_sem = 1;
 
+    if (pthread_mutex_init(&save_mutex, NULL) != 0)
+    {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR,
+                "Error: pthread_mutex_init(): %i: %s", errno, strerror(errno));
+        daemon_exit(EXIT_FAILURE);
+    }
+    exposed_allocate.save_mutex = 1;
+
+    if (pthread_cond_init(&save_cond, NULL) != 0)
+    {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR,
+                "Error: pthread_cond_init(): %i: %s", errno, strerror(errno));
+        daemon_exit(EXIT_FAILURE);
+    }
+    exposed_allocate.save_cond = 1;
+
+    if (pthread_mutex_init(&event_mutex, NULL) != 0)
+    {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR,
+                "Error: pthread_mutex_init(): %i: %s", errno, strerror(errno));
+        daemon_exit(EXIT_FAILURE);
+    }
+    exposed_allocate.event_mutex = 1;
+
+    if (pthread_cond_init(&event_cond, NULL) != 0)
+    {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR,
+                "Error: pthread_cond_init(): %i: %s", errno, strerror(errno));
+        daemon_exit(EXIT_FAILURE);
+    }
+    exposed_allocate.event_cond = 1;
+
     memset(exposed_log, 0, sizeof(exposed_log));
 
     (void) signal(SIGTERM, daemon_signal); /* abort            */
@@ -2408,6 +3529,13 @@ int main(int argc, char *argv[])
     (void) signal(SIGUSR1, daemon_signal); /* readout          */
     (void) signal(SIGPIPE, SIG_IGN); /* send()           */
 
+    if (pthread_create(&save_pthread, NULL, save_loop, NULL) != 0)
+    {
+        log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR,
+                "Error: pthread_create(): %i: %s", errno, strerror(errno));
+        daemon_exit(EXIT_FAILURE);
+    }
+
     if (pthread_create(&accept_pthread, NULL, expose_loop, NULL) != 0)
     {
         log4c_category_log(p_logcat, LOG4C_PRIORITY_ERROR,
@@ -2425,6 +3553,7 @@ int main(int argc, char *argv[])
     xmlrpc_registry_add_method3(&env, registryP, &expose_get_key_MI);
     xmlrpc_registry_add_method3(&env, registryP, &expose_get_all_keys_MI);
     xmlrpc_registry_add_method3(&env, registryP, &expose_start_MI);
+    xmlrpc_registry_add_method3(&env, registryP, &expose_continuous_MI);
     xmlrpc_registry_add_method3(&env, registryP, &expose_add_time_MI);
     xmlrpc_registry_add_method3(&env, registryP, &expose_abort_MI);
     xmlrpc_registry_add_method3(&env, registryP, &expose_readout_MI);
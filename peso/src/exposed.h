@@ -7,6 +7,11 @@
 #ifndef __EXPOSED_H
 #define __EXPOSED_H
 
+#include <fitsio.h>
+
+#include "modules.h"
+#include "header.h"
+
 #define APP_NAME         "exposed"
 #define MAKE_DATE_TIME   "(" __DATE__ " " __TIME__ ")"
 
@@ -20,6 +25,13 @@
 #define EXPOSED_XML_MAX         1023
 #define PREFIX_MAX              31
 #define EXPOSED_STR_MAX         1023
+#define EXPOSED_SAVE_QUEUE_MAX  4
+
+/* mod_ccd.expose() and mod_ccd.readout() poll interval [ms] */
+#define EXPOSED_POLL_MAX        1000
+#define EXPOSED_POLL_READOUT    100
+#define EXPOSED_POLL_EXPMETER   100
+#define EXPOSED_TEMP_PERIOD     15
 
 #define hms2s(h,m,s) \
   ((h)*3600 + (m)*60 + (s))
@@ -37,8 +49,27 @@ typedef struct
     int service_sem;
     int global_mutex;
     int mod_ccd;
+    int save_mutex;
+    int save_cond;
+    int event_mutex;
+    int event_cond;
 } EXPOSED_ALLOCATE_T;
 
+/* completed frame waiting in save queue for writer thread */
+typedef struct
+{
+    char fits_file[PESO_PATH_MAX + 1];
+    char raw_image[PESO_PATH_MAX + 1];
+    int archive;
+    long naxes[2];
+    /* rows are already written to open file, only finish it, p_lease is NULL */
+    fitsfile *p_fits;
+    PESO_FRAME_T *p_lease;
+    /* continuous readout frame, p_lease points here, p_data is malloc()ed */
+    PESO_FRAME_T copy;
+    PESO_HEADER_T header[PHDR_INDEX_MAX_E];
+} EXPOSED_FRAME_T;
+
 extern log4c_category_t *p_logcat;
 
 #endif
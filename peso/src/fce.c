@@ -12,6 +12,10 @@
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <dirent.h>
 
 #include "cfg.h"
 #include "fce.h"
@@ -27,6 +31,11 @@ log4c_category_t *p_logcat = NULL;
 
 #endif
 
+/* sequence allocator state, see fce_make_filename() */
+static char fce_seq_path[FCE_PATH_MAX + 1];
+static char fce_seq_prefix[FCE_PATH_MAX + 1];
+static int fce_seq_next = 0;
+
 /*
  * https://stelweb.asu.cas.cz/wiki/index.php/2m_FITS
  *
@@ -199,39 +208,118 @@ int fce_make_fits_prefix(char instrument_prefix, char *p_prefix, int prefix_len)
     return 0;
 }
 
-int fce_make_filename(char *p_path, char *p_prefix, char *p_filename,
-        int filename_len)
+/*
+ * Highest frame number NNNN of files p_prefixNNNN.* in directory p_path,
+ * 0 if there is none.
+ */
+static int fce_scan_numbers(char *p_path, char *p_prefix)
 {
+    DIR *p_dir;
+    struct dirent *p_dirent;
     int i;
-    int j;
-    int len = 0;
-    char *suffix[] =
-    { "raw", "fit" };
+    int number;
+    int number_max = 0;
+    int prefix_len = strlen(p_prefix);
 
-    for (i = 1; i <= PESO_MAX_NUMBER_OF_EXPOSE; ++i)
+    if ((p_dir = opendir(p_path)) == NULL)
     {
-        for (j = 0; j < 2; ++j)
+        return -1;
+    }
+
+    while ((p_dirent = readdir(p_dir)) != NULL)
+    {
+        if (strncmp(p_dirent->d_name, p_prefix, prefix_len))
         {
-            len = snprintf(p_filename, filename_len, "%s/%s%04i.%s", p_path,
-                    p_prefix, i, suffix[j]);
+            continue;
+        }
 
-            /* assert */
-            if (len > (filename_len - 1))
+        number = 0;
+        for (i = prefix_len; i < (prefix_len + 4); ++i)
+        {
+            if (!isdigit((unsigned char) p_dirent->d_name[i]))
             {
-                i = PESO_MAX_NUMBER_OF_EXPOSE;
                 break;
             }
+            number = (number * 10) + (p_dirent->d_name[i] - '0');
+        }
 
-            if (fce_isfile_exist(p_filename))
-            {
-                break;
-            }
-            else if (j == 1)
+        if ((i == (prefix_len + 4)) && (p_dirent->d_name[i] == '.')
+                && (number > number_max))
+        {
+            number_max = number;
+        }
+    }
+
+    closedir(p_dir);
+
+    return number_max;
+}
+
+/*
+ * Return p_path/p_prefixNNNN. (without suffix) with next free frame number.
+ *
+ * Directory is scanned only when p_path or p_prefix (new night) changes,
+ * then the number is kept in memory. Name is claimed by creating empty
+ * p_path/p_prefixNNNN.tmp with O_EXCL, so it can't be returned twice even
+ * if the files are written later. After restart the directory is scanned
+ * again and numbering continues after the highest existing frame.
+ */
+int fce_make_filename(char *p_path, char *p_prefix, char *p_filename,
+        int filename_len)
+{
+    int fd;
+    int len;
+    struct stat st;
+
+    if (strcmp(fce_seq_path, p_path) || strcmp(fce_seq_prefix, p_prefix)
+            || (fce_seq_next == 0))
+    {
+        if ((fce_seq_next = fce_scan_numbers(p_path, p_prefix)) == -1)
+        {
+            fce_seq_next = 0;
+            memset(p_filename, '\0', filename_len);
+            return -1;
+        }
+
+        ++fce_seq_next;
+        strncpy(fce_seq_path, p_path, FCE_PATH_MAX);
+        strncpy(fce_seq_prefix, p_prefix, FCE_PATH_MAX);
+        fce_seq_path[FCE_PATH_MAX] = '\0';
+        fce_seq_prefix[FCE_PATH_MAX] = '\0';
+    }
+
+    for (; fce_seq_next <= PESO_MAX_NUMBER_OF_EXPOSE; ++fce_seq_next)
+    {
+        len = snprintf(p_filename, filename_len, "%s/%s%04i.fit", p_path,
+                p_prefix, fce_seq_next);
+
+        /* assert */
+        if (len > (filename_len - 1))
+        {
+            break;
+        }
+
+        /* files created by someone else after scan */
+        if (stat(p_filename, &st) == 0)
+        {
+            continue;
+        }
+
+        strcpy(p_filename + len - 3, FCE_TMP_SUFFIX);
+
+        if ((fd = open(p_filename, O_WRONLY | O_CREAT | O_EXCL, 0644)) == -1)
+        {
+            if (errno == EEXIST)
             {
-                p_filename[strlen(p_filename) - 3] = '\0'; /* remove suffix */
-                return 0;
+                continue;
             }
+            break;
         }
+        close(fd);
+
+        p_filename[len - 3] = '\0'; /* remove suffix */
+        ++fce_seq_next;
+        return 0;
     }
 
     memset(p_filename, '\0', filename_len);
@@ -372,10 +460,45 @@ char *fce_strstrip(char *p_str)
 
 #ifdef SELF_TEST_FCE
 
+static int st_fce_errors = 0;
+
+static void st_fce_touch(char *p_path, char *p_prefix, int number, char *p_suffix)
+{
+    int fd;
+    char filename[PREFIX_MAX+1];
+
+    snprintf(filename, PREFIX_MAX, "%s/%s%04i.%s", p_path, p_prefix, number, p_suffix);
+
+    if ((fd = open(filename, O_WRONLY | O_CREAT, 0644)) == -1) {
+        perror("open()");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+}
+
+static void st_fce_expect(char *p_path, char *p_prefix, int number)
+{
+    char filename[PREFIX_MAX+1];
+    char expected[PREFIX_MAX+1];
+
+    snprintf(expected, PREFIX_MAX, "%s/%s%04i.", p_path, p_prefix, number);
+
+    if ((fce_make_filename(p_path, p_prefix, filename, PREFIX_MAX) == -1)
+            || strcmp(filename, expected)) {
+        printf("FAIL: fce_make_filename(%s, %s) => %s, expected %s\n", p_path, p_prefix,
+            filename, expected);
+        ++st_fce_errors;
+        return;
+    }
+
+    printf("fce_make_filename(%s, %s) => %s\n", p_path, p_prefix, filename);
+}
+
 int main(int argc, char *argv[])
 {
     int i;
     char prefix[PREFIX_MAX+1];
+    char path[] = "/tmp/st_fce_XXXXXX";
 
     // 2013-09-30 12:00
     for (i = 1; i >= 0; --i) {
@@ -401,6 +524,43 @@ int main(int argc, char *argv[])
         printf("fce_make_fits_prefix(time = %li) => prefix = %s\n", st_fce_time, prefix);
     }
 
+    if (mkdtemp(path) == NULL) {
+        perror("mkdtemp()");
+        exit(EXIT_FAILURE);
+    }
+
+    /* empty directory, counter continues in memory */
+    for (i = 1; i <= 3; ++i) {
+        st_fce_expect(path, prefix, i);
+    }
+
+    /* simulate restart, claimed .tmp files count as used */
+    fce_seq_next = 0;
+    st_fce_expect(path, prefix, 4);
+
+    /* gap after restart, numbering continues after highest frame */
+    st_fce_touch(path, prefix, 10, "fit");
+    fce_seq_next = 0;
+    st_fce_expect(path, prefix, 11);
+
+    /* .tmp claimed by someone else, O_EXCL collision */
+    st_fce_touch(path, prefix, 12, FCE_TMP_SUFFIX);
+    st_fce_expect(path, prefix, 13);
+
+    /* .fit created by someone else after scan */
+    st_fce_touch(path, prefix, 14, "fit");
+    st_fce_expect(path, prefix, 15);
+    st_fce_expect(path, prefix, 16);
+
+    /* different prefix (new night) is scanned again */
+    st_fce_expect(path, "b20131010", 1);
+
+    if (st_fce_errors) {
+        printf("%i error(s)\n", st_fce_errors);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("OK\n");
     exit(EXIT_SUCCESS);
 }
 #endif
@@ -8,6 +8,10 @@
 #define __FCE_H
 
 #define PESO_MAX_NUMBER_OF_EXPOSE 999
+#define FCE_PATH_MAX              1023
+
+/* FITS file is written as p_prefixNNNN.tmp and renamed when complete */
+#define FCE_TMP_SUFFIX            "tmp"
 
 int fce_make_fits_prefix(char instrument, char *p_prefix, int prefix_len);
 int fce_make_filename(char *p_path, char *p_prefix, char *p_filename,
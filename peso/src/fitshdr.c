@@ -0,0 +1,684 @@
+/**
+ * Author: Jan Fuchs <fuky@sunstel.asu.cas.cz>
+ * $Date$
+ * $Rev$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fitsio.h>
+
+#include "header.h"
+#include "fitshdr.h"
+
+#ifdef SELF_TEST_FITSHDR
+#include <limits.h>
+
+extern PESO_HEADER_T peso_header[];
+#endif
+
+/* pad card with spaces, cards are not null terminated inside block */
+static void fhdr_card(char *p_card, const char *p_key, const char *p_value,
+        const char *p_comment, int is_str)
+{
+    int len;
+    char card[FHDR_CARD_LEN + 1];
+
+    len = snprintf(card, FHDR_CARD_LEN + 1, (is_str) ? "%-8.8s= %-20s"
+            : "%-8.8s= %20s", p_key, p_value);
+
+    if ((p_comment[0] != '\0') && (len < FHDR_CARD_LEN))
+    {
+        len += snprintf(card + len, FHDR_CARD_LEN + 1 - len, " / %s",
+                p_comment);
+    }
+
+    if (len > FHDR_CARD_LEN)
+    {
+        len = FHDR_CARD_LEN;
+    }
+
+    memset(p_card, ' ', FHDR_CARD_LEN);
+    memcpy(p_card, card, len);
+}
+
+/* 'value' with doubled quotes, at least 8 characters as CFITSIO does */
+static void fhdr_quote(const char *p_value, char *p_out)
+{
+    int i = 0;
+
+    p_out[i++] = '\'';
+
+    for (; *p_value != '\0'; ++p_value)
+    {
+        /* value must fit into columns 11-80 including closing quote */
+        if (i >= (FHDR_CARD_LEN - 10 - 2))
+        {
+            break;
+        }
+
+        if (*p_value == '\'')
+        {
+            p_out[i++] = '\'';
+        }
+        p_out[i++] = *p_value;
+    }
+
+    while (i < 9)
+    {
+        p_out[i++] = ' ';
+    }
+
+    p_out[i++] = '\'';
+    p_out[i] = '\0';
+}
+
+/* floating point value always contains decimal point, e.g. "1." or "1.E+10" */
+static void fhdr_real(double value, int digits, char *p_out, int out_len)
+{
+    char *p_exp;
+    int len;
+
+    len = snprintf(p_out, out_len, "%.*G", digits, value);
+
+    if ((strchr(p_out, '.') != NULL) || (len + 1 >= out_len))
+    {
+        return;
+    }
+
+    if ((p_exp = strchr(p_out, 'E')) != NULL)
+    {
+        memmove(p_exp + 1, p_exp, strlen(p_exp) + 1);
+        *p_exp = '.';
+    }
+    else
+    {
+        strcat(p_out, ".");
+    }
+}
+
+static void fhdr_header_card(char *p_card, PESO_HEADER_T *p_header)
+{
+    char value[FHDR_CARD_LEN + 1];
+
+    switch (p_header->type)
+    {
+    case PHDR_TYPE_INT_E:
+        snprintf(value, FHDR_CARD_LEN, "%i", atoi(p_header->value));
+        break;
+
+    case PHDR_TYPE_FLOAT_E:
+        fhdr_real((float) atof(p_header->value), 7, value, FHDR_CARD_LEN);
+        break;
+
+    case PHDR_TYPE_DOUBLE_E:
+        fhdr_real(atof(p_header->value), 15, value, FHDR_CARD_LEN);
+        break;
+
+    case PHDR_TYPE_STR_E:
+    default:
+        fhdr_quote(p_header->value, value);
+        fhdr_card(p_card, p_header->key, value, p_header->comment, 1);
+        return;
+    }
+
+    fhdr_card(p_card, p_header->key, value, p_header->comment, 0);
+}
+
+static void fhdr_date_card(char *p_card)
+{
+    time_t t;
+    struct tm utc_tm;
+    char date[FHDR_CARD_LEN + 1];
+    char value[FHDR_CARD_LEN + 1];
+
+    t = time(NULL);
+    gmtime_r(&t, &utc_tm);
+
+    strftime(date, FHDR_CARD_LEN, "%Y-%m-%dT%H:%M:%S", &utc_tm);
+    fhdr_quote(date, value);
+    fhdr_card(p_card, "DATE", value,
+            "file creation date (YYYY-MM-DDThh:mm:ss UT)", 1);
+}
+
+static void fhdr_int_card(char *p_card, const char *p_key, long number,
+        const char *p_comment)
+{
+    char value[FHDR_CARD_LEN + 1];
+
+    snprintf(value, FHDR_CARD_LEN, "%li", number);
+    fhdr_card(p_card, p_key, value, p_comment, 0);
+}
+
+/* NAXIS1 is the 4th card, see fhdr_build() */
+static void fhdr_naxis_card(FHDR_T *p_fhdr, int axis)
+{
+    char key[FHDR_CARD_LEN + 1];
+    char comment[FHDR_CARD_LEN + 1];
+
+    snprintf(key, FHDR_CARD_LEN, "NAXIS%i", axis + 1);
+    snprintf(comment, FHDR_CARD_LEN, "length of data axis %i", axis + 1);
+    fhdr_int_card(p_fhdr->block + ((3 + axis) * FHDR_CARD_LEN), key,
+            p_fhdr->naxes[axis], comment);
+}
+
+static void fhdr_comment_card(char *p_card, const char *p_text)
+{
+    int len = strlen(p_text);
+
+    memcpy(p_card, p_text, (len > FHDR_CARD_LEN) ? FHDR_CARD_LEN : len);
+}
+
+/*
+ * Serialize whole primary header. Mandatory keywords, BZERO and BSCALE are
+ * the same as fits_create_img(USHORT_IMG) writes, cards of empty
+ * peso_header[] values are omitted like in previous fits_update_key()
+ * implementation.
+ */
+int fhdr_build(FHDR_T *p_fhdr, PESO_HEADER_T *p_header, int naxis,
+        long *p_naxes)
+{
+    int i;
+    int n;
+    char *p_card;
+
+    if ((naxis < 1) || (naxis > FHDR_NAXIS_MAX))
+    {
+        return -1;
+    }
+
+    memset(p_fhdr->block, ' ', sizeof(p_fhdr->block));
+    p_fhdr->naxis = naxis;
+
+    p_card = p_fhdr->block;
+    fhdr_card(p_card, "SIMPLE", "T", "file does conform to FITS standard", 0);
+    /* USHORT_IMG is stored as SHORT_IMG with BZERO = 32768 */
+    fhdr_int_card(p_card += FHDR_CARD_LEN, "BITPIX", SHORT_IMG,
+            "number of bits per data pixel");
+    fhdr_int_card(p_card += FHDR_CARD_LEN, "NAXIS", naxis,
+            "number of data axes");
+
+    for (i = 0; i < naxis; ++i)
+    {
+        p_fhdr->naxes[i] = p_naxes[i];
+        fhdr_naxis_card(p_fhdr, i);
+        p_card += FHDR_CARD_LEN;
+    }
+
+    fhdr_card(p_card += FHDR_CARD_LEN, "EXTEND", "T",
+            "FITS dataset may contain extensions", 0);
+    fhdr_comment_card(p_card += FHDR_CARD_LEN, "COMMENT   FITS (Flexible "
+            "Image Transport System) format is defined in 'Astronomy");
+    fhdr_comment_card(p_card += FHDR_CARD_LEN, "COMMENT   and Astrophysics', "
+            "volume 376, page 359; bibcode: 2001A&A...376..359H");
+    fhdr_int_card(p_card += FHDR_CARD_LEN, "BZERO", 32768, "");
+    fhdr_int_card(p_card += FHDR_CARD_LEN, "BSCALE", 1,
+            "REAL=TAPE*BSCALE+BZERO");
+    n = (p_card - p_fhdr->block) / FHDR_CARD_LEN + 1;
+
+    for (i = 0; i < PHDR_INDEX_MAX_E; ++i)
+    {
+        strcpy(p_fhdr->value[i], p_header[i].value);
+        strcpy(p_fhdr->comment[i], p_header[i].comment);
+
+        if (p_header[i].value[0] == '\0')
+        {
+            p_fhdr->card[i] = -1;
+            continue;
+        }
+
+        /* DATE, END and spare cards */
+        if ((n + 2 + FHDR_CARDS_SPARE) > FHDR_CARDS_MAX)
+        {
+            return -1;
+        }
+
+        p_fhdr->card[i] = n;
+        fhdr_header_card(p_fhdr->block + (n++ * FHDR_CARD_LEN), &p_header[i]);
+    }
+
+    p_fhdr->date_card = n;
+    fhdr_date_card(p_fhdr->block + (n++ * FHDR_CARD_LEN));
+    memcpy(p_fhdr->block + (n++ * FHDR_CARD_LEN), "END", 3);
+
+    p_fhdr->ncards = n;
+    p_fhdr->len = ((n + FHDR_CARDS_SPARE + FHDR_BLOCK_CARDS - 1)
+            / FHDR_BLOCK_CARDS) * FHDR_BLOCK_LEN;
+
+    return 0;
+}
+
+/*
+ * Rewrite cards changed since last call in place. Whole block is built again
+ * only if the set of cards or NAXIS changes. Returns count of rewritten
+ * peso_header[] cards.
+ */
+int fhdr_update(FHDR_T *p_fhdr, PESO_HEADER_T *p_header, int naxis,
+        long *p_naxes)
+{
+    int i;
+    int count = 0;
+
+    if (p_fhdr->naxis != naxis)
+    {
+        return fhdr_build(p_fhdr, p_header, naxis, p_naxes);
+    }
+
+    for (i = 0; i < PHDR_INDEX_MAX_E; ++i)
+    {
+        if ((p_header[i].value[0] == '\0') != (p_fhdr->card[i] == -1))
+        {
+            return fhdr_build(p_fhdr, p_header, naxis, p_naxes);
+        }
+    }
+
+    for (i = 0; i < naxis; ++i)
+    {
+        if (p_fhdr->naxes[i] != p_naxes[i])
+        {
+            p_fhdr->naxes[i] = p_naxes[i];
+            fhdr_naxis_card(p_fhdr, i);
+        }
+    }
+
+    for (i = 0; i < PHDR_INDEX_MAX_E; ++i)
+    {
+        if ((p_fhdr->card[i] == -1)
+                || (!strcmp(p_fhdr->value[i], p_header[i].value)
+                        && !strcmp(p_fhdr->comment[i], p_header[i].comment)))
+        {
+            continue;
+        }
+
+        strcpy(p_fhdr->value[i], p_header[i].value);
+        strcpy(p_fhdr->comment[i], p_header[i].comment);
+        fhdr_header_card(p_fhdr->block + (p_fhdr->card[i] * FHDR_CARD_LEN),
+                &p_header[i]);
+        ++count;
+    }
+
+    fhdr_date_card(p_fhdr->block + (p_fhdr->date_card * FHDR_CARD_LEN));
+
+    return count;
+}
+
+/*
+ * Write whole header with one write() into empty file, fits_open_file() then
+ * finds data unit right after it. Spare cards after END are left for
+ * fits_write_chksum(). Sets errno on failure.
+ */
+int fhdr_write(FHDR_T *p_fhdr, int fd)
+{
+    ssize_t len;
+
+    if ((len = write(fd, p_fhdr->block, p_fhdr->len)) != p_fhdr->len)
+    {
+        if (len != -1)
+        {
+            errno = ENOSPC;
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Rewrite cards changed since fhdr_update() in header which is already
+ * written, e.g. FITS cube whose header is written before its frames. Cards
+ * missing in the header are appended.
+ */
+int fhdr_rewrite(FHDR_T *p_fhdr, PESO_HEADER_T *p_header, fitsfile *p_fits,
+        int *p_fits_status)
+{
+    int i;
+
+    for (i = 0; i < PHDR_INDEX_MAX_E; ++i)
+    {
+        if ((p_header[i].value[0] == '\0') || ((p_fhdr->card[i] != -1)
+                && !strcmp(p_fhdr->value[i], p_header[i].value)
+                && !strcmp(p_fhdr->comment[i], p_header[i].comment)))
+        {
+            continue;
+        }
+
+        if (p_fhdr->card[i] != -1)
+        {
+            strcpy(p_fhdr->value[i], p_header[i].value);
+            strcpy(p_fhdr->comment[i], p_header[i].comment);
+            fhdr_header_card(p_fhdr->block + (p_fhdr->card[i] * FHDR_CARD_LEN),
+                    &p_header[i]);
+        }
+
+        if (fhdr_rewrite_card(&p_header[i], p_fits, p_fits_status) == -1)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int fhdr_rewrite_card(PESO_HEADER_T *p_header, fitsfile *p_fits,
+        int *p_fits_status)
+{
+    char card[FHDR_CARD_LEN + 1];
+
+    card[FHDR_CARD_LEN] = '\0';
+    fhdr_header_card(card, p_header);
+
+    if (fits_update_card(p_fits, (char *) p_header->key, card, p_fits_status))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+#ifdef SELF_TEST_FITSHDR
+
+/* header written by fits_update_key() as exposed did before FHDR_T */
+static int st_fhdr_reference(fitsfile *p_fits, int *p_fits_status)
+{
+    int i;
+    int value_int;
+    float value_float;
+    double value_double;
+
+    for (i = 0; i < PHDR_INDEX_MAX_E; ++i)
+    {
+        if (peso_header[i].value[0] == '\0')
+        {
+            continue;
+        }
+
+        switch (peso_header[i].type)
+        {
+        case PHDR_TYPE_INT_E:
+            value_int = atoi(peso_header[i].value);
+            fits_update_key(p_fits, TINT, (char *) peso_header[i].key,
+                    &value_int, peso_header[i].comment, p_fits_status);
+            break;
+
+        case PHDR_TYPE_FLOAT_E:
+            value_float = atof(peso_header[i].value);
+            fits_update_key(p_fits, TFLOAT, (char *) peso_header[i].key,
+                    &value_float, peso_header[i].comment, p_fits_status);
+            break;
+
+        case PHDR_TYPE_DOUBLE_E:
+            value_double = atof(peso_header[i].value);
+            fits_update_key(p_fits, TDOUBLE, (char *) peso_header[i].key,
+                    &value_double, peso_header[i].comment, p_fits_status);
+            break;
+
+        case PHDR_TYPE_STR_E:
+        default:
+            fits_update_key(p_fits, TSTRING, (char *) peso_header[i].key,
+                    peso_header[i].value, peso_header[i].comment,
+                    p_fits_status);
+            break;
+        }
+    }
+
+    fits_write_date(p_fits, p_fits_status);
+
+    return (*p_fits_status) ? -1 : 0;
+}
+
+static int st_fhdr_create(fitsfile **pp_fits, int naxis, long *p_naxes,
+        int *p_fits_status)
+{
+    int bscale = 1;
+    int bzero = 32768;
+
+    fits_create_file(pp_fits, "mem://", p_fits_status);
+    fits_create_img(*pp_fits, USHORT_IMG, naxis, p_naxes, p_fits_status);
+    fits_update_key(*pp_fits, TINT, "BZERO", &bzero, "", p_fits_status);
+    fits_update_key(*pp_fits, TINT, "BSCALE", &bscale,
+            "REAL=TAPE*BSCALE+BZERO", p_fits_status);
+
+    return (*p_fits_status) ? -1 : 0;
+}
+
+/* header written by fhdr_write() into temporary file as exposed does */
+static int st_fhdr_open(FHDR_T *p_fhdr, char *p_file, fitsfile **pp_fits,
+        int *p_fits_status)
+{
+    int fd;
+
+    strcpy(p_file, "/tmp/st_fitshdrXXXXXX");
+
+    if ((fd = mkstemp(p_file)) == -1)
+    {
+        perror("mkstemp()");
+        return -1;
+    }
+
+    if (fhdr_write(p_fhdr, fd) == -1)
+    {
+        perror("fhdr_write()");
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+
+    fits_open_file(pp_fits, p_file, READWRITE, p_fits_status);
+
+    return (*p_fits_status) ? -1 : 0;
+}
+
+/*
+ * Pixels and checksum written by CFITSIO after header block must not move
+ * the data unit, CHECKSUM and DATASUM go to spare cards.
+ */
+static int st_fhdr_data(FHDR_T *p_fhdr, fitsfile *p_fits, char *p_file,
+        int naxis, long *p_naxes)
+{
+    int i;
+    int errors = 0;
+    int fits_status = 0;
+    int dataok;
+    int hduok;
+    long nelements = 1;
+    unsigned short *p_data;
+    unsigned short nulval = 0;
+    int anynul;
+    LONGLONG headstart;
+    LONGLONG datastart;
+    LONGLONG dataend;
+
+    for (i = 0; i < naxis; ++i)
+    {
+        nelements *= p_naxes[i];
+    }
+
+    if ((p_data = (unsigned short *) malloc(nelements
+            * sizeof(unsigned short))) == NULL)
+    {
+        perror("malloc()");
+        return 1;
+    }
+
+    for (i = 0; i < nelements; ++i)
+    {
+        p_data[i] = i * 7;
+    }
+
+    if (fits_write_img(p_fits, TUSHORT, 1, nelements, p_data, &fits_status)
+            || fits_write_chksum(p_fits, &fits_status)
+            || fits_close_file(p_fits, &fits_status)
+            || fits_open_file(&p_fits, p_file, READONLY, &fits_status)
+            || fits_verify_chksum(p_fits, &dataok, &hduok, &fits_status)
+            || fits_get_hduaddrll(p_fits, &headstart, &datastart, &dataend,
+                    &fits_status))
+    {
+        fits_report_error(stdout, fits_status);
+        free(p_data);
+        return 1;
+    }
+
+    if ((dataok != 1) || (hduok != 1))
+    {
+        printf("FAIL: checksum dataok = %i, hduok = %i\n", dataok, hduok);
+        ++errors;
+    }
+
+    if (datastart != p_fhdr->len)
+    {
+        printf("FAIL: data starts at %lli, expected %i\n",
+                (long long) datastart, p_fhdr->len);
+        ++errors;
+    }
+
+    memset(p_data, 0, nelements * sizeof(unsigned short));
+
+    if (fits_read_img(p_fits, TUSHORT, 1, nelements, &nulval, p_data, &anynul,
+            &fits_status))
+    {
+        fits_report_error(stdout, fits_status);
+        ++errors;
+    }
+
+    for (i = 0; (i < nelements) && (!fits_status); ++i)
+    {
+        if (p_data[i] != (unsigned short) (i * 7))
+        {
+            printf("FAIL: pixel %i = %u\n", i, p_data[i]);
+            ++errors;
+            break;
+        }
+    }
+
+    fits_status = 0;
+    fits_close_file(p_fits, &fits_status);
+    free(p_data);
+
+    return errors;
+}
+
+/*
+ * Compare header written by fhdr_write() with CFITSIO reference card by
+ * card, DATE may differ by a second. Returns count of errors.
+ */
+static int st_fhdr_compare(FHDR_T *p_fhdr, int naxis, long *p_naxes)
+{
+    int i;
+    int errors = 0;
+    int fits_status = 0;
+    int nkeys[2];
+    int morekeys;
+    char card[2][FHDR_CARD_LEN + 1];
+    char file[PATH_MAX];
+    fitsfile *p_fits[2];
+
+    if ((st_fhdr_create(&p_fits[0], naxis, p_naxes, &fits_status) == -1)
+            || (st_fhdr_reference(p_fits[0], &fits_status) == -1)
+            || (st_fhdr_open(p_fhdr, file, &p_fits[1], &fits_status) == -1)
+            || fits_get_hdrspace(p_fits[0], &nkeys[0], &morekeys, &fits_status)
+            || fits_get_hdrspace(p_fits[1], &nkeys[1], &morekeys, &fits_status))
+    {
+        fits_report_error(stdout, fits_status);
+        return 1;
+    }
+
+    if (nkeys[0] != nkeys[1])
+    {
+        printf("FAIL: %i cards, expected %i\n", nkeys[1], nkeys[0]);
+        ++errors;
+    }
+
+    for (i = 1; (i <= nkeys[0]) && (i <= nkeys[1]); ++i)
+    {
+        if (fits_read_record(p_fits[0], i, card[0], &fits_status)
+                || fits_read_record(p_fits[1], i, card[1], &fits_status))
+        {
+            fits_report_error(stdout, fits_status);
+            return errors + 1;
+        }
+
+        if (!strncmp(card[0], "DATE    ", 8) && !strncmp(card[1], "DATE    ", 8))
+        {
+            continue;
+        }
+
+        if (strcmp(card[0], card[1]))
+        {
+            printf("FAIL: %s|\n   expected %s|\n", card[1], card[0]);
+            ++errors;
+        }
+    }
+
+    fits_close_file(p_fits[0], &fits_status);
+    errors += st_fhdr_data(p_fhdr, p_fits[1], file, naxis, p_naxes);
+    remove(file);
+
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    int i;
+    int count;
+    int errors = 0;
+    long naxes[FHDR_NAXIS_MAX] = { 2048, 512, 3 };
+    FHDR_T fhdr;
+
+    strcpy(peso_header[PHDR_OBJECT_E].value, "Vega's spectrum");
+    strcpy(peso_header[PHDR_EXPTIME_E].value, "600");
+    strcpy(peso_header[PHDR_CCDTEMP_E].value, "-110.3");
+
+    if (fhdr_build(&fhdr, peso_header, 2, naxes) == -1)
+    {
+        printf("fhdr_build() failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    errors += st_fhdr_compare(&fhdr, 2, naxes);
+
+    strcpy(peso_header[PHDR_EXPTIME_E].value, "1200");
+    strcpy(peso_header[PHDR_CCDTEMP_E].value, "-109.75");
+    count = fhdr_update(&fhdr, peso_header, 2, naxes);
+
+    if (count != 2)
+    {
+        printf("FAIL: fhdr_update() rewrote %i cards, expected 2\n", count);
+        ++errors;
+    }
+
+    errors += st_fhdr_compare(&fhdr, 2, naxes);
+
+    /* FITS cube of continuous readout */
+    naxes[0] = 256;
+    naxes[1] = 64;
+
+    if (fhdr_update(&fhdr, peso_header, 3, naxes) == -1)
+    {
+        printf("FAIL: fhdr_update(NAXIS = 3) failed\n");
+        ++errors;
+    }
+
+    errors += st_fhdr_compare(&fhdr, 3, naxes);
+
+    for (i = 0; i < fhdr.ncards; ++i)
+    {
+        printf("%.80s|\n", fhdr.block + (i * FHDR_CARD_LEN));
+    }
+
+    if (errors)
+    {
+        printf("%i error(s)\n", errors);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("cards = %i, blocks = %i, rewritten = %i, OK\n", fhdr.ncards,
+            fhdr.len / FHDR_BLOCK_LEN, count);
+
+    exit(EXIT_SUCCESS);
+}
+#endif
@@ -0,0 +1,53 @@
+/**
+ * Author: Jan Fuchs <fuky@sunstel.asu.cas.cz>
+ * $Date$
+ * $Rev$
+ */
+
+#ifndef __FITSHDR_H
+#define __FITSHDR_H
+
+#include <fitsio.h>
+
+#include "header.h"
+
+#define FHDR_CARD_LEN     80
+#define FHDR_BLOCK_LEN    2880
+#define FHDR_BLOCK_CARDS  (FHDR_BLOCK_LEN / FHDR_CARD_LEN)
+#define FHDR_BLOCKS_MAX   4
+#define FHDR_CARDS_MAX    (FHDR_BLOCKS_MAX * FHDR_BLOCK_CARDS)
+#define FHDR_NAXIS_MAX    3
+
+/* free cards after END for CHECKSUM, DATASUM and cards appended later */
+#define FHDR_CARDS_SPARE  4
+
+/*
+ * Primary header of USHORT_IMG serialized exactly as it is stored in FITS
+ * file, including END and padding to whole FITS blocks. Cards keep their
+ * position, so fhdr_update() rewrites only NAXISn, DATE and cards whose value
+ * or comment has changed since previous frame.
+ */
+typedef struct
+{
+    char block[FHDR_BLOCKS_MAX * FHDR_BLOCK_LEN];
+    int len;
+    int ncards;
+    int naxis;
+    long naxes[FHDR_NAXIS_MAX];
+    int date_card;
+    int card[PHDR_INDEX_MAX_E];
+    char value[PHDR_INDEX_MAX_E][PHDR_VALUE_MAX + 1];
+    char comment[PHDR_INDEX_MAX_E][PHDR_COMMENT_MAX + 1];
+} FHDR_T;
+
+int fhdr_build(FHDR_T *p_fhdr, PESO_HEADER_T *p_header, int naxis,
+        long *p_naxes);
+int fhdr_update(FHDR_T *p_fhdr, PESO_HEADER_T *p_header, int naxis,
+        long *p_naxes);
+int fhdr_write(FHDR_T *p_fhdr, int fd);
+int fhdr_rewrite(FHDR_T *p_fhdr, PESO_HEADER_T *p_header, fitsfile *p_fits,
+        int *p_fits_status);
+int fhdr_rewrite_card(PESO_HEADER_T *p_header, fitsfile *p_fits,
+        int *p_fits_status);
+
+#endif
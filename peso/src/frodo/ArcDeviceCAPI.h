@@ -117,6 +117,8 @@ CARCDEVICE_API int ArcDevice_IsReadout( int* pStatus );
 CARCDEVICE_API int ArcDevice_GetPixelCount( int* pStatus );
 CARCDEVICE_API int ArcDevice_GetCRPixelCount( int* pStatus );
 CARCDEVICE_API int ArcDevice_GetFrameCount( int* pStatus );
+CARCDEVICE_API int ArcDevice_WaitForPixels( int dPixelCount, int dTimeoutMs, int* pStatus );
+CARCDEVICE_API int ArcDevice_WaitForFrame( int dFrame, int dTimeoutMs, int* pStatus );
 
 // +----------------------------------------------------------------------------------------------------------------------------+
 // | Error & Degug message access                                                                                               |
@@ -137,6 +139,11 @@ CARCDEVICE_API  void   ArcDevice_SetArrayTemperature( double gTempVal, int* pSta
 CARCDEVICE_API  void   ArcDevice_LoadTemperatureCtrlData( const char* pszFilename, int* pStatus );
 CARCDEVICE_API  void   ArcDevice_SaveTemperatureCtrlData( const char* pszFilename, int* pStatus );
 
+CARCDEVICE_API  void   ArcDevice_StartTemperatureSampler( int dPeriodMs, int* pStatus );
+CARCDEVICE_API  void   ArcDevice_StopTemperatureSampler( int* pStatus );
+CARCDEVICE_API  void   ArcDevice_PauseTemperatureSampler( int bPause, int* pStatus );
+CARCDEVICE_API  double ArcDevice_GetCachedArrayTemperature( long* pTime, int* pStatus );
+
 CARCDEVICE_API const char* ArcDevice_GetLastError();
 
 #ifdef __cplusplus
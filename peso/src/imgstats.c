@@ -0,0 +1,745 @@
+/**
+ * Author: Jan Fuchs <fuky@sunstel.asu.cas.cz>
+ * $Date$
+ * $Rev$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef SELF_TEST_IMGSTATS
+#include <time.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IST_X86
+#include <immintrin.h>
+#endif
+
+#include "imgstats.h"
+
+/*
+ * Pixels are processed in chunks which stay in L1 cache while histogram is
+ * filled after SIMD kernel. Chunk also bounds 16-bit and 32-bit lane
+ * counters of SIMD kernels.
+ */
+#define IST_CHUNK           4096
+
+/* smaller regions are not worth starting threads */
+#define IST_THREAD_PIXELS   (256 * 1024)
+
+typedef void (*IST_KERNEL_T)(IST_T *p_ist, const unsigned short *p_data,
+        size_t nelements);
+
+typedef struct
+{
+    IST_T ist;
+    const unsigned short *p_data;
+    long cols;
+    long x1;
+    long x2;
+    long y1;
+    long y2;
+} IST_PART_T;
+
+static pthread_once_t ist_once = PTHREAD_ONCE_INIT;
+static PXC_ISA_T ist_isa = PXC_ISA_SCALAR_E;
+static PXC_ISA_T ist_isa_max = PXC_ISA_SCALAR_E;
+static IST_KERNEL_T ist_kernel[PXC_ISA_MAX_E];
+
+/* min, max, sums and saturated pixels, pixel count and histogram are not
+ * updated by kernels */
+static void ist_span_scalar(IST_T *p_ist, const unsigned short *p_data,
+        size_t nelements)
+{
+    size_t i;
+    unsigned int pixel;
+    unsigned short min = p_ist->min;
+    unsigned short max = p_ist->max;
+    unsigned long long sum = 0;
+    unsigned long long sumsq = 0;
+    unsigned long long saturated = 0;
+
+    for (i = 0; i < nelements; ++i)
+    {
+        pixel = p_data[i];
+
+        if (pixel < min)
+        {
+            min = pixel;
+        }
+
+        if (pixel > max)
+        {
+            max = pixel;
+        }
+
+        sum += pixel;
+        sumsq += pixel * pixel;
+        saturated += (pixel >= p_ist->saturation);
+    }
+
+    p_ist->min = min;
+    p_ist->max = max;
+    p_ist->sum += sum;
+    p_ist->sumsq += sumsq;
+    p_ist->saturated += saturated;
+}
+
+#ifdef IST_X86
+
+/*
+ * SIMD kernels work with signed pixels s = x - 32768 (highest bit flipped),
+ * because SSE2 has only signed 16-bit min/max and multiply-add. Sums are
+ * converted back: sum(x) = sum(s) + 32768 n and
+ * sum(x^2) = sum(s^2) + 65536 sum(s) + 32768^2 n.
+ */
+static void ist_span_merge(IST_T *p_ist, size_t n, short min, short max,
+        long long sum, unsigned long long sumsq, unsigned long long saturated)
+{
+    unsigned short umin = (unsigned short) (min ^ 0x8000);
+    unsigned short umax = (unsigned short) (max ^ 0x8000);
+
+    if (n == 0)
+    {
+        return;
+    }
+
+    if (umin < p_ist->min)
+    {
+        p_ist->min = umin;
+    }
+
+    if (umax > p_ist->max)
+    {
+        p_ist->max = umax;
+    }
+
+    p_ist->sum += (unsigned long long) (sum + 32768LL * (long long) n);
+    p_ist->sumsq += sumsq + (unsigned long long) (65536LL * sum
+            + 32768LL * 32768LL * (long long) n);
+    p_ist->saturated += (p_ist->saturation == 0) ? n : saturated;
+}
+
+/* 8 pixels per step, rest is processed by scalar code */
+__attribute__((target("sse2")))
+static void ist_span_sse2(IST_T *p_ist, const unsigned short *p_data,
+        size_t nelements)
+{
+    int j;
+    size_t i = 0;
+    long long sum = 0;
+    unsigned long long sumsq = 0;
+    unsigned long long saturated = 0;
+    short min = 0x7fff;
+    short max = (short) 0x8000;
+    short lanes16[8];
+    int lanes32[4];
+    unsigned long long lanes64[2];
+    const __m128i sign = _mm_set1_epi16((short) 0x8000);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    /* s > limit <=> x >= saturation, saturation == 0 is counted by merge */
+    const __m128i limit = _mm_set1_epi16(
+            (short) (((p_ist->saturation - 1) & 0xffff) ^ 0x8000));
+    __m128i vmin = _mm_set1_epi16(min);
+    __m128i vmax = _mm_set1_epi16(max);
+    __m128i vsum = zero;
+    __m128i vsumsq = zero;
+    __m128i vsat = zero;
+    __m128i v;
+    __m128i sq;
+
+    for (; (i + 8) <= nelements; i += 8)
+    {
+        v = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (p_data + i)),
+                sign);
+
+        vmin = _mm_min_epi16(vmin, v);
+        vmax = _mm_max_epi16(vmax, v);
+        vsum = _mm_add_epi32(vsum, _mm_madd_epi16(v, ones));
+
+        /* s0^2 + s1^2 <= 2^31 fits unsigned 32-bit lane */
+        sq = _mm_madd_epi16(v, v);
+        vsumsq = _mm_add_epi64(vsumsq, _mm_unpacklo_epi32(sq, zero));
+        vsumsq = _mm_add_epi64(vsumsq, _mm_unpackhi_epi32(sq, zero));
+
+        vsat = _mm_sub_epi16(vsat, _mm_cmpgt_epi16(v, limit));
+    }
+
+    _mm_storeu_si128((__m128i *) lanes16, vmin);
+    for (j = 0; j < 8; ++j)
+    {
+        min = (lanes16[j] < min) ? lanes16[j] : min;
+    }
+
+    _mm_storeu_si128((__m128i *) lanes16, vmax);
+    for (j = 0; j < 8; ++j)
+    {
+        max = (lanes16[j] > max) ? lanes16[j] : max;
+    }
+
+    _mm_storeu_si128((__m128i *) lanes16, vsat);
+    for (j = 0; j < 8; ++j)
+    {
+        saturated += (unsigned short) lanes16[j];
+    }
+
+    _mm_storeu_si128((__m128i *) lanes32, vsum);
+    for (j = 0; j < 4; ++j)
+    {
+        sum += lanes32[j];
+    }
+
+    _mm_storeu_si128((__m128i *) lanes64, vsumsq);
+    sumsq = lanes64[0] + lanes64[1];
+
+    ist_span_merge(p_ist, i, min, max, sum, sumsq, saturated);
+    ist_span_scalar(p_ist, p_data + i, nelements - i);
+}
+
+/* 16 pixels per step, rest is processed by scalar code */
+__attribute__((target("avx2")))
+static void ist_span_avx2(IST_T *p_ist, const unsigned short *p_data,
+        size_t nelements)
+{
+    int j;
+    size_t i = 0;
+    long long sum = 0;
+    unsigned long long sumsq = 0;
+    unsigned long long saturated = 0;
+    short min = 0x7fff;
+    short max = (short) 0x8000;
+    short lanes16[16];
+    int lanes32[8];
+    unsigned long long lanes64[4];
+    const __m256i sign = _mm256_set1_epi16((short) 0x8000);
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i limit = _mm256_set1_epi16(
+            (short) (((p_ist->saturation - 1) & 0xffff) ^ 0x8000));
+    __m256i vmin = _mm256_set1_epi16(min);
+    __m256i vmax = _mm256_set1_epi16(max);
+    __m256i vsum = zero;
+    __m256i vsumsq = zero;
+    __m256i vsat = zero;
+    __m256i v;
+    __m256i sq;
+
+    for (; (i + 16) <= nelements; i += 16)
+    {
+        v = _mm256_xor_si256(
+                _mm256_loadu_si256((const __m256i *) (p_data + i)), sign);
+
+        vmin = _mm256_min_epi16(vmin, v);
+        vmax = _mm256_max_epi16(vmax, v);
+        vsum = _mm256_add_epi32(vsum, _mm256_madd_epi16(v, ones));
+
+        sq = _mm256_madd_epi16(v, v);
+        vsumsq = _mm256_add_epi64(vsumsq, _mm256_unpacklo_epi32(sq, zero));
+        vsumsq = _mm256_add_epi64(vsumsq, _mm256_unpackhi_epi32(sq, zero));
+
+        vsat = _mm256_sub_epi16(vsat, _mm256_cmpgt_epi16(v, limit));
+    }
+
+    _mm256_storeu_si256((__m256i *) lanes16, vmin);
+    for (j = 0; j < 16; ++j)
+    {
+        min = (lanes16[j] < min) ? lanes16[j] : min;
+    }
+
+    _mm256_storeu_si256((__m256i *) lanes16, vmax);
+    for (j = 0; j < 16; ++j)
+    {
+        max = (lanes16[j] > max) ? lanes16[j] : max;
+    }
+
+    _mm256_storeu_si256((__m256i *) lanes16, vsat);
+    for (j = 0; j < 16; ++j)
+    {
+        saturated += (unsigned short) lanes16[j];
+    }
+
+    _mm256_storeu_si256((__m256i *) lanes32, vsum);
+    for (j = 0; j < 8; ++j)
+    {
+        sum += lanes32[j];
+    }
+
+    _mm256_storeu_si256((__m256i *) lanes64, vsumsq);
+    sumsq = lanes64[0] + lanes64[1] + lanes64[2] + lanes64[3];
+
+    ist_span_merge(p_ist, i, min, max, sum, sumsq, saturated);
+    ist_span_scalar(p_ist, p_data + i, nelements - i);
+}
+
+#endif
+
+static void ist_init_isa(void)
+{
+    ist_kernel[PXC_ISA_SCALAR_E] = ist_span_scalar;
+
+#ifdef IST_X86
+    ist_kernel[PXC_ISA_SSE2_E] = ist_span_sse2;
+    ist_kernel[PXC_ISA_AVX2_E] = ist_span_avx2;
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        ist_isa_max = PXC_ISA_AVX2_E;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        ist_isa_max = PXC_ISA_SSE2_E;
+    }
+#endif
+
+    ist_isa = ist_isa_max;
+}
+
+void ist_init(IST_T *p_ist, unsigned short saturation, unsigned int *p_hist)
+{
+    memset(p_ist, 0, sizeof(IST_T));
+
+    p_ist->min = 0xffff;
+    p_ist->saturation = saturation;
+    p_ist->p_hist = p_hist;
+
+    if (p_hist != NULL)
+    {
+        memset(p_hist, 0, IST_HIST_SIZE * sizeof(unsigned int));
+    }
+}
+
+void ist_add(IST_T *p_ist, const unsigned short *p_data, size_t nelements)
+{
+    size_t i;
+    size_t j;
+    size_t n;
+
+    pthread_once(&ist_once, ist_init_isa);
+
+    for (i = 0; i < nelements; i += n)
+    {
+        n = ((nelements - i) < IST_CHUNK) ? (nelements - i) : IST_CHUNK;
+
+        ist_kernel[ist_isa](p_ist, p_data + i, n);
+
+        if (p_ist->p_hist != NULL)
+        {
+            for (j = 0; j < n; ++j)
+            {
+                ++p_ist->p_hist[p_data[i + j]];
+            }
+        }
+    }
+
+    p_ist->pixels += nelements;
+}
+
+static void ist_add_rows(IST_T *p_ist, const unsigned short *p_data, long cols,
+        long x1, long y1, long x2, long y2)
+{
+    long y;
+
+    /* whole rows are one contiguous span */
+    if ((x1 == 0) && (x2 == cols))
+    {
+        ist_add(p_ist, p_data + (y1 * cols), (y2 - y1) * cols);
+        return;
+    }
+
+    for (y = y1; y < y2; ++y)
+    {
+        ist_add(p_ist, p_data + (y * cols) + x1, x2 - x1);
+    }
+}
+
+static void *ist_thread(void *p_arg)
+{
+    IST_PART_T *p_part = (IST_PART_T *) p_arg;
+
+    ist_add_rows(&p_part->ist, p_part->p_data, p_part->cols, p_part->x1,
+            p_part->y1, p_part->x2, p_part->y2);
+
+    return NULL;
+}
+
+int ist_add_region(IST_T *p_ist, const unsigned short *p_data, long cols,
+        long x1, long y1, long x2, long y2, int threads)
+{
+    int t;
+    int failed = 0;
+    long pixels;
+    IST_PART_T part[IST_THREADS_MAX];
+    pthread_t tid[IST_THREADS_MAX];
+    int started[IST_THREADS_MAX];
+
+    if ((cols <= 0) || (x1 < 0) || (y1 < 0) || (x1 > x2) || (y1 > y2)
+            || (x2 > cols))
+    {
+        return -1;
+    }
+
+    if (threads <= 0)
+    {
+        threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    pixels = (x2 - x1) * (y2 - y1);
+
+    if (threads > (pixels / IST_THREAD_PIXELS))
+    {
+        threads = pixels / IST_THREAD_PIXELS;
+    }
+
+    if (threads > (y2 - y1))
+    {
+        threads = y2 - y1;
+    }
+
+    if (threads > IST_THREADS_MAX)
+    {
+        threads = IST_THREADS_MAX;
+    }
+
+    if (threads <= 1)
+    {
+        ist_add_rows(p_ist, p_data, cols, x1, y1, x2, y2);
+        return 0;
+    }
+
+    /* part 0 fills caller's histogram, other parts have their own */
+    for (t = 0; t < threads; ++t)
+    {
+        ist_init(&part[t].ist, p_ist->saturation, NULL);
+
+        if (p_ist->p_hist != NULL)
+        {
+            if (t == 0)
+            {
+                part[t].ist.p_hist = p_ist->p_hist;
+            }
+            else if ((part[t].ist.p_hist = (unsigned int *) calloc(
+                    IST_HIST_SIZE, sizeof(unsigned int))) == NULL)
+            {
+                failed = 1;
+            }
+        }
+
+        part[t].p_data = p_data;
+        part[t].cols = cols;
+        part[t].x1 = x1;
+        part[t].x2 = x2;
+        part[t].y1 = y1 + ((y2 - y1) * t) / threads;
+        part[t].y2 = y1 + ((y2 - y1) * (t + 1)) / threads;
+        started[t] = 0;
+    }
+
+    if (failed)
+    {
+        for (t = 1; t < threads; ++t)
+        {
+            free(part[t].ist.p_hist);
+        }
+
+        return -1;
+    }
+
+    for (t = 1; t < threads; ++t)
+    {
+        started[t] = !pthread_create(&tid[t], NULL, ist_thread, &part[t]);
+    }
+
+    ist_thread(&part[0]);
+
+    for (t = 1; t < threads; ++t)
+    {
+        if (started[t])
+        {
+            pthread_join(tid[t], NULL);
+        }
+        else
+        {
+            ist_thread(&part[t]);
+        }
+    }
+
+    part[0].ist.p_hist = NULL;
+    ist_merge(p_ist, &part[0].ist);
+
+    for (t = 1; t < threads; ++t)
+    {
+        ist_merge(p_ist, &part[t].ist);
+        free(part[t].ist.p_hist);
+    }
+
+    return 0;
+}
+
+void ist_merge(IST_T *p_dst, const IST_T *p_src)
+{
+    int i;
+
+    if (p_src->pixels == 0)
+    {
+        return;
+    }
+
+    p_dst->pixels += p_src->pixels;
+    p_dst->sum += p_src->sum;
+    p_dst->sumsq += p_src->sumsq;
+    p_dst->saturated += p_src->saturated;
+
+    if (p_src->min < p_dst->min)
+    {
+        p_dst->min = p_src->min;
+    }
+
+    if (p_src->max > p_dst->max)
+    {
+        p_dst->max = p_src->max;
+    }
+
+    if ((p_dst->p_hist != NULL) && (p_src->p_hist != NULL)
+            && (p_dst->p_hist != p_src->p_hist))
+    {
+        for (i = 0; i < IST_HIST_SIZE; ++i)
+        {
+            p_dst->p_hist[i] += p_src->p_hist[i];
+        }
+    }
+}
+
+double ist_mean(const IST_T *p_ist)
+{
+    if (p_ist->pixels == 0)
+    {
+        return 0;
+    }
+
+    return (double) p_ist->sum / p_ist->pixels;
+}
+
+/* population variance as CImage::GetStats(), sums are exact */
+double ist_variance(const IST_T *p_ist)
+{
+    double mean;
+    double variance;
+
+    if (p_ist->pixels == 0)
+    {
+        return 0;
+    }
+
+    mean = ist_mean(p_ist);
+    variance = ((double) p_ist->sumsq / p_ist->pixels) - (mean * mean);
+
+    return (variance < 0) ? 0 : variance;
+}
+
+double ist_stddev(const IST_T *p_ist)
+{
+    return sqrt(ist_variance(p_ist));
+}
+
+PXC_ISA_T ist_get_isa(void)
+{
+    pthread_once(&ist_once, ist_init_isa);
+
+    return ist_isa;
+}
+
+int ist_set_isa(PXC_ISA_T isa)
+{
+    pthread_once(&ist_once, ist_init_isa);
+
+    if ((isa < 0) || (isa > ist_isa_max))
+    {
+        return -1;
+    }
+
+    ist_isa = isa;
+
+    return 0;
+}
+
+#ifdef SELF_TEST_IMGSTATS
+
+#define IST_LOOPS 20
+
+static double ist_elapsed_ms(struct timespec *p_start, struct timespec *p_end)
+{
+    return ((p_end->tv_sec - p_start->tv_sec) * 1000.0)
+            + ((p_end->tv_nsec - p_start->tv_nsec) / 1000000.0);
+}
+
+static int ist_equal(const IST_T *p_a, const IST_T *p_b)
+{
+    if ((p_a->pixels != p_b->pixels) || (p_a->sum != p_b->sum)
+            || (p_a->sumsq != p_b->sumsq) || (p_a->saturated != p_b->saturated)
+            || (p_a->min != p_b->min) || (p_a->max != p_b->max))
+    {
+        return 0;
+    }
+
+    if ((p_a->p_hist != NULL) && (p_b->p_hist != NULL)
+            && memcmp(p_a->p_hist, p_b->p_hist,
+                    IST_HIST_SIZE * sizeof(unsigned int)))
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Check every kernel and threaded regions against scalar code and print time
+ * per frame. Odd sizes exercise scalar tails, saturation 0 and 1 the
+ * comparison limits.
+ */
+int main(int argc, char *argv[])
+{
+    int i;
+    int j;
+    int k;
+    int loop;
+    int failed = 0;
+    size_t n;
+    long sizes[][2] = { { 4096, 4096 }, { 2048, 2048 }, { 37, 3 } };
+    unsigned short saturations[] = { IST_SATURATION, 40000, 1, 0 };
+    unsigned short *p_src;
+    unsigned int *p_hist;
+    unsigned int *p_ref_hist;
+    IST_T ref;
+    IST_T ist;
+    struct timespec start;
+    struct timespec end;
+
+    printf("cpu: %s\n", pxc_get_isa_name(ist_get_isa()));
+
+    p_hist = malloc(IST_HIST_SIZE * sizeof(unsigned int));
+    p_ref_hist = malloc(IST_HIST_SIZE * sizeof(unsigned int));
+
+    for (i = 0; i < (sizeof(sizes) / sizeof(sizes[0])); ++i)
+    {
+        n = sizes[i][0] * sizes[i][1];
+
+        if ((p_src = malloc(n * sizeof(unsigned short))) == NULL)
+        {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+
+        for (j = 0; j < n; ++j)
+        {
+            p_src[j] = (unsigned short) (j * 2654435761u >> 7);
+        }
+
+        /* extremes */
+        p_src[n / 2] = 0;
+        p_src[n - 1] = 0xffff;
+
+        printf("%lix%li:\n", sizes[i][0], sizes[i][1]);
+
+        for (j = 0; j < (sizeof(saturations) / sizeof(saturations[0])); ++j)
+        {
+            ist_set_isa(PXC_ISA_SCALAR_E);
+            ist_init(&ref, saturations[j], p_ref_hist);
+            ist_add(&ref, p_src, n);
+
+            for (k = 0; k < PXC_ISA_MAX_E; ++k)
+            {
+                if (ist_set_isa(k) == -1)
+                {
+                    continue;
+                }
+
+                ist_init(&ist, saturations[j], p_hist);
+                ist_add(&ist, p_src, n);
+
+                if (!ist_equal(&ist, &ref))
+                {
+                    printf("FAILED %s saturation %u\n", pxc_get_isa_name(k),
+                            saturations[j]);
+                    failed = 1;
+                }
+
+                ist_init(&ist, saturations[j], p_hist);
+                ist_add_region(&ist, p_src, sizes[i][0], 0, 0, sizes[i][0],
+                        sizes[i][1], IST_THREADS_MAX);
+
+                if (!ist_equal(&ist, &ref))
+                {
+                    printf("FAILED %s saturation %u region\n",
+                            pxc_get_isa_name(k), saturations[j]);
+                    failed = 1;
+                }
+
+                if (j != 0)
+                {
+                    continue;
+                }
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                for (loop = 0; loop < IST_LOOPS; ++loop)
+                {
+                    ist_init(&ist, saturations[j], NULL);
+                    ist_add(&ist, p_src, n);
+                }
+                clock_gettime(CLOCK_MONOTONIC, &end);
+
+                printf("    %-6s %8.3f ms/frame", pxc_get_isa_name(k),
+                        ist_elapsed_ms(&start, &end) / IST_LOOPS);
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                for (loop = 0; loop < IST_LOOPS; ++loop)
+                {
+                    ist_init(&ist, saturations[j], p_hist);
+                    ist_add_region(&ist, p_src, sizes[i][0], 0, 0,
+                            sizes[i][0], sizes[i][1], 0);
+                }
+                clock_gettime(CLOCK_MONOTONIC, &end);
+
+                printf(", %8.3f ms/frame with histogram\n",
+                        ist_elapsed_ms(&start, &end) / IST_LOOPS);
+            }
+        }
+
+        /* inner region, threads against single pass over its rows */
+        if (sizes[i][1] > 4)
+        {
+            ist_set_isa(PXC_ISA_SCALAR_E);
+            ist_init(&ref, IST_SATURATION, p_ref_hist);
+            for (j = 1; j < (sizes[i][1] - 1); ++j)
+            {
+                ist_add(&ref, p_src + (j * sizes[i][0]) + 3,
+                        sizes[i][0] - 8);
+            }
+
+            ist_set_isa(ist_isa_max);
+            ist_init(&ist, IST_SATURATION, p_hist);
+            ist_add_region(&ist, p_src, sizes[i][0], 3, 1, sizes[i][0] - 5,
+                    sizes[i][1] - 1, IST_THREADS_MAX);
+
+            if (!ist_equal(&ist, &ref))
+            {
+                printf("FAILED inner region\n");
+                failed = 1;
+            }
+        }
+
+        free(p_src);
+    }
+
+    free(p_hist);
+    free(p_ref_hist);
+
+    exit((failed) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+#endif
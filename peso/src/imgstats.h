@@ -0,0 +1,62 @@
+/**
+ * Author: Jan Fuchs <fuky@sunstel.asu.cas.cz>
+ * $Date$
+ * $Rev$
+ */
+
+#ifndef __IMGSTATS_H
+#define __IMGSTATS_H
+
+#include <stddef.h>
+
+#include "pixconv.h"
+
+#define IST_HIST_SIZE   65536
+#define IST_SATURATION  65535
+#define IST_THREADS_MAX 16
+
+/*
+ * Streaming statistics of 16-bit pixels. Sums are exact integers, so pixels
+ * may be added in any order and pieces merged without loss of precision.
+ * Histogram is optional, p_hist points to IST_HIST_SIZE bins owned by
+ * caller.
+ */
+typedef struct
+{
+    unsigned long long pixels;
+    unsigned long long sum;
+    unsigned long long sumsq;
+    unsigned long long saturated;
+    unsigned short min;
+    unsigned short max;
+    unsigned short saturation; /* pixels >= saturation are counted */
+    unsigned int *p_hist;
+} IST_T;
+
+/* p_hist may be NULL, otherwise it is cleared */
+void ist_init(IST_T *p_ist, unsigned short saturation, unsigned int *p_hist);
+
+/* add nelements pixels in one pass, histogram is filled on the fly */
+void ist_add(IST_T *p_ist, const unsigned short *p_data, size_t nelements);
+
+/*
+ * Add region [x1, x2) x [y1, y2) of image with cols pixels per row. Rows are
+ * split between threads (0 = number of CPUs), each with its own histogram.
+ * Returns -1 if region is invalid or memory for histograms is missing.
+ */
+int ist_add_region(IST_T *p_ist, const unsigned short *p_data, long cols,
+        long x1, long y1, long x2, long y2, int threads);
+
+/* p_dst += p_src, histograms are added too if both have one */
+void ist_merge(IST_T *p_dst, const IST_T *p_src);
+
+double ist_mean(const IST_T *p_ist);
+double ist_variance(const IST_T *p_ist);
+double ist_stddev(const IST_T *p_ist);
+
+PXC_ISA_T ist_get_isa(void);
+
+/* force instruction set, returns -1 if CPU doesn't support it */
+int ist_set_isa(PXC_ISA_T isa);
+
+#endif
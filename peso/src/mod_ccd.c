@@ -5,12 +5,18 @@
  * $URL$
  */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "modules.h"
 #include "mod_ccd.h"
 #include "thread.h"
 
+static PESO_FRAME_T mod_ccd_frames[PESO_FRAME_BUFFERS];
+static int mod_ccd_frame_index = 0;
+static pthread_mutex_t mod_ccd_frame_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mod_ccd_frame_cond = PTHREAD_COND_INITIALIZER;
+
 int mod_ccd_check_state(int state)
 {
     if (state != CCD_STATE_READY_E)
@@ -107,3 +113,116 @@ const char *peso_get_version(void)
 {
     return SVN_REV;
 }
+
+/*
+ * Allocate PESO_FRAME_BUFFERS frame buffers once, they are reused for all
+ * exposures.
+ */
+int mod_ccd_frame_init(long nelements)
+{
+    int i;
+
+    mod_ccd_frame_uninit();
+
+    for (i = 0; i < PESO_FRAME_BUFFERS; ++i)
+    {
+        mod_ccd_frames[i].id = i;
+        mod_ccd_frames[i].state = PESO_FRAME_FREE_E;
+        mod_ccd_frames[i].nelements = nelements;
+
+        if ((mod_ccd_frames[i].p_data = (unsigned short *) malloc(
+                nelements * sizeof(unsigned short))) == NULL)
+        {
+            mod_ccd_frame_uninit();
+            strncpy(peso.msg, "Error: mod_ccd_frame_init(): malloc() failed",
+                    CCD_MSG_MAX);
+            return -1;
+        }
+    }
+
+    mod_ccd_frame_index = 0;
+
+    return 0;
+}
+
+void mod_ccd_frame_uninit(void)
+{
+    int i;
+
+    for (i = 0; i < PESO_FRAME_BUFFERS; ++i)
+    {
+        free(mod_ccd_frames[i].p_data);
+        mod_ccd_frames[i].p_data = NULL;
+        mod_ccd_frames[i].state = PESO_FRAME_FREE_E;
+    }
+}
+
+/*
+ * Return buffer for the next readout, wait until exposed releases one if
+ * all of them are leased.
+ */
+unsigned short *mod_ccd_frame_fill(void)
+{
+    PESO_FRAME_T *p_frame;
+
+    /* LOCK */
+    pthr_mutex_lock(&mod_ccd_frame_mutex);
+
+    while (mod_ccd_frames[mod_ccd_frame_index].state == PESO_FRAME_LEASED_E)
+    {
+        pthread_cond_wait(&mod_ccd_frame_cond, &mod_ccd_frame_mutex);
+    }
+
+    p_frame = &mod_ccd_frames[mod_ccd_frame_index];
+    p_frame->state = PESO_FRAME_FILL_E;
+
+    pthr_mutex_unlock(&mod_ccd_frame_mutex);
+    /* UNLOCK */
+
+    return p_frame->p_data;
+}
+
+/* lend the filled buffer and switch to the next one */
+int mod_ccd_frame_acquire(PESO_FRAME_T **pp_frame)
+{
+    PESO_FRAME_T *p_frame;
+
+    /* LOCK */
+    pthr_mutex_lock(&mod_ccd_frame_mutex);
+
+    p_frame = &mod_ccd_frames[mod_ccd_frame_index];
+
+    if ((p_frame->p_data == NULL) || (p_frame->state != PESO_FRAME_FILL_E))
+    {
+        pthr_mutex_unlock(&mod_ccd_frame_mutex);
+        /* UNLOCK */
+
+        strncpy(peso.msg, "Error: mod_ccd_frame_acquire(): frame not filled",
+                CCD_MSG_MAX);
+        return -1;
+    }
+
+    p_frame->state = PESO_FRAME_LEASED_E;
+    mod_ccd_frame_index = (mod_ccd_frame_index + 1) % PESO_FRAME_BUFFERS;
+
+    pthr_mutex_unlock(&mod_ccd_frame_mutex);
+    /* UNLOCK */
+
+    *pp_frame = p_frame;
+
+    return 0;
+}
+
+int mod_ccd_frame_release(PESO_FRAME_T *p_frame)
+{
+    /* LOCK */
+    pthr_mutex_lock(&mod_ccd_frame_mutex);
+
+    p_frame->state = PESO_FRAME_FREE_E;
+    pthread_cond_broadcast(&mod_ccd_frame_cond);
+
+    pthr_mutex_unlock(&mod_ccd_frame_mutex);
+    /* UNLOCK */
+
+    return 0;
+}
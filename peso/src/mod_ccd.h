@@ -9,6 +9,12 @@
 
 int mod_ccd_check_state(int state);
 
+int mod_ccd_frame_init(long nelements);
+void mod_ccd_frame_uninit(void);
+unsigned short *mod_ccd_frame_fill(void);
+int mod_ccd_frame_acquire(PESO_FRAME_T **pp_frame);
+int mod_ccd_frame_release(PESO_FRAME_T *p_frame);
+
 void peso_set_int(int *p_peso_int, int number);
 void peso_get_int(int *p_peso_int, int *p_number);
 void peso_set_double(double *p_peso_double, double number);
@@ -34,6 +34,7 @@
 #include "mod_ccd_bilbo.h"
 #include "header.h"
 #include "thread.h"
+#include "pixconv.h"
 
 PESO_T peso;
 
@@ -496,16 +497,6 @@ void bil_set_autoreadout(int yesno)
     }
 }
 
-static void bil_subtract_32768(unsigned short int * sbuf, size_t count) {
-    int n;
-    unsigned short int *sp;
-
-    sp = sbuf;
-    for ( n = 0; n < count; n++ ) {
-        *sp++ -= 32768;
-    }
-}
-
 // Nastavi ruzne parametry kamery dulezite pro vycitani dat
 static void bil_set_common()
 {
@@ -886,9 +877,8 @@ int ccd_readout(void)
 
 int ccd_save_raw_image()
 {
-    int x, y, offset, items, imlen, wlen;
-    int x1, x2;
-    unsigned short int *xp, *xpend, dummy;
+    int y, offset, items, imlen, wlen;
+    int x1;
     int Xover, Yover, xover = 0, yover = 0;
     FILE *fw;
     int startline = 0;
@@ -929,23 +919,14 @@ int ccd_save_raw_image()
     }
 
     x1 = bil_brocam_info.imx - (xover / bil_brocam_info.binx);
-    x2 = x1 / 2;
 
+    /* mirror lines without overscan */
     for (y = startline; y < endline; y++)
     {
-        xp = imbuf + (y * bil_brocam_info.imx);
-        xpend = xp + x1 - 1;
-        for (x = 0; x < x2; x++)
-        {
-            dummy = *(xp);
-            *(xp++) = *(xpend);
-            *(xpend--) = dummy;
-        }
+        pxc_convert(imbuf + (y * bil_brocam_info.imx),
+                imbuf + (y * bil_brocam_info.imx), x1, PXC_REVERSE);
     }
 
-    //bil_subtract_32768(imstart, items);
-    //swab((void *) imstart, (void *) imstart, imlen);
-
     /* peso.raw_image not lock */
     if ((fw = fopen(peso.raw_image, "w")) == NULL)
     {
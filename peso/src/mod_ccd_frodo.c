@@ -25,6 +25,7 @@
 #include "mod_ccd.h"
 #include "thread.h"
 #include "mod_ccd_frodo.h"
+#include "imgstats.h"
 
 #define LINUX 
 typedef int HANDLE;
@@ -41,6 +42,13 @@ typedef int HANDLE;
 
 #define PCI_DEVICE_NAME         "/dev/astropci0\0"
 
+/* missing in CArcDevice libraries built without ASTROPCI_WAIT_FOR_PIXELS */
+#pragma weak ArcDevice_WaitForPixels
+#pragma weak ArcDevice_WaitForFrame
+#pragma weak ArcDevice_StartTemperatureSampler
+#pragma weak ArcDevice_PauseTemperatureSampler
+#pragma weak ArcDevice_GetCachedArrayTemperature
+
 #ifdef SELF_TEST_FRODO
 
 log4c_category_t *p_logcat = NULL;
@@ -57,8 +65,37 @@ static int fro_expose;
 static int fro_buffer_size;
 static float fro_readout_set;
 static unsigned long fro_data_size;
-static unsigned short *p_fro_raw_data = NULL;
 static int fro_status;
+static int fro_pixel_count;
+static int fro_temp_sampler;
+static int fro_temp_paused;
+
+/*
+ * Readout waiter thread sleeps in ArcDevice_WaitForPixels() and calls
+ * fro_readout_notify() whenever pixel count changes or readout ends.
+ * fro_wait_* are protected by fro_wait_mutex.
+ */
+static void (*fro_readout_notify)(void);
+static pthread_t fro_wait_thread;
+static pthread_mutex_t fro_wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int fro_wait_running;
+static int fro_wait_pixel_max;
+static int fro_wait_pixel_count;
+static int fro_wait_status;
+static int fro_wait_done;
+static int fro_wait_stop;
+
+/*
+ * Continuous readout, controller writes frames into ring of fro_cont_slots
+ * slots in DMA common buffer, frame n (from 1) is stored in slot
+ * (n - 1) % fro_cont_slots.
+ */
+static unsigned char *p_fro_cont_buffer;
+static long fro_cont_slot_size;
+static int fro_cont_slots;
+static int fro_cont_frames;
+static int fro_cont_read;
+static PESO_FRAME_T fro_cont_frame;
 
 __attribute__((format(printf,1,2)))
 static int ccd_save_error(const char *p_fmt, ...)
@@ -107,15 +144,20 @@ int controller_setup(void)
 {
     //ArcCam_OpenByNameWithBuffer(fro_dev_list.szDevList[0], fro_buffer_size,
     //        &fro_status);
-    ArcDevice_Open(0, &fro_status);
+    ArcDevice_Open_I(0, fro_buffer_size, &fro_status);
 
     if (fro_status != ARC_STATUS_OK)
     {
-        ccd_save_error("Error: ArcCam_OpenByNameWithBuffer() failed: %s\n",
-                ArcDevice_GetLastError());
+        ccd_save_error("Error: ArcDevice_Open_I(0, %i) failed: %s\n",
+                fro_buffer_size, ArcDevice_GetLastError());
         return -1;
     }
 
+    log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_INFO,
+            "common buffer %i B, %i frames of %lu B\n",
+            ArcDevice_CommonBufferSize(&fro_status),
+            peso.p_exposed_cfg->ccd_frodo.buffer_frames, fro_data_size);
+
 //    ArcCam_SetLogCmds(1);
 //    while (ArcCam_GetLoggedCmdCount() > 0)
 //    {
@@ -147,8 +189,77 @@ int controller_setup(void)
     return 0;
 }
 
+/*
+ * Temperature sampler in library reads controller in background, so
+ * ccd_get_temp() never waits for the fibre link, not even during exposure.
+ */
+static void fro_temp_sampler_start(void)
+{
+    fro_temp_sampler = 0;
+    fro_temp_paused = 0;
+
+    if (ArcDevice_StartTemperatureSampler == NULL)
+    {
+        return;
+    }
+
+    ArcDevice_StartTemperatureSampler(FRO_TEMP_PERIOD, &fro_status);
+
+    if (fro_status != ARC_STATUS_OK)
+    {
+        log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_WARN,
+                "Warning: ArcDevice_StartTemperatureSampler() failed: %s\n",
+                ArcDevice_GetLastError());
+        return;
+    }
+
+    fro_temp_sampler = 1;
+}
+
+/*
+ * Keep sampler off the fibre link while exposure is started (SET/SEX) and
+ * while it is read out, it runs during the exposure itself.
+ */
+static void fro_temp_sampler_pause(int pause)
+{
+    if ((!fro_temp_sampler) || (fro_temp_paused == pause))
+    {
+        return;
+    }
+
+    ArcDevice_PauseTemperatureSampler(pause, &fro_status);
+    fro_temp_paused = pause;
+}
+
 int ccd_get_temp(double *p_temp)
 {
+    long sample_time;
+
+    if (fro_temp_sampler)
+    {
+        *p_temp = ArcDevice_GetCachedArrayTemperature(&sample_time,
+                &fro_status);
+
+        if ((fro_status == ARC_STATUS_OK)
+                && (time(NULL) - sample_time <= FRO_TEMP_MAX_AGE))
+        {
+            return 0;
+        }
+
+        /* controller must not be read now, last sample is the best we have */
+        if ((fro_status == ARC_STATUS_OK) && fro_temp_paused)
+        {
+            log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_INFO,
+                    "sampler paused, cached array temperature age %lds\n",
+                    (long) (time(NULL) - sample_time));
+            return 0;
+        }
+
+        log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_WARN,
+                "Warning: cached array temperature is not valid (age %lds)\n",
+                (long) (time(NULL) - sample_time));
+    }
+
     if (mod_ccd_check_state(peso.state) == -1)
     {
         return -1;
@@ -185,20 +296,24 @@ int ccd_init(void)
     peso.pixel_count_max = peso.x2 * peso.y2;
     peso.bits_per_pixel = peso.p_exposed_cfg->ccd.bits_per_pixel;
 
-    fro_buffer_size = 2200 * 2200 * 2;
-
     fro_data_size = (peso.x2 - peso.x1 + 1) / peso.xb;
     fro_data_size *= (peso.y2 - peso.y1 + 1) / peso.yb;
     fro_data_size *= sizeof(unsigned short);
 
-    if (p_fro_raw_data != NULL)
+    /* frames are 1024 bytes aligned, see ccd_continuous_start() */
+    fro_buffer_size = ((fro_data_size + 1023) & ~1023L)
+            * peso.p_exposed_cfg->ccd_frodo.buffer_frames;
+
+    if (peso.p_exposed_cfg->ccd_frodo.buffer_frames < 1)
     {
-        free(p_fro_raw_data);
-        p_fro_raw_data = NULL;
+        ccd_save_error("Error: ccd_frodo.buffer_frames = %i, at least 1 "
+                "required\n", peso.p_exposed_cfg->ccd_frodo.buffer_frames);
+        return -1;
     }
-    if ((p_fro_raw_data = (unsigned short *) malloc(fro_data_size)) == NULL)
+
+    if (mod_ccd_frame_init(fro_data_size / sizeof(unsigned short)) == -1)
     {
-        log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_ERROR, "Error: malloc() failed");
+        log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_ERROR, "%s", peso.msg);
         return -1;
     }
 
@@ -223,6 +338,8 @@ int ccd_init(void)
         return -1;
     }
 
+    fro_temp_sampler_start();
+
 //    while (ArcCam_GetLoggedCmdCount() > 0)
 //    {
 //        log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_INFO, "ASTROPCI => %s\n",
@@ -248,8 +365,7 @@ int ccd_uninit(void)
 {
     ArcDevice_Close();
 
-    free(p_fro_raw_data);
-    p_fro_raw_data = NULL;
+    mod_ccd_frame_uninit();
 
     return 0;
 }
@@ -257,6 +373,7 @@ int ccd_uninit(void)
 int ccd_expose_init(void)
 {
     peso_set_int(&peso.readout_time, 30);
+    fro_pixel_count = 0;
 
     return 0;
 }
@@ -320,12 +437,15 @@ int ccd_expose_start(void)
 //        return -1;
 //    }
 
+    fro_temp_sampler_pause(1);
+
     log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_INFO, "ccd_expose_start SET");
     ArcDevice_Command_I(TIM_ID, SET, peso.exptime * 1000, &fro_status);
     if (fro_status != ARC_STATUS_OK)
     {
         ccd_save_error("Error: ArcDevice_Command_I(TIM_ID, SET, %d) failed: %s\n",
                 peso.exptime, ArcDevice_GetLastError());
+        fro_temp_sampler_pause(0);
         return -1;
     }
 
@@ -335,6 +455,7 @@ int ccd_expose_start(void)
     {
         ccd_save_error("Error: ArcDevice_SetOpenShutter(%d) failed: %s\n",
                 peso.shutter, ArcDevice_GetLastError());
+        fro_temp_sampler_pause(0);
         return -1;
     }
 
@@ -346,9 +467,12 @@ int ccd_expose_start(void)
     {
         ccd_save_error("Error: ArcDevice_Command_I(TIM_ID, SEX, -1) failed: %s\n",
                 ArcDevice_GetLastError());
+        fro_temp_sampler_pause(0);
         return -1;
     }
 
+    fro_temp_sampler_pause(0);
+
     return 0;
 }
 
@@ -373,6 +497,7 @@ int ccd_expose(void)
 
     if (is_readout)
     {
+        fro_temp_sampler_pause(1);
         fro_readout = 1;
         /* expose = false */
         return 0;
@@ -475,9 +600,95 @@ int ccd_expose(void)
     return 1;
 }
 
+static void *fro_readout_wait(void *p_arg)
+{
+    int pixel_count;
+    int status = ARC_STATUS_OK;
+    int done;
+
+    do
+    {
+        /* returns on end of readout interrupt or after FRO_READOUT_WAIT */
+        pixel_count = ArcDevice_WaitForPixels(fro_wait_pixel_max,
+                FRO_READOUT_WAIT, &status);
+
+        /* LOCK */
+        pthread_mutex_lock(&fro_wait_mutex);
+
+        fro_wait_pixel_count = pixel_count;
+        fro_wait_status = status;
+        done = ((pixel_count >= fro_wait_pixel_max)
+                || (status != ARC_STATUS_OK) || fro_wait_stop);
+        fro_wait_done = done;
+
+        pthread_mutex_unlock(&fro_wait_mutex);
+        /* UNLOCK */
+
+        fro_readout_notify();
+    } while (!done);
+
+    return NULL;
+}
+
+static int fro_readout_wait_start(int pixel_max)
+{
+    fro_wait_pixel_max = pixel_max;
+    fro_wait_pixel_count = 0;
+    fro_wait_status = ARC_STATUS_OK;
+    fro_wait_done = 0;
+    fro_wait_stop = 0;
+
+    if (pthread_create(&fro_wait_thread, NULL, fro_readout_wait, NULL) != 0)
+    {
+        ccd_save_error("Error: pthread_create(fro_readout_wait): %i: %s",
+                errno, strerror(errno));
+        return -1;
+    }
+
+    fro_wait_running = 1;
+
+    return 0;
+}
+
+static void fro_readout_wait_join(void)
+{
+    if (!fro_wait_running)
+    {
+        return;
+    }
+
+    /* LOCK */
+    pthread_mutex_lock(&fro_wait_mutex);
+    fro_wait_stop = 1;
+    pthread_mutex_unlock(&fro_wait_mutex);
+    /* UNLOCK */
+
+    pthread_join(fro_wait_thread, NULL);
+    fro_wait_running = 0;
+}
+
+/*
+ * Register function called when readout progresses, ccd_readout() then
+ * does not sleep in the driver. Library without ArcDevice_WaitForPixels()
+ * cannot notify, exposed polls.
+ */
+int ccd_readout_notify(void (*p_notify)(void))
+{
+    if (ArcDevice_WaitForPixels == NULL)
+    {
+        return -1;
+    }
+
+    fro_readout_notify = p_notify;
+
+    return 0;
+}
+
 int ccd_readout(void)
 {
+    int done;
     int pixel_count;
+    int pixel_max;
     time_t actual_time;
 
     //ArcCam_IsReadout(&fro_status);
@@ -491,7 +702,40 @@ int ccd_readout(void)
     (void) time(&actual_time);
     peso_set_int(&peso.elapsed_time, actual_time - peso.stop_exposure_time);
 
-    pixel_count = ArcDevice_GetPixelCount(&fro_status);
+    pixel_max = peso.p_exposed_cfg->ccd.y2 * peso.p_exposed_cfg->ccd.x2;
+
+    if (fro_readout_notify != NULL)
+    {
+        if ((!fro_wait_running) && (fro_readout_wait_start(pixel_max) == -1))
+        {
+            /* readout = true, retry */
+            return 1;
+        }
+
+        /* LOCK */
+        pthread_mutex_lock(&fro_wait_mutex);
+        pixel_count = fro_wait_pixel_count;
+        fro_status = fro_wait_status;
+        done = fro_wait_done;
+        pthread_mutex_unlock(&fro_wait_mutex);
+        /* UNLOCK */
+
+        if (done)
+        {
+            fro_readout_wait_join();
+        }
+    }
+    else if (ArcDevice_WaitForPixels != NULL)
+    {
+        /* sleeps until the end of readout interrupt or FRO_READOUT_WAIT */
+        pixel_count = ArcDevice_WaitForPixels(pixel_max, FRO_READOUT_WAIT,
+                &fro_status);
+    }
+    else
+    {
+        pixel_count = ArcDevice_GetPixelCount(&fro_status);
+    }
+
     if (fro_status != ARC_STATUS_OK)
     {
         ccd_save_error("Error: ArcDevice_GetPixelCount() failed: %s\n",
@@ -502,7 +746,9 @@ int ccd_readout(void)
 
     //log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_INFO, "pixel_count = %i\n", pixel_count);
 
-    if (pixel_count < (peso.p_exposed_cfg->ccd.y2 * peso.p_exposed_cfg->ccd.x2))
+    fro_pixel_count = pixel_count;
+
+    if (pixel_count < pixel_max)
     {
         /* readout = true */
         return 1;
@@ -540,50 +786,292 @@ int ccd_save_raw_image(void)
 
 int ccd_save_fits_file(fitsfile *p_fits, int *p_fits_status)
 {
-    unsigned short *p_from;
-    unsigned short *p_morf;
-    unsigned short *p_data = ArcDevice_CommonBufferVA(&fro_status);
     long fpixel = 1;
     // TODO: pripravit a otestovat i pro x1, xb, y1, yb
     long nelements = peso.x2 * peso.y2;
 
-    /*
-     *  Ukazatele p_fro_raw_data a p_data je treba pred prictenim
-     *  fro_data_size pretypovat na (char *), protoze fro_data_size
-     *  uvadi velikost jiz vynasobenou sizeof(unsigned short)
-     */
-    //p_morf = (unsigned short *) ((char *) p_fro_raw_data + fro_data_size);
-    //p_from = (unsigned short *) ((char *) p_data + fro_data_size);
+    /* controller sends pixels in host byte order, no pxc_convert() needed */
 
-    /* swap bytes */
-    //while (p_from > p_data)
-    //{
-    //    unsigned short left;
-    //    unsigned short right;
+    if (fits_write_img(p_fits, TUSHORT, fpixel, nelements,
+            ArcDevice_CommonBufferVA(&fro_status), p_fits_status))
+    {
+        return -1;
+    }
 
-    //    left = *p_from >> 8;
-    //    right = *p_from << 8;
-    //    *p_morf = left | right;
+    return 0;
+}
 
-    //    p_from--;
-    //    p_morf--;
-    //}
+/*
+ * Append rows completed since last call, pixel count is the one seen by
+ * last ccd_readout(). DMA fills common buffer linearly, so everything
+ * below it is final. *p_written is number of pixels already in file. Rows
+ * are added to p_stats (may be NULL) while they are still in cache.
+ */
+int ccd_save_fits_rows(fitsfile *p_fits, long *p_written, IST_T *p_stats,
+        int *p_fits_status)
+{
+    long complete;
+    long nelements = peso.x2 * peso.y2;
+    unsigned short *p_data;
 
-    //if (fits_write_img(p_fits, TUSHORT, fpixel, nelements,
-    //        p_fro_raw_data, p_fits_status))
-    //{
-    //    return -1;
-    //}
+    complete = (fro_pixel_count / peso.x2) * peso.x2;
 
-    if (fits_write_img(p_fits, TUSHORT, fpixel, nelements,
-            ArcDevice_CommonBufferVA(&fro_status), p_fits_status))
+    if (complete > nelements)
+    {
+        complete = nelements;
+    }
+
+    if (complete <= *p_written)
+    {
+        return 0;
+    }
+
+    p_data = ArcDevice_CommonBufferVA(&fro_status);
+
+    if ((fro_status != ARC_STATUS_OK) || (p_data == NULL))
+    {
+        ccd_save_error("Error: ArcDevice_CommonBufferVA() failed: %s\n",
+                ArcDevice_GetLastError());
+        return -1;
+    }
+
+    if (fits_write_img(p_fits, TUSHORT, 1 + *p_written, complete - *p_written,
+            p_data + *p_written, p_fits_status))
+    {
+        return -1;
+    }
+
+    if (p_stats != NULL)
+    {
+        ist_add(p_stats, p_data + *p_written, complete - *p_written);
+    }
+
+    *p_written = complete;
+
+    return 0;
+}
+
+/*
+ * Next exposure overwrites DMA common buffer, so the frame is copied into
+ * module frame buffer which exposed holds until it is saved.
+ */
+int ccd_frame_acquire(PESO_FRAME_T **pp_frame)
+{
+    unsigned short *p_data;
+
+    p_data = ArcDevice_CommonBufferVA(&fro_status);
+
+    if ((fro_status != ARC_STATUS_OK) || (p_data == NULL))
+    {
+        ccd_save_error("Error: ArcDevice_CommonBufferVA() failed: %s\n",
+                ArcDevice_GetLastError());
+        return -1;
+    }
+
+    memcpy(mod_ccd_frame_fill(), p_data, fro_data_size);
+
+    return mod_ccd_frame_acquire(pp_frame);
+}
+
+int ccd_frame_release(PESO_FRAME_T *p_frame)
+{
+    return mod_ccd_frame_release(p_frame);
+}
+
+static int fro_tim_command(int command, const char *p_command, int arg)
+{
+    ArcDevice_Command_I(TIM_ID, command, arg, &fro_status);
+
+    if (fro_status != ARC_STATUS_OK)
     {
+        ccd_save_error("Error: ArcDevice_Command_I(TIM_ID, %s, %i) failed: %s\n",
+                p_command, arg, ArcDevice_GetLastError());
         return -1;
     }
 
     return 0;
 }
 
+/*
+ * Slot of frame is overwritten by frame + fro_cont_slots, whose readout
+ * starts when frame + fro_cont_slots - 1 is complete.
+ */
+static int fro_cont_overrun(int frame_count, int frame)
+{
+    if ((frame_count - frame) >= (fro_cont_slots - 1))
+    {
+        ccd_save_error("Error: continuous readout overrun, frame %i "
+                "overwritten (%i frames read, %i slots)\n", frame, frame_count,
+                fro_cont_slots);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Start continuous readout of frames, each exposed exptime miliseconds.
+ * Frames are read by ccd_continuous_frame() and ccd_continuous_release().
+ */
+int ccd_continuous_start(int exptime, int frames)
+{
+    int buffer_size;
+
+    /* frames are 1024 bytes aligned, see CArcDevice::Continuous() */
+    fro_cont_slot_size = (fro_data_size + 1023) & ~1023L;
+
+    buffer_size = ArcDevice_CommonBufferSize(&fro_status);
+    p_fro_cont_buffer = ArcDevice_CommonBufferVA(&fro_status);
+
+    if ((fro_status != ARC_STATUS_OK) || (p_fro_cont_buffer == NULL))
+    {
+        ccd_save_error("Error: ArcDevice_CommonBufferVA() failed: %s\n",
+                ArcDevice_GetLastError());
+        return -1;
+    }
+
+    fro_cont_slots = buffer_size / fro_cont_slot_size;
+
+    if (fro_cont_slots < 2)
+    {
+        ccd_save_error("Error: common buffer %i B holds %i frames, "
+                "at least 2 required\n", buffer_size, fro_cont_slots);
+        return -1;
+    }
+
+    fro_cont_frames = frames;
+    fro_cont_read = 0;
+    fro_abort = 0;
+    fro_readout = 0;
+
+    log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_INFO,
+            "ccd_continuous_start(%i, %i), %i slots", exptime, frames,
+            fro_cont_slots);
+
+    fro_temp_sampler_pause(1);
+
+    if ((fro_tim_command(FPB, "FPB", fro_cont_slots) == -1)
+            || (fro_tim_command(SNF, "SNF", frames) == -1))
+    {
+        fro_temp_sampler_pause(0);
+        return -1;
+    }
+
+    ArcDevice_SetOpenShutter(peso.shutter, &fro_status);
+    if (fro_status != ARC_STATUS_OK)
+    {
+        ccd_save_error("Error: ArcDevice_SetOpenShutter(%i) failed: %s\n",
+                peso.shutter, ArcDevice_GetLastError());
+        fro_temp_sampler_pause(0);
+        return -1;
+    }
+
+    if ((fro_tim_command(SET, "SET", exptime) == -1)
+            || (fro_tim_command(SEX, "SEX", -1) == -1))
+    {
+        fro_temp_sampler_pause(0);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Wait at most timeout miliseconds for next frame. Returns 1 and the frame
+ * slot in DMA common buffer, 0 if the frame is not read yet, -1 on error or
+ * if the frame was overwritten. The slot must be returned by
+ * ccd_continuous_release() before next call.
+ */
+int ccd_continuous_frame(PESO_FRAME_T **pp_frame, int timeout)
+{
+    int frame_count;
+
+    if (ArcDevice_WaitForFrame != NULL)
+    {
+        frame_count = ArcDevice_WaitForFrame(fro_cont_read + 1, timeout,
+                &fro_status);
+    }
+    else
+    {
+        frame_count = ArcDevice_GetFrameCount(&fro_status);
+    }
+
+    if (fro_status != ARC_STATUS_OK)
+    {
+        ccd_save_error("Error: ArcDevice_GetFrameCount() failed: %s\n",
+                ArcDevice_GetLastError());
+        return -1;
+    }
+
+    if (frame_count <= fro_cont_read)
+    {
+        return 0;
+    }
+
+    if (fro_cont_overrun(frame_count, fro_cont_read + 1))
+    {
+        return -1;
+    }
+
+    fro_cont_frame.id = fro_cont_read + 1;
+    fro_cont_frame.state = PESO_FRAME_LEASED_E;
+    fro_cont_frame.nelements = fro_data_size / sizeof(unsigned short);
+    fro_cont_frame.p_data = (unsigned short *) (p_fro_cont_buffer
+            + (fro_cont_read % fro_cont_slots) * fro_cont_slot_size);
+
+    *pp_frame = &fro_cont_frame;
+
+    return 1;
+}
+
+/*
+ * Return frame slot, fails if the controller may have written next frame
+ * into the slot while it was being copied.
+ */
+int ccd_continuous_release(PESO_FRAME_T *p_frame)
+{
+    int frame_count;
+
+    frame_count = ArcDevice_GetFrameCount(&fro_status);
+
+    if (fro_status != ARC_STATUS_OK)
+    {
+        ccd_save_error("Error: ArcDevice_GetFrameCount() failed: %s\n",
+                ArcDevice_GetLastError());
+        return -1;
+    }
+
+    p_frame->state = PESO_FRAME_FREE_E;
+    fro_cont_read = p_frame->id;
+
+    if (fro_cont_overrun(frame_count, p_frame->id))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* stop readout if not all frames were read and set single frame mode */
+int ccd_continuous_end(void)
+{
+    if (fro_cont_read < fro_cont_frames)
+    {
+        ArcDevice_StopContinuous(&fro_status);
+
+        if (fro_status != ARC_STATUS_OK)
+        {
+            ccd_save_error("Error: ArcDevice_StopContinuous() failed: %s\n",
+                    ArcDevice_GetLastError());
+            return -1;
+        }
+
+        return 0;
+    }
+
+    return fro_tim_command(SNF, "SNF", 1);
+}
+
 int ccd_expose_end(void)
 {
     if (!fro_readout)
@@ -603,6 +1091,9 @@ int ccd_expose_end(void)
 
 int ccd_expose_uninit(void)
 {
+    fro_readout_wait_join();
+    fro_temp_sampler_pause(0);
+
     if (fro_abort) {
         ArcDevice_StopExposure(&fro_status);
 
@@ -10,6 +10,15 @@
 
 #define FRO_HARDWARE_DATA_MAX 1000000
 
+/* ccd_readout() or readout waiter sleeps in the driver at most [ms] */
+#define FRO_READOUT_WAIT 250
+
+/* background array temperature sample period [ms] */
+#define FRO_TEMP_PERIOD 2000
+
+/* older sample means sampler is stuck, read controller unless paused [s] */
+#define FRO_TEMP_MAX_AGE (3 * FRO_TEMP_PERIOD / 1000)
+
 typedef enum
 {
     FRO_SPEED_10KHZ_E, FRO_SPEED_1MHZ_E, FRO_SPEED_MAX_E,
@@ -36,8 +36,8 @@ static char gan_ccd_gains[PESO_GAINS_MAX + 1];
 static PicamHandle gan_camera;
 static PicamCameraID gan_camera_id;
 static PicamAvailableData gan_available_data;
+/* frame buffer filled by last readout, see mod_ccd_frame_fill() */
 static unsigned short *p_raw_data = NULL;
-static unsigned short *p_raw_data_reverse = NULL;
 
 static unsigned long gan_data_size;
 
@@ -147,6 +147,12 @@ int ccd_init(void)
     gan_data_size *= (peso.y2 - peso.y1 + 1) / peso.yb;
     gan_data_size *= sizeof(unsigned short);
 
+    if (mod_ccd_frame_init(gan_data_size / sizeof(unsigned short)) == -1)
+    {
+        log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_ERROR, "%s", peso.msg);
+        return -1;
+    }
+
     //if (p_gan_raw_data != NULL)
     //{
     //    free(p_gan_raw_data);
@@ -227,8 +233,8 @@ int ccd_uninit(void)
 
     Picam_UninitializeLibrary();
 
-    //free(p_gan_raw_data);
-    //p_gan_raw_data = NULL;
+    mod_ccd_frame_uninit();
+    p_raw_data = NULL;
 
     return 0;
 }
@@ -245,28 +251,6 @@ int ccd_expose_init(void)
     gan_data_size *= (peso.y2 - peso.y1 + 1) / peso.yb;
     gan_data_size *= 2;
 
-    if (p_raw_data != NULL)
-    {
-        free(p_raw_data);
-        p_raw_data = NULL;
-    }
-    if ((p_raw_data = (unsigned short *) malloc(gan_data_size)) == NULL)
-    {
-        log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_INFO, "Error: malloc()");
-        return -1;
-    }
-
-    if (p_raw_data_reverse != NULL)
-    {
-        free(p_raw_data_reverse);
-        p_raw_data_reverse = NULL;
-    }
-    if ((p_raw_data_reverse = (unsigned short *) malloc(gan_data_size)) == NULL)
-    {
-        log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_INFO, "Error: malloc()");
-        return -1;
-    }
-
     int running = 1;
     error = Picam_IsAcquisitionRunning(gan_camera, &running);
     log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_INFO, "Picam_IsAcquisitionRunning(): => %i [running = %i]", error, running);
@@ -508,6 +492,7 @@ int ccd_save_raw_image(void)
     }
 
     // TODO: kontrolovat meze
+    p_raw_data = mod_ccd_frame_fill();
     memcpy(p_raw_data, gan_available_data.initial_readout, sizeof(int16_t) * (2048 * 512));
     fwrite(p_raw_data, sizeof(int16_t), (2048 * 512), fw);
 
@@ -521,18 +506,9 @@ int ccd_save_raw_image(void)
 
 int ccd_save_fits_file(fitsfile *p_fits, int *p_fits_status)
 {
-    //register unsigned short *from;
-    //int index = 0;
     long fpixel = 1;
     long nelements = peso.x2 * peso.y2;
 
-    /* save reverse raw data */
-    //from = (unsigned short *) ((char *) p_raw_data + gan_size);
-    //while (from > p_raw_data)
-    //{
-    //    p_raw_data_reverse[index++] = *from--;
-    //}
-
     if (fits_write_img(p_fits, TUSHORT, fpixel, nelements, p_raw_data,
             p_fits_status))
     {
@@ -542,6 +518,26 @@ int ccd_save_fits_file(fitsfile *p_fits, int *p_fits_status)
     return 0;
 }
 
+/* readout buffer belongs to PICam, copy it into frame buffer */
+int ccd_frame_acquire(PESO_FRAME_T **pp_frame)
+{
+    if (gan_available_data.initial_readout == NULL)
+    {
+        ccd_save_error("Error: ccd_frame_acquire(): readout data not available");
+        return -1;
+    }
+
+    p_raw_data = mod_ccd_frame_fill();
+    memcpy(p_raw_data, gan_available_data.initial_readout, gan_data_size);
+
+    return mod_ccd_frame_acquire(pp_frame);
+}
+
+int ccd_frame_release(PESO_FRAME_T *p_frame)
+{
+    return mod_ccd_frame_release(p_frame);
+}
+
 int ccd_expose_end(void)
 {
     return 0;
@@ -549,12 +545,6 @@ int ccd_expose_end(void)
 
 int ccd_expose_uninit(void)
 {
-    free(p_raw_data_reverse);
-    p_raw_data_reverse = NULL;
-
-    free(p_raw_data);
-    p_raw_data = NULL;
-
     ccd_readout();
     return 0;
 }
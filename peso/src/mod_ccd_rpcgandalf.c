@@ -13,13 +13,17 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
 #include <time.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <fitsio.h>
 #include <xmlrpc-c/base.h>
 #include <xmlrpc-c/client.h>
 #include <log4c.h>
-#include <glib.h>
 
 #include "modules.h"
 #include "mod_ccd.h"
@@ -33,6 +37,22 @@
 #define GAN_RPC_ANSWER_MAX     1023
 #define GAN_RPC_COMMAND_MAX    1023
 
+//#define GAN_RPC_HOST         "127.0.0.1"
+#define GAN_RPC_HOST           "192.168.193.198"
+#define GAN_RPC_PORT           "5000"
+
+/*
+ * Pixels are sent over plain TCP stream, XML-RPC is used only for control.
+ * Header (network byte order): magic, version, bytes per pixel, width,
+ * height, data length [B], Adler-32 of data. Pixels follow in host order of
+ * gandalf host (little endian).
+ */
+#define GAN_DATA_PORT          "5001"
+#define GAN_DATA_MAGIC         0x47414E44 /* "GAND" */
+#define GAN_DATA_VERSION       1
+#define GAN_DATA_HEADER_LEN    24
+#define GAN_DATA_TIMEOUT       10 /* [s] */
+
 #ifdef SELF_TEST_RPCGANDALF
 
 log4c_category_t *p_logcat = NULL;
@@ -44,8 +64,9 @@ PESO_T peso;
 static char ccd_readout_speeds[PESO_READOUT_SPEEDS_MAX + 1];
 static char gan_ccd_gains[PESO_GAINS_MAX + 1];
 static unsigned long gan_size;
+static unsigned long gan_buffer_size;
+/* frame buffer filled by last readout, see mod_ccd_frame_fill() */
 static unsigned short *p_raw_data = NULL;
-static unsigned short *p_raw_data_reverse = NULL;
 
 static xmlrpc_env gan_rpc_env;
 static xmlrpc_client *p_gan_rpc_client = NULL;
@@ -94,14 +115,11 @@ static int gan_rpc_is_fault_occurred(xmlrpc_env *p_gan_rpc_env)
 int gan_rpc_init(void)
 {
     char server_url[GAN_RPC_SERVER_URL_MAX + 1];
-    //char *p_spectrograph_host = "127.0.0.1";
-    char *p_spectrograph_host = "192.168.193.198";
-    char *p_spectrograph_port = "5000";
 
     bzero(gan_rpc_err_msg, GAN_RPC_ERR_MSG_MAX + 1);
 
+    /* frame is not transferred by XML-RPC, default size limit is enough */
     xmlrpc_env_init(&gan_rpc_env);
-    xmlrpc_limit_set(XMLRPC_XML_SIZE_LIMIT_ID, 10 * 1024 * 1024);
 
     xmlrpc_client_create(&gan_rpc_env, 0, "peso", SVN_REV, NULL, 0, &p_gan_rpc_client);
     if (gan_rpc_is_fault_occurred(&gan_rpc_env))
@@ -110,7 +128,7 @@ int gan_rpc_init(void)
     }
 
     snprintf(server_url, GAN_RPC_SERVER_URL_MAX, "http://%s:%s/RPC2",
-            p_spectrograph_host, p_spectrograph_port);
+            GAN_RPC_HOST, GAN_RPC_PORT);
     p_gan_rpc_server_info = xmlrpc_server_info_new(&gan_rpc_env, server_url);
     if (gan_rpc_is_fault_occurred(&gan_rpc_env))
     {
@@ -267,6 +285,15 @@ int ccd_init(void)
     peso.pixel_count_max = peso.x2 * peso.y2;
     peso.bits_per_pixel = peso.p_exposed_cfg->ccd.bits_per_pixel;
 
+    gan_buffer_size = (peso.x2 - peso.x1 + 1) / peso.xb;
+    gan_buffer_size *= (peso.y2 - peso.y1 + 1) / peso.yb;
+    gan_buffer_size *= 2;
+
+    if (mod_ccd_frame_init(gan_buffer_size / 2) == -1)
+    {
+        return -1;
+    }
+
     gan_rpc_init();
     ccd_set_temp(peso.require_temp);
     ccd_get_temp(&peso.actual_temp);
@@ -277,6 +304,8 @@ int ccd_init(void)
 int ccd_uninit(void)
 {
     gan_rpc_uninit();
+    mod_ccd_frame_uninit();
+    p_raw_data = NULL;
     return 0;
 }
 
@@ -292,25 +321,11 @@ int ccd_expose_init(void)
     gan_size *= (peso.y2 - peso.y1 + 1) / peso.yb;
     gan_size *= 2;
 
-    if (p_raw_data != NULL)
-    {
-        free(p_raw_data);
-        p_raw_data = NULL;
-    }
-    if ((p_raw_data = (unsigned short *) malloc(gan_size)) == NULL)
+    if (gan_size > gan_buffer_size)
     {
-        save_sys_error("Error: malloc():");
-        return -1;
-    }
-
-    if (p_raw_data_reverse != NULL)
-    {
-        free(p_raw_data_reverse);
-        p_raw_data_reverse = NULL;
-    }
-    if ((p_raw_data_reverse = (unsigned short *) malloc(gan_size)) == NULL)
-    {
-        save_sys_error("Error: malloc():");
+        snprintf(peso.msg, CCD_MSG_MAX,
+                "Error: frame size %lu > buffer size %lu", gan_size,
+                gan_buffer_size);
         return -1;
     }
 
@@ -445,48 +460,207 @@ int ccd_readout(void)
     return result;
 }
 
-int ccd_save_raw_image()
+static unsigned long gan_adler32(unsigned char *p_data, unsigned long len)
 {
-    const char *p_str;
-    //register unsigned short *from;
-    FILE *fw;
+    unsigned long a = 1;
+    unsigned long b = 0;
+    unsigned long n;
 
-    p_str = gan_rpc_execute_rstr("ccd_save_raw_image");
+    while (len > 0)
+    {
+        /* 5552 is the largest n such that b doesn't overflow 32 bits */
+        n = (len < 5552) ? len : 5552;
+        len -= n;
 
-    guchar *p_out;
-    gsize out_len;
+        while (n-- > 0)
+        {
+            a += *p_data++;
+            b += a;
+        }
 
-    p_out = g_base64_decode(p_str, &out_len);
-    free((void *)p_str);
+        a %= 65521;
+        b %= 65521;
+    }
 
-    /* peso.raw_image not lock */
-    if ((fw = fopen(peso.raw_image, "w")) == NULL)
+    return (b << 16) | a;
+}
+
+static int gan_data_recv(int sockfd, void *p_buffer, unsigned long len)
+{
+    ssize_t count;
+    unsigned char *p_data = p_buffer;
+
+    while (len > 0)
+    {
+        if ((count = recv(sockfd, p_data, len, 0)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            save_sys_error("Error: recv():");
+            return -1;
+        }
+
+        if (count == 0)
+        {
+            snprintf(peso.msg, CCD_MSG_MAX,
+                    "Error: data connection closed, %lu bytes missing", len);
+            return -1;
+        }
+
+        p_data += count;
+        len -= count;
+    }
+
+    return 0;
+}
+
+static int gan_data_connect(void)
+{
+    int sockfd;
+    int result;
+    struct addrinfo hints;
+    struct addrinfo *p_addrinfo;
+    struct timeval timeout = { GAN_DATA_TIMEOUT, 0 };
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if ((result = getaddrinfo(GAN_RPC_HOST, GAN_DATA_PORT, &hints,
+            &p_addrinfo)) != 0)
+    {
+        snprintf(peso.msg, CCD_MSG_MAX, "Error: getaddrinfo(%s): %s",
+                GAN_RPC_HOST, gai_strerror(result));
+        return -1;
+    }
+
+    if ((sockfd = socket(p_addrinfo->ai_family, p_addrinfo->ai_socktype,
+            p_addrinfo->ai_protocol)) == -1)
+    {
+        save_sys_error("Error: socket():");
+        freeaddrinfo(p_addrinfo);
+        return -1;
+    }
+
+    /* SO_SNDTIMEO limits connect() too, unreachable host doesn't block */
+    setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (connect(sockfd, p_addrinfo->ai_addr, p_addrinfo->ai_addrlen) == -1)
+    {
+        save_sys_error("Error: connect(%s:%s):", GAN_RPC_HOST, GAN_DATA_PORT);
+        freeaddrinfo(p_addrinfo);
+        close(sockfd);
+        return -1;
+    }
+
+    freeaddrinfo(p_addrinfo);
+
+    return sockfd;
+}
+
+static unsigned long gan_data_header_get(unsigned char *p_header, int offset,
+        int len)
+{
+    uint32_t value32;
+    uint16_t value16;
+
+    if (len == 2)
+    {
+        memcpy(&value16, p_header + offset, 2);
+        return ntohs(value16);
+    }
+
+    memcpy(&value32, p_header + offset, 4);
+    return ntohl(value32);
+}
+
+/* download frame from gandalf host directly into frame buffer */
+static int gan_fetch_raw_data(void)
+{
+    int sockfd;
+    unsigned char header[GAN_DATA_HEADER_LEN];
+    unsigned long width;
+    unsigned long height;
+    unsigned long length;
+    unsigned long checksum;
+
+    if ((sockfd = gan_data_connect()) == -1)
+    {
+        return -1;
+    }
+
+    if (gan_data_recv(sockfd, header, GAN_DATA_HEADER_LEN) == -1)
+    {
+        close(sockfd);
+        return -1;
+    }
+
+    width = gan_data_header_get(header, 8, 4);
+    height = gan_data_header_get(header, 12, 4);
+    length = gan_data_header_get(header, 16, 4);
+    checksum = gan_data_header_get(header, 20, 4);
+
+    if ((gan_data_header_get(header, 0, 4) != GAN_DATA_MAGIC)
+            || (gan_data_header_get(header, 4, 2) != GAN_DATA_VERSION)
+            || (gan_data_header_get(header, 6, 2) != sizeof(unsigned short))
+            || (length != (width * height * sizeof(unsigned short))))
+    {
+        snprintf(peso.msg, CCD_MSG_MAX, "Error: invalid data header");
+        close(sockfd);
+        return -1;
+    }
+
+    if ((length == 0) || (length > gan_size))
+    {
+        snprintf(peso.msg, CCD_MSG_MAX,
+                "Error: received %lux%lu frame (%lu bytes), expected max %lu bytes",
+                width, height, length, gan_size);
+        close(sockfd);
+        return -1;
+    }
+
+    p_raw_data = mod_ccd_frame_fill();
+
+    if (gan_data_recv(sockfd, p_raw_data, length) == -1)
+    {
+        close(sockfd);
+        return -1;
+    }
+
+    close(sockfd);
+
+    if (gan_adler32((unsigned char *) p_raw_data, length) != checksum)
     {
+        snprintf(peso.msg, CCD_MSG_MAX, "Error: frame checksum mismatch");
         return -1;
     }
 
-    fwrite(p_out, sizeof(*p_out), out_len, fw);
-    // TODO: kontrolovat meze
-    memcpy(p_raw_data, p_out, sizeof(*p_out) * out_len);
-    g_free(p_out);
+    log4c_category_log(peso.p_logcat, LOG4C_PRIORITY_INFO,
+            "received %lux%lu frame (%lu bytes)", width, height, length);
+
+    return 0;
+}
 
-    ///* swap bytes */
-    //from = (unsigned short *) ((char *) p_raw_data + gan_size);
-    //// TODO: zapomnelo se na prvni byte
-    //while (from > p_raw_data)
-    //{
-    //    unsigned short morf;
-    //    unsigned short left;
-    //    unsigned short right;
+int ccd_save_raw_image()
+{
+    FILE *fw;
 
-    //    left = *from >> 8;
-    //    left += 0x80;
-    //    right = *from << 8;
-    //    morf = left | right;
+    if (gan_fetch_raw_data() == -1)
+    {
+        return -1;
+    }
 
-    //    fwrite(&morf, sizeof(morf), 1, fw);
-    //    from--;
-    //}
+    /* peso.raw_image not lock */
+    if ((fw = fopen(peso.raw_image, "w")) == NULL)
+    {
+        return -1;
+    }
+
+    fwrite(p_raw_data, 1, gan_size, fw);
 
     if (fclose(fw) == EOF)
     {
@@ -496,20 +670,26 @@ int ccd_save_raw_image()
     return 0;
 }
 
+int ccd_frame_acquire(PESO_FRAME_T **pp_frame)
+{
+    if (gan_fetch_raw_data() == -1)
+    {
+        return -1;
+    }
+
+    return mod_ccd_frame_acquire(pp_frame);
+}
+
+int ccd_frame_release(PESO_FRAME_T *p_frame)
+{
+    return mod_ccd_frame_release(p_frame);
+}
+
 int ccd_save_fits_file(fitsfile *p_fits, int *p_fits_status)
 {
-    //register unsigned short *from;
-    //int index = 0;
     long fpixel = 1;
     long nelements = peso.x2 * peso.y2;
 
-    /* save reverse raw data */
-    //from = (unsigned short *) ((char *) p_raw_data + gan_size);
-    //while (from > p_raw_data)
-    //{
-    //    p_raw_data_reverse[index++] = *from--;
-    //}
-
     if (fits_write_img(p_fits, TUSHORT, fpixel, nelements, p_raw_data,
             p_fits_status))
     {
@@ -528,12 +708,6 @@ int ccd_expose_uninit(void)
 {
     int result;
 
-    free(p_raw_data_reverse);
-    p_raw_data_reverse = NULL;
-
-    free(p_raw_data);
-    p_raw_data = NULL;
-
     xmlrpc_value *p_param_array = xmlrpc_array_new(&gan_rpc_env);
 
     result = gan_rpc_execute_rint("ccd_expose_uninit", p_param_array);
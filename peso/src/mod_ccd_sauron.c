@@ -25,6 +25,7 @@
 #include "mod_ccd_sauron.h"
 #include "header.h"
 #include "thread.h"
+#include "pixconv.h"
 
 PESO_T peso;
 
@@ -34,8 +35,8 @@ static char ccd_readout_speeds[PESO_READOUT_SPEEDS_MAX + 1];
 static char gan_ccd_gains[PESO_GAINS_MAX + 1];
 static short cam;
 static unsigned long size;
+static unsigned long sauron_data_size;
 static unsigned short *p_raw_data = NULL;
-static unsigned short *p_raw_data_reverse = NULL;
 
 __attribute__((format(printf,1,2)))
 static int ccd_save_pl_error(const char *p_fmt, ...)
@@ -166,6 +167,23 @@ int ccd_init(void)
     peso.y2 = 2048;
     peso.yb = 1;
 
+    /* buffers are allocated once, geometry is fixed */
+    sauron_data_size = (peso.x2 - peso.x1 + 1) / peso.xb;
+    sauron_data_size *= (peso.y2 - peso.y1 + 1) / peso.yb;
+    sauron_data_size *= 2;
+
+    free(p_raw_data);
+    if ((p_raw_data = (unsigned short *) malloc(sauron_data_size)) == NULL)
+    {
+        save_sys_error("Error: malloc():");
+        return -1;
+    }
+
+    if (mod_ccd_frame_init(sauron_data_size / 2) == -1)
+    {
+        return -1;
+    }
+
     if (!pl_pvcam_init())
     {
         ccd_save_pl_error("Error: pl_pvcam_init():");
@@ -193,6 +211,10 @@ int ccd_uninit(void)
         return -1;
     }
 
+    free(p_raw_data);
+    p_raw_data = NULL;
+    mod_ccd_frame_uninit();
+
     return 0;
 }
 
@@ -232,28 +254,6 @@ int ccd_expose_init(void)
     //pthread_mutex_unlock(peso.p_global_mutex);
     /* UNLOCK */
 
-    if (p_raw_data != NULL)
-    {
-        free(p_raw_data);
-        p_raw_data = NULL;
-    }
-    if ((p_raw_data = (unsigned short *) malloc(size)) == NULL)
-    {
-        save_sys_error("Error: malloc():");
-        return -1;
-    }
-
-    if (p_raw_data_reverse != NULL)
-    {
-        free(p_raw_data_reverse);
-        p_raw_data_reverse = NULL;
-    }
-    if ((p_raw_data_reverse = (unsigned short *) malloc(size)) == NULL)
-    {
-        save_sys_error("Error: malloc():");
-        return -1;
-    }
-
     if (!pl_set_param(cam, PARAM_SPDTAB_INDEX, (void *) &speed))
     {
         ccd_save_pl_error("Error: pl_set_param(PARAM_SPDTAB_INDEX, %i):",
@@ -281,6 +281,13 @@ int ccd_expose_init(void)
                 size);
         return -1;
     }
+    if (size > sauron_data_size)
+    {
+        snprintf(peso.msg, CCD_MSG_MAX,
+                "Error: frame size %li > buffer size %li", size,
+                sauron_data_size);
+        return -1;
+    }
     if (!pl_exp_start_seq(cam, p_raw_data))
     {
         ccd_save_pl_error("Error: pl_exp_start_seq():");
@@ -371,7 +378,10 @@ int ccd_readout(void)
 
 int ccd_save_raw_image()
 {
-    register unsigned short *from;
+    static unsigned short chunk[SAURON_RAW_CHUNK];
+    unsigned long nelements = size / sizeof(unsigned short);
+    unsigned long done = 0;
+    unsigned long count;
     FILE *fw;
 
     /* peso.raw_image not lock */
@@ -380,22 +390,25 @@ int ccd_save_raw_image()
         return -1;
     }
 
-    /* swap bytes */
-    from = (unsigned short *) ((char *) p_raw_data + size);
-    // TODO: zapomnelo se na prvni byte
-    while (from > p_raw_data)
+    /* reverse, subtract BZERO and swap bytes in one pass */
+    while (done < nelements)
     {
-        unsigned short morf;
-        unsigned short left;
-        unsigned short right;
+        count = nelements - done;
+        if (count > SAURON_RAW_CHUNK)
+        {
+            count = SAURON_RAW_CHUNK;
+        }
+
+        pxc_convert(chunk, p_raw_data + nelements - done - count, count,
+                PXC_REVERSE | PXC_SIGN | PXC_SWAP);
 
-        left = *from >> 8;
-        left += 0x80;
-        right = *from << 8;
-        morf = left | right;
+        if (fwrite(chunk, sizeof(*chunk), count, fw) != count)
+        {
+            fclose(fw);
+            return -1;
+        }
 
-        fwrite(&morf, sizeof(morf), 1, fw);
-        from--;
+        done += count;
     }
 
     if (fclose(fw) == EOF)
@@ -406,22 +419,25 @@ int ccd_save_raw_image()
     return 0;
 }
 
+/* reverse raw data into frame buffer */
+static unsigned short *sauron_reverse_raw_data(void)
+{
+    unsigned short *p_raw_data_reverse;
+
+    p_raw_data_reverse = mod_ccd_frame_fill();
+    pxc_convert(p_raw_data_reverse, p_raw_data, size / sizeof(unsigned short),
+            PXC_REVERSE);
+
+    return p_raw_data_reverse;
+}
+
 int ccd_save_fits_file(fitsfile *p_fits, int *p_fits_status)
 {
-    register unsigned short *from;
-    int index = 0;
     long fpixel = 1;
     long nelements = 2048 * 2048;
 
-    /* save reverse raw data */
-    from = (unsigned short *) ((char *) p_raw_data + size);
-    while (from > p_raw_data)
-    {
-        p_raw_data_reverse[index++] = *from--;
-    }
-
-    if (fits_write_img(p_fits, TUSHORT, fpixel, nelements, p_raw_data_reverse,
-            p_fits_status))
+    if (fits_write_img(p_fits, TUSHORT, fpixel, nelements,
+            sauron_reverse_raw_data(), p_fits_status))
     {
         return -1;
     }
@@ -429,6 +445,18 @@ int ccd_save_fits_file(fitsfile *p_fits, int *p_fits_status)
     return 0;
 }
 
+int ccd_frame_acquire(PESO_FRAME_T **pp_frame)
+{
+    sauron_reverse_raw_data();
+
+    return mod_ccd_frame_acquire(pp_frame);
+}
+
+int ccd_frame_release(PESO_FRAME_T *p_frame)
+{
+    return mod_ccd_frame_release(p_frame);
+}
+
 int ccd_expose_end(void)
 {
     return ccd_ttl_set(0);
@@ -436,9 +464,6 @@ int ccd_expose_end(void)
 
 int ccd_expose_uninit(void)
 {
-    free(p_raw_data_reverse);
-    p_raw_data_reverse = NULL;
-
     if (!pl_exp_finish_seq(cam, p_raw_data, 0))
     {
         ccd_save_pl_error("pl_exp_finish_seq() failure:");
@@ -450,9 +475,6 @@ int ccd_expose_uninit(void)
         return -1;
     }
 
-    free(p_raw_data);
-    p_raw_data = NULL;
-
     return 0;
 }
 
@@ -8,6 +8,9 @@
 #ifndef __MOD_CCD_SAURON_H
 #define __MOD_CCD_SAURON_H
 
+/* pixels converted per fwrite() in ccd_save_raw_image() */
+#define SAURON_RAW_CHUNK 65536
+
 typedef enum
 {
     SAURON_SPEED_100KHZ_E, SAURON_SPEED_1MHZ_E, SAURON_SPEED_MAX_E,
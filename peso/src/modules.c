@@ -63,6 +63,23 @@ int mod_ccd_init(char *p_mod_ccd_path, MOD_CCD_T *p_mod_ccd, PESO_T **p_peso)
     mod_ccd.get_gain = mod_dlsym(module, "ccd_get_gain");
     mod_ccd.get_gains = mod_dlsym(module, "ccd_get_gains");
 
+    /* optional symbols */
+    mod_ccd.frame_acquire = dlsym(module, "ccd_frame_acquire");
+    mod_ccd.frame_release = dlsym(module, "ccd_frame_release");
+    mod_ccd.save_fits_rows = dlsym(module, "ccd_save_fits_rows");
+    mod_ccd.readout_notify = dlsym(module, "ccd_readout_notify");
+    mod_ccd.continuous_start = dlsym(module, "ccd_continuous_start");
+    mod_ccd.continuous_frame = dlsym(module, "ccd_continuous_frame");
+    mod_ccd.continuous_release = dlsym(module, "ccd_continuous_release");
+    mod_ccd.continuous_end = dlsym(module, "ccd_continuous_end");
+
+    if ((mod_ccd.continuous_start == NULL) || (mod_ccd.continuous_frame == NULL)
+            || (mod_ccd.continuous_release == NULL)
+            || (mod_ccd.continuous_end == NULL))
+    {
+        mod_ccd.continuous_start = NULL;
+    }
+
     mod_ccd.peso_set_int = mod_dlsym(module, "peso_set_int");
     mod_ccd.peso_get_int = mod_dlsym(module, "peso_get_int");
     mod_ccd.peso_set_double = mod_dlsym(module, "peso_set_double");
@@ -21,6 +21,7 @@
 #define PESO_READOUT_SPEEDS_MAX (10 * PESO_READOUT_SPEED_MAX)
 #define PESO_GAIN_MAX           15
 #define PESO_GAINS_MAX          (10 * PESO_GAIN_MAX)
+#define PESO_FRAME_BUFFERS      2
 
 typedef struct
 {
@@ -39,6 +40,28 @@ typedef struct
     int (*set_readout_speed)();
     int (*set_gain)();
 
+    /* optional, NULL if module does not export frame lease API */
+    int (*frame_acquire)();
+    int (*frame_release)();
+
+    /*
+     * optional, NULL if module cannot write rows while reading out, written
+     * rows are added to IST_T statistics
+     */
+    int (*save_fits_rows)();
+
+    /*
+     * optional, NULL if module cannot signal readout progress, registered
+     * function is called from module thread when ccd_readout() has news
+     */
+    int (*readout_notify)();
+
+    /* optional, NULL if module does not support continuous readout */
+    int (*continuous_start)();
+    int (*continuous_frame)();
+    int (*continuous_release)();
+    int (*continuous_end)();
+
     void (*peso_set_int)();
     void (*peso_get_int)();
     void (*peso_set_double)();
@@ -57,6 +80,25 @@ typedef struct
     const char *(*get_gains)();
 } MOD_CCD_T;
 
+typedef enum
+{
+    PESO_FRAME_FREE_E,
+    PESO_FRAME_FILL_E,
+    PESO_FRAME_LEASED_E,
+} PESO_FRAME_STATE_T;
+
+/*
+ * Frame buffer owned by module. Readout fills it, ccd_frame_acquire() lends
+ * it to exposed and ccd_frame_release() returns it to the module.
+ */
+typedef struct
+{
+    int id;
+    PESO_FRAME_STATE_T state;
+    long nelements;
+    unsigned short *p_data;
+} PESO_FRAME_T;
+
 typedef enum
 {
     CCD_IMGTYPE_UNKNOWN_E,
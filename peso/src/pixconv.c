@@ -0,0 +1,426 @@
+/**
+ * Author: Jan Fuchs <fuky@sunstel.asu.cas.cz>
+ * $Date$
+ * $Rev$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef SELF_TEST_PIXCONV
+#include <time.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PXC_X86
+#include <immintrin.h>
+#endif
+
+#include "pixconv.h"
+
+typedef void (*PXC_KERNEL_T)(unsigned short *p_dst,
+        const unsigned short *p_src, size_t nelements, int flags);
+
+static const char *pxc_isa_name[PXC_ISA_MAX_E] = { "scalar", "sse2", "avx2" };
+static pthread_once_t pxc_once = PTHREAD_ONCE_INIT;
+static PXC_ISA_T pxc_isa = PXC_ISA_SCALAR_E;
+static PXC_ISA_T pxc_isa_max = PXC_ISA_SCALAR_E;
+static PXC_KERNEL_T pxc_kernel[PXC_ISA_MAX_E];
+
+/* PXC_SIGN is applied before PXC_SWAP, result is big endian FITS pixel */
+static inline unsigned short pxc_op(unsigned short pixel, int flags)
+{
+    if (flags & PXC_SIGN)
+    {
+        pixel ^= 0x8000;
+    }
+
+    if (flags & PXC_SWAP)
+    {
+        pixel = (unsigned short) ((pixel << 8) | (pixel >> 8));
+    }
+
+    return pixel;
+}
+
+static void pxc_convert_scalar(unsigned short *p_dst,
+        const unsigned short *p_src, size_t nelements, int flags)
+{
+    size_t i;
+    size_t lo;
+    size_t hi;
+    unsigned short pixel;
+
+    if (!(flags & PXC_REVERSE))
+    {
+        for (i = 0; i < nelements; ++i)
+        {
+            p_dst[i] = pxc_op(p_src[i], flags);
+        }
+    }
+    else if (p_dst != p_src)
+    {
+        for (i = 0; i < nelements; ++i)
+        {
+            p_dst[i] = pxc_op(p_src[nelements - 1 - i], flags);
+        }
+    }
+    else
+    {
+        /* in place, swap pixels from both ends */
+        lo = 0;
+        hi = nelements;
+
+        while ((hi - lo) >= 2)
+        {
+            pixel = p_dst[lo];
+            p_dst[lo++] = pxc_op(p_dst[--hi], flags);
+            p_dst[hi] = pxc_op(pixel, flags);
+        }
+
+        if (hi > lo)
+        {
+            p_dst[lo] = pxc_op(p_dst[lo], flags);
+        }
+    }
+}
+
+#ifdef PXC_X86
+
+__attribute__((target("sse2")))
+static inline __m128i pxc_op_sse2(__m128i v, int flags)
+{
+    if (flags & PXC_SIGN)
+    {
+        v = _mm_xor_si128(v, _mm_set1_epi16((short) 0x8000));
+    }
+
+    if (flags & PXC_SWAP)
+    {
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    }
+
+    if (flags & PXC_REVERSE)
+    {
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    }
+
+    return v;
+}
+
+/* 8 pixels per step, rest is converted by scalar code */
+__attribute__((target("sse2")))
+static void pxc_convert_sse2(unsigned short *p_dst,
+        const unsigned short *p_src, size_t nelements, int flags)
+{
+    size_t i = 0;
+    size_t lo;
+    size_t hi;
+    __m128i a;
+    __m128i b;
+
+    if (!(flags & PXC_REVERSE))
+    {
+        for (; (i + 8) <= nelements; i += 8)
+        {
+            a = _mm_loadu_si128((const __m128i *) (p_src + i));
+            _mm_storeu_si128((__m128i *) (p_dst + i), pxc_op_sse2(a, flags));
+        }
+
+        pxc_convert_scalar(p_dst + i, p_src + i, nelements - i, flags);
+    }
+    else if (p_dst != p_src)
+    {
+        for (; (i + 8) <= nelements; i += 8)
+        {
+            a = _mm_loadu_si128(
+                    (const __m128i *) (p_src + nelements - i - 8));
+            _mm_storeu_si128((__m128i *) (p_dst + i), pxc_op_sse2(a, flags));
+        }
+
+        /* first nelements - i source pixels are left */
+        pxc_convert_scalar(p_dst + i, p_src, nelements - i, flags);
+    }
+    else
+    {
+        lo = 0;
+        hi = nelements;
+
+        while ((hi - lo) >= 16)
+        {
+            a = _mm_loadu_si128((const __m128i *) (p_dst + lo));
+            b = _mm_loadu_si128((const __m128i *) (p_dst + hi - 8));
+            _mm_storeu_si128((__m128i *) (p_dst + lo), pxc_op_sse2(b, flags));
+            _mm_storeu_si128((__m128i *) (p_dst + hi - 8),
+                    pxc_op_sse2(a, flags));
+            lo += 8;
+            hi -= 8;
+        }
+
+        pxc_convert_scalar(p_dst + lo, p_dst + lo, hi - lo, flags);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i pxc_op_avx2(__m256i v, int flags)
+{
+    if (flags & PXC_SIGN)
+    {
+        v = _mm256_xor_si256(v, _mm256_set1_epi16((short) 0x8000));
+    }
+
+    if (flags & PXC_SWAP)
+    {
+        v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+    }
+
+    if (flags & PXC_REVERSE)
+    {
+        /* reverse pixels inside each 128-bit lane, then swap lanes */
+        v = _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+                14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+                14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1));
+        v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 0, 3, 2));
+    }
+
+    return v;
+}
+
+/* 16 pixels per step, rest is converted by scalar code */
+__attribute__((target("avx2")))
+static void pxc_convert_avx2(unsigned short *p_dst,
+        const unsigned short *p_src, size_t nelements, int flags)
+{
+    size_t i = 0;
+    size_t lo;
+    size_t hi;
+    __m256i a;
+    __m256i b;
+
+    if (!(flags & PXC_REVERSE))
+    {
+        for (; (i + 16) <= nelements; i += 16)
+        {
+            a = _mm256_loadu_si256((const __m256i *) (p_src + i));
+            _mm256_storeu_si256((__m256i *) (p_dst + i),
+                    pxc_op_avx2(a, flags));
+        }
+
+        pxc_convert_scalar(p_dst + i, p_src + i, nelements - i, flags);
+    }
+    else if (p_dst != p_src)
+    {
+        for (; (i + 16) <= nelements; i += 16)
+        {
+            a = _mm256_loadu_si256(
+                    (const __m256i *) (p_src + nelements - i - 16));
+            _mm256_storeu_si256((__m256i *) (p_dst + i),
+                    pxc_op_avx2(a, flags));
+        }
+
+        pxc_convert_scalar(p_dst + i, p_src, nelements - i, flags);
+    }
+    else
+    {
+        lo = 0;
+        hi = nelements;
+
+        while ((hi - lo) >= 32)
+        {
+            a = _mm256_loadu_si256((const __m256i *) (p_dst + lo));
+            b = _mm256_loadu_si256((const __m256i *) (p_dst + hi - 16));
+            _mm256_storeu_si256((__m256i *) (p_dst + lo),
+                    pxc_op_avx2(b, flags));
+            _mm256_storeu_si256((__m256i *) (p_dst + hi - 16),
+                    pxc_op_avx2(a, flags));
+            lo += 16;
+            hi -= 16;
+        }
+
+        pxc_convert_scalar(p_dst + lo, p_dst + lo, hi - lo, flags);
+    }
+}
+
+#endif
+
+static void pxc_init(void)
+{
+    pxc_kernel[PXC_ISA_SCALAR_E] = pxc_convert_scalar;
+
+#ifdef PXC_X86
+    pxc_kernel[PXC_ISA_SSE2_E] = pxc_convert_sse2;
+    pxc_kernel[PXC_ISA_AVX2_E] = pxc_convert_avx2;
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        pxc_isa_max = PXC_ISA_AVX2_E;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        pxc_isa_max = PXC_ISA_SSE2_E;
+    }
+#endif
+
+    pxc_isa = pxc_isa_max;
+}
+
+void pxc_convert(unsigned short *p_dst, const unsigned short *p_src,
+        size_t nelements, int flags)
+{
+    pthread_once(&pxc_once, pxc_init);
+
+    if ((flags == PXC_COPY) && (p_dst != p_src))
+    {
+        memcpy(p_dst, p_src, nelements * sizeof(*p_dst));
+        return;
+    }
+
+    pxc_kernel[pxc_isa](p_dst, p_src, nelements, flags);
+}
+
+PXC_ISA_T pxc_get_isa(void)
+{
+    pthread_once(&pxc_once, pxc_init);
+
+    return pxc_isa;
+}
+
+const char *pxc_get_isa_name(PXC_ISA_T isa)
+{
+    if ((isa < 0) || (isa >= PXC_ISA_MAX_E))
+    {
+        return "unknown";
+    }
+
+    return pxc_isa_name[isa];
+}
+
+int pxc_set_isa(PXC_ISA_T isa)
+{
+    pthread_once(&pxc_once, pxc_init);
+
+    if ((isa < 0) || (isa > pxc_isa_max))
+    {
+        return -1;
+    }
+
+    pxc_isa = isa;
+
+    return 0;
+}
+
+#ifdef SELF_TEST_PIXCONV
+
+#define PXC_LOOPS 20
+
+static double pxc_elapsed_ms(struct timespec *p_start, struct timespec *p_end)
+{
+    return ((p_end->tv_sec - p_start->tv_sec) * 1000.0)
+            + ((p_end->tv_nsec - p_start->tv_nsec) / 1000000.0);
+}
+
+/*
+ * Check every kernel against scalar code and print time per frame. Odd
+ * sizes exercise scalar tails and in place reverse.
+ */
+int main(int argc, char *argv[])
+{
+    int i;
+    int j;
+    int k;
+    int loop;
+    int failed = 0;
+    size_t n;
+    long sizes[][2] = { { 2048, 2048 }, { 2048, 512 }, { 37, 3 } };
+    int flags[] = { PXC_REVERSE, PXC_SWAP, PXC_SIGN, PXC_SIGN | PXC_SWAP,
+            PXC_REVERSE | PXC_SIGN | PXC_SWAP };
+    const char *flags_name[] = { "reverse", "swap", "sign", "sign+swap",
+            "reverse+sign+swap" };
+    unsigned short *p_src;
+    unsigned short *p_dst;
+    unsigned short *p_ref;
+    struct timespec start;
+    struct timespec end;
+
+    printf("cpu: %s\n", pxc_get_isa_name(pxc_get_isa()));
+
+    for (i = 0; i < (sizeof(sizes) / sizeof(sizes[0])); ++i)
+    {
+        n = sizes[i][0] * sizes[i][1];
+
+        p_src = malloc(n * sizeof(unsigned short));
+        p_dst = malloc(n * sizeof(unsigned short));
+        p_ref = malloc(n * sizeof(unsigned short));
+
+        if ((p_src == NULL) || (p_dst == NULL) || (p_ref == NULL))
+        {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+
+        for (j = 0; j < n; ++j)
+        {
+            p_src[j] = (unsigned short) (j * 2654435761u >> 7);
+        }
+
+        printf("%lix%li:\n", sizes[i][0], sizes[i][1]);
+
+        for (j = 0; j < (sizeof(flags) / sizeof(flags[0])); ++j)
+        {
+            pxc_set_isa(PXC_ISA_SCALAR_E);
+            pxc_convert(p_ref, p_src, n, flags[j]);
+
+            for (k = 0; k < PXC_ISA_MAX_E; ++k)
+            {
+                if (pxc_set_isa(k) == -1)
+                {
+                    continue;
+                }
+
+                memset(p_dst, 0, n * sizeof(unsigned short));
+                pxc_convert(p_dst, p_src, n, flags[j]);
+
+                if (memcmp(p_dst, p_ref, n * sizeof(unsigned short)))
+                {
+                    printf("FAILED %s %s\n", pxc_get_isa_name(k),
+                            flags_name[j]);
+                    failed = 1;
+                }
+
+                memcpy(p_dst, p_src, n * sizeof(unsigned short));
+                pxc_convert(p_dst, p_dst, n, flags[j]);
+
+                if (memcmp(p_dst, p_ref, n * sizeof(unsigned short)))
+                {
+                    printf("FAILED %s %s in place\n", pxc_get_isa_name(k),
+                            flags_name[j]);
+                    failed = 1;
+                }
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                for (loop = 0; loop < PXC_LOOPS; ++loop)
+                {
+                    pxc_convert(p_dst, p_src, n, flags[j]);
+                }
+                clock_gettime(CLOCK_MONOTONIC, &end);
+
+                printf("    %-18s %-6s %8.3f ms/frame\n", flags_name[j],
+                        pxc_get_isa_name(k),
+                        pxc_elapsed_ms(&start, &end) / PXC_LOOPS);
+            }
+        }
+
+        free(p_src);
+        free(p_dst);
+        free(p_ref);
+    }
+
+    exit((failed) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+#endif
@@ -0,0 +1,40 @@
+/**
+ * Author: Jan Fuchs <fuky@sunstel.asu.cas.cz>
+ * $Date$
+ * $Rev$
+ */
+
+#ifndef __PIXCONV_H
+#define __PIXCONV_H
+
+#include <stddef.h>
+
+/* pxc_convert() flags, any combination is allowed */
+#define PXC_COPY     0x00
+#define PXC_REVERSE  0x01 /* last pixel first */
+#define PXC_SWAP     0x02 /* swap bytes of each pixel */
+#define PXC_SIGN     0x04 /* flip highest bit, i.e. subtract BZERO = 32768 */
+
+typedef enum
+{
+    PXC_ISA_SCALAR_E = 0,
+    PXC_ISA_SSE2_E,
+    PXC_ISA_AVX2_E,
+    PXC_ISA_MAX_E,
+} PXC_ISA_T;
+
+/*
+ * Convert nelements 16-bit pixels from p_src into p_dst. Buffers may be
+ * the same (in place), otherwise they must not overlap. Fastest instruction
+ * set supported by CPU is selected on first call.
+ */
+void pxc_convert(unsigned short *p_dst, const unsigned short *p_src,
+        size_t nelements, int flags);
+
+PXC_ISA_T pxc_get_isa(void);
+const char *pxc_get_isa_name(PXC_ISA_T isa);
+
+/* force instruction set, returns -1 if CPU doesn't support it */
+int pxc_set_isa(PXC_ISA_T isa);
+
+#endif
@@ -15,6 +15,9 @@ import base64
 import traceback
 import logging
 import socket
+import struct
+import threading
+import zlib
 
 from ctypes import *
 from SimpleXMLRPCServer import SimpleXMLRPCServer
@@ -24,6 +27,13 @@ from logging.handlers import TimedRotatingFileHandler
 HOST = "192.168.193.199"
 PORT = 23
 
+# pixels are sent by FrameServer, XML-RPC is used only for control
+DATA_PORT = 5001
+DATA_MAGIC = 0x47414E44 # "GAND"
+DATA_VERSION = 1
+FRAME_WIDTH = 2048
+FRAME_HEIGHT = 512
+
 logger = logging.getLogger("gandalf_xmlrpc_server")
 
 class RequestHandler(SimpleXMLRPCRequestHandler):
@@ -346,6 +356,14 @@ class PylonCCD:
     def get_data(self):
         return self.data_base64
 
+    def get_frame(self):
+        if ((self.gan_available_data.readout_count != 1) or \
+                (not self.gan_available_data.initial_readout)):
+            return ""
+
+        return string_at(self.gan_available_data.initial_readout, \
+            FRAME_WIDTH * FRAME_HEIGHT * 2)
+
     def expose_end(self):
         return 0
 
@@ -598,6 +616,49 @@ class GandalfServerFunctions:
             logger.exception("PylonCCD exception")
             return -1
 
+class FrameServer(threading.Thread):
+    """
+    Send last frame to every client which connects to DATA_PORT.
+
+    Header (network byte order): magic, version, bytes per pixel, width,
+    height, data length, Adler-32 of data. Raw 16-bit pixels follow.
+    """
+
+    def __init__(self, ccd):
+        threading.Thread.__init__(self)
+        self.daemon = True
+        self.ccd = ccd
+
+    def send_frame(self, conn):
+        data = self.ccd.get_frame()
+
+        if (data):
+            width, height = FRAME_WIDTH, FRAME_HEIGHT
+        else:
+            width, height = 0, 0
+
+        header = struct.pack("!IHHIIII", DATA_MAGIC, DATA_VERSION, 2, \
+            width, height, len(data), zlib.adler32(data) & 0xFFFFFFFF)
+
+        conn.sendall(header)
+        conn.sendall(data)
+        logger.info("send_frame() => %i bytes" % len(data))
+
+    def run(self):
+        s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        s.bind(("0.0.0.0", DATA_PORT))
+        s.listen(1)
+
+        while True:
+            conn, address = s.accept()
+            try:
+                self.send_frame(conn)
+            except:
+                logger.exception("FrameServer exception")
+            finally:
+                conn.close()
+
 def print_flush(text):
     print text
     sys.stdout.flush()
@@ -612,9 +673,12 @@ def main():
     logger.setLevel(logging.DEBUG)
     logger.addHandler(fh)
 
+    ccd = PylonCCD()
+    FrameServer(ccd).start()
+
     server = SimpleXMLRPCServer(("0.0.0.0", 5000), requestHandler=RequestHandler)
     server.register_introspection_functions()
-    server.register_instance(GandalfServerFunctions(PylonCCD()))
+    server.register_instance(GandalfServerFunctions(ccd))
     server.serve_forever()
 
 if __name__ == '__main__':
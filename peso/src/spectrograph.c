@@ -38,11 +38,15 @@ static xmlrpc_client *p_sgh_client = NULL;
 static xmlrpc_server_info *p_sgh_server_info = NULL;
 static char sgh_err_msg[SGH_ERR_MSG_MAX + 1];
 
-static int sgh_is_fault_occurred(xmlrpc_env *p_sgh_env)
+/* sgh_spectrograph_info() may run in another thread, it has its own client */
+static xmlrpc_client *p_sgh_info_client = NULL;
+static char sgh_info_err_msg[SGH_ERR_MSG_MAX + 1];
+
+static int sgh_is_fault_occurred(xmlrpc_env *p_sgh_env, char *p_err_msg)
 {
     if (p_sgh_env->fault_occurred)
     {
-        snprintf(sgh_err_msg, SGH_ERR_MSG_MAX, "XML-RPC Fault: %s (%d)",
+        snprintf(p_err_msg, SGH_ERR_MSG_MAX, "XML-RPC Fault: %s (%d)",
                 p_sgh_env->fault_string, p_sgh_env->fault_code);
         fprintf(stderr, "XML-RPC Fault: %s (%d)\n", p_sgh_env->fault_string,
                 p_sgh_env->fault_code);
@@ -79,21 +83,22 @@ static int sgh_is_fault_occurred(xmlrpc_env *p_sgh_env)
 //    return 0;
 //}
 
-static char *sgh_get_item(xmlrpc_value *p_result, const char *p_name)
+static char *sgh_get_item(xmlrpc_env *p_env, xmlrpc_value *p_result,
+        const char *p_name)
 {
     xmlrpc_value *p_value;
     char *p_str;
 
-    xmlrpc_struct_read_value(&sgh_env, p_result, p_name, &p_value);
+    xmlrpc_struct_read_value(p_env, p_result, p_name, &p_value);
 
-    if (sgh_is_fault_occurred(&sgh_env))
+    if (sgh_is_fault_occurred(p_env, sgh_info_err_msg))
     {
         return NULL;
     }
 
-    xmlrpc_read_string(&sgh_env, p_value, (const char **) &p_str);
+    xmlrpc_read_string(p_env, p_value, (const char **) &p_str);
 
-    if (sgh_is_fault_occurred(&sgh_env))
+    if (sgh_is_fault_occurred(p_env, sgh_info_err_msg))
     {
         return NULL;
     }
@@ -114,6 +119,12 @@ const char *sgh_get_err_msg(void)
     return sgh_err_msg;
 }
 
+/* error of last sgh_spectrograph_info() */
+const char *sgh_get_info_err_msg(void)
+{
+    return sgh_info_err_msg;
+}
+
 // (-205.294 * <stupne.desetiny...> + 12667.1)  ....[pocet inkrementu]
 int sgh_gratang2gratpos(double gratang)
 {
@@ -151,6 +162,7 @@ int sgh_init(void)
     char *p_spectrograph_port = getenv("SPECTROGRAPH_PORT");
 
     bzero(sgh_err_msg, SGH_ERR_MSG_MAX + 1);
+    bzero(sgh_info_err_msg, SGH_ERR_MSG_MAX + 1);
 
     if ((p_spectrograph_host == NULL) || (p_spectrograph_port == NULL))
     {
@@ -168,7 +180,15 @@ int sgh_init(void)
     }
 
     xmlrpc_client_create(&sgh_env, 0, "peso", SVN_REV, NULL, 0, &p_sgh_client);
-    if (sgh_is_fault_occurred(&sgh_env))
+    if (sgh_is_fault_occurred(&sgh_env, sgh_err_msg))
+    {
+        fprintf(stderr, "\n%s\n", sgh_err_msg);
+        return -1;
+    }
+
+    xmlrpc_client_create(&sgh_env, 0, "peso", SVN_REV, NULL, 0,
+            &p_sgh_info_client);
+    if (sgh_is_fault_occurred(&sgh_env, sgh_err_msg))
     {
         fprintf(stderr, "\n%s\n", sgh_err_msg);
         return -1;
@@ -177,7 +197,7 @@ int sgh_init(void)
     snprintf(server_url, SGH_SERVER_URL_MAX, "http://%s:%s/RPC2",
             p_spectrograph_host, p_spectrograph_port);
     p_sgh_server_info = xmlrpc_server_info_new(&sgh_env, server_url);
-    if (sgh_is_fault_occurred(&sgh_env))
+    if (sgh_is_fault_occurred(&sgh_env, sgh_err_msg))
     {
         fprintf(stderr, "\n%s\n", sgh_err_msg);
         return -1;
@@ -200,6 +220,12 @@ int sgh_uninit(void)
         p_sgh_client = NULL;
     }
 
+    if (p_sgh_info_client != NULL)
+    {
+        xmlrpc_client_destroy(p_sgh_info_client);
+        p_sgh_info_client = NULL;
+    }
+
     xmlrpc_env_clean(&sgh_env);
     bxr_client_cleanup();
 
@@ -216,27 +242,27 @@ int sgh_spectrograph_execute(char *p_command, char *p_answer)
 
     p_param_array = xmlrpc_array_new(&sgh_env);
     p_item = xmlrpc_string_new(&sgh_env, p_command);
-    if (sgh_is_fault_occurred(&sgh_env))
+    if (sgh_is_fault_occurred(&sgh_env, sgh_err_msg))
     {
         return -1;
     }
 
     xmlrpc_array_append_item(&sgh_env, p_param_array, p_item);
-    if (sgh_is_fault_occurred(&sgh_env))
+    if (sgh_is_fault_occurred(&sgh_env, sgh_err_msg))
     {
         return -1;
     }
 
     xmlrpc_client_call2(&sgh_env, p_sgh_client, p_sgh_server_info,
             "spectrograph_execute", p_param_array, &p_result);
-    if (sgh_is_fault_occurred(&sgh_env))
+    if (sgh_is_fault_occurred(&sgh_env, sgh_err_msg))
     {
         return -1;
     }
 
     xmlrpc_read_string(&sgh_env, p_result, &p_str);
 
-    if (sgh_is_fault_occurred(&sgh_env))
+    if (sgh_is_fault_occurred(&sgh_env, sgh_err_msg))
     {
         return -1;
     }
@@ -252,6 +278,12 @@ int sgh_spectrograph_execute(char *p_command, char *p_answer)
     return 0;
 }
 
+/*
+ * Own xmlrpc_env, client and error message, because exposed calls it from a
+ * separate thread while the exposure meter uses sgh_env, see
+ * sgh_get_info_err_msg(). Spectrographd without "observatory_snapshot"
+ * answers the same values with "spectrograph_info".
+ */
 int sgh_spectrograph_info(SGH_INFO_T *p_sgh_info)
 {
     int i;
@@ -259,24 +291,40 @@ int sgh_spectrograph_info(SGH_INFO_T *p_sgh_info)
     char *p_glst;
     char *p_item;
     char *p_save = NULL;
+    xmlrpc_env env;
     xmlrpc_value *p_result;
     xmlrpc_value *p_param_array;
 
     memset(p_sgh_info, 0, sizeof(SGH_INFO_T));
 
-    p_param_array = xmlrpc_array_new(&sgh_env);
-    xmlrpc_client_call2(&sgh_env, p_sgh_client, p_sgh_server_info,
-            "spectrograph_info", p_param_array, &p_result);
-    if (sgh_is_fault_occurred(&sgh_env))
+    xmlrpc_env_init(&env);
+
+    p_param_array = xmlrpc_array_new(&env);
+    xmlrpc_client_call2(&env, p_sgh_info_client, p_sgh_server_info,
+            "observatory_snapshot", p_param_array, &p_result);
+    if (env.fault_occurred && (env.fault_code == XMLRPC_NO_SUCH_METHOD_ERROR))
+    {
+        xmlrpc_env_clean(&env);
+        xmlrpc_env_init(&env);
+        xmlrpc_client_call2(&env, p_sgh_info_client, p_sgh_server_info,
+                "spectrograph_info", p_param_array, &p_result);
+    }
+
+    if (sgh_is_fault_occurred(&env, sgh_info_err_msg))
     {
+        xmlrpc_DECREF(p_param_array);
+        xmlrpc_env_clean(&env);
         return -1;
     }
 
     p_sgh_info->flat = 0;
     p_sgh_info->comp = 0;
 
-    if ((p_glst = sgh_get_item(p_result, "GLST")) == NULL)
+    if ((p_glst = sgh_get_item(&env, p_result, "GLST")) == NULL)
     {
+        xmlrpc_DECREF(p_result);
+        xmlrpc_DECREF(p_param_array);
+        xmlrpc_env_clean(&env);
         return -1;
     }
 
@@ -365,49 +413,49 @@ int sgh_spectrograph_info(SGH_INFO_T *p_sgh_info)
 
     sgh_free_item(p_glst);
 
-    if ((p_item = sgh_get_item(p_result, "SPFE_14")) != NULL)
+    if ((p_item = sgh_get_item(&env, p_result, "SPFE_14")) != NULL)
     {
         p_sgh_info->exp_freq = atoi(p_item);
         sgh_free_item(p_item);
     }
 
-    if ((p_item = sgh_get_item(p_result, "SPCE_14")) != NULL)
+    if ((p_item = sgh_get_item(&env, p_result, "SPCE_14")) != NULL)
     {
         p_sgh_info->exp_sum = atoi(p_item);
         sgh_free_item(p_item);
     }
 
-    if ((p_item = sgh_get_item(p_result, "SPGP_13")) != NULL)
+    if ((p_item = sgh_get_item(&env, p_result, "SPGP_13")) != NULL)
     {
         p_sgh_info->grating_position = atoi(p_item);
         sgh_free_item(p_item);
     }
 
-    if ((p_item = sgh_get_item(p_result, "SPGP_5")) != NULL)
+    if ((p_item = sgh_get_item(&env, p_result, "SPGP_5")) != NULL)
     {
         p_sgh_info->focus_1400 = atoi(p_item);
         sgh_free_item(p_item);
     }
 
-    if ((p_item = sgh_get_item(p_result, "SPGP_4")) != NULL)
+    if ((p_item = sgh_get_item(&env, p_result, "SPGP_4")) != NULL)
     {
         p_sgh_info->focus_700 = atoi(p_item);
         sgh_free_item(p_item);
     }
 
-    if ((p_item = sgh_get_item(p_result, "SPGP_22")) != NULL)
+    if ((p_item = sgh_get_item(&env, p_result, "SPGP_22")) != NULL)
     {
         p_sgh_info->focus_oes = atoi(p_item);
         sgh_free_item(p_item);
     }
 
-    if ((p_item = sgh_get_item(p_result, "SPGS_19")) != NULL)
+    if ((p_item = sgh_get_item(&env, p_result, "SPGS_19")) != NULL)
     {
         p_sgh_info->coude_temp = atoi(p_item);
         sgh_free_item(p_item);
     }
 
-    if ((p_item = sgh_get_item(p_result, "SPGS_20")) != NULL)
+    if ((p_item = sgh_get_item(&env, p_result, "SPGS_20")) != NULL)
     {
         p_sgh_info->oes_temp = atoi(p_item);
         sgh_free_item(p_item);
@@ -415,6 +463,7 @@ int sgh_spectrograph_info(SGH_INFO_T *p_sgh_info)
 
     xmlrpc_DECREF(p_result);
     xmlrpc_DECREF(p_param_array);
+    xmlrpc_env_clean(&env);
 
     return 0;
 }
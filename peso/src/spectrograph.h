@@ -37,6 +37,7 @@ typedef struct
 } SGH_INFO_T;
 
 const char *sgh_get_err_msg(void);
+const char *sgh_get_info_err_msg(void);
 int sgh_init(void);
 int sgh_uninit(void);
 int sgh_spectrograph_execute(char *p_command, char *p_answer);
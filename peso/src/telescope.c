@@ -41,11 +41,15 @@ static xmlrpc_client *p_tle_client = NULL;
 static xmlrpc_server_info *p_tle_server_info = NULL;
 static char tle_err_msg[TLE_ERR_MSG_MAX + 1];
 
-static int tle_is_fault_occurred(xmlrpc_env *p_tle_env)
+/* tle_telescope_info() may run in another thread, it has its own client */
+static xmlrpc_client *p_tle_info_client = NULL;
+static char tle_info_err_msg[TLE_ERR_MSG_MAX + 1];
+
+static int tle_is_fault_occurred(xmlrpc_env *p_tle_env, char *p_err_msg)
 {
     if (p_tle_env->fault_occurred)
     {
-        snprintf(tle_err_msg, TLE_ERR_MSG_MAX, "XML-RPC Fault: %s (%d)",
+        snprintf(p_err_msg, TLE_ERR_MSG_MAX, "XML-RPC Fault: %s (%d)",
                 p_tle_env->fault_string, p_tle_env->fault_code);
         return 1;
     }
@@ -55,21 +59,21 @@ static int tle_is_fault_occurred(xmlrpc_env *p_tle_env)
     }
 }
 
-static int tle_struct_read(xmlrpc_value *p_result, const char *p_name,
-        char *p_output)
+static int tle_struct_read(xmlrpc_env *p_env, xmlrpc_value *p_result,
+        const char *p_name, char *p_output)
 {
     xmlrpc_value *p_value;
     const char *p_str;
 
-    xmlrpc_struct_read_value(&tle_env, p_result, p_name, &p_value);
+    xmlrpc_struct_read_value(p_env, p_result, p_name, &p_value);
 
     // TODO
-    tle_is_fault_occurred(&tle_env);
+    tle_is_fault_occurred(p_env, tle_info_err_msg);
 
-    xmlrpc_read_string(&tle_env, p_value, &p_str);
+    xmlrpc_read_string(p_env, p_value, &p_str);
 
     // TODO
-    tle_is_fault_occurred(&tle_env);
+    tle_is_fault_occurred(p_env, tle_info_err_msg);
 
     strncpy(p_output, p_str, TLE_ANSWER_MAX);
 
@@ -188,9 +192,70 @@ void tle_compute_st(char *p_st, char *p_ut)
     snprintf(p_st, TLE_ST_MAX, "%02i:%02i:%02i", st[0], st[1], st[2]);
 }
 
+// TODO: uvolnovani pameti i pri predcasnem ukonceni
+static int tle_execute(xmlrpc_env *p_env, xmlrpc_client *p_client,
+        char *p_err_msg, char *p_command, char *p_answer)
+{
+    xmlrpc_value *p_result;
+    xmlrpc_value *p_param_array;
+    xmlrpc_value *p_item;
+    const char *p_str;
+
+    p_param_array = xmlrpc_array_new(p_env);
+    p_item = xmlrpc_string_new(p_env, p_command);
+    if (tle_is_fault_occurred(p_env, p_err_msg))
+    {
+        return -1;
+    }
+
+    xmlrpc_array_append_item(p_env, p_param_array, p_item);
+    if (tle_is_fault_occurred(p_env, p_err_msg))
+    {
+        return -1;
+    }
+
+    xmlrpc_client_call2(p_env, p_client, p_tle_server_info,
+            "telescope_execute", p_param_array, &p_result);
+    if (tle_is_fault_occurred(p_env, p_err_msg))
+    {
+        return -1;
+    }
+
+    xmlrpc_read_string(p_env, p_result, &p_str);
+
+    if (tle_is_fault_occurred(p_env, p_err_msg))
+    {
+        return -1;
+    }
+
+    xmlrpc_DECREF(p_result);
+
+    strncpy(p_answer, p_str, TLE_ANSWER_MAX);
+    free((char*) p_str);
+
+    xmlrpc_DECREF(p_item);
+    xmlrpc_DECREF(p_param_array);
+
+    return 0;
+}
+
+int tle_telescope_execute(char *p_command, char *p_answer)
+{
+    return tle_execute(&tle_env, p_tle_client, tle_err_msg, p_command,
+            p_answer);
+}
+
+/*
+ * Own xmlrpc_env, client and error message, so exposed can call it from a
+ * separate thread while an exposure runs, see tle_get_info_err_msg().
+ * Telescoped without "observatory_snapshot" gets the old "telescope_info"
+ * + four "GLME n" round trips.
+ */
 int tle_telescope_info(TLE_INFO_T *p_tle_info)
 {
     int i;
+    int snapshot = 1;
+    xmlrpc_env env;
     xmlrpc_value *p_result;
     xmlrpc_value *p_param_array;
     char answer[TLE_ANSWER_MAX + 1];
@@ -200,18 +265,31 @@ int tle_telescope_info(TLE_INFO_T *p_tle_info)
 
     bzero(p_tle_info, sizeof(TLE_INFO_T));
 
-    p_param_array = xmlrpc_array_new(&tle_env);
-    xmlrpc_client_call2(&tle_env, p_tle_client, p_tle_server_info,
-            "telescope_info", p_param_array, &p_result);
-    if (tle_is_fault_occurred(&tle_env))
+    xmlrpc_env_init(&env);
+
+    p_param_array = xmlrpc_array_new(&env);
+    xmlrpc_client_call2(&env, p_tle_info_client, p_tle_server_info,
+            "observatory_snapshot", p_param_array, &p_result);
+    if (env.fault_occurred && (env.fault_code == XMLRPC_NO_SUCH_METHOD_ERROR))
     {
+        snapshot = 0;
+        xmlrpc_env_clean(&env);
+        xmlrpc_env_init(&env);
+        xmlrpc_client_call2(&env, p_tle_info_client, p_tle_server_info,
+                "telescope_info", p_param_array, &p_result);
+    }
+
+    if (tle_is_fault_occurred(&env, tle_info_err_msg))
+    {
+        xmlrpc_DECREF(p_param_array);
+        xmlrpc_env_clean(&env);
         return -1;
     }
 
-    tle_struct_read(p_result, "fopo", answer);
+    tle_struct_read(&env, p_result, "fopo", answer);
     p_tle_info->fopo = atof(answer);
 
-    tle_struct_read(p_result, "glst", answer);
+    tle_struct_read(&env, p_result, "glst", answer);
     p_str = answer;
     p_tle_info->focus_state = -1;
     for (i = 0; i < 5; ++i)
@@ -230,25 +308,40 @@ int tle_telescope_info(TLE_INFO_T *p_tle_info)
         p_str = NULL;
     }
 
-    tle_struct_read(p_result, "dopo", p_tle_info->domeaz);
-    tle_struct_read(p_result, "trcs", p_tle_info->trcs);
-    tle_struct_read(p_result, "trgv", p_tle_info->trgv);
-    tle_struct_read(p_result, "trhd", p_tle_info->trhd);
-    tle_struct_read(p_result, "trus", p_tle_info->trus);
-    tle_struct_read(p_result, "ut", p_tle_info->ut);
+    tle_struct_read(&env, p_result, "dopo", p_tle_info->domeaz);
+    tle_struct_read(&env, p_result, "trcs", p_tle_info->trcs);
+    tle_struct_read(&env, p_result, "trgv", p_tle_info->trgv);
+    tle_struct_read(&env, p_result, "trhd", p_tle_info->trhd);
+    tle_struct_read(&env, p_result, "trus", p_tle_info->trus);
+    tle_struct_read(&env, p_result, "ut", p_tle_info->ut);
 
     tle_compute_st(p_tle_info->st, p_tle_info->ut);
 
-    tle_struct_read(p_result, "trrd", p_tle_info->trrd);
+    tle_struct_read(&env, p_result, "trrd", p_tle_info->trrd);
     tle_trrd2radec(p_tle_info);
 
-    tle_telescope_execute("GLME 2", p_tle_info->airhumex);
-    tle_telescope_execute("GLME 1", p_tle_info->airpress);
-    tle_telescope_execute("GLME 0", p_tle_info->outtemp);
-    tle_telescope_execute("GLME 4", p_tle_info->dometemp);
+    if (snapshot)
+    {
+        tle_struct_read(&env, p_result, "glme_2", p_tle_info->airhumex);
+        tle_struct_read(&env, p_result, "glme_1", p_tle_info->airpress);
+        tle_struct_read(&env, p_result, "glme_0", p_tle_info->outtemp);
+        tle_struct_read(&env, p_result, "glme_4", p_tle_info->dometemp);
+    }
+    else
+    {
+        tle_execute(&env, p_tle_info_client, tle_info_err_msg,
+                "GLME 2", p_tle_info->airhumex);
+        tle_execute(&env, p_tle_info_client, tle_info_err_msg,
+                "GLME 1", p_tle_info->airpress);
+        tle_execute(&env, p_tle_info_client, tle_info_err_msg,
+                "GLME 0", p_tle_info->outtemp);
+        tle_execute(&env, p_tle_info_client, tle_info_err_msg,
+                "GLME 4", p_tle_info->dometemp);
+    }
 
     xmlrpc_DECREF(p_result);
     xmlrpc_DECREF(p_param_array);
+    xmlrpc_env_clean(&env);
 
     return 0;
 }
@@ -258,6 +351,12 @@ const char *tle_get_err_msg(void)
     return tle_err_msg;
 }
 
+/* error of last tle_telescope_info() */
+const char *tle_get_info_err_msg(void)
+{
+    return tle_info_err_msg;
+}
+
 int tle_init(void)
 {
     char server_url[TLE_SERVER_URL_MAX + 1];
@@ -265,6 +364,7 @@ int tle_init(void)
     char *p_telescope_port = getenv("TELESCOPE_PORT");
 
     bzero(tle_err_msg, TLE_ERR_MSG_MAX + 1);
+    bzero(tle_info_err_msg, TLE_ERR_MSG_MAX + 1);
 
     if ((p_telescope_host == NULL) || (p_telescope_port == NULL))
     {
@@ -282,7 +382,15 @@ int tle_init(void)
     }
 
     xmlrpc_client_create(&tle_env, 0, "peso", SVN_REV, NULL, 0, &p_tle_client);
-    if (tle_is_fault_occurred(&tle_env))
+    if (tle_is_fault_occurred(&tle_env, tle_err_msg))
+    {
+        fprintf(stderr, "\n%s\n", tle_err_msg);
+        return -1;
+    }
+
+    xmlrpc_client_create(&tle_env, 0, "peso", SVN_REV, NULL, 0,
+            &p_tle_info_client);
+    if (tle_is_fault_occurred(&tle_env, tle_err_msg))
     {
         fprintf(stderr, "\n%s\n", tle_err_msg);
         return -1;
@@ -291,7 +399,7 @@ int tle_init(void)
     snprintf(server_url, TLE_SERVER_URL_MAX, "http://%s:%s/RPC2",
             p_telescope_host, p_telescope_port);
     p_tle_server_info = xmlrpc_server_info_new(&tle_env, server_url);
-    if (tle_is_fault_occurred(&tle_env))
+    if (tle_is_fault_occurred(&tle_env, tle_err_msg))
     {
         fprintf(stderr, "\n%s\n", tle_err_msg);
         return -1;
@@ -314,57 +422,18 @@ int tle_uninit(void)
         p_tle_client = NULL;
     }
 
+    if (p_tle_info_client != NULL)
+    {
+        xmlrpc_client_destroy(p_tle_info_client);
+        p_tle_info_client = NULL;
+    }
+
     xmlrpc_env_clean(&tle_env);
     bxr_client_cleanup();
 
     return 1;
 }
 
-// TODO: uvolnovani pameti i pri predcasnem ukonceni
-int tle_telescope_execute(char *p_command, char *p_answer)
-{
-    xmlrpc_value *p_result;
-    xmlrpc_value *p_param_array;
-    xmlrpc_value *p_item;
-    const char *p_str;
-
-    p_param_array = xmlrpc_array_new(&tle_env);
-    p_item = xmlrpc_string_new(&tle_env, p_command);
-    if (tle_is_fault_occurred(&tle_env))
-    {
-        return -1;
-    }
-
-    xmlrpc_array_append_item(&tle_env, p_param_array, p_item);
-    if (tle_is_fault_occurred(&tle_env))
-    {
-        return -1;
-    }
-
-    xmlrpc_client_call2(&tle_env, p_tle_client, p_tle_server_info,
-            "telescope_execute", p_param_array, &p_result);
-    if (tle_is_fault_occurred(&tle_env))
-    {
-        return -1;
-    }
-
-    xmlrpc_read_string(&tle_env, p_result, &p_str);
-
-    if (tle_is_fault_occurred(&tle_env))
-    {
-        return -1;
-    }
-
-    xmlrpc_DECREF(p_result);
-
-    strncpy(p_answer, p_str, TLE_ANSWER_MAX);
-    free((char*) p_str);
-
-    xmlrpc_DECREF(p_item);
-    xmlrpc_DECREF(p_param_array);
-
-    return 0;
-}
 
 // TODO: odstranit
 int tle_load_info(TLE_INFO_T *p_tle_info)
@@ -51,6 +51,7 @@ typedef struct
 } TLE_INFO_T;
 
 const char *tle_get_err_msg(void);
+const char *tle_get_info_err_msg(void);
 int tle_init(void);
 int tle_uninit(void);
 int tle_telescope_execute(char *p_command, char *p_answer);
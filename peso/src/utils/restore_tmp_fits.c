@@ -0,0 +1,183 @@
+/**
+ * Author: Jan Fuchs <fuky@sunstel.asu.cas.cz>
+ * $Date$
+ * $Rev$
+ *
+ * Recover FITS file from temporary file p_prefixNNNN.tmp left by exposed
+ * after crash (see save_fits_commit()). Missing pixels are set to 0, HISTORY
+ * card records how many of them were missing. Cube of continuous readout is
+ * truncated to frames actually written.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fitsio.h>
+
+#define BUFFER_MAX 1023
+
+int main(int argc, char *argv[])
+{
+    fitsfile *p_fitsfile;
+    int fits_status = 0; // MUST initialize fits_status
+    int len;
+    int bitpix;
+    int naxis;
+    long naxes[3] = { 0, 0, 1 };
+    long plane;
+    long frames;
+    long nelements;
+    long available;
+    long missing;
+    LONGLONG headstart;
+    LONGLONG datastart;
+    LONGLONG dataend;
+    struct stat st;
+    char fits_file[BUFFER_MAX + 1];
+    char history[FLEN_CARD];
+    unsigned short *p_zero_data = NULL;
+
+    if ((argc != 2) && (argc != 3))
+    {
+        printf("Usage: %s DATA_TMP [DATA_FIT]\n", argv[0]);
+        exit(EXIT_SUCCESS);
+    }
+
+    if (argc == 3)
+    {
+        strncpy(fits_file, argv[2], BUFFER_MAX);
+        fits_file[BUFFER_MAX] = '\0';
+    }
+    else
+    {
+        // a201311090001.tmp => a201311090001.fit
+        strncpy(fits_file, argv[1], BUFFER_MAX);
+        fits_file[BUFFER_MAX] = '\0';
+
+        if (((len = strlen(fits_file)) < 4) || strcmp(fits_file + len - 4, ".tmp"))
+        {
+            printf("Error: %s has not suffix .tmp, specify DATA_FIT\n", argv[1]);
+            exit(EXIT_FAILURE);
+        }
+
+        strcpy(fits_file + len - 3, "fit");
+    }
+
+    if (access(fits_file, F_OK) == 0)
+    {
+        printf("Error: %s already exists\n", fits_file);
+        exit(EXIT_FAILURE);
+    }
+
+    if (stat(argv[1], &st) == -1)
+    {
+        perror("stat");
+        exit(EXIT_FAILURE);
+    }
+
+    // header must be complete, otherwise there is nothing to recover
+    if (fits_open_file(&p_fitsfile, argv[1], READWRITE, &fits_status))
+    {
+        fits_report_error(stderr, fits_status);
+        exit(fits_status);
+    }
+
+    fits_get_img_param(p_fitsfile, 3, &bitpix, &naxis, naxes, &fits_status);
+    fits_get_hduaddrll(p_fitsfile, &headstart, &datastart, &dataend, &fits_status);
+
+    if (fits_status)
+    {
+        fits_report_error(stderr, fits_status);
+        exit(fits_status);
+    }
+
+    if ((naxis != 2) && (naxis != 3))
+    {
+        printf("Error: %s has NAXIS = %i, only image or cube can be restored\n",
+            argv[1], naxis);
+        exit(EXIT_FAILURE);
+    }
+
+    plane = naxes[0] * naxes[1];
+    nelements = plane * naxes[2];
+    available = (st.st_size > datastart) ? (st.st_size - datastart) / 2 : 0;
+
+    if (available > nelements)
+    {
+        available = nelements;
+    }
+
+    printf("%s: %li x %li x %li, %li of %li pixels present\n", argv[1],
+        naxes[0], naxes[1], naxes[2], available, nelements);
+
+    // NAXIS3 is number of requested frames, keep only started ones
+    if ((naxis == 3) && (available < nelements))
+    {
+        frames = (available + plane - 1) / plane;
+
+        if (frames == 0)
+        {
+            frames = 1;
+        }
+
+        snprintf(history, FLEN_CARD, "restore_tmp_fits: NAXIS3 %li truncated to %li",
+            naxes[2], frames);
+
+        naxes[2] = frames;
+        nelements = plane * frames;
+
+        if (fits_resize_img(p_fitsfile, bitpix, naxis, naxes, &fits_status)
+            || fits_write_history(p_fitsfile, history, &fits_status))
+        {
+            fits_report_error(stderr, fits_status);
+            exit(fits_status);
+        }
+
+        printf("%s: truncated to %li frames\n", argv[1], frames);
+    }
+
+    missing = nelements - available;
+
+    if (missing > 0)
+    {
+        if ((p_zero_data = (unsigned short *) calloc(missing, sizeof(*p_zero_data))) == NULL)
+        {
+            perror("calloc(): ");
+            exit(EXIT_FAILURE);
+        }
+
+        if (fits_write_img(p_fitsfile, TUSHORT, available + 1, missing, p_zero_data, &fits_status))
+        {
+            fits_report_error(stderr, fits_status);
+            exit(fits_status);
+        }
+
+        free(p_zero_data);
+
+        snprintf(history, FLEN_CARD, "restore_tmp_fits: %li of %li pixels missing, set to 0",
+            missing, nelements);
+        fits_write_history(p_fitsfile, history, &fits_status);
+    }
+
+    fits_write_chksum(p_fitsfile, &fits_status);
+    fits_close_file(p_fitsfile, &fits_status);
+
+    if (fits_status)
+    {
+        fits_report_error(stderr, fits_status);
+        exit(fits_status);
+    }
+
+    if (rename(argv[1], fits_file) == -1)
+    {
+        perror("rename");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%s => %s\n", argv[1], fits_file);
+
+    exit(EXIT_SUCCESS);
+}